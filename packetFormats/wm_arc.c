@@ -0,0 +1,463 @@
+/*
+ ============================================================================
+ Name        : wm_arc.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Binary packet archive tool, CSV and packet converters
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_codec.h"
+#include "wm_archive.h"
+#include "wm_base64.h"
+#include "wm_batch.h"
+#include "wm_csv.h"
+#include "wm_store.h"
+
+static const char * helpText =
+"\n"
+"   WindOp packet archive\n"
+"\n"
+"   Keeps raw packets per device in one binary file in place of the\n"
+"   stream_data_*.csv intermediates, and converts both ways.\n"
+"\n"
+"      wm_arc add archive -d device [-b64] [file]   : Add packets, one hex or\n"
+"                                                     base64 packet per line\n"
+"      wm_arc fromcsv archive -d device [file]      : Repack a Perl CSV into\n"
+"                                                     packets and add them\n"
+"      wm_arc tocsv archive [options]               : Write the Perl CSV\n"
+"      wm_arc list archive                          : List the chunk index\n"
+"\n"
+"      -d device              : Device id, required to add, and for tocsv\n"
+"                               when the archive holds more than one device\n"
+"                               as rows sharing a minute are merged\n"
+"      -from YYYYMMDDhhmmss   : tocsv, first reading time to keep\n"
+"      -to YYYYMMDDhhmmss     : tocsv, last reading time to keep\n"
+"      -o file                : tocsv, write to file, default stdout\n"
+"      -b64                   : add, lines are base64, default is hex\n"
+"      -help                  : Prints this\n"
+"\n"
+"   Input is read from stdin when no file is given.\n"
+"\n";
+
+typedef struct arcCfg {
+    const char * command;
+    const char * archive;
+    const char * device;
+    const char * inFile;
+    const char * outFile;
+    int64_t from;
+    int64_t to;
+    uint8_t base64;
+} arcCfg;
+
+static FILE * openInput(const char * path) {
+    FILE * in = stdin;
+    if ((path != NULL) && ((in = fopen(path, "r")) == NULL)) {
+        fprintf(stderr, "Can't open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    return in;
+}
+
+static void openWriter(arcCfg * cfg, WindOpArchiveWriter * writer) {
+    if (cfg->device == NULL) {
+        fprintf(stderr, "ERROR -d device is needed to add packets\n");
+        exit(EXIT_FAILURE);
+    }
+    if (open_WindOpArchiveWriter(writer, cfg->archive) != WINDOP_OK) {
+        fprintf(stderr, "Can't open %s as an archive\n", cfg->archive);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void closeWriter(WindOpArchiveWriter * writer) {
+    if (close_WindOpArchiveWriter(writer) != WINDOP_OK) {
+        fprintf(stderr, "ERROR writing the archive\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* ****************************************************************************
+ *
+ * add, packet lines straight into the archive
+ *
+ * */
+static void addPackets(arcCfg * cfg) {
+    WindOpArchiveWriter writer;
+    FILE * in = openInput(cfg->inFile);
+    char * line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t lineLength;
+    uint8_t packet[BYTEBUFFERSIZE];
+    int32_t length;
+    uint32_t added = 0;
+    uint32_t failed = 0;
+
+    openWriter(cfg, &writer);
+    while ((lineLength = getline(&line, &lineCapacity, in)) >= 0) {
+        while ((lineLength > 0) && ((line[lineLength - 1] == '\n') || (line[lineLength - 1] == '\r') || (line[lineLength - 1] == ' '))) {
+            lineLength--;
+        }
+        if (lineLength == 0) {
+            continue;
+        }
+        if (cfg->base64) {
+            length = decode_WindOpBase64(line, (uint32_t) lineLength, packet, sizeof(packet));
+        } else {
+            length = decode_WindOpHex(line, (uint32_t) lineLength, packet, sizeof(packet));
+        }
+        if ((length < 0) || (append_WindOpArchive(&writer, cfg->device, packet, (uint32_t) length) != WINDOP_OK)) {
+            failed++;
+        } else {
+            added++;
+        }
+    }
+    free(line);
+    if (in != stdin) {
+        fclose(in);
+    }
+    closeWriter(&writer);
+
+    fprintf(stderr, "---Added %u packets, %u failed\n", added, failed);
+}
+
+/* ****************************************************************************
+ *
+ * fromcsv. Each CSV row goes into the lane of the packet type that can carry
+ * it, a lane per type, then runs of rows a minute apart are packed. A row
+ * with every channel is T3, otherwise wind is T4 and environment T5. T6 is
+ * used for environment values T5 cannot hold exactly, so the CSV written
+ * back out matches the CSV read in.
+ *
+ * */
+#define LANE_T3                  0
+#define LANE_T4                  1
+#define LANE_T5                  2
+#define LANE_T6                  3
+#define NUM_LANES                4
+
+static const uint8_t laneTypes[NUM_LANES] = {
+    WINDOPDATAPACKET_T3_TYPE, WINDOPDATAPACKET_T4_TYPE, WINDOPDATAPACKET_T5_TYPE, WINDOPDATAPACKET_T6_TYPE
+};
+
+// Raw values of the channels in mask at the type's scales, 0 if not exact
+static uint8_t toRaw(uint8_t dataType, uint8_t mask, const double * value, int32_t * raw) {
+    const WindOpTypeInfo * info = info_WindOpDataType(dataType);
+    const WindOpFieldInfo * field;
+    int64_t limit;
+    uint8_t ch;
+
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        if ((mask & (1 << ch)) == 0) {
+            continue;
+        }
+        field = &info->byChannel[ch];
+        raw[ch] = (int32_t) lround(value[ch] / field->scale);
+        limit = (int64_t) 1 << (8 * field->bytes - field->isSigned);
+        if ((raw[ch] >= limit) || (raw[ch] < (field->isSigned ? -limit : 0)) ||
+            (fabs(raw[ch] * field->scale - value[ch]) > 1e-9 * (1 + fabs(value[ch])))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static uint8_t addEnvironment(WindOpColumns * lanes, int64_t time, const double * value, int32_t * raw) {
+    if (toRaw(WINDOPDATAPACKET_T5_TYPE, WINDOP_ENV_CHANNELS, value, raw)) {
+        return appendChannels_WindOpColumns(&lanes[LANE_T5], time, WINDOPDATAPACKET_T5_TYPE, raw, WINDOP_ENV_CHANNELS);
+    }
+    if (toRaw(WINDOPDATAPACKET_T6_TYPE, WINDOP_ENV_CHANNELS, value, raw)) {
+        return appendChannels_WindOpColumns(&lanes[LANE_T6], time, WINDOPDATAPACKET_T6_TYPE, raw, WINDOP_ENV_CHANNELS);
+    }
+    return WINDOP_ERR_FORMAT;
+}
+
+static uint8_t laneRow(WindOpColumns * lanes, int64_t time, uint8_t valid, const double * value) {
+    int32_t raw[WINDOP_NUM_CHANNELS];
+    uint8_t result = WINDOP_OK;
+
+    if ((valid == 0xFF) && toRaw(WINDOPDATAPACKET_T3_TYPE, valid, value, raw)) {
+        return appendChannels_WindOpColumns(&lanes[LANE_T3], time, WINDOPDATAPACKET_T3_TYPE, raw, valid);
+    }
+    if ((valid & ~(WINDOP_WIND_CHANNELS | WINDOP_ENV_CHANNELS)) ||
+        ((valid & WINDOP_WIND_CHANNELS) && ((valid & WINDOP_WIND_CHANNELS) != WINDOP_WIND_CHANNELS)) ||
+        ((valid & WINDOP_ENV_CHANNELS) && ((valid & WINDOP_ENV_CHANNELS) != WINDOP_ENV_CHANNELS))) {
+        return WINDOP_ERR_FORMAT; // No packet type carries part of a group
+    }
+    if (valid & WINDOP_WIND_CHANNELS) {
+        if (!toRaw(WINDOPDATAPACKET_T4_TYPE, WINDOP_WIND_CHANNELS, value, raw)) {
+            return WINDOP_ERR_FORMAT;
+        }
+        result = appendChannels_WindOpColumns(&lanes[LANE_T4], time, WINDOPDATAPACKET_T4_TYPE, raw, WINDOP_WIND_CHANNELS);
+    }
+    if ((result == WINDOP_OK) && (valid & WINDOP_ENV_CHANNELS)) {
+        result = addEnvironment(lanes, time, value, raw);
+    }
+    return result;
+}
+
+static uint32_t packLane(WindOpArchiveWriter * writer, const char * device, const WindOpColumns * lane,
+                         uint8_t dataType) {
+    const WindOpTypeInfo * info = info_WindOpDataType(dataType);
+    uint8_t packet[WINDOP_MAX_PACKET_LENGTH];
+    uint32_t maxReadings;
+    uint32_t start;
+    uint32_t end;
+    uint32_t packets = 0;
+    uint16_t length;
+    uint8_t incSeconds;
+
+    maxReadings = (WINDOP_MAX_PACKET_LENGTH - WINDOP_PACKET_HEADER_SIZE - WINDOP_TIME_EXT_SIZE) / info->readingSize;
+    for (start = 0; start < lane->numRows; start = end) {
+        for (end = start + 1; (end < lane->numRows) && (end - start < maxReadings) &&
+             (lane->time[end] == lane->time[start] + 60 * (int64_t) (end - start)); end++) {
+        }
+        incSeconds = ((lane->time[start] - info->firstOffset) % 60) != 0;
+        length = pack_WindOpDataPacketFromColumns(lane, start, end - start, dataType, incSeconds, packet);
+        if ((length != 0) && (append_WindOpArchive(writer, device, packet, length) == WINDOP_OK)) {
+            packets++;
+        }
+    }
+    return packets;
+}
+
+static void addCsv(arcCfg * cfg) {
+    WindOpArchiveWriter writer;
+    WindOpColumns lanes[NUM_LANES];
+    FILE * in = openInput(cfg->inFile);
+    char * line = NULL;
+    size_t lineCapacity = 0;
+    double value[WINDOP_NUM_CHANNELS];
+    int64_t time;
+    uint32_t rows = 0;
+    uint32_t failed = 0;
+    uint32_t packets = 0;
+    uint8_t valid;
+    uint8_t i;
+
+    for (i = 0; i < NUM_LANES; i++) {
+        init_WindOpColumns(&lanes[i], 0);
+    }
+    while (getline(&line, &lineCapacity, in) >= 0) {
+        if (parseRow_WindOpCsv(line, &time, &valid, value) != WINDOP_OK) {
+            failed += (line[0] != 't') && (line[0] != '\n'); // Header and blank lines are expected
+            continue;
+        }
+        if (laneRow(lanes, time, valid, value) != WINDOP_OK) {
+            failed++;
+        } else {
+            rows++;
+        }
+    }
+    free(line);
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    openWriter(cfg, &writer);
+    for (i = 0; i < NUM_LANES; i++) {
+        packets += packLane(&writer, cfg->device, &lanes[i], laneTypes[i]);
+        free_WindOpColumns(&lanes[i]);
+    }
+    closeWriter(&writer);
+
+    fprintf(stderr, "---Packed %u rows into %u packets, %u rows failed\n", rows, packets, failed);
+}
+
+/* ****************************************************************************
+ *
+ * tocsv and list
+ *
+ * */
+static uint8_t selectChunk(const WindOpArchiveReader * reader, uint32_t chunk, int32_t device, int64_t from) {
+    return ((device < 0) || (reader->chunks[chunk].device == (uint32_t) device)) &&
+           (reader->chunks[chunk].lastTime >= from);
+}
+
+static void writeCsv(arcCfg * cfg) {
+    WindOpArchiveReader reader;
+    WindOpColumns cols;
+    FILE * out = stdout;
+    int32_t device = -1;
+    uint32_t lastChunk;
+    uint32_t rows = 0;
+    uint32_t failed = 0;
+    uint32_t i;
+    uint32_t row;
+    uint8_t ch;
+
+    if (open_WindOpArchiveReader(&reader, cfg->archive) != WINDOP_OK) {
+        fprintf(stderr, "Can't open %s as an archive\n", cfg->archive);
+        exit(EXIT_FAILURE);
+    }
+    if ((cfg->device != NULL) && ((device = findDevice_WindOpArchive(&reader, cfg->device)) < 0)) {
+        fprintf(stderr, "No device %s in %s\n", cfg->device, cfg->archive);
+        exit(EXIT_FAILURE);
+    }
+    // One CSV row per time stamp would mix devices' readings
+    if ((cfg->device == NULL) && (reader.numDevices > 1)) {
+        fprintf(stderr, "ERROR %s holds %u devices, tocsv needs -d device\n", cfg->archive, reader.numDevices);
+        exit(EXIT_FAILURE);
+    }
+
+    lastChunk = lastChunk_WindOpArchive(&reader, cfg->to);
+    for (i = 0; i < lastChunk; i++) {
+        rows += selectChunk(&reader, i, device, cfg->from) ? chunkRows_WindOpArchive(&reader, i) : 0;
+    }
+    if (init_WindOpColumns(&cols, rows) != WINDOP_OK) {
+        fprintf(stderr, "ERROR out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < lastChunk; i++) {
+        if (selectChunk(&reader, i, device, cfg->from)) {
+            failed += decodeChunk_WindOpArchive(&reader, i, &cols);
+        }
+    }
+
+    // Chunks overlapping the ends of the range hold readings outside it
+    rows = 0;
+    for (i = 0; i < cols.numRows; i++) {
+        if ((cols.time[i] < cfg->from) || (cols.time[i] > cfg->to)) {
+            continue;
+        }
+        row = rows++;
+        cols.time[row] = cols.time[i];
+        cols.packet[row] = cols.packet[i];
+        cols.dataType[row] = cols.dataType[i];
+        cols.valid[row] = cols.valid[i];
+        for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+            cols.channel[ch][row] = cols.channel[ch][i];
+        }
+    }
+    cols.numRows = rows;
+
+    if ((cfg->outFile != NULL) && ((out = fopen(cfg->outFile, "w")) == NULL)) {
+        fprintf(stderr, "Can't open %s\n", cfg->outFile);
+        exit(EXIT_FAILURE);
+    }
+    if (writeColumns_WindOpCsv(out, &cols) != WINDOP_OK) {
+        fprintf(stderr, "ERROR out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    fprintf(stderr, "---Wrote %u readings, %u packets failed\n", cols.numRows, failed);
+    free_WindOpColumns(&cols);
+    close_WindOpArchiveReader(&reader);
+}
+
+static void listChunks(arcCfg * cfg) {
+    WindOpArchiveReader reader;
+    const WindOpArchiveChunk * chunk;
+    Calendar first;
+    Calendar last;
+    uint32_t i;
+
+    if (open_WindOpArchiveReader(&reader, cfg->archive) != WINDOP_OK) {
+        fprintf(stderr, "Can't open %s as an archive\n", cfg->archive);
+        exit(EXIT_FAILURE);
+    }
+    printf("%u devices, %u chunks\n", reader.numDevices, reader.numChunks);
+    printf("%-24s %-14s %-14s %8s %8s\n", "device", "first", "last", "packets", "bytes");
+    for (i = 0; i < reader.numChunks; i++) {
+        chunk = &reader.chunks[i];
+        calendar_WindOpEpoch(&first, chunk->firstTime);
+        calendar_WindOpEpoch(&last, chunk->lastTime);
+        printf("%-24s %04u%02u%02u%02u%02u%02u %04u%02u%02u%02u%02u%02u %8u %8u\n",
+               device_WindOpArchive(&reader, chunk->device),
+               first.Year, first.Month, first.DayOfMonth, first.Hours, first.Minutes, first.Seconds,
+               last.Year, last.Month, last.DayOfMonth, last.Hours, last.Minutes, last.Seconds,
+               chunk->numPackets, chunk->bytes);
+    }
+    close_WindOpArchiveReader(&reader);
+}
+
+static void usageError(const char * message) {
+    fprintf(stderr, "ERROR %s\n%s", message, helpText);
+    exit(EXIT_FAILURE);
+}
+
+static void processCommandLine(int argc, char ** argv, arcCfg * cfg) {
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b64") == 0) {
+            cfg->base64 = 1;
+        } else if ((strcmp(argv[i], "-d") == 0) && (i + 1 < argc)) {
+            cfg->device = argv[++i];
+        } else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+            cfg->outFile = argv[++i];
+        } else if ((strcmp(argv[i], "-from") == 0) && (i + 1 < argc)) {
+            if (parseTime_WindOpCsv(argv[++i], &cfg->from) != WINDOP_OK) {
+                usageError("-from wants YYYYMMDDhhmmss");
+            }
+        } else if ((strcmp(argv[i], "-to") == 0) && (i + 1 < argc)) {
+            if (parseTime_WindOpCsv(argv[++i], &cfg->to) != WINDOP_OK) {
+                usageError("-to wants YYYYMMDDhhmmss");
+            }
+        } else if ((strcmp(argv[i], "-help") == 0) || (argv[i][0] == '-')) {
+            printf("%s", helpText);
+            exit(EXIT_SUCCESS);
+        } else if (cfg->command == NULL) {
+            cfg->command = argv[i];
+        } else if (cfg->archive == NULL) {
+            cfg->archive = argv[i];
+        } else {
+            cfg->inFile = argv[i];
+        }
+    }
+    if ((cfg->command == NULL) || (cfg->archive == NULL)) {
+        usageError("a command and an archive are needed");
+    }
+}
+
+int main(int argc, char ** argv) {
+    arcCfg cfg = { NULL, NULL, NULL, NULL, NULL, INT64_MIN, INT64_MAX, 0 };
+
+    processCommandLine(argc, argv, &cfg);
+
+    if (strcmp(cfg.command, "add") == 0) {
+        addPackets(&cfg);
+    } else if (strcmp(cfg.command, "fromcsv") == 0) {
+        addCsv(&cfg);
+    } else if (strcmp(cfg.command, "tocsv") == 0) {
+        writeCsv(&cfg);
+    } else if (strcmp(cfg.command, "list") == 0) {
+        listChunks(&cfg);
+    } else {
+        usageError("unknown command");
+    }
+
+    return EXIT_SUCCESS;
+}
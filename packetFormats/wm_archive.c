@@ -0,0 +1,448 @@
+/*
+ ============================================================================
+ Name        : wm_archive.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Append only binary packet archive, writer and mmap reader
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "wm_archive.h"
+#include "wm_view.h"
+
+_Static_assert(sizeof(WindOpArchiveChunk) == 40, "archive index entry layout");
+_Static_assert(sizeof(WindOpArchiveFooter) == 32, "archive footer layout");
+
+#define MAGIC_SIZE               8
+#define TABLE_ALIGN              8 // Keeps the mmapped tables naturally aligned
+
+static void * growTable(void * table, uint32_t * capacity, uint32_t needed, size_t elemSize) {
+    uint32_t newCapacity = *capacity ? *capacity : 64;
+    void * grown;
+
+    if (needed <= *capacity) {
+        return table;
+    }
+    while (newCapacity < needed) {
+        newCapacity *= 2;
+    }
+    grown = realloc(table, newCapacity * elemSize);
+    if (grown != NULL) {
+        *capacity = newCapacity;
+    }
+    return grown;
+}
+
+/* ****************************************************************************
+ *
+ * Load the tables of an existing archive so new chunks can follow its last
+ * chunk. The old tables are overwritten by the next chunk or at close.
+ *
+ * */
+static uint8_t loadTables(WindOpArchiveWriter * writer, uint64_t size) {
+    WindOpArchiveFooter footer;
+    uint32_t i;
+
+    if ((size < MAGIC_SIZE + sizeof(footer)) ||
+        (fseeko(writer->file, (off_t) (size - sizeof(footer)), SEEK_SET) != 0) ||
+        (fread(&footer, sizeof(footer), 1, writer->file) != 1) ||
+        (memcmp(footer.magic, WINDOP_ARCHIVE_END_MAGIC, MAGIC_SIZE) != 0) ||
+        (footer.deviceOffset > footer.indexOffset) || (footer.indexOffset > size) ||
+        ((uint64_t) footer.numDevices * WINDOP_ARCHIVE_DEVICE_SIZE > footer.indexOffset - footer.deviceOffset) ||
+        ((uint64_t) footer.numChunks * sizeof(WindOpArchiveChunk) > size - footer.indexOffset)) {
+        return WINDOP_ERR_FORMAT;
+    }
+
+    writer->devices = growTable(NULL, &writer->deviceCapacity, footer.numDevices, sizeof(WindOpArchiveDevice));
+    writer->chunks = growTable(NULL, &writer->chunkCapacity, footer.numChunks, sizeof(WindOpArchiveChunk));
+    if ((writer->devices == NULL) || (writer->chunks == NULL)) {
+        return WINDOP_ERR_MEMORY;
+    }
+
+    fseeko(writer->file, (off_t) footer.deviceOffset, SEEK_SET);
+    for (i = 0; i < footer.numDevices; i++) {
+        memset(&writer->devices[i], 0, sizeof(WindOpArchiveDevice));
+        if ((fread(writer->devices[i].name, WINDOP_ARCHIVE_DEVICE_SIZE, 1, writer->file) != 1) ||
+            (writer->devices[i].name[WINDOP_ARCHIVE_DEVICE_SIZE - 1] != '\0')) {
+            return WINDOP_ERR_FORMAT;
+        }
+    }
+    fseeko(writer->file, (off_t) footer.indexOffset, SEEK_SET);
+    if (fread(writer->chunks, sizeof(WindOpArchiveChunk), footer.numChunks, writer->file) != footer.numChunks) {
+        return WINDOP_ERR_FORMAT;
+    }
+
+    writer->numDevices = footer.numDevices;
+    writer->numChunks = footer.numChunks;
+    writer->offset = footer.deviceOffset;
+    return WINDOP_OK;
+}
+
+uint8_t open_WindOpArchiveWriter(WindOpArchiveWriter * writer, const char * path) {
+    char magic[MAGIC_SIZE];
+    struct stat st;
+    uint8_t result = WINDOP_OK;
+
+    memset(writer, 0, sizeof(*writer));
+    writer->file = fopen(path, "r+b");
+    if (writer->file == NULL) {
+        writer->file = fopen(path, "w+b");
+        if (writer->file == NULL) {
+            return WINDOP_ERR_FORMAT;
+        }
+    }
+
+    if ((fstat(fileno(writer->file), &st) != 0)) {
+        result = WINDOP_ERR_FORMAT;
+    } else if (st.st_size == 0) {
+        // New archive, the first chunk follows the magic
+        fwrite(WINDOP_ARCHIVE_MAGIC, MAGIC_SIZE, 1, writer->file);
+        writer->offset = MAGIC_SIZE;
+    } else if ((fread(magic, MAGIC_SIZE, 1, writer->file) != 1) ||
+               (memcmp(magic, WINDOP_ARCHIVE_MAGIC, MAGIC_SIZE) != 0)) {
+        result = WINDOP_ERR_FORMAT;
+    } else {
+        result = loadTables(writer, (uint64_t) st.st_size);
+    }
+
+    if (result != WINDOP_OK) {
+        fclose(writer->file);
+        free(writer->devices);
+        free(writer->chunks);
+        memset(writer, 0, sizeof(*writer));
+    }
+    return result;
+}
+
+static uint8_t flushDevice(WindOpArchiveWriter * writer, uint32_t device) {
+    WindOpArchiveDevice * dev = &writer->devices[device];
+    WindOpArchiveChunk * chunk;
+
+    if (dev->pendingPackets == 0) {
+        return WINDOP_OK;
+    }
+    writer->chunks = growTable(writer->chunks, &writer->chunkCapacity, writer->numChunks + 1,
+                               sizeof(WindOpArchiveChunk));
+    if (writer->chunks == NULL) {
+        return WINDOP_ERR_MEMORY;
+    }
+    if ((fseeko(writer->file, (off_t) writer->offset, SEEK_SET) != 0) ||
+        (fwrite(dev->pending, 1, dev->pendingBytes, writer->file) != dev->pendingBytes)) {
+        return WINDOP_ERR_FORMAT;
+    }
+
+    chunk = &writer->chunks[writer->numChunks++];
+    memset(chunk, 0, sizeof(*chunk));
+    chunk->firstTime = dev->firstTime;
+    chunk->lastTime = dev->lastTime;
+    chunk->offset = writer->offset;
+    chunk->bytes = dev->pendingBytes;
+    chunk->numPackets = dev->pendingPackets;
+    chunk->device = device;
+
+    writer->offset += dev->pendingBytes;
+    dev->pendingBytes = 0;
+    dev->pendingPackets = 0;
+    return WINDOP_OK;
+}
+
+static int32_t deviceIndex(WindOpArchiveWriter * writer, const char * device) {
+    WindOpArchiveDevice * dev;
+    uint32_t i;
+
+    // Fleets are tens of nodes, a scan beats keeping a hash in step
+    for (i = 0; i < writer->numDevices; i++) {
+        if (strcmp(writer->devices[i].name, device) == 0) {
+            return (int32_t) i;
+        }
+    }
+
+    writer->devices = growTable(writer->devices, &writer->deviceCapacity, writer->numDevices + 1,
+                                sizeof(WindOpArchiveDevice));
+    if (writer->devices == NULL) {
+        return -1;
+    }
+    dev = &writer->devices[writer->numDevices];
+    memset(dev, 0, sizeof(*dev));
+    strcpy(dev->name, device);
+    return (int32_t) writer->numDevices++;
+}
+
+uint8_t append_WindOpArchive(WindOpArchiveWriter * writer, const char * device, const uint8_t * packet,
+                             uint32_t length) {
+    WindOpPacketView view;
+    WindOpArchiveDevice * dev;
+    int64_t firstTime;
+    int64_t lastTime;
+    int32_t index;
+    uint8_t result;
+
+    if (strlen(device) >= WINDOP_ARCHIVE_DEVICE_SIZE) {
+        return WINDOP_ERR_LENGTH;
+    }
+    result = open_WindOpPacketView(&view, packet, length);
+    if (result == WINDOP_OK) {
+        result = readingTime_WindOpPacketView(&view, 0, &firstTime);
+    }
+    if (result == WINDOP_OK) {
+        result = readingTime_WindOpPacketView(&view, view.numReadings ? view.numReadings - 1 : 0, &lastTime);
+    }
+    if (result != WINDOP_OK) {
+        return result;
+    }
+    length = length_WindOpPacketView(&view); // Trailing bytes past the packet are dropped
+
+    index = deviceIndex(writer, device);
+    if (index < 0) {
+        return WINDOP_ERR_MEMORY;
+    }
+    dev = &writer->devices[index];
+    if ((dev->pendingBytes + length > WINDOP_ARCHIVE_CHUNK_BYTES) && ((result = flushDevice(writer, index)) != WINDOP_OK)) {
+        return result;
+    }
+    if (dev->pending == NULL) {
+        dev->pending = malloc(WINDOP_ARCHIVE_CHUNK_BYTES);
+        if (dev->pending == NULL) {
+            return WINDOP_ERR_MEMORY;
+        }
+    }
+
+    memcpy(&dev->pending[dev->pendingBytes], packet, length);
+    if ((dev->pendingPackets == 0) || (firstTime < dev->firstTime)) {
+        dev->firstTime = firstTime;
+    }
+    if ((dev->pendingPackets == 0) || (lastTime > dev->lastTime)) {
+        dev->lastTime = lastTime;
+    }
+    dev->pendingBytes += length;
+    dev->pendingPackets++;
+
+    return WINDOP_OK;
+}
+
+static int compareChunks(const void * a, const void * b) {
+    const WindOpArchiveChunk * ca = a;
+    const WindOpArchiveChunk * cb = b;
+
+    if (ca->firstTime != cb->firstTime) {
+        return (ca->firstTime < cb->firstTime) ? -1 : 1;
+    }
+    return (ca->offset < cb->offset) ? -1 : (ca->offset > cb->offset);
+}
+
+uint8_t close_WindOpArchiveWriter(WindOpArchiveWriter * writer) {
+    static const uint8_t zeros[TABLE_ALIGN] = { 0 };
+    WindOpArchiveFooter footer;
+    uint32_t pad;
+    uint32_t i;
+    uint8_t result = WINDOP_OK;
+
+    for (i = 0; (i < writer->numDevices) && (result == WINDOP_OK); i++) {
+        result = flushDevice(writer, i);
+    }
+
+    if (result == WINDOP_OK) {
+        qsort(writer->chunks, writer->numChunks, sizeof(WindOpArchiveChunk), compareChunks);
+
+        memset(&footer, 0, sizeof(footer));
+        pad = (TABLE_ALIGN - writer->offset % TABLE_ALIGN) % TABLE_ALIGN;
+        footer.deviceOffset = writer->offset + pad;
+        footer.indexOffset = footer.deviceOffset + (uint64_t) writer->numDevices * WINDOP_ARCHIVE_DEVICE_SIZE;
+        footer.numDevices = writer->numDevices;
+        footer.numChunks = writer->numChunks;
+        memcpy(footer.magic, WINDOP_ARCHIVE_END_MAGIC, MAGIC_SIZE);
+
+        fseeko(writer->file, (off_t) writer->offset, SEEK_SET);
+        fwrite(zeros, 1, pad, writer->file);
+        for (i = 0; i < writer->numDevices; i++) {
+            fwrite(writer->devices[i].name, WINDOP_ARCHIVE_DEVICE_SIZE, 1, writer->file);
+        }
+        fwrite(writer->chunks, sizeof(WindOpArchiveChunk), writer->numChunks, writer->file);
+        fwrite(&footer, sizeof(footer), 1, writer->file);
+        fflush(writer->file);
+        if (ftruncate(fileno(writer->file), ftello(writer->file)) != 0 || ferror(writer->file)) {
+            result = WINDOP_ERR_FORMAT;
+        }
+    }
+
+    fclose(writer->file);
+    for (i = 0; i < writer->numDevices; i++) {
+        free(writer->devices[i].pending);
+    }
+    free(writer->devices);
+    free(writer->chunks);
+    memset(writer, 0, sizeof(*writer));
+    return result;
+}
+
+/* ****************************************************************************
+ *
+ * Reader
+ *
+ * */
+uint8_t open_WindOpArchiveReader(WindOpArchiveReader * reader, const char * path) {
+    const WindOpArchiveFooter * footer;
+    struct stat st;
+    uint64_t tablesEnd;
+    uint32_t i;
+    int fd;
+
+    memset(reader, 0, sizeof(*reader));
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return WINDOP_ERR_FORMAT;
+    }
+    if ((fstat(fd, &st) != 0) || ((size_t) st.st_size < MAGIC_SIZE + sizeof(WindOpArchiveFooter))) {
+        close(fd);
+        return WINDOP_ERR_FORMAT;
+    }
+    reader->size = (size_t) st.st_size;
+    reader->map = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (reader->map == MAP_FAILED) {
+        memset(reader, 0, sizeof(*reader));
+        return WINDOP_ERR_MEMORY;
+    }
+
+    // Offsets come from the file, so every check subtracts from a bound already
+    // checked rather than adding to an offset that could wrap
+    tablesEnd = reader->size - sizeof(WindOpArchiveFooter);
+    footer = (const WindOpArchiveFooter *) &reader->map[tablesEnd];
+    if ((memcmp(reader->map, WINDOP_ARCHIVE_MAGIC, MAGIC_SIZE) != 0) ||
+        (memcmp(footer->magic, WINDOP_ARCHIVE_END_MAGIC, MAGIC_SIZE) != 0) ||
+        (footer->deviceOffset % TABLE_ALIGN != 0) ||
+        (footer->deviceOffset > footer->indexOffset) || (footer->indexOffset > tablesEnd) ||
+        ((uint64_t) footer->numDevices * WINDOP_ARCHIVE_DEVICE_SIZE != footer->indexOffset - footer->deviceOffset) ||
+        ((uint64_t) footer->numChunks * sizeof(WindOpArchiveChunk) > tablesEnd - footer->indexOffset)) {
+        close_WindOpArchiveReader(reader);
+        return WINDOP_ERR_FORMAT;
+    }
+    reader->devices = (const char *) &reader->map[footer->deviceOffset];
+    reader->numDevices = footer->numDevices;
+    reader->chunks = (const WindOpArchiveChunk *) &reader->map[footer->indexOffset];
+    reader->numChunks = footer->numChunks;
+
+    // Names are used as strings, each must end inside its slot
+    for (i = 0; i < reader->numDevices; i++) {
+        if (reader->devices[(size_t) (i + 1) * WINDOP_ARCHIVE_DEVICE_SIZE - 1] != '\0') {
+            close_WindOpArchiveReader(reader);
+            return WINDOP_ERR_FORMAT;
+        }
+    }
+
+    // Every chunk must sit between the magic and the tables
+    for (i = 0; i < reader->numChunks; i++) {
+        if ((reader->chunks[i].offset < MAGIC_SIZE) || (reader->chunks[i].device >= reader->numDevices) ||
+            (reader->chunks[i].offset > footer->deviceOffset) ||
+            (reader->chunks[i].bytes > footer->deviceOffset - reader->chunks[i].offset)) {
+            close_WindOpArchiveReader(reader);
+            return WINDOP_ERR_FORMAT;
+        }
+    }
+    return WINDOP_OK;
+}
+
+void close_WindOpArchiveReader(WindOpArchiveReader * reader) {
+    if (reader->map != NULL) {
+        munmap((void *) reader->map, reader->size);
+    }
+    memset(reader, 0, sizeof(*reader));
+}
+
+int32_t findDevice_WindOpArchive(const WindOpArchiveReader * reader, const char * device) {
+    uint32_t i;
+
+    for (i = 0; i < reader->numDevices; i++) {
+        if (strcmp(device_WindOpArchive(reader, i), device) == 0) {
+            return (int32_t) i;
+        }
+    }
+    return -1;
+}
+
+uint32_t lastChunk_WindOpArchive(const WindOpArchiveReader * reader, int64_t time) {
+    uint32_t low = 0;
+    uint32_t high = reader->numChunks;
+    uint32_t mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (reader->chunks[mid].firstTime <= time) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+uint32_t chunkRows_WindOpArchive(const WindOpArchiveReader * reader, uint32_t chunk) {
+    const uint8_t * bytes = chunkBytes_WindOpArchive(reader, chunk);
+    uint32_t size = reader->chunks[chunk].bytes;
+    uint32_t offset = 0;
+    uint32_t rows = 0;
+    uint32_t length;
+
+    while (offset + WINDOP_PACKET_HEADER_SIZE <= size) {
+        length = bytes[offset + 1];
+        if ((length == 0) || (offset + length > size)) {
+            break;
+        }
+        rows += maxReadings_WindOpPacket(&bytes[offset], length);
+        offset += length;
+    }
+    return rows;
+}
+
+uint32_t decodeChunk_WindOpArchive(const WindOpArchiveReader * reader, uint32_t chunk, WindOpColumns * cols) {
+    const uint8_t * bytes = chunkBytes_WindOpArchive(reader, chunk);
+    uint32_t size = reader->chunks[chunk].bytes;
+    uint32_t offset = 0;
+    uint32_t failed = 0;
+    uint32_t packet = 0;
+    uint32_t length;
+
+    while (offset + WINDOP_PACKET_HEADER_SIZE <= size) {
+        length = bytes[offset + 1];
+        if ((length == 0) || (offset + length > size)) {
+            failed++;
+            break;
+        }
+        if (decode_WindOpPacketColumns(&bytes[offset], length, packet++, cols) != WINDOP_OK) {
+            failed++;
+        }
+        offset += length;
+    }
+    return failed;
+}
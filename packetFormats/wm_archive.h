@@ -0,0 +1,178 @@
+/*
+ ============================================================================
+ Name        : wm_archive.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Append only binary packet archive, writer and mmap reader
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_ARCHIVE_H
+#define WM_ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wm_codec.h"
+#include "wm_batch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WINDOP_ARCHIVE_MAGIC        "WMARC002"
+#define WINDOP_ARCHIVE_END_MAGIC    "WMARCEND"
+#define WINDOP_ARCHIVE_DEVICE_SIZE  64    // Device id bytes, zero padded, as WINDOP_JSON_DEVICE_SIZE
+#define WINDOP_ARCHIVE_CHUNK_BYTES  65536 // Packet bytes held per device before a chunk is written
+
+/* ****************************************************************************
+ *
+ * Archive file layout. Integers are little endian, the structs below are
+ * written as they sit in memory so the reader can use them in place.
+ *
+ *   magic      8 bytes WINDOP_ARCHIVE_MAGIC
+ *   chunks     each the packets of one device back to back, exactly as
+ *              received, so the packet length bytes walk the chunk
+ *   devices    numDevices names of WINDOP_ARCHIVE_DEVICE_SIZE bytes
+ *   index      numChunks WindOpArchiveChunk, sorted by firstTime
+ *   footer     WindOpArchiveFooter, last 32 bytes of the file
+ *
+ * Appending reopens the file, loads the device table and index, writes new
+ * chunks over the old tables and puts new tables and footer behind them.
+ * Chunk bytes, once written, never move.
+ *
+ * */
+typedef struct WindOpArchiveChunk {
+    int64_t firstTime;        // Earliest reading, epoch seconds UTC
+    int64_t lastTime;         // Latest reading
+    uint64_t offset;          // File offset of the first packet
+    uint32_t bytes;
+    uint32_t numPackets;
+    uint32_t device;          // Index into the device table
+    uint32_t reserved;
+} WindOpArchiveChunk;
+
+typedef struct WindOpArchiveFooter {
+    uint64_t deviceOffset;
+    uint64_t indexOffset;
+    uint32_t numDevices;
+    uint32_t numChunks;
+    char magic[8];
+} WindOpArchiveFooter;
+
+/* ****************************************************************************
+ *
+ * Writer. Packets are held per device until WINDOP_ARCHIVE_CHUNK_BYTES are
+ * pending, then written as one chunk. Nothing is readable until close.
+ *
+ * */
+typedef struct WindOpArchiveDevice {
+    char name[WINDOP_ARCHIVE_DEVICE_SIZE];
+    uint8_t * pending;
+    uint32_t pendingBytes;
+    uint32_t pendingPackets;
+    int64_t firstTime;
+    int64_t lastTime;
+} WindOpArchiveDevice;
+
+typedef struct WindOpArchiveWriter {
+    FILE * file;
+    uint64_t offset;          // Where the next chunk is written
+    WindOpArchiveDevice * devices;
+    uint32_t numDevices;
+    uint32_t deviceCapacity;
+    WindOpArchiveChunk * chunks;
+    uint32_t numChunks;
+    uint32_t chunkCapacity;
+} WindOpArchiveWriter;
+
+// Create path, or reopen it for appending. Returns a WINDOP_* code
+uint8_t open_WindOpArchiveWriter(WindOpArchiveWriter * writer, const char * path);
+
+// Add one packet for device. Packets that do not open as a view are refused,
+// as with WINDOP_ERR_LENGTH are ids of WINDOP_ARCHIVE_DEVICE_SIZE bytes or more
+uint8_t append_WindOpArchive(WindOpArchiveWriter * writer, const char * device, const uint8_t * packet,
+                             uint32_t length);
+
+// Write the pending chunks, tables and footer, then release the writer
+uint8_t close_WindOpArchiveWriter(WindOpArchiveWriter * writer);
+
+/* ****************************************************************************
+ *
+ * Reader over the mmapped file. The device table and index are used in place.
+ *
+ * */
+typedef struct WindOpArchiveReader {
+    const uint8_t * map;
+    size_t size;
+    const char * devices;     // numDevices names, WINDOP_ARCHIVE_DEVICE_SIZE apart
+    uint32_t numDevices;
+    const WindOpArchiveChunk * chunks;
+    uint32_t numChunks;
+} WindOpArchiveReader;
+
+uint8_t open_WindOpArchiveReader(WindOpArchiveReader * reader, const char * path);
+void close_WindOpArchiveReader(WindOpArchiveReader * reader);
+
+// Index of device in the table, -1 if the archive has no such device
+int32_t findDevice_WindOpArchive(const WindOpArchiveReader * reader, const char * device);
+
+/*
+ * Number of chunks whose firstTime is at or before time. As the index is
+ * sorted by firstTime the chunks of a [from, to] query are among the first
+ * lastChunk_WindOpArchive(reader, to) entries, with lastTime >= from.
+ */
+uint32_t lastChunk_WindOpArchive(const WindOpArchiveReader * reader, int64_t time);
+
+/*
+ * Decode every packet of chunk into cols through decode_WindOpPacketColumns.
+ * cols must have room for chunkRows_WindOpArchive rows. Returns the number of
+ * packets that failed to decode.
+ */
+uint32_t decodeChunk_WindOpArchive(const WindOpArchiveReader * reader, uint32_t chunk, WindOpColumns * cols);
+
+/*
+ * Upper bound on the readings held in a chunk, the sum of
+ * maxReadings_WindOpPacket over its packets. Delta packets carry more
+ * readings than their bytes suggest, so the chunk size alone is no bound.
+ */
+uint32_t chunkRows_WindOpArchive(const WindOpArchiveReader * reader, uint32_t chunk);
+
+static inline const char * device_WindOpArchive(const WindOpArchiveReader * reader, uint32_t device) {
+    return &reader->devices[device * WINDOP_ARCHIVE_DEVICE_SIZE];
+}
+
+static inline const uint8_t * chunkBytes_WindOpArchive(const WindOpArchiveReader * reader, uint32_t chunk) {
+    return &reader->map[reader->chunks[chunk].offset];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_ARCHIVE_H
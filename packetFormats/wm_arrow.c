@@ -0,0 +1,733 @@
+/*
+ ============================================================================
+ Name        : wm_arrow.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Arrow IPC file (Feather V2) writer for decoded readings
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_arrow.h"
+
+#define ARROW_MAGIC              "ARROW1"
+#define ARROW_MAGIC_SIZE         6
+#define ARROW_ALIGN              8
+#define ARROW_CONTINUATION       0xFFFFFFFFu
+#define ARROW_V5                 4  // MetadataVersion
+
+// Message.header union
+#define HEADER_SCHEMA            1
+#define HEADER_DICTIONARY        2
+#define HEADER_RECORD_BATCH      3
+
+// Field.type union
+#define TYPE_INT                 2
+#define TYPE_FLOAT               3
+#define TYPE_UTF8                5
+#define TYPE_TIMESTAMP           10
+
+#define FLOAT_DOUBLE             2
+#define UNIT_SECOND              0
+
+#define COLUMN_DEVICE            0
+#define COLUMN_TIME              1
+#define COLUMN_TYPE              2
+#define COLUMN_CHANNEL           3  // First of the WINDOP_NUM_CHANNELS channel columns
+
+#define MAX_BUFFERS              (2 * WINDOP_ARROW_COLUMNS)
+#define MAX_TABLE_FIELDS         8
+
+/* ****************************************************************************
+ *
+ * FlatBuffers builder. The buffer is filled from the end backwards, so an
+ * object is finished before anything that refers to it, and an object is
+ * named by its distance from the end, which stays fixed as the buffer
+ * grows. A reference is stored as the forward distance from where it sits
+ * to the object, as the format wants.
+ *
+ * */
+typedef struct fbBuilder {
+    uint8_t * buf;
+    uint32_t capacity;
+    uint32_t size;            // Bytes in use, at the end of buf
+    uint32_t minAlign;
+    uint32_t tableStart;
+    uint32_t fields[MAX_TABLE_FIELDS]; // Where each field of the open table went, 0 when absent
+    uint8_t numFields;
+    uint8_t failed;
+} fbBuilder;
+
+static void fbInit(fbBuilder * b) {
+    memset(b, 0, sizeof(*b));
+    b->minAlign = 1;
+}
+
+static void fbFree(fbBuilder * b) {
+    free(b->buf);
+    memset(b, 0, sizeof(*b));
+}
+
+static uint8_t fbReserve(fbBuilder * b, uint32_t bytes) {
+    uint32_t capacity = b->capacity ? b->capacity : 1024;
+    uint8_t * grown;
+
+    if (b->capacity - b->size >= bytes) {
+        return 1;
+    }
+    while (capacity - b->size < bytes) {
+        capacity *= 2;
+    }
+    grown = malloc(capacity);
+    if (grown == NULL) {
+        b->failed = 1;
+        return 0;
+    }
+    if (b->buf != NULL) {
+        memcpy(&grown[capacity - b->size], &b->buf[b->capacity - b->size], b->size);
+        free(b->buf);
+    }
+    b->buf = grown;
+    b->capacity = capacity;
+    return 1;
+}
+
+static void fbPush(fbBuilder * b, const void * data, uint32_t bytes) {
+    if (fbReserve(b, bytes)) {
+        b->size += bytes;
+        memcpy(&b->buf[b->capacity - b->size], data, bytes);
+    }
+}
+
+static void fbPad(fbBuilder * b, uint32_t bytes) {
+    if (fbReserve(b, bytes)) {
+        b->size += bytes;
+        memset(&b->buf[b->capacity - b->size], 0, bytes);
+    }
+}
+
+// Pad so the buffer is aligned to align once extra more bytes are pushed
+static void fbAlign(fbBuilder * b, uint32_t align, uint32_t extra) {
+    fbPad(b, (0u - (b->size + extra)) & (align - 1));
+    b->minAlign = (align > b->minAlign) ? align : b->minAlign;
+}
+
+static void fbScalar(fbBuilder * b, const void * value, uint32_t bytes) {
+    fbAlign(b, bytes, 0);
+    fbPush(b, value, bytes);
+}
+
+static void fbReference(fbBuilder * b, uint32_t object) {
+    uint32_t distance;
+
+    fbAlign(b, 4, 0);
+    distance = b->size + 4 - object;
+    fbPush(b, &distance, 4);
+}
+
+static uint32_t fbString(fbBuilder * b, const char * text) {
+    const uint32_t length = (uint32_t) strlen(text);
+
+    fbAlign(b, 4, length + 1);
+    fbPad(b, 1);
+    fbPush(b, text, length);
+    fbPush(b, &length, 4);
+    return b->size;
+}
+
+// Vector of n structs of size bytes, element 0 at data
+static uint32_t fbStructs(fbBuilder * b, const void * data, uint32_t n, uint32_t size, uint32_t align) {
+    uint32_t i;
+
+    fbAlign(b, 4, n * size);
+    fbAlign(b, align, n * size);
+    for (i = n; i > 0; i--) {
+        fbPush(b, (const uint8_t *) data + (i - 1) * size, size);
+    }
+    fbPush(b, &n, 4);
+    return b->size;
+}
+
+static uint32_t fbReferences(fbBuilder * b, const uint32_t * objects, uint32_t n) {
+    uint32_t i;
+
+    fbAlign(b, 4, n * 4);
+    for (i = n; i > 0; i--) {
+        fbReference(b, objects[i - 1]);
+    }
+    fbPush(b, &n, 4);
+    return b->size;
+}
+
+static void fbStartTable(fbBuilder * b, uint8_t numFields) {
+    memset(b->fields, 0, sizeof(b->fields));
+    b->numFields = numFields;
+    b->tableStart = b->size;
+}
+
+static void fbField(fbBuilder * b, uint8_t field, const void * value, uint32_t bytes) {
+    fbScalar(b, value, bytes);
+    b->fields[field] = b->size;
+}
+
+static void fbFieldReference(fbBuilder * b, uint8_t field, uint32_t object) {
+    fbReference(b, object);
+    b->fields[field] = b->size;
+}
+
+static void fbFieldU8(fbBuilder * b, uint8_t field, uint8_t value) { fbField(b, field, &value, 1); }
+static void fbFieldI16(fbBuilder * b, uint8_t field, int16_t value) { fbField(b, field, &value, 2); }
+static void fbFieldI32(fbBuilder * b, uint8_t field, int32_t value) { fbField(b, field, &value, 4); }
+static void fbFieldI64(fbBuilder * b, uint8_t field, int64_t value) { fbField(b, field, &value, 8); }
+
+// The table's offset to its vtable, then the vtable just before it
+static uint32_t fbEndTable(fbBuilder * b) {
+    const int32_t placeholder = 0;
+    uint32_t object;
+    uint16_t entry;
+    int32_t vtable;
+    uint8_t f;
+
+    fbScalar(b, &placeholder, 4);
+    object = b->size;
+    for (f = b->numFields; f > 0; f--) {
+        entry = (uint16_t) (b->fields[f - 1] ? object - b->fields[f - 1] : 0);
+        fbPush(b, &entry, 2);
+    }
+    entry = (uint16_t) (object - b->tableStart);
+    fbPush(b, &entry, 2);
+    entry = (uint16_t) (2 * (b->numFields + 2));
+    fbPush(b, &entry, 2);
+    if (!b->failed) {
+        vtable = (int32_t) (b->size - object);
+        memcpy(&b->buf[b->capacity - object], &vtable, 4);
+    }
+    return object;
+}
+
+static void fbFinish(fbBuilder * b, uint32_t root) {
+    fbAlign(b, b->minAlign, 4);
+    fbReference(b, root);
+}
+
+static const uint8_t * fbData(const fbBuilder * b) {
+    return &b->buf[b->capacity - b->size];
+}
+
+/* ****************************************************************************
+ *
+ * Arrow schema and messages, see format/Schema.fbs and format/Message.fbs
+ *
+ * */
+static uint32_t intType(fbBuilder * b, int32_t bitWidth, uint8_t isSigned) {
+    fbStartTable(b, 2);
+    fbFieldI32(b, 0, bitWidth);
+    fbFieldU8(b, 1, isSigned);
+    return fbEndTable(b);
+}
+
+static uint32_t field(fbBuilder * b, const char * name, uint8_t nullable, uint8_t typeType, uint32_t type,
+                      uint32_t dictionary) {
+    uint32_t nameRef = fbString(b, name);
+    uint32_t children = fbReferences(b, NULL, 0);
+
+    fbStartTable(b, 7);
+    fbFieldReference(b, 0, nameRef);
+    fbFieldReference(b, 3, type);
+    if (dictionary != 0) {
+        fbFieldReference(b, 4, dictionary);
+    }
+    fbFieldReference(b, 5, children);
+    fbFieldU8(b, 1, nullable);
+    fbFieldU8(b, 2, typeType);
+    return fbEndTable(b);
+}
+
+static uint32_t buildSchema(fbBuilder * b) {
+    uint32_t fields[WINDOP_ARROW_COLUMNS];
+    uint32_t type;
+    uint32_t index;
+    uint32_t dictionary;
+    uint32_t timezone;
+    uint32_t vector;
+    uint8_t ch;
+
+    // Device names, int32 indices into dictionary 0
+    index = intType(b, 32, 1);
+    fbStartTable(b, 4);
+    fbFieldI64(b, 0, 0);
+    fbFieldReference(b, 1, index);
+    fbFieldU8(b, 2, 0);
+    dictionary = fbEndTable(b);
+    fbStartTable(b, 0);
+    type = fbEndTable(b);
+    fields[COLUMN_DEVICE] = field(b, "device", 0, TYPE_UTF8, type, dictionary);
+
+    timezone = fbString(b, "UTC");
+    fbStartTable(b, 2);
+    fbFieldReference(b, 1, timezone);
+    fbFieldI16(b, 0, UNIT_SECOND);
+    type = fbEndTable(b);
+    fields[COLUMN_TIME] = field(b, "time", 0, TYPE_TIMESTAMP, type, 0);
+
+    type = intType(b, 8, 0);
+    fields[COLUMN_TYPE] = field(b, "type", 0, TYPE_INT, type, 0);
+
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        fbStartTable(b, 1);
+        fbFieldI16(b, 0, FLOAT_DOUBLE);
+        type = fbEndTable(b);
+        fields[COLUMN_CHANNEL + ch] = field(b, key_WindOpChannel(ch), 1, TYPE_FLOAT, type, 0);
+    }
+
+    vector = fbReferences(b, fields, WINDOP_ARROW_COLUMNS);
+    fbStartTable(b, 2);
+    fbFieldReference(b, 1, vector);
+    fbFieldI16(b, 0, 0); // Little endian
+    return fbEndTable(b);
+}
+
+// FieldNode and Buffer structs of Message.fbs
+typedef struct arrowPair {
+    int64_t a;
+    int64_t b;
+} arrowPair;
+
+static uint32_t recordBatch(fbBuilder * b, int64_t length, const arrowPair * nodes, uint32_t numNodes,
+                            const arrowPair * buffers, uint32_t numBuffers) {
+    uint32_t nodeVector = fbStructs(b, nodes, numNodes, sizeof(arrowPair), 8);
+    uint32_t bufferVector = fbStructs(b, buffers, numBuffers, sizeof(arrowPair), 8);
+
+    fbStartTable(b, 3);
+    fbFieldI64(b, 0, length);
+    fbFieldReference(b, 1, nodeVector);
+    fbFieldReference(b, 2, bufferVector);
+    return fbEndTable(b);
+}
+
+static uint32_t message(fbBuilder * b, uint8_t headerType, uint32_t header, int64_t bodyLength) {
+    fbStartTable(b, 4);
+    fbFieldI64(b, 3, bodyLength);
+    fbFieldReference(b, 2, header);
+    fbFieldI16(b, 0, ARROW_V5);
+    fbFieldU8(b, 1, headerType);
+    return fbEndTable(b);
+}
+
+/* ****************************************************************************
+ *
+ * Writer
+ *
+ * */
+static void writeBytes(WindOpArrowWriter * writer, const void * data, uint64_t bytes) {
+    if ((bytes != 0) && (fwrite(data, 1, bytes, writer->file) != bytes)) {
+        writer->status = WINDOP_ERR_FORMAT;
+    }
+    writer->offset += bytes;
+}
+
+static void writePadding(WindOpArrowWriter * writer) {
+    static const uint8_t zeros[ARROW_ALIGN] = { 0 };
+    writeBytes(writer, zeros, (0u - writer->offset) & (ARROW_ALIGN - 1));
+}
+
+static inline uint64_t padded(uint64_t bytes) {
+    return (bytes + ARROW_ALIGN - 1) & ~(uint64_t) (ARROW_ALIGN - 1);
+}
+
+// Continuation marker, metadata length, metadata padded to 8. Returns the block
+static WindOpArrowBlock writeMetadata(WindOpArrowWriter * writer, fbBuilder * b, uint32_t root, int64_t bodyLength) {
+    const uint32_t continuation = ARROW_CONTINUATION;
+    WindOpArrowBlock block;
+    int32_t length;
+
+    fbFinish(b, root);
+    if (b->failed) {
+        writer->status = WINDOP_ERR_MEMORY;
+    }
+    length = (int32_t) padded(b->size);
+    block.offset = (int64_t) writer->offset;
+    block.metaDataLength = 8 + length;
+    block.reserved = 0;
+    block.bodyLength = bodyLength;
+    writeBytes(writer, &continuation, 4);
+    writeBytes(writer, &length, 4);
+    if (!b->failed) {
+        writeBytes(writer, fbData(b), b->size);
+    }
+    writePadding(writer);
+    return block;
+}
+
+static uint8_t addBlock(WindOpArrowWriter * writer, WindOpArrowBlock block) {
+    uint32_t capacity;
+    WindOpArrowBlock * grown;
+
+    if (writer->numBatches == writer->batchCapacity) {
+        capacity = writer->batchCapacity ? 2 * writer->batchCapacity : 64;
+        grown = realloc(writer->batches, capacity * sizeof(WindOpArrowBlock));
+        if (grown == NULL) {
+            return WINDOP_ERR_MEMORY;
+        }
+        writer->batches = grown;
+        writer->batchCapacity = capacity;
+    }
+    writer->batches[writer->numBatches++] = block;
+    return WINDOP_OK;
+}
+
+static void freeBatch(WindOpArrowWriter * writer) {
+    uint8_t ch;
+
+    free(writer->device);
+    free(writer->time);
+    free(writer->dataType);
+    free(writer->valid);
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        free(writer->value[ch]);
+    }
+}
+
+static void freeWriter(WindOpArrowWriter * writer) {
+    freeBatch(writer);
+    free(writer->devices);
+    free(writer->hash);
+    free(writer->batches);
+    memset(writer, 0, sizeof(*writer));
+}
+
+uint8_t open_WindOpArrowWriter(WindOpArrowWriter * writer, const char * path) {
+    static const uint8_t magic[ARROW_ALIGN] = ARROW_MAGIC;
+    fbBuilder b;
+    uint8_t failed;
+    uint8_t ch;
+
+    memset(writer, 0, sizeof(*writer));
+    writer->lastDevice = -1;
+    writer->device = malloc(WINDOP_ARROW_BATCH_ROWS * sizeof(int32_t));
+    writer->time = malloc(WINDOP_ARROW_BATCH_ROWS * sizeof(int64_t));
+    writer->dataType = malloc(WINDOP_ARROW_BATCH_ROWS);
+    writer->valid = malloc(WINDOP_ARROW_BATCH_ROWS);
+    failed = (writer->device == NULL) || (writer->time == NULL) || (writer->dataType == NULL) ||
+             (writer->valid == NULL);
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        writer->value[ch] = malloc(WINDOP_ARROW_BATCH_ROWS * sizeof(double));
+        failed |= (writer->value[ch] == NULL);
+    }
+    if (failed) {
+        freeWriter(writer);
+        return WINDOP_ERR_MEMORY;
+    }
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        freeWriter(writer);
+        return WINDOP_ERR_FORMAT;
+    }
+
+    writeBytes(writer, magic, ARROW_ALIGN);
+    fbInit(&b);
+    writeMetadata(writer, &b, message(&b, HEADER_SCHEMA, buildSchema(&b), 0), 0);
+    fbFree(&b);
+    return writer->status;
+}
+
+/* ****************************************************************************
+ * Device dictionary, FNV-1a over the name into an open addressed index
+ * */
+static uint32_t nameHash(const char * name) {
+    uint32_t h = 2166136261u;
+    uint32_t i;
+    for (i = 0; (i < WINDOP_ARROW_DEVICE_SIZE - 1) && name[i]; i++) {
+        h = (h ^ (uint8_t) name[i]) * 16777619u;
+    }
+    return h;
+}
+
+static uint32_t * findSlot(const WindOpArrowWriter * writer, const char * name) {
+    uint32_t mask = writer->hashSize - 1;
+    uint32_t h = nameHash(name) & mask;
+
+    while ((writer->hash[h] != 0) &&
+           (strncmp(writer->devices[writer->hash[h] - 1], name, WINDOP_ARROW_DEVICE_SIZE - 1) != 0)) {
+        h = (h + 1) & mask;
+    }
+    return &writer->hash[h];
+}
+
+static int32_t deviceIndex(WindOpArrowWriter * writer, const char * name) {
+    uint32_t * slot;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t i;
+    void * grown;
+
+    if ((writer->lastDevice >= 0) &&
+        (strncmp(writer->devices[writer->lastDevice], name, WINDOP_ARROW_DEVICE_SIZE - 1) == 0)) {
+        return writer->lastDevice;
+    }
+    if (2 * (writer->numDevices + 1) > writer->hashSize) {
+        size = writer->hashSize ? 2 * writer->hashSize : 64;
+        free(writer->hash);
+        writer->hash = calloc(size, sizeof(uint32_t));
+        if (writer->hash == NULL) {
+            writer->hashSize = 0;
+            return -1;
+        }
+        writer->hashSize = size;
+        for (i = 0; i < writer->numDevices; i++) {
+            *findSlot(writer, writer->devices[i]) = i + 1;
+        }
+    }
+    slot = findSlot(writer, name);
+    if (*slot == 0) {
+        if (writer->numDevices == writer->deviceCapacity) {
+            capacity = writer->deviceCapacity ? 2 * writer->deviceCapacity : 16;
+            grown = realloc(writer->devices, capacity * sizeof(writer->devices[0]));
+            if (grown == NULL) {
+                return -1;
+            }
+            writer->devices = grown;
+            writer->deviceCapacity = capacity;
+        }
+        memset(writer->devices[writer->numDevices], 0, WINDOP_ARROW_DEVICE_SIZE);
+        strncpy(writer->devices[writer->numDevices], name, WINDOP_ARROW_DEVICE_SIZE - 1);
+        *slot = ++writer->numDevices;
+    }
+    writer->lastDevice = (int32_t) *slot - 1;
+    return writer->lastDevice;
+}
+
+/* ****************************************************************************
+ * Record batches
+ * */
+static void flushBatch(WindOpArrowWriter * writer) {
+    static uint8_t bitmaps[WINDOP_NUM_CHANNELS][WINDOP_ARROW_BATCH_ROWS / 8];
+    const uint32_t rows = writer->batchRows;
+    const uint32_t bitmapBytes = (rows + 7) / 8;
+    arrowPair nodes[WINDOP_ARROW_COLUMNS];
+    arrowPair buffers[MAX_BUFFERS];
+    const void * data[MAX_BUFFERS];
+    uint32_t numBuffers = 0;
+    uint32_t nulls;
+    uint32_t r;
+    uint32_t i;
+    int64_t body = 0;
+    uint32_t root;
+    fbBuilder b;
+    uint8_t ch;
+
+    if (rows == 0) {
+        return;
+    }
+
+    // validity and values per column, a column without nulls has no bitmap
+#define ADD_BUFFER(ptr, bytes)                            \
+    do {                                                  \
+        data[numBuffers] = (ptr);                         \
+        buffers[numBuffers].a = body;                     \
+        buffers[numBuffers].b = (int64_t) (bytes);        \
+        body += (int64_t) padded(bytes);                  \
+        numBuffers++;                                     \
+    } while (0)
+
+    nodes[COLUMN_DEVICE].a = rows;
+    nodes[COLUMN_DEVICE].b = 0;
+    ADD_BUFFER(NULL, 0);
+    ADD_BUFFER(writer->device, rows * sizeof(int32_t));
+    nodes[COLUMN_TIME] = nodes[COLUMN_DEVICE];
+    ADD_BUFFER(NULL, 0);
+    ADD_BUFFER(writer->time, rows * sizeof(int64_t));
+    nodes[COLUMN_TYPE] = nodes[COLUMN_DEVICE];
+    ADD_BUFFER(NULL, 0);
+    ADD_BUFFER(writer->dataType, rows);
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        memset(bitmaps[ch], 0, bitmapBytes);
+        nulls = 0;
+        for (r = 0; r < rows; r++) {
+            const uint8_t bit = (writer->valid[r] >> ch) & 1;
+            bitmaps[ch][r / 8] |= (uint8_t) (bit << (r % 8));
+            nulls += bit ^ 1;
+        }
+        nodes[COLUMN_CHANNEL + ch].a = rows;
+        nodes[COLUMN_CHANNEL + ch].b = nulls;
+        ADD_BUFFER(bitmaps[ch], (nulls != 0) ? bitmapBytes : 0);
+        ADD_BUFFER(writer->value[ch], rows * sizeof(double));
+    }
+#undef ADD_BUFFER
+
+    fbInit(&b);
+    root = message(&b, HEADER_RECORD_BATCH,
+                   recordBatch(&b, rows, nodes, WINDOP_ARROW_COLUMNS, buffers, numBuffers), body);
+    if (addBlock(writer, writeMetadata(writer, &b, root, body)) != WINDOP_OK) {
+        writer->status = WINDOP_ERR_MEMORY;
+    }
+    fbFree(&b);
+    for (i = 0; i < numBuffers; i++) {
+        writeBytes(writer, data[i], (uint64_t) buffers[i].b);
+        writePadding(writer);
+    }
+    writer->rows += rows;
+    writer->batchRows = 0;
+}
+
+uint8_t append_WindOpArrow(WindOpArrowWriter * writer, const char * device, const WindOpColumns * cols) {
+    const WindOpTypeInfo * info;
+    int32_t index;
+    uint32_t row;
+    uint32_t slot;
+    uint8_t valid;
+    uint8_t ch;
+
+    if (writer->file == NULL) {
+        return WINDOP_ERR_FORMAT;
+    }
+    index = deviceIndex(writer, device);
+    if (index < 0) {
+        writer->status = WINDOP_ERR_MEMORY;
+        return writer->status;
+    }
+    for (row = 0; row < cols->numRows; row++) {
+        info = info_WindOpDataType(cols->dataType[row]);
+        if (info == NULL) {
+            continue;
+        }
+        slot = writer->batchRows;
+        valid = cols->valid[row];
+        writer->device[slot] = index;
+        writer->time[slot] = cols->time[row];
+        writer->dataType[slot] = cols->dataType[row];
+        writer->valid[slot] = valid;
+        for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+            writer->value[ch][slot] = ((valid >> ch) & 1) ? cols->channel[ch][row] * info->scale[ch] : 0.0;
+        }
+        if (++writer->batchRows == WINDOP_ARROW_BATCH_ROWS) {
+            flushBatch(writer);
+        }
+    }
+    return writer->status;
+}
+
+/* ****************************************************************************
+ * The dictionary as a utf8 batch, then end of stream and the footer
+ * */
+static WindOpArrowBlock writeDictionary(WindOpArrowWriter * writer) {
+    const uint32_t n = writer->numDevices;
+    arrowPair node;
+    arrowPair buffers[3];
+    int32_t offset = 0;
+    int64_t body;
+    uint32_t root;
+    uint32_t i;
+    fbBuilder b;
+    WindOpArrowBlock block;
+
+    for (i = 0; i < n; i++) {
+        offset += (int32_t) strlen(writer->devices[i]);
+    }
+    node.a = n;
+    node.b = 0;
+    buffers[0].a = 0;
+    buffers[0].b = 0;
+    buffers[1].a = 0;
+    buffers[1].b = (int64_t) (n + 1) * 4;
+    buffers[2].a = (int64_t) padded((uint64_t) buffers[1].b);
+    buffers[2].b = offset;
+
+    fbInit(&b);
+    root = recordBatch(&b, n, &node, 1, buffers, 3);
+    fbStartTable(&b, 3);
+    fbFieldI64(&b, 0, 0);
+    fbFieldReference(&b, 1, root);
+    fbFieldU8(&b, 2, 0);
+    root = fbEndTable(&b);
+    body = buffers[2].a + (int64_t) padded((uint64_t) offset);
+    block = writeMetadata(writer, &b, message(&b, HEADER_DICTIONARY, root, body), body);
+    fbFree(&b);
+
+    offset = 0;
+    for (i = 0; i < n; i++) {
+        writeBytes(writer, &offset, 4);
+        offset += (int32_t) strlen(writer->devices[i]);
+    }
+    writeBytes(writer, &offset, 4);
+    writePadding(writer);
+    for (i = 0; i < n; i++) {
+        writeBytes(writer, writer->devices[i], strlen(writer->devices[i]));
+    }
+    writePadding(writer);
+    return block;
+}
+
+uint8_t close_WindOpArrowWriter(WindOpArrowWriter * writer) {
+    static const uint32_t endOfStream[2] = { ARROW_CONTINUATION, 0 };
+    WindOpArrowBlock dictionary;
+    uint32_t schema;
+    uint32_t dictionaries;
+    uint32_t batches;
+    uint64_t start;
+    int32_t length;
+    uint8_t status;
+    fbBuilder b;
+
+    if (writer->file == NULL) {
+        return WINDOP_ERR_FORMAT;
+    }
+    flushBatch(writer);
+    dictionary = writeDictionary(writer);
+    writeBytes(writer, endOfStream, sizeof(endOfStream));
+
+    fbInit(&b);
+    schema = buildSchema(&b);
+    dictionaries = fbStructs(&b, &dictionary, 1, sizeof(WindOpArrowBlock), 8);
+    batches = fbStructs(&b, writer->batches, writer->numBatches, sizeof(WindOpArrowBlock), 8);
+    fbStartTable(&b, 5);
+    fbFieldReference(&b, 1, schema);
+    fbFieldReference(&b, 2, dictionaries);
+    fbFieldReference(&b, 3, batches);
+    fbFieldI16(&b, 0, ARROW_V5);
+    fbFinish(&b, fbEndTable(&b));
+    if (b.failed) {
+        writer->status = WINDOP_ERR_MEMORY;
+    } else {
+        start = writer->offset;
+        writeBytes(writer, fbData(&b), b.size);
+        length = (int32_t) (writer->offset - start);
+        writeBytes(writer, &length, 4);
+        writeBytes(writer, ARROW_MAGIC, ARROW_MAGIC_SIZE);
+    }
+    fbFree(&b);
+
+    if (fclose(writer->file) != 0) {
+        writer->status = WINDOP_ERR_FORMAT;
+    }
+    writer->file = NULL;
+    status = writer->status;
+    freeWriter(writer);
+    return status;
+}
@@ -0,0 +1,121 @@
+/*
+ ============================================================================
+ Name        : wm_arrow.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Arrow IPC file (Feather V2) writer for decoded readings
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+
+#ifndef WM_ARROW_H
+#define WM_ARROW_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wm_codec.h"
+#include "wm_batch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ****************************************************************************
+ *
+ * Decoded readings as an Arrow IPC file, the format pyarrow.feather and
+ * pandas.read_feather open, memory mapped with no parsing. One row per
+ * reading in the order appended, the columns
+ *
+ *   device   dictionary<int32, utf8>   device id
+ *   time     timestamp[s, UTC]         int64 epoch seconds
+ *   type     uint8                     packet type
+ *   ws, wsa, wsm, wd, tmp, pres, hum, bv
+ *            float64 in units, as the CSV, null where the packet has no
+ *            such channel
+ *
+ * Rows are written out a record batch of WINDOP_ARROW_BATCH_ROWS at a time,
+ * so memory stays at one batch however long the input. The device
+ * dictionary is only complete at the end, it goes after the batches as the
+ * file format allows, with the footer pointing readers at it.
+ *
+ * Arrow metadata is FlatBuffers, built here by hand for the few tables the
+ * file needs. Little endian hosts only, as Arrow buffers are.
+ *
+ * */
+#define WINDOP_ARROW_BATCH_ROWS    65536
+#define WINDOP_ARROW_DEVICE_SIZE   64    // Longest device id kept, as in wm_json.h
+#define WINDOP_ARROW_COLUMNS       (3 + WINDOP_NUM_CHANNELS)
+
+typedef struct WindOpArrowBlock {
+    int64_t offset;           // File offset of the message
+    int32_t metaDataLength;   // Prefix and padded metadata bytes
+    int32_t reserved;
+    int64_t bodyLength;
+} WindOpArrowBlock;
+
+typedef struct WindOpArrowWriter {
+    FILE * file;
+    uint64_t offset;          // Bytes written so far
+    uint64_t rows;
+    uint8_t status;           // First error, WINDOP_OK until one happens
+
+    // Device dictionary, index by name hash
+    char (*devices)[WINDOP_ARROW_DEVICE_SIZE];
+    uint32_t numDevices;
+    uint32_t deviceCapacity;
+    uint32_t * hash;          // Device index + 1, 0 for free
+    uint32_t hashSize;
+    int32_t lastDevice;       // Index of the last device appended, -1 for none
+
+    // The batch being filled
+    uint32_t batchRows;
+    int32_t * device;
+    int64_t * time;
+    uint8_t * dataType;
+    uint8_t * valid;
+    double * value[WINDOP_NUM_CHANNELS];
+
+    WindOpArrowBlock * batches;
+    uint32_t numBatches;
+    uint32_t batchCapacity;
+} WindOpArrowWriter;
+
+// Create path and write the magic and schema, returns a WINDOP_* code
+uint8_t open_WindOpArrowWriter(WindOpArrowWriter * writer, const char * path);
+
+// Add the rows of cols read from device, returns a WINDOP_* code
+uint8_t append_WindOpArrow(WindOpArrowWriter * writer, const char * device, const WindOpColumns * cols);
+
+// Write the last batch, the dictionary and the footer, then close
+uint8_t close_WindOpArrowWriter(WindOpArrowWriter * writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_ARROW_H
@@ -0,0 +1,161 @@
+/*
+ ============================================================================
+ Name        : wm_base64.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Base64 and hex text to packet bytes
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include "wm_base64.h"
+
+#define B64_BAD  0xFF
+#define B64_PAD  0xFE
+
+static const char base64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* ****************************************************************************
+ *
+ * 256 entry lookup. Padding maps to B64_PAD, everything outside the alphabet
+ * to B64_BAD. Constant so decoder threads can share it.
+ *
+ * */
+#define XX B64_BAD
+#define PD B64_PAD
+static const uint8_t base64Table[256] = {
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, 62, XX, XX, XX, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, XX, XX, XX, PD, XX, XX,
+    XX,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, XX, XX, XX, XX, XX,
+    XX, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+};
+#undef XX
+#undef PD
+
+int32_t decode_WindOpBase64(const char * in, uint32_t inLength, uint8_t * out, uint32_t outCapacity) {
+    uint32_t i;
+    uint32_t bytes = 0;
+    uint32_t accumulator = 0;
+    uint32_t bits = 0;
+    uint8_t v;
+
+    for (i = 0; i < inLength; i++) {
+        v = base64Table[(uint8_t) in[i]];
+        if (v == B64_PAD) {
+            break;
+        }
+        if (v == B64_BAD) {
+            return -1;
+        }
+        accumulator = (accumulator << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (bytes >= outCapacity) {
+                return -1;
+            }
+            out[bytes++] = (uint8_t) (accumulator >> bits);
+        }
+    }
+    // Only padding may follow the first pad character
+    for (; i < inLength; i++) {
+        if (in[i] != '=') {
+            return -1;
+        }
+    }
+
+    return (int32_t) bytes;
+}
+
+static inline int32_t hexNibble(char c) {
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    }
+    c |= 0x20; // Fold to lower case
+    if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+int32_t decode_WindOpHex(const char * in, uint32_t inLength, uint8_t * out, uint32_t outCapacity) {
+    uint32_t i;
+    int32_t hi;
+    int32_t lo;
+
+    if ((inLength & 1) || ((inLength >> 1) > outCapacity)) {
+        return -1;
+    }
+    for (i = 0; i < inLength; i += 2) {
+        hi = hexNibble(in[i]);
+        lo = hexNibble(in[i + 1]);
+        if ((hi < 0) || (lo < 0)) {
+            return -1;
+        }
+        out[i >> 1] = (uint8_t) ((hi << 4) | lo);
+    }
+
+    return (int32_t) (inLength >> 1);
+}
+
+uint32_t encode_WindOpBase64(const uint8_t * in, uint32_t inLength, char * out) {
+    uint32_t i;
+    uint32_t o = 0;
+    uint32_t v;
+
+    for (i = 0; i + 2 < inLength; i += 3) {
+        v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+        out[o++] = base64Chars[(v >> 18) & 0x3F];
+        out[o++] = base64Chars[(v >> 12) & 0x3F];
+        out[o++] = base64Chars[(v >> 6) & 0x3F];
+        out[o++] = base64Chars[v & 0x3F];
+    }
+    if (i < inLength) {
+        v = in[i] << 16;
+        if (i + 1 < inLength) {
+            v |= in[i + 1] << 8;
+        }
+        out[o++] = base64Chars[(v >> 18) & 0x3F];
+        out[o++] = base64Chars[(v >> 12) & 0x3F];
+        out[o++] = (i + 1 < inLength) ? base64Chars[(v >> 6) & 0x3F] : '=';
+        out[o++] = '=';
+    }
+    out[o] = '\0';
+
+    return o;
+}
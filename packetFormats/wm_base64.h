@@ -0,0 +1,55 @@
+/*
+ ============================================================================
+ Name        : wm_base64.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Base64 and hex text to packet bytes
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_BASE64_H
+#define WM_BASE64_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Decode straight to bytes. Return the number of bytes written, or -1 if the
+// text is malformed or would not fit in outCapacity bytes.
+int32_t decode_WindOpBase64(const char * in, uint32_t inLength, uint8_t * out, uint32_t outCapacity);
+int32_t decode_WindOpHex(const char * in, uint32_t inLength, uint8_t * out, uint32_t outCapacity);
+
+// Encode to text, returns the number of characters written without the NUL.
+uint32_t encode_WindOpBase64(const uint8_t * in, uint32_t inLength, char * out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_BASE64_H
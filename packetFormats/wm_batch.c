@@ -0,0 +1,236 @@
+/*
+ ============================================================================
+ Name        : wm_batch.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Batch packet decode into columnar arrays
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_batch.h"
+#include "wm_delta.h"
+#include "wm_metrics.h"
+
+static void * allocAligned(size_t bytes) {
+    void * ptr = NULL;
+    if (posix_memalign(&ptr, WINDOP_COLUMNS_ALIGN, bytes) != 0) {
+        return NULL;
+    }
+    return ptr;
+}
+
+uint8_t init_WindOpColumns(WindOpColumns * cols, uint32_t capacity) {
+    uint8_t ch;
+    uint8_t failed;
+
+    // One spare row keeps zero sized allocations out of the picture for empty inputs
+    memset(cols, 0, sizeof(*cols));
+    cols->time = allocAligned((capacity + 1) * sizeof(int64_t));
+    cols->packet = allocAligned((capacity + 1) * sizeof(uint32_t));
+    cols->dataType = allocAligned(capacity + 1);
+    cols->valid = allocAligned(capacity + 1);
+    failed = (cols->time == NULL) || (cols->packet == NULL) || (cols->dataType == NULL) || (cols->valid == NULL);
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        cols->channel[ch] = allocAligned((capacity + 1) * sizeof(int32_t));
+        failed |= (cols->channel[ch] == NULL);
+    }
+    if (failed) {
+        free_WindOpColumns(cols);
+        return WINDOP_ERR_MEMORY;
+    }
+    cols->capacity = capacity;
+
+    return WINDOP_OK;
+}
+
+void free_WindOpColumns(WindOpColumns * cols) {
+    uint8_t ch;
+
+    free(cols->time);
+    free(cols->packet);
+    free(cols->dataType);
+    free(cols->valid);
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        free(cols->channel[ch]);
+    }
+    memset(cols, 0, sizeof(*cols));
+}
+
+/* ****************************************************************************
+ *
+ * Swap one column for a larger aligned copy, realloc would not keep the
+ * alignment. used is the byte count to keep.
+ *
+ * */
+static uint8_t growColumn(void ** column, size_t used, uint32_t capacity, size_t elemSize) {
+    void * grown = allocAligned((capacity + 1) * elemSize);
+    if (grown == NULL) {
+        return WINDOP_ERR_MEMORY;
+    }
+    if (*column != NULL) {
+        memcpy(grown, *column, used);
+        free(*column);
+    }
+    *column = grown;
+    return WINDOP_OK;
+}
+
+uint8_t reserve_WindOpColumns(WindOpColumns * cols, uint32_t rows) {
+    const uint32_t used = cols->numRows;
+    uint32_t capacity = cols->capacity ? cols->capacity : 1024;
+    uint8_t result = WINDOP_OK;
+    uint8_t ch;
+
+    if (rows <= cols->capacity - cols->numRows) {
+        return WINDOP_OK;
+    }
+    while (capacity - cols->numRows < rows) {
+        if (capacity > UINT32_MAX / 2) {
+            return WINDOP_ERR_CAPACITY;
+        }
+        capacity *= 2;
+    }
+    result |= growColumn((void **) &cols->time, used * sizeof(int64_t), capacity, sizeof(int64_t));
+    result |= growColumn((void **) &cols->packet, used * sizeof(uint32_t), capacity, sizeof(uint32_t));
+    result |= growColumn((void **) &cols->dataType, used, capacity, 1);
+    result |= growColumn((void **) &cols->valid, used, capacity, 1);
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        result |= growColumn((void **) &cols->channel[ch], used * sizeof(int32_t), capacity, sizeof(int32_t));
+    }
+    if (result != WINDOP_OK) {
+        return WINDOP_ERR_MEMORY;
+    }
+    cols->capacity = capacity;
+    return WINDOP_OK;
+}
+
+uint8_t append_WindOpColumns(WindOpColumns * dst, const WindOpColumns * src) {
+    uint32_t row = dst->numRows;
+    uint8_t ch;
+
+    if (reserve_WindOpColumns(dst, src->numRows) != WINDOP_OK) {
+        return WINDOP_ERR_MEMORY;
+    }
+    memcpy(&dst->time[row], src->time, src->numRows * sizeof(int64_t));
+    memcpy(&dst->packet[row], src->packet, src->numRows * sizeof(uint32_t));
+    memcpy(&dst->dataType[row], src->dataType, src->numRows);
+    memcpy(&dst->valid[row], src->valid, src->numRows);
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        memcpy(&dst->channel[ch][row], src->channel[ch], src->numRows * sizeof(int32_t));
+    }
+    dst->numRows += src->numRows;
+    return WINDOP_OK;
+}
+
+/* ****************************************************************************
+ *
+ * Decode a single packet. All bounds are checked before any reading is
+ * touched so a corrupt uplink never writes a partial set of rows.
+ *
+ * */
+uint8_t decode_WindOpPacketColumns(const uint8_t * packet, uint32_t length, uint32_t packetIndex,
+                                   WindOpColumns * out) {
+    WindOpMetricsThread * const metrics = self_WindOpMetrics();
+    const uint64_t start = start_WindOpStage(metrics, WINDOP_STAGE_COLUMNS);
+    WindOpPacketHeader hdr;
+    uint32_t address;
+    uint32_t i;
+    uint32_t row;
+    uint8_t result;
+
+    result = parse_WindOpPacketHeader(&hdr, packet, length);
+    if ((result == WINDOP_OK) && (hdr.numReadings > out->capacity - out->numRows)) {
+        result = WINDOP_ERR_CAPACITY;
+    }
+    if (result != WINDOP_OK) {
+        countFailure_WindOpMetrics(metrics, result);
+        return result;
+    }
+
+    address = hdr.dataOffset;
+    row = out->numRows;
+    if (hdr.info->readingSize == 0) {
+        unpack_WindOpDeltaReadings(&packet[address], out->channel, row);
+    }
+    for (i = 0; i < hdr.numReadings; i++) {
+        out->time[row] = hdr.firstTime + 60 * (int64_t) i;
+        out->packet[row] = packetIndex;
+        out->dataType[row] = hdr.info->dataType;
+        out->valid[row] = hdr.channels;
+        if (hdr.info->readingSize != 0) {
+            unpack_WindOpReadingChannels(hdr.info, out->channel, row, &packet[address]);
+            address += hdr.info->readingSize;
+        }
+        row++;
+    }
+    out->numRows = row;
+
+    countPacket_WindOpMetrics(metrics, packet[0], packet[1], hdr.numReadings);
+    end_WindOpStage(metrics, WINDOP_STAGE_COLUMNS, start);
+    return WINDOP_OK;
+}
+
+uint32_t decode_WindOpBatch(const uint8_t * packets, const uint32_t * offsets, uint32_t numPackets,
+                            WindOpColumns * out, uint8_t * status) {
+    uint32_t startRows = out->numRows;
+    uint32_t i;
+    uint8_t result;
+
+    for (i = 0; i < numPackets; i++) {
+        if (offsets[i + 1] < offsets[i]) {
+            result = WINDOP_ERR_LENGTH;
+        } else {
+            result = decode_WindOpPacketColumns(&packets[offsets[i]], offsets[i + 1] - offsets[i], i, out);
+        }
+        if (status != NULL) {
+            status[i] = result;
+        }
+    }
+
+    return out->numRows - startRows;
+}
+
+uint32_t maxReadings_WindOpPacket(const uint8_t * packet, uint32_t length) {
+    uint32_t offset = WINDOP_PACKET_HEADER_SIZE + WINDOP_TIME_SIZE;
+
+    if (length < offset) {
+        return 0;
+    }
+
+    // Delta packets say how many they hold
+    if (packet[0] == WINDOPDATAPACKET_T8_TYPE) {
+        offset += packet[WINDOP_PACKET_HEADER_SIZE + 3] >> 7;
+        return (length > offset) ? packet[offset] : 0;
+    }
+
+    // The smallest reading is 8 bytes behind the smallest 6 byte header
+    return (length - offset) / 8;
+}
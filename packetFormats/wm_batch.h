@@ -0,0 +1,99 @@
+/*
+ ============================================================================
+ Name        : wm_batch.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Batch packet decode into columnar arrays
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_BATCH_H
+#define WM_BATCH_H
+
+#include <stdint.h>
+
+#include "wm_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WINDOP_COLUMNS_ALIGN     64 // Cache line, also covers AVX2 loads
+
+/* ****************************************************************************
+ *
+ * Structure of arrays readings. Each channel is a separate contiguous array
+ * aligned to WINDOP_COLUMNS_ALIGN, so a scan over one channel (ws for plots,
+ * bv for battery alarms) only touches that channel's memory. Every array
+ * must hold capacity entries. Channel values are left raw, multiply by
+ * info_WindOpDataType(dataType[row])->scale[channel] to get units. Channels
+ * the packet type does not carry are cleared to 0 with their valid bit clear.
+ *
+ * */
+typedef struct WindOpColumns {
+    uint32_t capacity;                         // Rows available in each array
+    uint32_t numRows;                          // Rows written so far
+    int64_t * time;                            // Reading time, epoch seconds UTC
+    uint32_t * packet;                         // Index of the source packet
+    uint8_t * dataType;                        // Packet type of the row
+    uint8_t * valid;                           // Bit n set when channel n holds data
+    int32_t * channel[WINDOP_NUM_CHANNELS];    // Raw reading values
+} WindOpColumns;
+
+// Allocate every column for capacity rows, returns a WINDOP_* code
+uint8_t init_WindOpColumns(WindOpColumns * cols, uint32_t capacity);
+void free_WindOpColumns(WindOpColumns * cols);
+
+// Grow the columns to hold rows more than numRows, returns a WINDOP_* code
+uint8_t reserve_WindOpColumns(WindOpColumns * cols, uint32_t rows);
+
+// Copy every row of src onto the end of dst, growing dst as needed
+uint8_t append_WindOpColumns(WindOpColumns * dst, const WindOpColumns * src);
+
+/* ****************************************************************************
+ *
+ * Decode numPackets packets held back to back in packets. Packet i starts at
+ * offsets[i] and ends at offsets[i + 1], so offsets holds numPackets + 1
+ * entries. Rows are appended to out, status (optional) receives one
+ * WINDOP_* code per packet. Returns the number of rows appended.
+ *
+ * */
+uint32_t decode_WindOpBatch(const uint8_t * packets, const uint32_t * offsets, uint32_t numPackets,
+                            WindOpColumns * out, uint8_t * status);
+
+// Single packet step of the batch decode, returns a WINDOP_* code
+uint8_t decode_WindOpPacketColumns(const uint8_t * packet, uint32_t length, uint32_t packetIndex,
+                                   WindOpColumns * out);
+
+// Upper bound on the readings held in length bytes of packet
+uint32_t maxReadings_WindOpPacket(const uint8_t * packet, uint32_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_BATCH_H
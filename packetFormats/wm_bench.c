@@ -0,0 +1,1102 @@
+/*
+ ============================================================================
+ Name        : wm_bench.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Throughput benchmarks for the native decode paths
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "wm_codec.h"
+#include "wm_csv.h"
+#include "wm_dedup.h"
+#include "wm_delta.h"
+#include "wm_sim.h"
+#include "wm_simd.h"
+
+static const char * helpText =
+"\n"
+"   WindOp decode benchmarks\n"
+"\n"
+"      wm_bench [filter...]           : Run the cases whose name contains a filter,\n"
+"                                       all cases when no filter is given\n"
+"      -series file           : Run the delta cases over a CSV from the s1\n"
+"                               scripts or wm_decode, default is a synthetic\n"
+"                               weather series\n"
+"      -list                  : List the cases\n"
+"      -help                  : Prints this\n"
+"\n";
+
+#define BENCH_MIN_SECONDS        0.25
+#define BENCH_READINGS           65536 // 1MB of T3 readings, stays in cache
+
+/* ****************************************************************************
+ *
+ * A case runs its work iterations times and returns the input bytes it
+ * processed. items is the number of readings (or packets) per iteration.
+ *
+ * */
+typedef struct benchCase {
+    const char * name;
+    uint64_t (*run)(uint32_t iterations);
+    uint32_t items;        // Items per iteration, 0 for the rows of the delta series
+    const char * baseline; // Case the speedup is reported against
+} benchCase;
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Stops the compiler dropping work whose result is never read
+static volatile float benchSink;
+
+static uint32_t lcgState = 12345;
+static uint32_t nextRandom(void) {
+    lcgState = lcgState * 1664525u + 1013904223u;
+    return lcgState >> 8;
+}
+
+/* ****************************************************************************
+ * De-interleave cases
+ * */
+static uint8_t * readingBytes;
+static float * channelData[WINDOP_NUM_CHANNELS];
+
+static void setupReadings(void) {
+    uint32_t i;
+    uint8_t ch;
+
+    if (readingBytes != NULL) {
+        return;
+    }
+    readingBytes = malloc(BENCH_READINGS * 16);
+    for (i = 0; i < BENCH_READINGS * 16; i++) {
+        readingBytes[i] = (uint8_t) nextRandom();
+    }
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        channelData[ch] = malloc(BENCH_READINGS * sizeof(float));
+    }
+}
+
+// The path the reference code takes, one struct per reading then scale
+static uint64_t runReference(uint8_t dataType, uint32_t iterations) {
+    const WindOpTypeInfo * info = info_WindOpDataType(dataType);
+    WindOpDataPacket_t3 reading;
+    uint32_t it;
+    uint32_t i;
+    uint8_t * p = NULL;
+
+    setupReadings();
+    for (it = 0; it < iterations; it++) {
+        p = readingBytes;
+        for (i = 0; i < BENCH_READINGS; i++) {
+            if (dataType != WINDOPDATAPACKET_T5_TYPE) {
+                if (dataType == WINDOPDATAPACKET_T3_TYPE) {
+                    p += unpack_WindOpDataReadings_t3(&reading, p);
+                } else {
+                    p += unpack_WindOpDataReadings_t4(&reading, p);
+                }
+                channelData[WINDOP_CH_WS][i] = (float) reading.ws * (float) info->scale[WINDOP_CH_WS];
+                channelData[WINDOP_CH_WSX][i] = (float) reading.wsx * (float) info->scale[WINDOP_CH_WSX];
+                channelData[WINDOP_CH_WSM][i] = (float) reading.wsm * (float) info->scale[WINDOP_CH_WSM];
+                channelData[WINDOP_CH_WD][i] = (float) reading.wd * (float) info->scale[WINDOP_CH_WD];
+            } else {
+                p += unpack_WindOpDataReadings_t5(&reading, p);
+            }
+            if (dataType != WINDOPDATAPACKET_T4_TYPE) {
+                channelData[WINDOP_CH_TMP][i] = (float) reading.tmp * (float) info->scale[WINDOP_CH_TMP];
+                channelData[WINDOP_CH_PRESS][i] = (float) reading.press * (float) info->scale[WINDOP_CH_PRESS];
+                channelData[WINDOP_CH_HUM][i] = (float) reading.hum * (float) info->scale[WINDOP_CH_HUM];
+                channelData[WINDOP_CH_BV][i] = (float) reading.bv * (float) info->scale[WINDOP_CH_BV];
+            }
+        }
+        benchSink = channelData[WINDOP_CH_WS][it % BENCH_READINGS];
+    }
+    return (uint64_t) iterations * BENCH_READINGS * info->readingSize;
+}
+
+static uint64_t runDeinterleave(uint8_t dataType, uint8_t level, uint32_t iterations) {
+    uint32_t it;
+
+    setupReadings();
+    setLevel_WindOpSimd(level);
+    for (it = 0; it < iterations; it++) {
+        deinterleave_WindOpReadings(dataType, readingBytes, BENCH_READINGS, channelData);
+        benchSink = channelData[WINDOP_CH_BV][it % BENCH_READINGS];
+    }
+    return (uint64_t) iterations * BENCH_READINGS * info_WindOpDataType(dataType)->readingSize;
+}
+
+#define DEINTERLEAVE_CASES(T, TYPE)                                                                 \
+    static uint64_t run_##T##_reference(uint32_t n) { return runReference(TYPE, n); }              \
+    static uint64_t run_##T##_scalar(uint32_t n) { return runDeinterleave(TYPE, WINDOP_SIMD_SCALAR, n); } \
+    static uint64_t run_##T##_sse2(uint32_t n) { return runDeinterleave(TYPE, WINDOP_SIMD_SSE2, n); } \
+    static uint64_t run_##T##_avx2(uint32_t n) { return runDeinterleave(TYPE, WINDOP_SIMD_AVX2, n); }
+
+DEINTERLEAVE_CASES(t3, WINDOPDATAPACKET_T3_TYPE)
+DEINTERLEAVE_CASES(t4, WINDOPDATAPACKET_T4_TYPE)
+DEINTERLEAVE_CASES(t5, WINDOPDATAPACKET_T5_TYPE)
+
+/* ****************************************************************************
+ *
+ * Time stamp cases. Decode a mix of 4 and 5 byte stamps to epoch seconds,
+ * then build the per reading time keys for a run of minute readings.
+ *
+ * */
+#define BENCH_STAMPS             4096
+#define STAMP_STRIDE             8
+
+static uint8_t * stampBytes;
+
+static void setupStamps(void) {
+    Calendar cal;
+    uint32_t i;
+
+    if (stampBytes != NULL) {
+        return;
+    }
+    stampBytes = malloc(BENCH_STAMPS * STAMP_STRIDE);
+    for (i = 0; i < BENCH_STAMPS; i++) {
+        cal.Year = 2000 + nextRandom() % 40;
+        cal.Month = 1 + nextRandom() % 12;
+        cal.DayOfMonth = 1 + nextRandom() % 28;
+        cal.Hours = nextRandom() % 24;
+        cal.Minutes = nextRandom() % 60;
+        cal.Seconds = nextRandom() % 60;
+        pack_WindOpMinuteTime(&cal, &stampBytes[i * STAMP_STRIDE], nextRandom() & 1);
+    }
+}
+
+// Calendar fields first, as parse_WindOpPacketHeader used to
+static uint64_t run_time_calendar(uint32_t iterations) {
+    Calendar cal;
+    int64_t sum = 0;
+    uint32_t it;
+    uint32_t i;
+
+    setupStamps();
+    for (it = 0; it < iterations; it++) {
+        for (i = 0; i < BENCH_STAMPS; i++) {
+            unpack_WindOpMinuteTime(&cal, &stampBytes[i * STAMP_STRIDE]);
+            if (check_WindOpMinuteTime(&cal) == WINDOP_OK) {
+                sum += epoch_WindOpCalendar(&cal);
+            }
+        }
+    }
+    benchSink = (float) sum;
+    return (uint64_t) iterations * BENCH_STAMPS * WINDOP_TIME_SIZE;
+}
+
+static uint64_t run_time_epoch(uint32_t iterations) {
+    int64_t sum = 0;
+    int64_t epoch;
+    uint32_t it;
+    uint32_t i;
+
+    setupStamps();
+    for (it = 0; it < iterations; it++) {
+        for (i = 0; i < BENCH_STAMPS; i++) {
+            if (unpack_WindOpEpochTime(&stampBytes[i * STAMP_STRIDE], &epoch) != 0) {
+                sum += epoch;
+            }
+        }
+    }
+    benchSink = (float) sum;
+    return (uint64_t) iterations * BENCH_STAMPS * WINDOP_TIME_SIZE;
+}
+
+// One key per minute reading, a full calendar conversion and printf each
+static uint64_t run_key_calendar(uint32_t iterations) {
+    char key[32];
+    Calendar cal;
+    uint32_t it;
+    uint32_t i;
+
+    for (it = 0; it < iterations; it++) {
+        for (i = 0; i < BENCH_STAMPS; i++) {
+            calendar_WindOpEpoch(&cal, 1503745200 + 60 * (int64_t) i);
+            snprintf(key, sizeof(key), "%04u%02u%02u%02u%02u%02u", cal.Year, cal.Month, cal.DayOfMonth,
+                     cal.Hours, cal.Minutes, cal.Seconds);
+        }
+        benchSink = key[13];
+    }
+    return (uint64_t) iterations * BENCH_STAMPS * (WINDOP_TIME_KEY_SIZE - 1);
+}
+
+static uint64_t run_key_cached(uint32_t iterations) {
+    char key[WINDOP_TIME_KEY_SIZE];
+    WindOpTimeFormat fmt;
+    uint32_t it;
+    uint32_t i;
+
+    init_WindOpTimeFormat(&fmt);
+    for (it = 0; it < iterations; it++) {
+        for (i = 0; i < BENCH_STAMPS; i++) {
+            format_WindOpTime(&fmt, 1503745200 + 60 * (int64_t) i, key);
+        }
+        benchSink = key[13];
+    }
+    return (uint64_t) iterations * BENCH_STAMPS * (WINDOP_TIME_KEY_SIZE - 1);
+}
+
+/* ****************************************************************************
+ *
+ * Full packet cases. The bounded codecs against the unchecked loops they
+ * replaced, printf aside, over packets of every fixed type. The speedup
+ * column is the cost of the checks, 0.95x or better is within 5%.
+ *
+ * */
+#define BENCH_PACKETS            1024
+#define PACKET_READINGS          8
+
+static uint8_t * packetBytes;
+static packCtrl * packetCtrl;
+
+static void setupPackets(void) {
+    static const uint8_t types[] = {
+        WINDOPDATAPACKET_T3_TYPE, WINDOPDATAPACKET_T4_TYPE, WINDOPDATAPACKET_T5_TYPE, WINDOPDATAPACKET_T6_TYPE
+    };
+    uint32_t length;
+    uint32_t i;
+    uint8_t r;
+
+    if (packetBytes != NULL) {
+        return;
+    }
+    packetBytes = malloc(BENCH_PACKETS * WINDOP_MAX_PACKET_LENGTH);
+    packetCtrl = calloc(BENCH_PACKETS, sizeof(packCtrl));
+    for (i = 0; i < BENCH_PACKETS; i++) {
+        packetCtrl[i].time.Year = 2017;
+        packetCtrl[i].time.Month = 1 + i % 12;
+        packetCtrl[i].time.DayOfMonth = 1 + i % 28;
+        packetCtrl[i].time.Hours = i % 24;
+        packetCtrl[i].time.Minutes = i % 60;
+        packetCtrl[i].incSeconds = i & 1;
+        packetCtrl[i].dataType = types[i % 4];
+        packetCtrl[i].numOfReadings = PACKET_READINGS;
+        for (r = 0; r < PACKET_READINGS; r++) {
+            packetCtrl[i].readings[r].ws = (uint16_t) nextRandom();
+            packetCtrl[i].readings[r].wsx = (uint16_t) nextRandom();
+            packetCtrl[i].readings[r].wsm = (uint16_t) nextRandom();
+            packetCtrl[i].readings[r].wd = (uint16_t) (nextRandom() % 360);
+            packetCtrl[i].readings[r].tmp = (int16_t) nextRandom();
+            packetCtrl[i].readings[r].press = (uint16_t) nextRandom();
+            packetCtrl[i].readings[r].hum = (uint16_t) nextRandom();
+            packetCtrl[i].readings[r].bv = (uint16_t) nextRandom();
+        }
+        packBounded_WindOpDataPacket(&packetCtrl[i], &packetBytes[i * WINDOP_MAX_PACKET_LENGTH],
+                                     WINDOP_MAX_PACKET_LENGTH, &length);
+    }
+}
+
+// The codecs before bounds checks, out of line like the library calls. The
+// unpack fills in the same packCtrl fields as the bounded one.
+__attribute__((noinline))
+static uint16_t packUnchecked(struct packCtrl * pack, uint8_t * outBuffer) {
+    const WindOpTypeInfo * info;
+    uint8_t i;
+
+    outBuffer[0] = pack->dataType;
+    outBuffer[1] = 2;
+    outBuffer[1] += pack_WindOpMinuteTime(&pack->time, &outBuffer[2], pack->incSeconds);
+    info = info_WindOpDataType(pack->dataType);
+    for (i = 0; i < pack->numOfReadings; i++) {
+        outBuffer[1] += info->packReading(&pack->readings[i], &outBuffer[outBuffer[1]]);
+    }
+    return outBuffer[1];
+}
+
+__attribute__((noinline))
+static uint16_t unpackUnchecked(struct packCtrl * pack, const uint8_t * inBuffer) {
+    const WindOpTypeInfo * info;
+    uint8_t address;
+    uint8_t i;
+
+    pack->dataType = inBuffer[0];
+    pack->packetLength = inBuffer[1];
+    pack->incSeconds = inBuffer[5] >> 7;
+    address = 2 + unpack_WindOpMinuteTime(&pack->time, &inBuffer[2]);
+    info = info_WindOpDataType(pack->dataType);
+    for (i = 0; address < inBuffer[1]; i++) {
+        address += info->unpackReading(&pack->readings[i], &inBuffer[address]);
+    }
+    pack->numOfReadings = i;
+    return i;
+}
+
+static uint64_t run_packet_pack_unchecked(uint32_t iterations) {
+    uint64_t bytes = 0;
+    uint32_t it;
+    uint32_t i;
+
+    setupPackets();
+    for (it = 0; it < iterations; it++) {
+        for (i = 0; i < BENCH_PACKETS; i++) {
+            bytes += packUnchecked(&packetCtrl[i], &packetBytes[i * WINDOP_MAX_PACKET_LENGTH]);
+        }
+    }
+    return bytes;
+}
+
+static uint64_t run_packet_pack_bounded(uint32_t iterations) {
+    uint64_t bytes = 0;
+    uint32_t length;
+    uint32_t it;
+    uint32_t i;
+
+    setupPackets();
+    for (it = 0; it < iterations; it++) {
+        for (i = 0; i < BENCH_PACKETS; i++) {
+            packBounded_WindOpDataPacket(&packetCtrl[i], &packetBytes[i * WINDOP_MAX_PACKET_LENGTH],
+                                         WINDOP_MAX_PACKET_LENGTH, &length);
+            bytes += length;
+        }
+    }
+    return bytes;
+}
+
+static uint64_t run_packet_unpack_unchecked(uint32_t iterations) {
+    static packCtrl out;
+    uint64_t bytes = 0;
+    uint32_t it;
+    uint32_t i;
+
+    setupPackets();
+    for (it = 0; it < iterations; it++) {
+        for (i = 0; i < BENCH_PACKETS; i++) {
+            unpackUnchecked(&out, &packetBytes[i * WINDOP_MAX_PACKET_LENGTH]);
+            bytes += packetBytes[i * WINDOP_MAX_PACKET_LENGTH + 1];
+        }
+        benchSink = out.readings[0].ws;
+    }
+    return bytes;
+}
+
+static uint64_t run_packet_unpack_bounded(uint32_t iterations) {
+    static packCtrl out;
+    uint64_t bytes = 0;
+    uint32_t it;
+    uint32_t i;
+
+    setupPackets();
+    for (it = 0; it < iterations; it++) {
+        for (i = 0; i < BENCH_PACKETS; i++) {
+            unpackBounded_WindOpDataPacket(&out, &packetBytes[i * WINDOP_MAX_PACKET_LENGTH], WINDOP_MAX_PACKET_LENGTH);
+            bytes += packetBytes[i * WINDOP_MAX_PACKET_LENGTH + 1];
+        }
+        benchSink = out.readings[0].ws;
+    }
+    return bytes;
+}
+
+/* ****************************************************************************
+ *
+ * Delta cases. A minute series is cut into packets of DELTA_READINGS and
+ * packed and unpacked as T3 and T4 readings and as T8 deltas of the same
+ * channels. The series is a captured CSV when given, otherwise a seeded
+ * random walk with the drift and gusts of a real site.
+ *
+ * */
+#define BENCH_SERIES             30720
+#define DELTA_READINGS           30
+
+static const char * seriesFile;
+static int32_t * seriesData[WINDOP_NUM_CHANNELS];
+static int32_t * seriesOut[WINDOP_NUM_CHANNELS];
+static uint32_t seriesRows;
+static uint8_t * seriesBytes;
+static uint8_t seriesPacked; // Type seriesBytes holds for the unpack cases
+static uint32_t seriesPackets;
+
+static int32_t randomStep(int32_t range) {
+    return (int32_t) (nextRandom() % (2 * range + 1)) - range;
+}
+
+static void syntheticSeries(void) {
+    int32_t ws = 500;
+    int32_t wd = 240;
+    int32_t gust;
+    uint32_t i;
+
+    for (i = 0; i < BENCH_SERIES; i++) {
+        ws += randomStep(25) + (500 - ws) / 50;
+        ws = (ws < 0) ? 0 : ws;
+        wd = (wd + randomStep(8) + 360) % 360;
+        gust = (int32_t) (nextRandom() % 300);
+        seriesData[WINDOP_CH_WS][i] = ws;
+        seriesData[WINDOP_CH_WSX][i] = ws + gust;
+        seriesData[WINDOP_CH_WSM][i] = (ws > gust / 2) ? ws - gust / 2 : 0;
+        seriesData[WINDOP_CH_WD][i] = wd;
+        seriesData[WINDOP_CH_TMP][i] = (i == 0) ? 120 : seriesData[WINDOP_CH_TMP][i - 1] + randomStep(1);
+        seriesData[WINDOP_CH_PRESS][i] = (i == 0) ? 40000 : seriesData[WINDOP_CH_PRESS][i - 1] + randomStep(2);
+        seriesData[WINDOP_CH_HUM][i] = (i == 0) ? 7500 : seriesData[WINDOP_CH_HUM][i - 1] + randomStep(6);
+        seriesData[WINDOP_CH_BV][i] = 3900 - (int32_t) (i / 2000) + randomStep(2);
+    }
+    seriesRows = BENCH_SERIES;
+}
+
+// Rows a minute apart with the wind channels, environment carried forward
+static void loadSeries(const char * path) {
+    const WindOpTypeInfo * info = info_WindOpDataType(WINDOPDATAPACKET_T3_TYPE);
+    double value[WINDOP_NUM_CHANNELS];
+    int32_t last[WINDOP_NUM_CHANNELS] = { 0 };
+    char line[512];
+    int64_t time;
+    uint8_t valid;
+    uint8_t ch;
+    FILE * in;
+
+    if ((in = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    while ((seriesRows < BENCH_SERIES) && (fgets(line, sizeof(line), in) != NULL)) {
+        if ((parseRow_WindOpCsv(line, &time, &valid, value) != WINDOP_OK) ||
+            ((valid & WINDOP_WIND_CHANNELS) != WINDOP_WIND_CHANNELS)) {
+            continue;
+        }
+        for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+            if (valid & (1 << ch)) {
+                last[ch] = (int32_t) (value[ch] / info->scale[ch] + ((value[ch] < 0) ? -0.5 : 0.5));
+            }
+            seriesData[ch][seriesRows] = last[ch];
+        }
+        seriesRows++;
+    }
+    fclose(in);
+    if (seriesRows < 2 * DELTA_READINGS) {
+        fprintf(stderr, "ERROR %s has too few wind rows\n", path);
+        exit(EXIT_FAILURE);
+    }
+    seriesRows -= seriesRows % DELTA_READINGS;
+}
+
+static void setupSeries(void) {
+    uint8_t ch;
+
+    if (seriesBytes != NULL) {
+        return;
+    }
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        seriesData[ch] = calloc(BENCH_SERIES, sizeof(int32_t));
+        seriesOut[ch] = calloc(BENCH_SERIES, sizeof(int32_t));
+    }
+    seriesBytes = malloc(BENCH_SERIES * 16 + BENCH_SERIES / DELTA_READINGS * WINDOP_MAX_PACKET_LENGTH);
+    if (seriesFile != NULL) {
+        loadSeries(seriesFile);
+    } else {
+        syntheticSeries();
+    }
+}
+
+static uint64_t runFixedPack(uint8_t dataType, uint32_t iterations) {
+    const WindOpTypeInfo * info = info_WindOpDataType(dataType);
+    uint8_t * p = NULL;
+    uint32_t it;
+    uint32_t i;
+
+    setupSeries();
+    for (it = 0; it < iterations; it++) {
+        p = seriesBytes;
+        for (i = 0; i < seriesRows; i++) {
+            p += pack_WindOpReadingChannels(info, seriesData, i, p);
+        }
+        benchSink = p[-1];
+    }
+    seriesPacked = dataType;
+    return (uint64_t) iterations * (p - seriesBytes);
+}
+
+static uint64_t runFixedUnpack(uint8_t dataType, uint32_t iterations) {
+    const WindOpTypeInfo * info = info_WindOpDataType(dataType);
+    uint32_t it;
+    uint32_t i;
+
+    if (seriesPacked != dataType) {
+        runFixedPack(dataType, 1);
+    }
+    for (it = 0; it < iterations; it++) {
+        for (i = 0; i < seriesRows; i++) {
+            unpack_WindOpReadingChannels(info, seriesOut, i, &seriesBytes[i * info->readingSize]);
+        }
+        benchSink = (float) seriesOut[WINDOP_CH_WS][it % seriesRows];
+    }
+    return (uint64_t) iterations * seriesRows * info->readingSize;
+}
+
+// Packets of DELTA_READINGS, split where a noisy series does not fit one
+static uint32_t deltaPackAll(uint8_t channels) {
+    uint32_t bytes = 0;
+    uint32_t size;
+    uint32_t row;
+    uint8_t n;
+
+    seriesPackets = 0;
+    for (row = 0; row < seriesRows; row += n) {
+        n = (seriesRows - row < DELTA_READINGS) ? (uint8_t) (seriesRows - row) : DELTA_READINGS;
+        while ((size = pack_WindOpDeltaReadings(seriesData, row, n, channels, &seriesBytes[bytes],
+                                                WINDOP_MAX_PACKET_LENGTH)) == 0) {
+            n /= 2;
+        }
+        bytes += size;
+        seriesPackets++;
+    }
+    seriesPacked = 0;
+    return bytes;
+}
+
+static uint64_t runDeltaPack(uint8_t channels, uint32_t iterations) {
+    uint32_t bytes = 0;
+    uint32_t it;
+
+    setupSeries();
+    for (it = 0; it < iterations; it++) {
+        bytes = deltaPackAll(channels);
+        benchSink = seriesBytes[bytes - 1];
+    }
+    return (uint64_t) iterations * bytes;
+}
+
+static uint64_t runDeltaUnpack(uint8_t channels, uint32_t iterations) {
+    uint32_t bytes;
+    uint32_t offset;
+    uint32_t row;
+    uint32_t it;
+
+    setupSeries();
+    bytes = deltaPackAll(channels);
+    for (it = 0; it < iterations; it++) {
+        row = 0;
+        for (offset = 0; offset < bytes; offset += check_WindOpDeltaReadings(&seriesBytes[offset], bytes - offset,
+                                                                              NULL, NULL)) {
+            row += unpack_WindOpDeltaReadings(&seriesBytes[offset], seriesOut, row);
+        }
+        benchSink = (float) seriesOut[WINDOP_CH_WS][it % seriesRows];
+    }
+    return (uint64_t) iterations * bytes;
+}
+
+static uint64_t run_t3_pack(uint32_t n) { return runFixedPack(WINDOPDATAPACKET_T3_TYPE, n); }
+static uint64_t run_t3_unpack(uint32_t n) { return runFixedUnpack(WINDOPDATAPACKET_T3_TYPE, n); }
+static uint64_t run_t4_pack(uint32_t n) { return runFixedPack(WINDOPDATAPACKET_T4_TYPE, n); }
+static uint64_t run_t4_unpack(uint32_t n) { return runFixedUnpack(WINDOPDATAPACKET_T4_TYPE, n); }
+static uint64_t run_t8_all_pack(uint32_t n) { return runDeltaPack(0xFF, n); }
+static uint64_t run_t8_all_unpack(uint32_t n) { return runDeltaUnpack(0xFF, n); }
+static uint64_t run_t8_wind_pack(uint32_t n) { return runDeltaPack(WINDOP_WIND_CHANNELS, n); }
+static uint64_t run_t8_wind_unpack(uint32_t n) { return runDeltaUnpack(WINDOP_WIND_CHANNELS, n); }
+
+// Most readings one packet of frame bytes holds, each packet cut greedily
+static double readingsPerFrame(uint8_t channels, uint32_t frame) {
+    const uint32_t header = WINDOP_PACKET_HEADER_SIZE + WINDOP_TIME_SIZE;
+    uint8_t packet[WINDOP_MAX_PACKET_LENGTH];
+    uint32_t packets = 0;
+    uint32_t row = 0;
+    uint32_t n;
+
+    while (row < seriesRows) {
+        for (n = 1; (row + n < seriesRows) && (n < WINDOP_DELTA_MAX_READINGS); n++) {
+            if (pack_WindOpDeltaReadings(seriesData, row, (uint8_t) (n + 1), channels, packet, frame - header) == 0) {
+                break;
+            }
+        }
+        row += n;
+        packets++;
+    }
+    return (double) seriesRows / packets;
+}
+
+// Including the type, length and time stamp of each packet
+static double deltaBytesPerReading(uint8_t channels) {
+    uint32_t bytes = deltaPackAll(channels);
+    return (double) (seriesPackets * (WINDOP_PACKET_HEADER_SIZE + WINDOP_TIME_SIZE) + bytes) / seriesRows;
+}
+
+static void reportSeriesSizes(void) {
+    const uint32_t header = WINDOP_PACKET_HEADER_SIZE + WINDOP_TIME_SIZE;
+    static const uint32_t frames[] = { 51, 115, 222 }; // EU868 payload limits, SF12-10, SF9, SF8-7
+    uint32_t f;
+
+    setupSeries();
+    printf("Series of %u minute readings from %s\n", seriesRows, (seriesFile != NULL) ? seriesFile : "synthetic");
+    printf("%-10s %18s %18s\n", "", "bytes/reading", "readings/frame");
+    printf("%-10s %9s %8s", "type", "all ch", "wind");
+    for (f = 0; f < sizeof(frames) / sizeof(frames[0]); f++) {
+        printf(" %5u B", frames[f]);
+    }
+    printf("\n%-10s %9.2f %8.2f", "T3 / T4", (header + 16.0 * DELTA_READINGS) / DELTA_READINGS,
+           (header + 8.0 * DELTA_READINGS) / DELTA_READINGS);
+    for (f = 0; f < sizeof(frames) / sizeof(frames[0]); f++) {
+        printf(" %7u", (frames[f] - header) / 8);
+    }
+    printf("  (T4)\n%-10s %9.2f %8.2f", "T8", deltaBytesPerReading(0xFF), deltaBytesPerReading(WINDOP_WIND_CHANNELS));
+    for (f = 0; f < sizeof(frames) / sizeof(frames[0]); f++) {
+        printf(" %7.1f", readingsPerFrame(WINDOP_WIND_CHANNELS, frames[f]));
+    }
+    printf("  (wind)\n\n");
+}
+
+/* ****************************************************************************
+ *
+ * Duplicate uplink cases. A stream of simulated uplinks, 2% of them sent
+ * twice, checked against WindOpDedup and against the naive set a %seen
+ * hash amounts to, a copy of every device and packet in a chained table.
+ * Both start empty each iteration, so the naive set grows with the stream
+ * while WindOpDedup holds DEDUP_CAPACITY keys and turns over.
+ *
+ * */
+#define BENCH_UPLINKS            262144
+#define DEDUP_CAPACITY           16384
+
+static char (*uplinkDevice)[WINDOP_SIM_NAME_SIZE];
+static uint8_t * uplinkBytes;
+static uint8_t * uplinkLength;
+static uint32_t uplinkDuplicates;
+
+static void setupUplinks(void) {
+    WindOpSimConfig config = { 7, 1000, 1512086400, 10, 0, 0, 20000 };
+    const WindOpSimUplink * up;
+    WindOpSim sim;
+    uint32_t i;
+
+    if (uplinkBytes != NULL) {
+        return;
+    }
+    uplinkDevice = malloc(BENCH_UPLINKS * sizeof(uplinkDevice[0]));
+    uplinkBytes = malloc(BENCH_UPLINKS * WINDOP_MAX_PACKET_LENGTH);
+    uplinkLength = malloc(BENCH_UPLINKS);
+    init_WindOpSim(&sim, &config);
+    for (i = 0; i < BENCH_UPLINKS; i++) {
+        up = next_WindOpSim(&sim);
+        name_WindOpSimNode(up->node, uplinkDevice[i]);
+        memcpy(&uplinkBytes[i * WINDOP_MAX_PACKET_LENGTH], up->bytes, up->length);
+        uplinkLength[i] = up->length;
+    }
+    uplinkDuplicates = (uint32_t) sim.duplicates;
+    free_WindOpSim(&sim);
+}
+
+typedef struct naiveEntry {
+    struct naiveEntry * next;
+    uint64_t hash;
+    uint32_t length;
+    uint8_t key[];            // Device, its NUL, then the packet
+} naiveEntry;
+
+typedef struct naiveSet {
+    naiveEntry ** buckets;
+    uint32_t mask;
+    uint32_t count;
+    size_t bytes;             // Allocated, buckets and entries
+} naiveSet;
+
+static uint8_t naiveCheck(naiveSet * set, const char * device, const uint8_t * packet, uint32_t length) {
+    uint8_t key[WINDOP_SIM_NAME_SIZE + WINDOP_MAX_PACKET_LENGTH];
+    naiveEntry ** grown;
+    naiveEntry * entry;
+    naiveEntry * next;
+    uint64_t h = 14695981039346656037ull;
+    uint32_t keyLength = (uint32_t) strlen(device) + 1;
+    uint32_t i;
+
+    memcpy(key, device, keyLength);
+    memcpy(&key[keyLength], packet, length);
+    keyLength += length;
+    for (i = 0; i < keyLength; i++) {
+        h = (h ^ key[i]) * 1099511628211ull;
+    }
+    for (entry = set->buckets[h & set->mask]; entry != NULL; entry = entry->next) {
+        if ((entry->hash == h) && (entry->length == keyLength) && (memcmp(entry->key, key, keyLength) == 0)) {
+            return 1;
+        }
+    }
+
+    if (set->count > set->mask) {
+        grown = calloc(2 * ((size_t) set->mask + 1), sizeof(naiveEntry *));
+        for (i = 0; i <= set->mask; i++) {
+            for (entry = set->buckets[i]; entry != NULL; entry = next) {
+                next = entry->next;
+                entry->next = grown[entry->hash & (2 * set->mask + 1)];
+                grown[entry->hash & (2 * set->mask + 1)] = entry;
+            }
+        }
+        free(set->buckets);
+        set->buckets = grown;
+        set->bytes += ((size_t) set->mask + 1) * sizeof(naiveEntry *);
+        set->mask = 2 * set->mask + 1;
+    }
+    entry = malloc(sizeof(naiveEntry) + keyLength);
+    entry->hash = h;
+    entry->length = keyLength;
+    memcpy(entry->key, key, keyLength);
+    entry->next = set->buckets[h & set->mask];
+    set->buckets[h & set->mask] = entry;
+    set->count++;
+    set->bytes += sizeof(naiveEntry) + keyLength;
+    return 0;
+}
+
+static void naiveFree(naiveSet * set) {
+    naiveEntry * entry;
+    naiveEntry * next;
+    uint32_t i;
+
+    for (i = 0; i <= set->mask; i++) {
+        for (entry = set->buckets[i]; entry != NULL; entry = next) {
+            next = entry->next;
+            free(entry);
+        }
+    }
+    free(set->buckets);
+}
+
+// Duplicates found, allocated bytes in *bytes
+static uint32_t naiveRun(size_t * bytes) {
+    naiveSet set = { NULL, 1023, 0, 1024 * sizeof(naiveEntry *) };
+    uint32_t found = 0;
+    uint32_t i;
+
+    set.buckets = calloc(1024, sizeof(naiveEntry *));
+    for (i = 0; i < BENCH_UPLINKS; i++) {
+        found += naiveCheck(&set, uplinkDevice[i], &uplinkBytes[i * WINDOP_MAX_PACKET_LENGTH], uplinkLength[i]);
+    }
+    *bytes = set.bytes;
+    naiveFree(&set);
+    return found;
+}
+
+static uint32_t boundedRun(size_t * bytes) {
+    WindOpDedup dedup;
+    uint32_t found = 0;
+    uint32_t i;
+
+    init_WindOpDedup(&dedup, DEDUP_CAPACITY);
+    for (i = 0; i < BENCH_UPLINKS; i++) {
+        found += check_WindOpDedup(&dedup, key_WindOpDedup(uplinkDevice[i], &uplinkBytes[i * WINDOP_MAX_PACKET_LENGTH],
+                                                            uplinkLength[i]));
+    }
+    *bytes = bytes_WindOpDedup(&dedup);
+    free_WindOpDedup(&dedup);
+    return found;
+}
+
+static uint64_t runDedup(uint32_t (*run)(size_t * bytes), uint32_t iterations) {
+    uint64_t bytes = 0;
+    size_t allocated;
+    uint32_t it;
+    uint32_t i;
+
+    setupUplinks();
+    for (it = 0; it < iterations; it++) {
+        benchSink += run(&allocated);
+    }
+    for (i = 0; i < BENCH_UPLINKS; i++) {
+        bytes += uplinkLength[i];
+    }
+    return bytes * iterations;
+}
+
+static uint64_t run_dedup_naive(uint32_t n) { return runDedup(naiveRun, n); }
+static uint64_t run_dedup_bounded(uint32_t n) { return runDedup(boundedRun, n); }
+
+static void reportDedupSizes(void) {
+    size_t naiveBytes;
+    size_t boundedBytes;
+    uint32_t naiveFound;
+    uint32_t boundedFound;
+
+    setupUplinks();
+    naiveFound = naiveRun(&naiveBytes);
+    boundedFound = boundedRun(&boundedBytes);
+    printf("Dedup over %u uplinks, %u sent twice\n", BENCH_UPLINKS, uplinkDuplicates);
+    printf("%-10s %10s %12s %14s\n", "set", "found", "MB", "bytes/uplink");
+    printf("%-10s %10u %12.2f %14.1f\n", "naive", naiveFound, naiveBytes / 1e6, (double) naiveBytes / BENCH_UPLINKS);
+    printf("%-10s %10u %12.2f %14.1f  (fixed, %u keys a generation)\n\n", "bounded", boundedFound, boundedBytes / 1e6,
+           (double) boundedBytes / BENCH_UPLINKS, DEDUP_CAPACITY);
+}
+
+/* ****************************************************************************
+ *
+ * Check every kernel level matches the scalar kernel before timing them.
+ *
+ * */
+static int verifyDeinterleave(void) {
+    static const uint8_t types[] = { WINDOPDATAPACKET_T3_TYPE, WINDOPDATAPACKET_T4_TYPE, WINDOPDATAPACKET_T5_TYPE };
+    float * expect[WINDOP_NUM_CHANNELS];
+    uint32_t count = 1000; // Not a multiple of 16 so the tails run
+    uint32_t i;
+    uint8_t t;
+    uint8_t level;
+    uint8_t ch;
+    int errors = 0;
+
+    setupReadings();
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        expect[ch] = calloc(count, sizeof(float));
+    }
+    for (t = 0; t < sizeof(types); t++) {
+        setLevel_WindOpSimd(WINDOP_SIMD_SCALAR);
+        deinterleave_WindOpReadings(types[t], readingBytes, count, expect);
+        for (level = WINDOP_SIMD_SSE2; level <= WINDOP_SIMD_AVX2; level++) {
+            if (setLevel_WindOpSimd(level) != level) {
+                continue;
+            }
+            for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+                memset(channelData[ch], 0, count * sizeof(float));
+            }
+            deinterleave_WindOpReadings(types[t], readingBytes, count, channelData);
+            for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+                if (!(info_WindOpDataType(types[t])->channels & (1 << ch))) {
+                    continue;
+                }
+                for (i = 0; i < count; i++) {
+                    if (channelData[ch][i] != expect[ch][i]) {
+                        printf("ERROR %s type %d channel %d reading %u differs from scalar\n",
+                               levelName_WindOpSimd(level), types[t], ch, i);
+                        errors++;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        free(expect[ch]);
+    }
+    return errors;
+}
+
+/*
+ * Delta round trips must be exact at every kernel level and give the same
+ * bytes, over random series of every width as well as the bench series.
+ */
+static int verifyDelta(void) {
+    uint8_t expect[WINDOP_MAX_PACKET_LENGTH];
+    uint8_t packet[WINDOP_MAX_PACKET_LENGTH];
+    uint32_t expectSize;
+    uint32_t size;
+    uint32_t trial;
+    uint32_t i;
+    uint8_t numReadings;
+    uint8_t channels;
+    uint8_t level;
+    uint8_t ch;
+    int32_t range;
+    int errors = 0;
+
+    setupSeries();
+    for (trial = 0; trial < 2000; trial++) {
+        numReadings = (uint8_t) (1 + trial % 40);
+        channels = (uint8_t) (1 + nextRandom() % 255);
+        range = 1 << (trial % 17);
+        for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+            for (i = 0; i < numReadings; i++) {
+                seriesOut[ch][i] = (i == 0) ? (int32_t) (nextRandom() & 0xFFFF) : seriesOut[ch][i - 1] + randomStep(range);
+                seriesOut[ch][i] = (ch == WINDOP_CH_TMP) ? (int16_t) seriesOut[ch][i] : (uint16_t) seriesOut[ch][i];
+            }
+        }
+
+        setLevel_WindOpSimd(WINDOP_SIMD_SCALAR);
+        expectSize = pack_WindOpDeltaReadings(seriesOut, 0, numReadings, channels, expect, sizeof(expect));
+        for (level = WINDOP_SIMD_SCALAR; level <= WINDOP_SIMD_AVX2; level++) {
+            if (setLevel_WindOpSimd(level) != level) {
+                continue;
+            }
+            size = pack_WindOpDeltaReadings(seriesOut, 0, numReadings, channels, packet, sizeof(packet));
+            if ((size != expectSize) || (memcmp(packet, expect, size) != 0) ||
+                (check_WindOpDeltaReadings(packet, size, NULL, NULL) != size)) {
+                printf("ERROR %s delta pack differs, trial %u\n", levelName_WindOpSimd(level), trial);
+                errors++;
+                continue;
+            }
+            if (size == 0) {
+                continue; // Did not fit, the same at every level
+            }
+            unpack_WindOpDeltaReadings(packet, seriesOut, BENCH_SERIES / 2);
+            for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+                for (i = 0; i < numReadings; i++) {
+                    if (seriesOut[ch][BENCH_SERIES / 2 + i] != ((channels & (1 << ch)) ? seriesOut[ch][i] : 0)) {
+                        printf("ERROR %s delta channel %d reading %u differs, trial %u\n",
+                               levelName_WindOpSimd(level), ch, i, trial);
+                        errors++;
+                        i = numReadings;
+                    }
+                }
+            }
+        }
+    }
+    setLevel_WindOpSimd(WINDOP_SIMD_AVX2);
+    return errors;
+}
+
+static const benchCase benchCases[] = {
+    { "deinterleave_t3_reference", run_t3_reference, BENCH_READINGS, NULL },
+    { "deinterleave_t3_scalar",    run_t3_scalar,    BENCH_READINGS, "deinterleave_t3_reference" },
+    { "deinterleave_t3_sse2",      run_t3_sse2,      BENCH_READINGS, "deinterleave_t3_reference" },
+    { "deinterleave_t3_avx2",      run_t3_avx2,      BENCH_READINGS, "deinterleave_t3_reference" },
+    { "deinterleave_t4_reference", run_t4_reference, BENCH_READINGS, NULL },
+    { "deinterleave_t4_scalar",    run_t4_scalar,    BENCH_READINGS, "deinterleave_t4_reference" },
+    { "deinterleave_t4_sse2",      run_t4_sse2,      BENCH_READINGS, "deinterleave_t4_reference" },
+    { "deinterleave_t4_avx2",      run_t4_avx2,      BENCH_READINGS, "deinterleave_t4_reference" },
+    { "deinterleave_t5_reference", run_t5_reference, BENCH_READINGS, NULL },
+    { "deinterleave_t5_scalar",    run_t5_scalar,    BENCH_READINGS, "deinterleave_t5_reference" },
+    { "deinterleave_t5_sse2",      run_t5_sse2,      BENCH_READINGS, "deinterleave_t5_reference" },
+    { "deinterleave_t5_avx2",      run_t5_avx2,      BENCH_READINGS, "deinterleave_t5_reference" },
+    { "packet_pack_unchecked",     run_packet_pack_unchecked,   BENCH_PACKETS * PACKET_READINGS, NULL },
+    { "packet_pack_bounded",       run_packet_pack_bounded,     BENCH_PACKETS * PACKET_READINGS,
+      "packet_pack_unchecked" },
+    { "packet_unpack_unchecked",   run_packet_unpack_unchecked, BENCH_PACKETS * PACKET_READINGS, NULL },
+    { "packet_unpack_bounded",     run_packet_unpack_bounded,   BENCH_PACKETS * PACKET_READINGS,
+      "packet_unpack_unchecked" },
+    { "pack_t3",                   run_t3_pack,      0,              NULL },
+    { "pack_t8_all",               run_t8_all_pack,  0,              "pack_t3" },
+    { "unpack_t3",                 run_t3_unpack,    0,              NULL },
+    { "unpack_t8_all",             run_t8_all_unpack, 0,             "unpack_t3" },
+    { "pack_t4",                   run_t4_pack,      0,              NULL },
+    { "pack_t8_wind",              run_t8_wind_pack, 0,              "pack_t4" },
+    { "unpack_t4",                 run_t4_unpack,    0,              NULL },
+    { "unpack_t8_wind",            run_t8_wind_unpack, 0,            "unpack_t4" },
+    { "time_decode_calendar",      run_time_calendar, BENCH_STAMPS,  NULL },
+    { "time_decode_epoch",         run_time_epoch,   BENCH_STAMPS,   "time_decode_calendar" },
+    { "time_key_calendar",         run_key_calendar, BENCH_STAMPS,   NULL },
+    { "time_key_cached",           run_key_cached,   BENCH_STAMPS,   "time_key_calendar" },
+    { "dedup_naive",               run_dedup_naive,  BENCH_UPLINKS,  NULL },
+    { "dedup_bounded",             run_dedup_bounded, BENCH_UPLINKS, "dedup_naive" },
+};
+
+#define NUM_BENCH_CASES (sizeof(benchCases) / sizeof(benchCases[0]))
+
+/* ****************************************************************************
+ *
+ * Time a case, doubling the iterations until it runs long enough to trust,
+ * then keep the best of BENCH_REPEATS runs at that count. The best run is
+ * the one least disturbed by the rest of the machine.
+ *
+ * */
+#define BENCH_REPEATS            3
+
+static double runCase(const benchCase * bc, double * bytesPerSecond) {
+    uint32_t iterations = 1;
+    uint64_t bytes;
+    double start;
+    double elapsed;
+    double best;
+    int repeat;
+
+    bc->run(1); // Warm up, also builds any shared input
+    for (;;) {
+        start = nowSeconds();
+        bytes = bc->run(iterations);
+        elapsed = nowSeconds() - start;
+        if ((elapsed >= BENCH_MIN_SECONDS) || (iterations >= (1u << 30))) {
+            break;
+        }
+        iterations *= 2;
+    }
+    best = elapsed;
+    for (repeat = 1; repeat < BENCH_REPEATS; repeat++) {
+        start = nowSeconds();
+        bc->run(iterations);
+        elapsed = nowSeconds() - start;
+        best = (elapsed < best) ? elapsed : best;
+    }
+    *bytesPerSecond = bytes / best;
+    return best * 1e9 / ((double) iterations * ((bc->items != 0) ? bc->items : seriesRows));
+}
+
+static int selected(const char * name, int argc, char ** argv) {
+    int i;
+    int filters = 0;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-series") == 0) {
+            i++;
+        } else if (argv[i][0] != '-') {
+            filters++;
+            if (strstr(name, argv[i]) != NULL) {
+                return 1;
+            }
+        }
+    }
+    return filters == 0;
+}
+
+int main(int argc, char ** argv) {
+    double nsPerItem[NUM_BENCH_CASES];
+    double bytesPerSecond;
+    uint32_t i;
+    uint32_t j;
+    int k;
+
+    for (k = 1; k < argc; k++) {
+        if (strcmp(argv[k], "-list") == 0) {
+            for (i = 0; i < NUM_BENCH_CASES; i++) {
+                printf("%s\n", benchCases[i].name);
+            }
+            return EXIT_SUCCESS;
+        } else if ((strcmp(argv[k], "-series") == 0) && (k + 1 < argc)) {
+            seriesFile = argv[++k];
+        } else if (argv[k][0] == '-') {
+            printf("%s", helpText);
+            return EXIT_SUCCESS;
+        }
+    }
+
+    if ((verifyDeinterleave() != 0) || (verifyDelta() != 0)) {
+        return EXIT_FAILURE;
+    }
+
+    printf("SIMD level available: %s\n", levelName_WindOpSimd(setLevel_WindOpSimd(WINDOP_SIMD_AVX2)));
+    if (selected("pack_t8", argc, argv)) {
+        reportSeriesSizes();
+    }
+    if (selected("dedup", argc, argv)) {
+        reportDedupSizes();
+    }
+    printf("%-32s %12s %10s %9s\n", "case", "ns/item", "GB/s", "speedup");
+    for (i = 0; i < NUM_BENCH_CASES; i++) {
+        nsPerItem[i] = 0;
+        if (!selected(benchCases[i].name, argc, argv)) {
+            continue;
+        }
+        nsPerItem[i] = runCase(&benchCases[i], &bytesPerSecond);
+        printf("%-32s %12.3f %10.3f", benchCases[i].name, nsPerItem[i], bytesPerSecond * 1e-9);
+        for (j = 0; (benchCases[i].baseline != NULL) && (j < i); j++) {
+            if ((strcmp(benchCases[j].name, benchCases[i].baseline) == 0) && (nsPerItem[j] > 0)) {
+                printf(" %8.2fx", nsPerItem[j] / nsPerItem[i]);
+            }
+        }
+        printf("\n");
+    }
+
+    return EXIT_SUCCESS;
+}
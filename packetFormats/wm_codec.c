@@ -0,0 +1,795 @@
+/*
+ ============================================================================
+ Name        : wm_codec.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : WindOp packet codec library
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_codec.h"
+#include "wm_delta.h"
+#include "wm_metrics.h"
+#include "wm_schema.h"
+
+static const char * const windOpChannelKeys[WINDOP_NUM_CHANNELS] = {
+    "ws", "wsa", "wsm", "wd", "tmp", "pres", "hum", "bv"
+};
+
+const char * key_WindOpChannel(uint8_t channel) {
+    return (channel < WINDOP_NUM_CHANNELS) ? windOpChannelKeys[channel] : NULL;
+}
+
+/* ****************************************************************************
+ *
+ * Calendar helpers. Days from civil and back, proleptic Gregorian, so the
+ * full 13 bit year range converts without a libc time zone lookup.
+ *
+ * */
+static int64_t daysFromCivil(int64_t y, uint32_t m, uint32_t d) {
+    y -= (m <= 2);
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const uint32_t yoe = (uint32_t) (y - era * 400);
+    const uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t) doe - 719468;
+}
+
+uint8_t check_WindOpMinuteTime(const Calendar * timeIn) {
+    if ((timeIn->Month < 1) || (timeIn->Month > 12) ||
+        (timeIn->DayOfMonth < 1) || (timeIn->DayOfMonth > 31) ||
+        (timeIn->Hours > 23) || (timeIn->Minutes > 59) || (timeIn->Seconds > 59)) {
+        return WINDOP_ERR_TIME;
+    }
+    return WINDOP_OK;
+}
+
+int64_t epoch_WindOpCalendar(const Calendar * timeIn) {
+    int64_t days = daysFromCivil(timeIn->Year, timeIn->Month, timeIn->DayOfMonth);
+    return days * 86400 + timeIn->Hours * 3600 + timeIn->Minutes * 60 + timeIn->Seconds;
+}
+
+// Inverse of daysFromCivil, z is days since 1970-01-01
+static void civilFromDays(int64_t z, uint32_t * year, uint32_t * month, uint32_t * day) {
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const uint32_t doe = (uint32_t) (z - era * 146097);
+    const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const uint32_t mp = (5 * doy + 2) / 153;
+
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = (uint32_t) (yoe + era * 400 + (*month <= 2));
+    *day = doy - (153 * mp + 2) / 5 + 1;
+}
+
+void calendar_WindOpEpoch(Calendar * timeOut, int64_t epoch) {
+    int64_t z = epoch / 86400;
+    int64_t secs = epoch % 86400;
+    uint32_t year;
+    uint32_t month;
+    uint32_t day;
+
+    if (secs < 0) {
+        secs += 86400;
+        z -= 1;
+    }
+    timeOut->DayOfWeek = (uint8_t) ((z % 7 + 11) % 7); // 1970-01-01 was a Thursday, 0 is Sunday
+    civilFromDays(z, &year, &month, &day);
+
+    timeOut->Year = (uint16_t) year;
+    timeOut->Month = (uint8_t) month;
+    timeOut->DayOfMonth = (uint8_t) day;
+    timeOut->Hours = (uint8_t) (secs / 3600);
+    timeOut->Minutes = (uint8_t) ((secs / 60) % 60);
+    timeOut->Seconds = (uint8_t) (secs % 60);
+}
+
+/* ****************************************************************************
+ *
+ * Time keys as the scripts build them, ymd('') . hms(''). Consecutive
+ * readings nearly always share a day, so the YYYYMMDD prefix is only
+ * rebuilt when the day changes and the rest is six digits.
+ *
+ * */
+void init_WindOpTimeFormat(WindOpTimeFormat * fmt) {
+    fmt->day = INT64_MIN;
+    fmt->prefix[0] = '\0';
+}
+
+void format_WindOpTime(WindOpTimeFormat * fmt, int64_t epoch, char * out) {
+    int64_t day = epoch / 86400;
+    int64_t secs = epoch % 86400;
+    uint32_t year;
+    uint32_t month;
+    uint32_t date;
+    uint32_t hms;
+
+    if (secs < 0) {
+        secs += 86400;
+        day -= 1;
+    }
+    if (day != fmt->day) {
+        civilFromDays(day, &year, &month, &date);
+        // The modulos bound every field to its width, so the prefix always fits
+        snprintf(fmt->prefix, sizeof(fmt->prefix), "%04u%02u%02u", year % 10000, month % 100, date % 100);
+        fmt->day = day;
+    }
+
+    memcpy(out, fmt->prefix, 8);
+    hms = (uint32_t) secs;
+    out[8] = (char) ('0' + hms / 36000);
+    out[9] = (char) ('0' + hms / 3600 % 10);
+    out[10] = (char) ('0' + hms / 600 % 6);
+    out[11] = (char) ('0' + hms / 60 % 10);
+    out[12] = (char) ('0' + hms % 60 / 10);
+    out[13] = (char) ('0' + hms % 10);
+    out[14] = '\0';
+}
+
+/* ****************************************************************************
+ * ****************************************************************************
+ * ***              PACKING FUNCTIONS OF INTEREST START                 *******
+ * ****************************************************************************
+ * ****************************************************************************
+ * */
+
+/* ****************************************************************************
+ *
+ * Pack the time stamp. 4 & 5 Byte version
+ *
+ * EYYY_YYYY___YYYY_MMMM___DDDD_DHHH___HHmm_mmmm
+ *
+ * E     : If set use extended second format, addition byte containing seconds
+ * Year  : 11 bits contain the year, 0...2047
+ * Month :  4 bits contain the Month, 1...12
+ * Day   :  5 bits contain the day of the Month 1...31
+ * Hour  :  5 bits contain the hour 0...23
+ * Minute:  6 bits contain the minute 0...59
+ *
+ * If Extended
+ * Seconds: 6 bits contain the seconds 0...59
+ * Year   : 2 bits added to the MSB of the Year, becomes 13 bits instead of 11.
+ *          Am I being serious here? These could be used for something else.
+ *
+ * */
+uint16_t pack_WindOpMinuteTime(Calendar * timeIn, uint8_t * outBuffer, uint8_t incSecs) {
+    uint8_t working1;
+    uint8_t working2;
+
+    // Remember LSByte first
+    // HHmm_mmmm
+    working2 = (timeIn->Hours & 0x03) << 6;
+    outBuffer[0] = timeIn->Minutes + working2;
+
+    // DDDD_DHHH
+    working2 = (timeIn->Hours & 0x1F) >> 2;
+    working1 = (timeIn->DayOfMonth & 0x1F) << 3;
+    outBuffer[1] = working1 + working2;
+
+    // YYYY_MMMM
+    working2 = (timeIn->Month & 0x0F);
+    working1 = (timeIn->Year & 0x0F) << 4;
+    outBuffer[2] = working1 + working2;
+
+    // EYYY_YYYY
+    working2 = ((timeIn->Year >> 4) & 0x7F);
+    outBuffer[3] = working2;
+
+    // Extended format, extra byte with seconds
+    if (incSecs) {
+        outBuffer[3] |= 0x80;
+        outBuffer[4] = ((timeIn->Year & 0x1800) >> 5);
+        outBuffer[4] += (timeIn->Seconds & 0x3F);
+        return 5;
+    } else {
+        return 4;
+    }
+
+}
+
+/* ****************************************************************************
+ *
+ * Reverse the PACK routine
+ *
+ * */
+uint16_t unpack_WindOpMinuteTime(Calendar * timeIn, const uint8_t * outBuffer) {
+
+    // Remember LSByte first
+    // HHmm_mmmm
+    timeIn->Minutes = outBuffer[0] & 0x3F;
+    timeIn->Hours = (outBuffer[0] & 0xC0) >> 6;
+
+    // DDDD_DHHH
+    timeIn->Hours += ((outBuffer[1] & 0x7) << 2);
+    timeIn->DayOfMonth = (outBuffer[1] & 0xF8) >> 3;
+
+    // YYYY_MMMM
+    timeIn->Month = (outBuffer[2] & 0x0F);
+    timeIn->Year = (outBuffer[2] & 0xF0) >> 4;
+
+    // EYYY_YYYY
+    timeIn->Year += (outBuffer[3] & 0x7F) << 4;
+
+    if ((outBuffer[3] & 0x80) == 0x80) {
+        timeIn->Year += (outBuffer[4] & 0xC0) << 5;
+        timeIn->Seconds = outBuffer[4] & 0x3F;
+        return 5;
+    } else {
+        timeIn->Seconds = 0; // Seconds always 0 in 4 byte mode
+        return 4;
+    }
+
+}
+
+/* ****************************************************************************
+ *
+ * The same time stamp straight to and from epoch seconds, UTC.
+ *
+ * The decode has no data dependent branches. The extension bit picks between
+ * byte 4 and byte 3 again, so a 4 byte stamp never reads past itself, and a
+ * mask clears what came from byte 3. The month offset is a table lookup and
+ * the year sums are those of daysFromCivil with the year moved up one 400
+ * year era, keeping every division unsigned for the whole 0...8191 range. Per reading times are then
+ * epoch + 60 * reading, with no calendar work at all.
+ *
+ * Returns the bytes used, or 0 when a field is out of range. epoch is written
+ * either way.
+ *
+ * */
+// Days from 1 March to the first of each month, indexed by the 4 bit month
+static const uint16_t daysBeforeMonth[16] = {
+    0, 306, 337, 0, 31, 61, 92, 122, 153, 184, 214, 245, 275, 0, 0, 0
+};
+
+uint16_t unpack_WindOpEpochTime(const uint8_t * inBuffer, int64_t * epoch) {
+    const uint32_t ext = inBuffer[3] >> 7;
+    const uint32_t secByte = inBuffer[3 + ext] & (0u - ext);
+    const uint32_t minute = inBuffer[0] & 0x3F;
+    const uint32_t hour = (inBuffer[0] >> 6) | ((inBuffer[1] & 0x07) << 2);
+    const uint32_t day = inBuffer[1] >> 3;
+    const uint32_t month = inBuffer[2] & 0x0F;
+    const uint32_t year = (inBuffer[2] >> 4) | ((inBuffer[3] & 0x7F) << 4) | ((secByte & 0xC0) << 5);
+    const uint32_t second = secByte & 0x3F;
+    const uint32_t bad = (month - 1 > 11) | (day - 1 > 30) | (hour > 23) | (minute > 59) | (second > 59);
+
+    // March based month and year, then days since 1970 less one era
+    const uint32_t y = year + 400 - (month <= 2);
+    const uint32_t doy = daysBeforeMonth[month] + day - 1;
+    const int64_t days = (int64_t) y * 365 + y / 4 - y / 100 + y / 400 + doy - 719468 - 146097;
+
+    *epoch = days * 86400 + hour * 3600 + minute * 60 + second;
+    return (uint16_t) ((4 + ext) & (0u - (bad ^ 1)));
+}
+
+/*
+ * Encoder to match. Without incSecs the seconds are dropped. Returns the bytes
+ * written, or 0 when the year does not fit, 11 bits or 13 with incSecs.
+ */
+uint16_t pack_WindOpEpochTime(int64_t epoch, uint8_t * outBuffer, uint8_t incSecs) {
+    int64_t z = epoch / 86400;
+    int64_t secs = epoch % 86400;
+    uint32_t year;
+    uint32_t month;
+    uint32_t day;
+    uint32_t hour;
+
+    if (secs < 0) {
+        secs += 86400;
+        z -= 1;
+    }
+    civilFromDays(z, &year, &month, &day);
+    if (year > (incSecs ? 0x1FFFu : 0x7FFu)) { // Years before 0 wrap to large values
+        return 0;
+    }
+    hour = (uint32_t) secs / 3600;
+
+    outBuffer[0] = (uint8_t) (((uint32_t) secs / 60 % 60) | (hour << 6));
+    outBuffer[1] = (uint8_t) ((day << 3) | (hour >> 2));
+    outBuffer[2] = (uint8_t) (((year & 0x0F) << 4) | month);
+    outBuffer[3] = (uint8_t) ((year >> 4) & 0x7F);
+    if (incSecs) {
+        outBuffer[3] |= 0x80;
+        outBuffer[4] = (uint8_t) (((year & 0x1800) >> 5) | ((uint32_t) secs % 60));
+        return 5;
+    }
+    return 4;
+}
+/* ****************************************************************************
+ *
+ * Reading codecs. Everything below is expanded from the field lists in
+ * wm_schema.h, one set per packet type:
+ *
+ *   layout_tN                          the reading as bytes, for the offsets
+ *   pack/unpack_WindOpDataReadings_tN  readings to and from packCtrl structs
+ *   packChannels/unpackChannels_tN     readings to and from channel columns
+ *   fields_tN, info_tN                 the type table entry
+ *
+ * Field widths and signs are constants in each expansion so every function
+ * is straight line code with no per reading switch.
+ *
+ * */
+#define PACK_FIELD(sfx, name, ch, bytes, sgn, scale)                     \
+    write_WindOpField(p, bytes, readingsIn->name);                       \
+    p += bytes;
+
+#define UNPACK_FIELD(sfx, name, ch, bytes, sgn, scale)                   \
+    readingsIn->name = read_WindOpField(p, bytes, sgn);                  \
+    p += bytes;
+
+#define PACK_CHANNEL(sfx, name, ch, bytes, sgn, scale)                   \
+    write_WindOpField(p, bytes, channel[ch][row]);                       \
+    p += bytes;
+
+#define UNPACK_CHANNEL(sfx, name, ch, bytes, sgn, scale)                 \
+    channel[ch][row] = read_WindOpField(p, bytes, sgn);                  \
+    p += bytes;
+
+#define LAYOUT_MEMBER(sfx, name, ch, bytes, sgn, scale)  uint8_t name[bytes];
+#define FIELD_BYTES(sfx, name, ch, bytes, sgn, scale)    + (bytes)
+#define FIELD_MASK(sfx, name, ch, bytes, sgn, scale)     | (1 << (ch))
+#define FIELD_COUNT(sfx, name, ch, bytes, sgn, scale)    + 1
+#define FIELD_SCALE(sfx, name, ch, bytes, sgn, scale)    [ch] = (scale),
+#define FIELD_INFO(sfx, name, ch, bytes, sgn, scale)                     \
+    { #name, ch, bytes, sgn, scale, offsetof(struct layout_##sfx, name) },
+#define CHANNEL_INFO(sfx, name, ch, bytes, sgn, scale)   [ch] = FIELD_INFO(sfx, name, ch, bytes, sgn, scale)
+
+// Text fields only take up room
+#define PACK_FIELD_TEXT(sfx, name, bytes)        memset(p, ' ', bytes); p += bytes;
+#define UNPACK_FIELD_TEXT(sfx, name, bytes)      p += bytes;
+#define PACK_CHANNEL_TEXT(sfx, name, bytes)      memset(p, ' ', bytes); p += bytes;
+#define UNPACK_CHANNEL_TEXT(sfx, name, bytes)    p += bytes;
+#define LAYOUT_MEMBER_TEXT(sfx, name, bytes)     uint8_t name[bytes];
+#define FIELD_BYTES_TEXT(sfx, name, bytes)       + (bytes)
+#define FIELD_MASK_TEXT(sfx, name, bytes)
+#define FIELD_COUNT_TEXT(sfx, name, bytes)
+#define FIELD_SCALE_TEXT(sfx, name, bytes)
+#define FIELD_INFO_TEXT(sfx, name, bytes)
+#define CHANNEL_INFO_TEXT(sfx, name, bytes)
+
+// Channels the type does not carry read back as 0
+static inline void clearChannels(uint8_t carried, int32_t * const * channel, uint32_t row) {
+    uint8_t ch;
+
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        if ((carried & (1 << ch)) == 0) {
+            channel[ch][row] = 0;
+        }
+    }
+}
+
+#define READINGS_CODEC(sfx, type, first, SCHEMA)                                                         \
+struct layout_##sfx { SCHEMA(LAYOUT_MEMBER, sfx) };                                                      \
+uint16_t pack_WindOpDataReadings_##sfx(struct WindOpDataPacket_t3 * readingsIn, uint8_t * outBuffer) {   \
+    uint8_t * p = outBuffer;                                                                             \
+    SCHEMA(PACK_FIELD, sfx)                                                                              \
+    return (uint16_t) (p - outBuffer);                                                                   \
+}                                                                                                        \
+uint16_t unpack_WindOpDataReadings_##sfx(struct WindOpDataPacket_t3 * readingsIn,                       \
+                                         const uint8_t * outBuffer) {                                    \
+    const uint8_t * p = outBuffer;                                                                       \
+    SCHEMA(UNPACK_FIELD, sfx)                                                                            \
+    return (uint16_t) (p - outBuffer);                                                                   \
+}                                                                                                        \
+static uint16_t packChannels_##sfx(int32_t * const * channel, uint32_t row, uint8_t * outBuffer) {       \
+    uint8_t * p = outBuffer;                                                                             \
+    SCHEMA(PACK_CHANNEL, sfx)                                                                            \
+    return (uint16_t) (p - outBuffer);                                                                   \
+}                                                                                                        \
+static void unpackChannels_##sfx(int32_t * const * channel, uint32_t row, const uint8_t * inBuffer) {    \
+    const uint8_t * p = inBuffer;                                                                        \
+    SCHEMA(UNPACK_CHANNEL, sfx)                                                                          \
+    clearChannels(0 SCHEMA(FIELD_MASK, sfx), channel, row);                                              \
+}                                                                                                        \
+static const WindOpFieldInfo fields_##sfx[] = { SCHEMA(FIELD_INFO, sfx) };                               \
+static const WindOpTypeInfo info_##sfx = {                                                               \
+    type, sizeof(struct layout_##sfx), first, 0 SCHEMA(FIELD_MASK, sfx),                                 \
+    { SCHEMA(FIELD_SCALE, sfx) },                                                                        \
+    #sfx, 0 SCHEMA(FIELD_COUNT, sfx), fields_##sfx,                                                      \
+    { SCHEMA(CHANNEL_INFO, sfx) },                                                                       \
+    pack_WindOpDataReadings_##sfx, unpack_WindOpDataReadings_##sfx,                                      \
+    packChannels_##sfx, unpackChannels_##sfx                                                             \
+};
+
+WINDOP_SCHEMA_TYPES(READINGS_CODEC)
+
+// T8 carries any of the T3 fields as deltas, the packet mask says which
+static const WindOpTypeInfo info_t8 = {
+    WINDOPDATAPACKET_T8_TYPE, 0, 0, 0 WINDOP_SCHEMA_T3(FIELD_MASK, t3),
+    { WINDOP_SCHEMA_T3(FIELD_SCALE, t3) },
+    "t8", 0 WINDOP_SCHEMA_T3(FIELD_COUNT, t3), fields_t3,
+    { WINDOP_SCHEMA_T3(CHANNEL_INFO, t3) },
+    NULL, NULL, NULL, NULL
+};
+
+#define TYPE_ENTRY(sfx, type, first, SCHEMA)   [type] = &info_##sfx,
+
+// Indexed directly by the packet type byte, unknown types are NULL
+static const WindOpTypeInfo * const windOpTypes[256] = {
+    WINDOP_SCHEMA_TYPES(TYPE_ENTRY)
+    [WINDOPDATAPACKET_T8_TYPE] = &info_t8,
+};
+
+const WindOpTypeInfo * info_WindOpDataType(uint8_t dataType) {
+    return windOpTypes[dataType];
+}
+
+/* ****************************************************************************
+ *
+ * T8 readings from and to the packCtrl structs, every T3 field carried.
+ *
+ * */
+#define READING_MEMBER(sfx, name, ch, bytes, sgn, scale)                 \
+    channel[ch][i] = pack->readings[i].name;
+#define READING_FIELD(sfx, name, ch, bytes, sgn, scale)                  \
+    pack->readings[i].name = channel[ch][i];
+
+static uint32_t packDeltaReadings(struct packCtrl * pack, uint8_t * outBuffer, uint32_t capacity) {
+    int32_t values[WINDOP_NUM_CHANNELS][READINGS_BUFFER_SIZE];
+    int32_t * channel[WINDOP_NUM_CHANNELS];
+    uint8_t ch;
+    uint8_t i;
+
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        channel[ch] = values[ch];
+    }
+    for (i = 0; i < pack->numOfReadings; i++) {
+        WINDOP_SCHEMA_T3(READING_MEMBER, t3)
+    }
+    return pack_WindOpDeltaReadings(channel, 0, i, info_t8.channels, outBuffer, capacity);
+}
+
+// numReadings from the checked header, no more than READINGS_BUFFER_SIZE
+static void unpackDeltaReadings(struct packCtrl * pack, const uint8_t * inBuffer, uint8_t numReadings) {
+    int32_t values[WINDOP_NUM_CHANNELS][WINDOP_DELTA_MAX_READINGS];
+    int32_t * channel[WINDOP_NUM_CHANNELS];
+    uint8_t ch;
+    uint8_t i;
+
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        channel[ch] = values[ch];
+    }
+    unpack_WindOpDeltaReadings(inBuffer, channel, 0);
+    for (i = 0; i < numReadings; i++) {
+        WINDOP_SCHEMA_T3(READING_FIELD, t3)
+    }
+}
+
+/* ****************************************************************************
+ *
+ * The one length check of a packet, everything of parse_WindOpPacketHeader
+ * but the time stamp. Leaves info, dataOffset, numReadings and channels.
+ *
+ * */
+// 2^16 / size rounded up. Exact quotients by multiply for any payload under 256 bytes
+#define RECIP(size)  (0x10000 / (size) + 1)
+static const uint32_t readingReciprocal[33] = {
+    0,          RECIP(1),   RECIP(2),   RECIP(3),   RECIP(4),   RECIP(5),   RECIP(6),   RECIP(7),
+    RECIP(8),   RECIP(9),   RECIP(10),  RECIP(11),  RECIP(12),  RECIP(13),  RECIP(14),  RECIP(15),
+    RECIP(16),  RECIP(17),  RECIP(18),  RECIP(19),  RECIP(20),  RECIP(21),  RECIP(22),  RECIP(23),
+    RECIP(24),  RECIP(25),  RECIP(26),  RECIP(27),  RECIP(28),  RECIP(29),  RECIP(30),  RECIP(31),
+    RECIP(32)
+};
+
+static inline uint8_t checkPacketLayout(WindOpPacketHeader * hdr, const uint8_t * packet, uint32_t length) {
+    const WindOpTypeInfo * info;
+    uint32_t dataOffset;
+    uint32_t declared;
+    uint32_t payload;
+    uint32_t numReadings;
+    uint8_t deltaReadings;
+    uint8_t channels;
+
+    if (length < WINDOP_PACKET_HEADER_SIZE + WINDOP_TIME_SIZE) {
+        return WINDOP_ERR_SHORT;
+    }
+    info = info_WindOpDataType(packet[0]);
+    dataOffset = WINDOP_PACKET_HEADER_SIZE + WINDOP_TIME_SIZE + (packet[WINDOP_PACKET_HEADER_SIZE + 3] >> 7);
+    declared = packet[1];
+
+    // One branch for the good packet, the reason only matters for a bad one
+    if ((info == NULL) | (declared < dataOffset) | (declared > length)) {
+        return (length < dataOffset) ? WINDOP_ERR_SHORT : (info == NULL) ? WINDOP_ERR_TYPE : WINDOP_ERR_LENGTH;
+    }
+
+    payload = declared - dataOffset;
+    if (info->readingSize == 0) {
+        // Delta readings fill the packet exactly, and there is at least one
+        if ((payload == 0) ||
+            (check_WindOpDeltaReadings(&packet[dataOffset], payload, &deltaReadings, &channels) != payload)) {
+            return WINDOP_ERR_LENGTH;
+        }
+        numReadings = deltaReadings;
+    } else {
+        numReadings = (payload * readingReciprocal[info->readingSize]) >> 16;
+        if (numReadings * info->readingSize != payload) {
+            return WINDOP_ERR_LENGTH;
+        }
+        channels = info->channels;
+    }
+
+    hdr->info = info;
+    hdr->dataOffset = (uint16_t) dataOffset;
+    hdr->numReadings = (uint16_t) numReadings;
+    hdr->channels = channels;
+    return WINDOP_OK;
+}
+
+/* ****************************************************************************
+ *
+ * Bounded full packet packing procedure. Everything that can go wrong with
+ * a fixed layout is known from the type, the reading count and the time
+ * before a byte is written, so the size is checked once and the readings
+ * packed blind. Delta sizes depend on the values, that packer checks itself.
+ *
+ * */
+uint8_t packBounded_WindOpDataPacket(struct packCtrl * pack, uint8_t * outBuffer, uint32_t capacity,
+                                     uint32_t * length) {
+    const WindOpTypeInfo * info = info_WindOpDataType(pack->dataType);
+    const Calendar * time = &pack->time;
+    const uint8_t numReadings = pack->numOfReadings;
+    const uint32_t dataOffset = WINDOP_PACKET_HEADER_SIZE + (pack->incSeconds ? WINDOP_TIME_EXT_SIZE : WINDOP_TIME_SIZE);
+    const uint32_t limit = (capacity < WINDOP_MAX_PACKET_LENGTH) ? capacity : WINDOP_MAX_PACKET_LENGTH;
+    uint8_t * p = &outBuffer[dataOffset];
+    uint32_t size;
+    uint8_t i;
+
+    *length = 0;
+    if (info == NULL) {
+        return WINDOP_ERR_TYPE;
+    }
+    if ((time->Month - 1u > 11) | (time->DayOfMonth - 1u > 30) | (time->Hours > 23) | (time->Minutes > 59) |
+        (time->Seconds > 59) | ((time->Year >> (pack->incSeconds ? 13 : 11)) != 0)) {
+        return WINDOP_ERR_TIME;
+    }
+    if (numReadings > READINGS_BUFFER_SIZE) {
+        return WINDOP_ERR_CAPACITY;
+    }
+
+    if (info->readingSize == 0) {
+        // Delta sizes depend on the values, the packer checks as it goes
+        size = (numReadings && (limit > dataOffset)) ? packDeltaReadings(pack, p, limit - dataOffset) : 0;
+        if (size == 0) {
+            return (numReadings == 0) ? WINDOP_ERR_FORMAT : // A delta packet has no way to say it is empty
+                   (capacity < WINDOP_MAX_PACKET_LENGTH) ? WINDOP_ERR_CAPACITY : WINDOP_ERR_LENGTH;
+        }
+        size += dataOffset;
+    } else {
+        size = dataOffset + (uint32_t) numReadings * info->readingSize;
+        if (size > limit) {
+            return (size > WINDOP_MAX_PACKET_LENGTH) ? WINDOP_ERR_LENGTH : WINDOP_ERR_CAPACITY;
+        }
+        for (i = 0; i < numReadings; i++) {
+            p += info->packReading(&pack->readings[i], p);
+        }
+    }
+
+    outBuffer[0] = pack->dataType;
+    outBuffer[1] = (uint8_t) size;
+    pack_WindOpMinuteTime(&pack->time, &outBuffer[WINDOP_PACKET_HEADER_SIZE], pack->incSeconds);
+
+    *length = size;
+    return WINDOP_OK;
+}
+
+/*
+ * Range check of the time stamp fields straight from the bytes. The hour
+ * straddles bytes 0 and 1 but is only out of range when its top three bits,
+ * the low bits of byte 1, exceed 5, and a 5 bit day is never over 31.
+ */
+static inline uint32_t checkTimeBytes(const uint8_t * in) {
+    const uint32_t ext = in[3] >> 7;
+    const uint32_t second = in[3 + ext] & (0u - ext) & 0x3F;
+
+    return ((in[0] & 0x3F) < 60) & ((in[1] & 0x07) < 6) & ((in[1] >> 3) != 0) & ((in[2] & 0x0F) - 1u < 12) &
+           (second < 60);
+}
+
+/* ****************************************************************************
+ *
+ * The bounded unpack. checkPacketLayout is the one length check, it leaves
+ * a known type and whole readings within length. The reading count is then
+ * checked against the packCtrl and the time fields in one test.
+ *
+ * The metrics wrap the decode rather than sit in it, one block lookup and
+ * one packed count per packet, and only parse_WindOpPacketHeader times the
+ * time stamp as a stage of its own.
+ *
+ * */
+static inline uint8_t unpackBounded(struct packCtrl * pack, const uint8_t * inBuffer, uint32_t length) {
+    WindOpPacketHeader hdr;
+    const WindOpTypeInfo * info;
+    const uint8_t * p;
+    uint8_t numReadings;
+    uint8_t status;
+    uint8_t i;
+
+    pack->numOfReadings = 0;
+    status = checkPacketLayout(&hdr, inBuffer, length);
+    if (status != WINDOP_OK) {
+        return status;
+    }
+    if ((hdr.numReadings > READINGS_BUFFER_SIZE) | !checkTimeBytes(&inBuffer[WINDOP_PACKET_HEADER_SIZE])) {
+        return (hdr.numReadings > READINGS_BUFFER_SIZE) ? WINDOP_ERR_CAPACITY : WINDOP_ERR_TIME;
+    }
+    unpack_WindOpMinuteTime(&pack->time, &inBuffer[WINDOP_PACKET_HEADER_SIZE]);
+
+    pack->dataType = inBuffer[0];
+    pack->packetLength = inBuffer[1];
+    pack->incSeconds = inBuffer[WINDOP_PACKET_HEADER_SIZE + 3] >> 7;
+
+    info = hdr.info;
+    p = &inBuffer[hdr.dataOffset];
+    numReadings = (uint8_t) hdr.numReadings;
+    if (info->readingSize == 0) {
+        unpackDeltaReadings(pack, p, numReadings);
+    } else {
+        for (i = 0; i < numReadings; i++) {
+            p += info->unpackReading(&pack->readings[i], p);
+        }
+    }
+
+    pack->numOfReadings = numReadings;
+    return WINDOP_OK;
+}
+
+uint8_t unpackBounded_WindOpDataPacket(struct packCtrl * pack, const uint8_t * inBuffer, uint32_t length) {
+    WindOpMetricsThread * metrics;
+    uint64_t start;
+    uint8_t status;
+
+    if (!WINDOP_METRICS) {
+        return unpackBounded(pack, inBuffer, length);
+    }
+    metrics = self_WindOpMetrics();
+    start = start_WindOpStage(metrics, WINDOP_STAGE_UNPACK);
+    status = unpackBounded(pack, inBuffer, length);
+    if (status != WINDOP_OK) {
+        countFailure_WindOpMetrics(metrics, status);
+        return status;
+    }
+    countPacket_WindOpMetrics(metrics, pack->dataType, pack->packetLength, pack->numOfReadings);
+    end_WindOpStage(metrics, WINDOP_STAGE_UNPACK, start);
+    return WINDOP_OK;
+}
+
+/* ****************************************************************************
+ *
+ * Full packet packing procedure.
+ *
+ * */
+uint16_t pack_WindOpDataPacket(struct packCtrl * pack, uint8_t * outBuffer) {
+    const WindOpTypeInfo * info;
+    uint32_t length;
+    uint8_t status;
+    uint8_t i;
+
+    status = packBounded_WindOpDataPacket(pack, outBuffer, BYTEBUFFERSIZE, &length);
+    if (status != WINDOP_OK) {
+        printf("ERROR packing data type %d, status %d\n", pack->dataType, status);
+        return 0;
+    }
+
+    if (WINDOP_TRACE) {
+        info = info_WindOpDataType(pack->dataType);
+        for (i = 0; (info->readingSize != 0) && (i < pack->numOfReadings); i++) {
+            printf("Buffer %3d start location is %4d\n", i,
+                   (int) (length - (pack->numOfReadings - i) * info->readingSize));
+        }
+    }
+
+    return (uint16_t) length; // This contains the packet length
+}
+
+/* ****************************************************************************
+ *
+ * The unpack
+ *
+ * */
+uint16_t unpack_WindOpDataPacket(struct packCtrl * pack, uint8_t * outBuffer) {
+    const WindOpTypeInfo * info;
+    uint8_t status;
+    uint8_t i;
+
+    status = unpackBounded_WindOpDataPacket(pack, outBuffer, outBuffer[1]);
+    if (status != WINDOP_OK) {
+        printf("ERROR unpacking data type %d, status %d\n", outBuffer[0], status);
+        return 0;
+    }
+
+    if (WINDOP_TRACE) {
+        info = info_WindOpDataType(pack->dataType);
+        for (i = 0; (info->readingSize != 0) && (i < pack->numOfReadings); i++) {
+            printf("Buffer %3d location is %4d Size: %4d\n", i,
+                   (int) (outBuffer[1] - (pack->numOfReadings - i) * info->readingSize), outBuffer[1]);
+        }
+    }
+
+    return pack->numOfReadings; // return the number of received packets
+}
+
+/* ****************************************************************************
+ *
+ * Channel array codec. Used by the columnar paths, readings go straight
+ * between the packet bytes and one int32_t array per channel at row.
+ *
+ * */
+void unpack_WindOpReadingChannels(const WindOpTypeInfo * info, int32_t * const * channel, uint32_t row,
+                                  const uint8_t * inBuffer) {
+    info->unpackChannels(channel, row, inBuffer);
+}
+
+uint16_t pack_WindOpReadingChannels(const WindOpTypeInfo * info, int32_t * const * channel, uint32_t row,
+                                    uint8_t * outBuffer) {
+    return info->packChannels(channel, row, outBuffer);
+}
+
+/* ****************************************************************************
+ *
+ * Check the packet header against the bytes available. After an OK return
+ * numReadings whole readings start at dataOffset, all within length.
+ *
+ * */
+uint8_t parse_WindOpPacketHeader(WindOpPacketHeader * hdr, const uint8_t * packet, uint32_t length) {
+    WindOpMetricsThread * const metrics = self_WindOpMetrics();
+    const uint64_t start = start_WindOpStage(metrics, WINDOP_STAGE_HEADER);
+    uint8_t status = checkPacketLayout(hdr, packet, length);
+    uint64_t timeStart;
+    uint16_t timeSize;
+
+    if (status != WINDOP_OK) {
+        return status;
+    }
+    timeStart = start_WindOpStage(metrics, WINDOP_STAGE_TIME);
+    timeSize = unpack_WindOpEpochTime(&packet[WINDOP_PACKET_HEADER_SIZE], &hdr->firstTime);
+    end_WindOpStage(metrics, WINDOP_STAGE_TIME, timeStart);
+    if (timeSize == 0) {
+        return WINDOP_ERR_TIME;
+    }
+    hdr->firstTime += hdr->info->firstOffset;
+
+    end_WindOpStage(metrics, WINDOP_STAGE_HEADER, start);
+    return WINDOP_OK;
+}
+
+// The length checks of parse_WindOpPacketHeader without the time stamp, for
+// readers such as wm_view that decode the time only when asked
+uint8_t check_WindOpPacketLayout(WindOpPacketHeader * hdr, const uint8_t * packet, uint32_t length) {
+    return checkPacketLayout(hdr, packet, length);
+}
+
+/* ****************************************************************************
+ * ****************************************************************************
+ * ***              PACKING FUNCTIONS OF INTEREST END                   *******
+ * ****************************************************************************
+ * ****************************************************************************
+ * */
@@ -0,0 +1,304 @@
+/*
+ ============================================================================
+ Name        : wm_codec.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : WindOp packet codec library, types and prototypes
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_CODEC_H
+#define WM_CODEC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define READINGS_BUFFER_SIZE     30
+#define BYTEBUFFERSIZE           1000 // Reference test buffers, see the bounded packet codecs
+
+// Packet type IDs as sent over the air. These match the IDs dispatched by the
+// call_packetUnpack_00x decoders in the ttnLoRaUtilities scripts, Tn == n.
+#define WINDOPDATAPACKET_T3_TYPE 0x03
+#define WINDOPDATAPACKET_T4_TYPE 0x04
+#define WINDOPDATAPACKET_T5_TYPE 0x05
+#define WINDOPDATAPACKET_T6_TYPE 0x06
+#define WINDOPDATAPACKET_T7_TYPE 0x07 // GPS fix, see wm_gps.h
+#define WINDOPDATAPACKET_T8_TYPE 0x08 // Delta coded T3 fields, see wm_delta.h
+
+// Packet header, type and total length bytes ahead of the time stamp
+#define WINDOP_PACKET_HEADER_SIZE 2
+#define WINDOP_TIME_SIZE          4
+#define WINDOP_TIME_EXT_SIZE      5
+#define WINDOP_MAX_PACKET_LENGTH  255 // The length byte limits a packet
+
+// Channel index of each reading field in the decoded columns
+#define WINDOP_CH_WS             0
+#define WINDOP_CH_WSX            1
+#define WINDOP_CH_WSM            2
+#define WINDOP_CH_WD             3
+#define WINDOP_CH_TMP            4
+#define WINDOP_CH_PRESS          5
+#define WINDOP_CH_HUM            6
+#define WINDOP_CH_BV             7
+#define WINDOP_NUM_CHANNELS      8
+
+#define WINDOP_WIND_CHANNELS     0x0F // ws, wsx, wsm, wd
+#define WINDOP_ENV_CHANNELS      0xF0 // tmp, press, hum, bv
+
+// Per packet decode status
+#define WINDOP_OK                0
+#define WINDOP_ERR_SHORT         1 // Not enough bytes for the header and time
+#define WINDOP_ERR_LENGTH        2 // Length byte disagrees with the bytes given
+#define WINDOP_ERR_TYPE          3 // Unknown data type
+#define WINDOP_ERR_TIME          4 // Time stamp fields out of range
+#define WINDOP_ERR_CAPACITY      5 // Output columns are full
+#define WINDOP_ERR_MEMORY        6 // Allocation failed
+#define WINDOP_ERR_FORMAT        7 // Text or file input does not parse
+
+//*****************************************************************************
+//
+//! \brief Used in the RTC_C_initCalendar() function as the CalendarTime
+//! parameter. (TI Header)
+//
+//*****************************************************************************
+typedef struct Calendar {
+    //! Seconds of minute between 0-59
+    uint8_t Seconds;
+    //! Minutes of hour between 0-59
+    uint8_t Minutes;
+    //! Hour of day between 0-23
+    uint8_t Hours;
+    //! Day of week between 0-6
+    uint8_t DayOfWeek;
+    //! Day of month between 1-31
+    uint8_t DayOfMonth;
+    //! Month between 0-11
+    uint8_t Month;
+    //! Year between 0-4095
+    uint16_t Year;
+} Calendar;
+
+/* ****************************************************************************
+ *
+ * Define struct of reading types
+ *
+ * */
+typedef struct WindOpDataPacket_t3 {
+    uint16_t ws; // Average minute windspeed
+    uint16_t wsx; // Second max speed windspeed
+    uint16_t wsm; // Second min windspeed
+    uint16_t wd;  // Wind direction
+    int16_t tmp; // temperature
+    uint16_t press; // Pressure
+    uint16_t hum; // Humidity
+    uint16_t bv; // Battery Voltage
+} WindOpDataPacket_t3;
+
+
+/*
+ * Optional data structs that can be used.
+ *
+ * */
+typedef struct WindOpDataPacket_t4 {
+    uint16_t ws; // Average minute windspeed
+    uint16_t wsx; // Second max speed windspeed
+    uint16_t wsm; // Second min windspeed
+    uint16_t wd;  // Wind direction
+} WindOpDataPacket_t4;
+
+typedef struct WindOpDataPacket_t5 {
+    int16_t tmp; // temperature
+    uint16_t press; // Pressure
+    uint16_t hum; // Humidity
+    uint16_t bv; // Battery Voltage
+} WindOpDataPacket_t5;
+
+/* ****************************************************************************
+ *
+ * Packet packing control struct
+ *
+ * */
+typedef struct packCtrl {
+    Calendar time;
+    uint8_t incSeconds;
+    uint8_t numOfReadings;
+    uint8_t extendedTimeFormat;
+    uint8_t dataType;
+    uint8_t packetLength;
+
+    // Note as T3 & T4 are subsets we simple reuse the T2 structure.
+    //
+    WindOpDataPacket_t3 readings[READINGS_BUFFER_SIZE];
+
+} packCtrl;
+
+/* ****************************************************************************
+ *
+ * One reading field as described in wm_schema.h
+ *
+ * */
+typedef struct WindOpFieldInfo {
+    const char * name;        // WindOpDataPacket_t3 member
+    uint8_t channel;          // WINDOP_CH_*
+    uint8_t bytes;            // 2 or 3, little endian
+    uint8_t isSigned;
+    double scale;
+    uint8_t offset;           // Byte offset within the reading
+} WindOpFieldInfo;
+
+/* ****************************************************************************
+ *
+ * Per packet type layout information, generated from wm_schema.h
+ *
+ * readingSize  : bytes used by each reading after the time stamp, 0 for
+ *                the variable T8 layout, which has no per reading codecs
+ * firstOffset  : seconds from the packet time to the first reading. Wind
+ *                packets time stamp the start of the first averaging minute.
+ * channels     : bit n set when the type carries channel n
+ * scale        : multiplier converting the raw channel value to units
+ * fields       : the readings fields in packet order
+ * byChannel    : the same fields indexed by channel, bytes is 0 for channels
+ *                the type does not carry
+ *
+ * The function pointers are the unrolled codecs for the type, callers pick
+ * them up once per packet rather than switching per reading.
+ *
+ * */
+typedef struct WindOpTypeInfo {
+    uint8_t dataType;
+    uint8_t readingSize;
+    uint8_t firstOffset;
+    uint8_t channels;
+    double scale[WINDOP_NUM_CHANNELS];
+    const char * name;
+    uint8_t numFields;
+    const WindOpFieldInfo * fields;
+    WindOpFieldInfo byChannel[WINDOP_NUM_CHANNELS];
+    uint16_t (*packReading)(struct WindOpDataPacket_t3 * readingsIn, uint8_t * outBuffer);
+    uint16_t (*unpackReading)(struct WindOpDataPacket_t3 * readingsIn, const uint8_t * outBuffer);
+    uint16_t (*packChannels)(int32_t * const * channel, uint32_t row, uint8_t * outBuffer);
+    void (*unpackChannels)(int32_t * const * channel, uint32_t row, const uint8_t * inBuffer);
+} WindOpTypeInfo;
+
+const WindOpTypeInfo * info_WindOpDataType(uint8_t dataType);
+
+// CSV column and script hash key of a channel, ws, wsa, wsm, wd, tmp, pres, hum, bv
+const char * key_WindOpChannel(uint8_t channel);
+
+/* ****************************************************************************
+ *
+ * Validated packet header, filled in by parse_WindOpPacketHeader. The
+ * layout check alone leaves firstTime untouched.
+ *
+ * */
+typedef struct WindOpPacketHeader {
+    const WindOpTypeInfo * info;
+    int64_t firstTime;        // Epoch seconds of the first reading
+    uint16_t dataOffset;      // Byte offset of the first reading
+    uint16_t numReadings;     // Whole readings held in the packet
+    uint8_t channels;         // Channels carried, from the mask for T8
+} WindOpPacketHeader;
+
+/* ****************************************************************************
+ * Time stamp
+ * */
+uint16_t pack_WindOpMinuteTime(Calendar * timeIn, uint8_t * outBuffer, uint8_t incSecs);
+uint16_t unpack_WindOpMinuteTime(Calendar * timeIn, const uint8_t * outBuffer);
+uint8_t check_WindOpMinuteTime(const Calendar * timeIn);
+int64_t epoch_WindOpCalendar(const Calendar * timeIn);
+void calendar_WindOpEpoch(Calendar * timeOut, int64_t epoch);
+
+// The 4 or 5 byte time stamp to and from epoch seconds, 0 returned on error
+uint16_t unpack_WindOpEpochTime(const uint8_t * inBuffer, int64_t * epoch);
+uint16_t pack_WindOpEpochTime(int64_t epoch, uint8_t * outBuffer, uint8_t incSecs);
+
+/* ****************************************************************************
+ *
+ * YYYYMMDDhhmmss time keys, the day prefix cached between calls
+ *
+ * */
+#define WINDOP_TIME_KEY_SIZE     15 // Including the terminating NUL
+
+typedef struct WindOpTimeFormat {
+    int64_t day;              // Epoch day of prefix
+    char prefix[9];
+} WindOpTimeFormat;
+
+void init_WindOpTimeFormat(WindOpTimeFormat * fmt);
+void format_WindOpTime(WindOpTimeFormat * fmt, int64_t epoch, char * out);
+
+/* ****************************************************************************
+ * Readings
+ * */
+uint16_t pack_WindOpDataReadings_t3(struct WindOpDataPacket_t3 * readingsIn, uint8_t * outBuffer);
+uint16_t pack_WindOpDataReadings_t4(struct WindOpDataPacket_t3 * readingsIn, uint8_t * outBuffer);
+uint16_t pack_WindOpDataReadings_t5(struct WindOpDataPacket_t3 * readingsIn, uint8_t * outBuffer);
+uint16_t pack_WindOpDataReadings_t6(struct WindOpDataPacket_t3 * readingsIn, uint8_t * outBuffer);
+uint16_t unpack_WindOpDataReadings_t3(struct WindOpDataPacket_t3 * readingsIn, const uint8_t * outBuffer);
+uint16_t unpack_WindOpDataReadings_t4(struct WindOpDataPacket_t3 * readingsIn, const uint8_t * outBuffer);
+uint16_t unpack_WindOpDataReadings_t5(struct WindOpDataPacket_t3 * readingsIn, const uint8_t * outBuffer);
+uint16_t unpack_WindOpDataReadings_t6(struct WindOpDataPacket_t3 * readingsIn, const uint8_t * outBuffer);
+
+// Readings to and from one int32_t array per channel, see WINDOP_CH_*
+void unpack_WindOpReadingChannels(const WindOpTypeInfo * info, int32_t * const * channel, uint32_t row,
+                                  const uint8_t * inBuffer);
+uint16_t pack_WindOpReadingChannels(const WindOpTypeInfo * info, int32_t * const * channel, uint32_t row,
+                                    uint8_t * outBuffer);
+
+/* ****************************************************************************
+ * Full packets
+ *
+ * The bounded codecs check a packet once, against the capacity or length
+ * given, then pack or unpack every reading with no further checks. They
+ * return a WINDOP_* status and are the ones to use on uplinks. The unpack
+ * fills in numOfReadings, incSeconds and packetLength.
+ *
+ * pack and unpack_WindOpDataPacket wrap them for the BYTEBUFFERSIZE buffers
+ * of the reference test, trusting the length byte, and return the packet
+ * length or readings unpacked, 0 on error. Built with WINDOP_TRACE set
+ * (make TRACE=1) they also print where each reading sits in the buffer.
+ * */
+#ifndef WINDOP_TRACE
+#define WINDOP_TRACE 0
+#endif
+
+uint8_t parse_WindOpPacketHeader(WindOpPacketHeader * hdr, const uint8_t * packet, uint32_t length);
+uint8_t check_WindOpPacketLayout(WindOpPacketHeader * hdr, const uint8_t * packet, uint32_t length);
+uint8_t packBounded_WindOpDataPacket(struct packCtrl * pack, uint8_t * outBuffer, uint32_t capacity,
+                                     uint32_t * length);
+uint8_t unpackBounded_WindOpDataPacket(struct packCtrl * pack, const uint8_t * inBuffer, uint32_t length);
+uint16_t pack_WindOpDataPacket(struct packCtrl * pack, uint8_t * outBuffer);
+uint16_t unpack_WindOpDataPacket(struct packCtrl * pack, uint8_t * outBuffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_CODEC_H
@@ -0,0 +1,189 @@
+/*
+ ============================================================================
+ Name        : wm_csv.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Perl compatible CSV reading and writing
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_csv.h"
+
+void writeHeader_WindOpCsv(FILE * out) {
+    uint8_t ch;
+
+    fprintf(out, "time,");
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        fprintf(out, "%s,", key_WindOpChannel(ch));
+    }
+    fputc('\n', out);
+}
+
+void writeRow_WindOpCsv(FILE * out, WindOpTimeFormat * fmt, int64_t time, uint8_t valid, const double * value) {
+    char key[WINDOP_TIME_KEY_SIZE];
+    uint8_t ch;
+
+    format_WindOpTime(fmt, time, key);
+    fputs(key, out);
+    fputc(',', out);
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        if (valid & (1 << ch)) {
+            fprintf(out, "%.15g,", value[ch]); // Matches Perl number stringification
+        } else {
+            fputc(',', out);
+        }
+    }
+    fputc('\n', out);
+}
+
+/* ****************************************************************************
+ *
+ * Sort rows by time keeping packet order for equal times. The columns are
+ * per thread so several writers can sort at once.
+ *
+ * */
+static __thread const WindOpColumns * sortColumns;
+
+static int compareRows(const void * a, const void * b) {
+    uint32_t ra = *(const uint32_t *) a;
+    uint32_t rb = *(const uint32_t *) b;
+    if (sortColumns->time[ra] != sortColumns->time[rb]) {
+        return (sortColumns->time[ra] < sortColumns->time[rb]) ? -1 : 1;
+    }
+    return (ra < rb) ? -1 : (ra > rb);
+}
+
+uint8_t writeColumns_WindOpCsv(FILE * out, const WindOpColumns * cols) {
+    uint32_t * order;
+    uint32_t i;
+    uint32_t j;
+    uint32_t row;
+    uint8_t ch;
+    uint8_t valid;
+    double value[WINDOP_NUM_CHANNELS];
+    const WindOpTypeInfo * info;
+    WindOpTimeFormat fmt;
+
+    order = malloc((cols->numRows + 1) * sizeof(uint32_t));
+    if (order == NULL) {
+        return WINDOP_ERR_MEMORY;
+    }
+    init_WindOpTimeFormat(&fmt);
+    for (i = 0; i < cols->numRows; i++) {
+        order[i] = i;
+    }
+    sortColumns = cols;
+    qsort(order, cols->numRows, sizeof(uint32_t), compareRows);
+
+    writeHeader_WindOpCsv(out);
+    for (i = 0; i < cols->numRows; i = j) {
+        // Merge every row with this time stamp
+        valid = 0;
+        for (j = i; (j < cols->numRows) && (cols->time[order[j]] == cols->time[order[i]]); j++) {
+            row = order[j];
+            info = info_WindOpDataType(cols->dataType[row]);
+            for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+                if (cols->valid[row] & (1 << ch)) {
+                    value[ch] = info->scale[ch] * cols->channel[ch][row];
+                }
+            }
+            valid |= cols->valid[row];
+        }
+        writeRow_WindOpCsv(out, &fmt, cols->time[order[i]], valid, value);
+    }
+
+    free(order);
+    return WINDOP_OK;
+}
+
+static uint32_t digits(const char * str, uint8_t count) {
+    uint32_t value = 0;
+    uint8_t i;
+
+    for (i = 0; i < count; i++) {
+        value = value * 10 + (str[i] - '0');
+    }
+    return value;
+}
+
+uint8_t parseTime_WindOpCsv(const char * str, int64_t * time) {
+    Calendar cal;
+    uint8_t i;
+
+    for (i = 0; i < 14; i++) {
+        if ((str[i] < '0') || (str[i] > '9')) {
+            return WINDOP_ERR_TIME;
+        }
+    }
+    memset(&cal, 0, sizeof(cal));
+    cal.Year = digits(&str[0], 4);
+    cal.Month = digits(&str[4], 2);
+    cal.DayOfMonth = digits(&str[6], 2);
+    cal.Hours = digits(&str[8], 2);
+    cal.Minutes = digits(&str[10], 2);
+    cal.Seconds = digits(&str[12], 2);
+    if (check_WindOpMinuteTime(&cal) != WINDOP_OK) {
+        return WINDOP_ERR_TIME;
+    }
+    *time = epoch_WindOpCalendar(&cal);
+    return WINDOP_OK;
+}
+
+uint8_t parseRow_WindOpCsv(const char * line, int64_t * time, uint8_t * valid, double * value) {
+    const char * p = line;
+    char * end;
+    uint8_t ch;
+    uint8_t result;
+
+    result = parseTime_WindOpCsv(p, time);
+    if (result != WINDOP_OK) {
+        return (p[0] == 't') ? WINDOP_ERR_FORMAT : result;
+    }
+    p += 14;
+    if (*p++ != ',') {
+        return WINDOP_ERR_FORMAT;
+    }
+
+    *valid = 0;
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        if ((*p == ',') || (*p == '\0') || (*p == '\n') || (*p == '\r')) {
+            p += (*p == ',');
+            continue;
+        }
+        value[ch] = strtod(p, &end);
+        if ((end == p) || ((*end != ',') && (ch != WINDOP_NUM_CHANNELS - 1))) {
+            return WINDOP_ERR_FORMAT;
+        }
+        *valid |= 1 << ch;
+        p = (*end == ',') ? end + 1 : end;
+    }
+
+    return WINDOP_OK;
+}
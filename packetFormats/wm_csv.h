@@ -0,0 +1,84 @@
+/*
+ ============================================================================
+ Name        : wm_csv.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Perl compatible CSV reading and writing
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_CSV_H
+#define WM_CSV_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wm_codec.h"
+#include "wm_batch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ****************************************************************************
+ *
+ * The CSV written by the s1_wm_*_fetchUnpack.pl scripts
+ *
+ *     time,ws,wsa,wsm,wd,tmp,pres,hum,bv,
+ *     20170826110000,3.33,5.06,0,256,,,,,
+ *
+ * time is YYYYMMDDhhmmss UTC, every value is scaled to units and a channel
+ * with no reading is left empty. Each line ends with a trailing comma.
+ *
+ * */
+void writeHeader_WindOpCsv(FILE * out);
+// fmt caches the day prefix across rows, see init_WindOpTimeFormat
+void writeRow_WindOpCsv(FILE * out, WindOpTimeFormat * fmt, int64_t time, uint8_t valid, const double * value);
+
+/*
+ * Write the decoded rows sorted by time. Rows sharing a time stamp are merged
+ * into one line, a later packet overwriting an earlier one as the Perl result
+ * hash does. Returns a WINDOP_* code.
+ */
+uint8_t writeColumns_WindOpCsv(FILE * out, const WindOpColumns * cols);
+
+/*
+ * Parse one data line. valid gets bit n set for each non empty channel n,
+ * value[n] its scaled value. Returns WINDOP_ERR_TIME for a bad time stamp
+ * and WINDOP_ERR_FORMAT for anything else that does not parse, including the
+ * header line.
+ */
+uint8_t parseRow_WindOpCsv(const char * line, int64_t * time, uint8_t * valid, double * value);
+
+// YYYYMMDDhhmmss to epoch seconds, returns a WINDOP_* code
+uint8_t parseTime_WindOpCsv(const char * str, int64_t * time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_CSV_H
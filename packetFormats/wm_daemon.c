@@ -0,0 +1,1266 @@
+/*
+ ============================================================================
+ Name        : wm_daemon.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Resident decode service on a Unix socket or stdin
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wm_codec.h"
+#include "wm_base64.h"
+#include "wm_batch.h"
+#include "wm_csv.h"
+#include "wm_dedup.h"
+#include "wm_json.h"
+#include "wm_metrics.h"
+#include "wm_rollup.h"
+
+static const char * helpText =
+"\n"
+"   WindOp decode daemon\n"
+"\n"
+"   Keeps the duplicate filter, minute coverage and rollups in memory and\n"
+"   answers requests over a Unix socket, or over stdin and stdout, so a\n"
+"   poll pays for a request rather than for starting the decoders.\n"
+"\n"
+"      wm_daemon [options]            : Serve stdin and stdout\n"
+"      wm_daemon -socket path         : Serve connections on path\n"
+"      wm_daemon -send path           : Send requests read from stdin to the\n"
+"                                       daemon on path, print the replies and\n"
+"                                       report the round trip times\n"
+"\n"
+"      -state file            : Restore the rollups from file, SAVE and\n"
+"                               shutting down write them back\n"
+"      -dedup n               : Catch duplicates up to n uplinks apart,\n"
+"                               default 262144, 0 keeps them\n"
+"      -replay file           : Feed a TTN storage dump before serving, in\n"
+"                               place of a fetch\n"
+"      -metrics port          : Answer Prometheus scrapes on 127.0.0.1:port\n"
+"      -metrics-file file     : Write the decode metrics to file every\n"
+"                               -metrics-every seconds, default 15, and on\n"
+"                               exit, for a textfile collector\n"
+"      -help                  : Prints this\n"
+"\n"
+"   Requests are a line, followed by count body lines where the request\n"
+"   has a count. A count line with anything after the count is refused on\n"
+"   its own and takes no body lines.\n"
+"\n"
+"      UP count               : Ingest count 'device base64' lines\n"
+"      UPHEX count            : Ingest count 'device hex' lines\n"
+"      UPRAW count            : Ingest count records, a 'device' line then\n"
+"                               the packet bytes, framed by its length byte\n"
+"      DECODE count           : Decode count base64 lines, reply the CSV\n"
+"                               without touching the state\n"
+"      ROLL device level [from to] : Rollup of device at 10min, hour or day,\n"
+"                               times YYYYMMDDhhmmss\n"
+"      GAPS device            : Missing minutes of device\n"
+"      REPLAY file            : Ingest a TTN storage dump, on a worker while\n"
+"                               other clients are served, one at a time\n"
+"      STATS                  : Counters and service times\n"
+"      METRICS                : Decode metrics, Prometheus text format\n"
+"      SAVE                   : Write the rollups to the -state file\n"
+"      PING, QUIT, SHUTDOWN\n"
+"\n"
+"   Each reply is 'OK lines [key=value...]' followed by lines lines, or\n"
+"   'ERR message'. Replies come in request order, a client that stops\n"
+"   reading them is not read from until its socket takes them again.\n"
+"\n";
+
+#define DEFAULT_DEDUP            262144
+#define MAX_CLIENTS              64
+#define MAX_REQUEST_BYTES        (4u << 20) // A batch bigger than this is refused
+#define MAX_PENDING_BYTES        (4u << 20) // Replies held for a slow reader before its requests wait
+#define MAX_GAPS                 (WINDOP_COVERAGE_MINUTES / 2)
+#define MAX_WORDS                8
+#define DEFAULT_METRICS_EVERY    15
+#define SCRAPE_WAIT_MS           200  // For the scraper's request, which is read and ignored
+#define MAX_SCRAPES              8    // Scrapes answered at once, more are closed
+
+static const char * levelNames[WINDOP_ROLLUP_LEVELS] = { "10min", "hour", "day" };
+
+typedef struct daemonCfg {
+    const char * socketPath;
+    const char * sendPath;
+    const char * stateFile;
+    const char * replayFile;
+    const char * metricsFile;
+    uint32_t metricsEvery;    // Seconds
+    uint16_t metricsPort;
+    uint32_t dedup;
+} daemonCfg;
+
+typedef struct replayJob replayJob;
+
+typedef struct daemonState {
+    const daemonCfg * cfg;
+    pthread_mutex_t lock;     // Held by the loop for a request and by a replay for an uplink
+    replayJob * job;          // NULL replays in line, on stdin where nothing else waits
+    WindOpDedup dedup;
+    WindOpCoverage cover;
+    WindOpRollup rollup;
+    WindOpRollupStats * stats;
+    WindOpGap * gaps;
+
+    // Totals
+    uint64_t uplinks;
+    uint64_t duplicates;
+    uint64_t failed;
+    uint64_t requests;
+    uint64_t serviceNs;
+    uint64_t maxServiceNs;
+} daemonState;
+
+typedef struct client {
+    int in;
+    int out;
+    char * buffer;
+    uint32_t length;
+    uint32_t capacity;
+    char * pending;           // Replies not yet taken by the socket
+    size_t pendingLength;
+    size_t pendingSent;
+    size_t pendingCapacity;
+    uint64_t id;
+    uint8_t waiting;          // A REPLAY runs for it, its later requests wait
+    uint8_t closing;          // Closed once pending is written
+} client;
+
+// One REPLAY at a time runs on a worker, which writes a byte to wake when done
+struct replayJob {
+    daemonState * state;
+    pthread_t thread;
+    char path[512];
+    uint64_t client;
+    uint32_t counts[3];
+    uint8_t status;
+    uint8_t running;
+    int wake[2];
+};
+
+static volatile sig_atomic_t stopping;
+
+static void onSignal(int sig) {
+    (void) sig;
+    stopping = 1;
+}
+
+static void outOfMemory(void) {
+    fprintf(stderr, "ERROR out of memory\n");
+    exit(EXIT_FAILURE);
+}
+
+static uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static uint8_t writeAll(int fd, const char * data, size_t length) {
+    ssize_t written;
+
+    while (length > 0) {
+        written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return WINDOP_ERR_FORMAT;
+        }
+        data += written;
+        length -= (size_t) written;
+    }
+    return WINDOP_OK;
+}
+
+/* ****************************************************************************
+ *
+ * State updates, one uplink through the filter, coverage and rollups
+ *
+ * */
+static void ingest(daemonState * state, const char * device, const uint8_t * packet, uint32_t length,
+                   uint32_t * counts) {
+    uint8_t status;
+
+    state->uplinks++;
+    if ((state->cfg->dedup != 0) && check_WindOpDedup(&state->dedup, key_WindOpDedup(device, packet, length))) {
+        state->duplicates++;
+        counts[1]++;
+        return;
+    }
+    status = addPacket_WindOpRollup(&state->rollup, device, packet, length);
+    if (status == WINDOP_OK) {
+        status = addPacket_WindOpCoverage(&state->cover, device, packet, length);
+    }
+    if (status == WINDOP_ERR_MEMORY) {
+        outOfMemory();
+    }
+    if (status != WINDOP_OK) {
+        state->failed++;
+        counts[2]++;
+        return;
+    }
+    counts[0]++;
+}
+
+typedef struct replayCtx {
+    daemonState * state;
+    pthread_mutex_t * lock;   // NULL when nothing else touches the state
+    uint32_t counts[3];       // Accepted, duplicate, failed
+} replayCtx;
+
+static void onUplink(void * context, const WindOpUplink * uplink) {
+    replayCtx * ctx = context;
+    uint8_t packet[WINDOP_JSON_RAW_SIZE];
+    int32_t length;
+
+    length = decode_WindOpBase64(uplink->raw, uplink->rawLength, packet, sizeof(packet));
+    if (ctx->lock != NULL) {
+        pthread_mutex_lock(ctx->lock);
+    }
+    if (length < 0) {
+        ctx->state->failed++;
+        ctx->counts[2]++;
+    } else {
+        ingest(ctx->state, uplink->device, packet, (uint32_t) length, ctx->counts);
+    }
+    if (ctx->lock != NULL) {
+        pthread_mutex_unlock(ctx->lock);
+    }
+}
+
+// Parsing runs outside lock, which is only held to ingest each uplink
+static uint8_t replay(daemonState * state, const char * path, pthread_mutex_t * lock, uint32_t * counts) {
+    WindOpJsonReader reader;
+    replayCtx ctx;
+    FILE * in;
+    uint8_t status;
+
+    memset(counts, 0, 3 * sizeof(uint32_t)); // A file that won't open replays nothing
+    if ((in = fopen(path, "r")) == NULL) {
+        return WINDOP_ERR_FORMAT;
+    }
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.state = state;
+    ctx.lock = lock;
+    if (init_WindOpJsonReader(&reader, in, NULL, 0) != WINDOP_OK) {
+        outOfMemory();
+    }
+    status = read_WindOpTtnJson(&reader, onUplink, &ctx);
+    free_WindOpJsonReader(&reader);
+    fclose(in);
+    memcpy(counts, ctx.counts, sizeof(ctx.counts));
+    return status;
+}
+
+static void * replayWorker(void * arg) {
+    replayJob * job = arg;
+    const char done = 1;
+
+    job->status = replay(job->state, job->path, &job->state->lock, job->counts);
+    while ((write(job->wake[1], &done, 1) < 0) && (errno == EINTR)) {
+    }
+    return NULL;
+}
+
+static uint8_t saveState(const daemonState * state) {
+    FILE * file;
+    uint8_t status;
+
+    if ((state->cfg->stateFile == NULL) || ((file = fopen(state->cfg->stateFile, "wb")) == NULL)) {
+        return WINDOP_ERR_FORMAT;
+    }
+    status = save_WindOpRollup(&state->rollup, file);
+    if (fclose(file) != 0) {
+        status = WINDOP_ERR_FORMAT;
+    }
+    return status;
+}
+
+/* ****************************************************************************
+ *
+ * Framing. A request is complete once its line and, for the batch verbs,
+ * all count body records are in the buffer. frameLength gives its bytes,
+ * 0 while more are needed.
+ *
+ * */
+#define NUM_BATCH_VERBS          4
+#define BATCH_UPHEX              1
+#define BATCH_UPRAW              2
+#define BATCH_DECODE             3
+
+static const char * batchVerbs[NUM_BATCH_VERBS] = { "UP", "UPHEX", "UPRAW", "DECODE" };
+
+static const char * lineEnd(const char * p, const char * end) {
+    const char * nl = memchr(p, '\n', (size_t) (end - p));
+    return (nl != NULL) ? nl + 1 : NULL;
+}
+
+// Index of word in batchVerbs, NUM_BATCH_VERBS when it is not one
+static uint32_t batchVerb(const char * word, size_t size) {
+    uint32_t i;
+
+    for (i = 0; (i < NUM_BATCH_VERBS) && ((strlen(batchVerbs[i]) != size) || (memcmp(word, batchVerbs[i], size) != 0));
+         i++) {
+    }
+    return i;
+}
+
+static uint8_t isSpace(char c) {
+    return (c == ' ') || (c == '\r') || (c == '\n');
+}
+
+/* A batch request line, up to end, is a batch verb and a count, split as
+ * splitWords splits, and nothing else. Only then does it carry a body, so
+ * a line with a stray word is framed alone and answered ERR rather than
+ * swallowing body lines the client meant for it. Returns the verb, or
+ * NUM_BATCH_VERBS when the line is not a batch request.
+ * */
+static uint32_t batchCount(const char * line, const char * end, unsigned long * count) {
+    const char * word[2] = { NULL, NULL };
+    size_t size[2] = { 0, 0 };
+    const char * p = line;
+    uint32_t n = 0;
+    size_t i;
+
+    while (p < end) {
+        if (isSpace(*p)) {
+            p++;
+            continue;
+        }
+        if (n == 2) {
+            return NUM_BATCH_VERBS;
+        }
+        word[n] = p;
+        while ((p < end) && !isSpace(*p)) {
+            p++;
+        }
+        size[n] = (size_t) (p - word[n]);
+        n++;
+    }
+    if ((n != 2) || (size[1] > 9)) {
+        return NUM_BATCH_VERBS;
+    }
+    for (i = 0, *count = 0; i < size[1]; i++) {
+        if ((word[1][i] < '0') || (word[1][i] > '9')) {
+            return NUM_BATCH_VERBS;
+        }
+        *count = *count * 10 + (unsigned long) (word[1][i] - '0');
+    }
+    return batchVerb(word[0], size[0]);
+}
+
+static uint32_t frameLength(const char * buffer, uint32_t length) {
+    const char * end = buffer + length;
+    const char * p = lineEnd(buffer, end);
+    unsigned long count;
+    unsigned long i;
+    uint32_t verb;
+
+    if (p == NULL) {
+        return 0;
+    }
+    if ((verb = batchCount(buffer, p, &count)) == NUM_BATCH_VERBS) {
+        return (uint32_t) (p - buffer);
+    }
+    for (i = 0; (i < count) && (p != NULL); i++) {
+        p = lineEnd(p, end);
+        if ((verb == BATCH_UPRAW) && (p != NULL)) {
+            // Packet bytes after the device line, its length byte says how many
+            if ((end - p < WINDOP_PACKET_HEADER_SIZE) || (end - p < (uint8_t) p[1])) {
+                return 0;
+            }
+            p += ((uint8_t) p[1] < WINDOP_PACKET_HEADER_SIZE) ? WINDOP_PACKET_HEADER_SIZE : (uint8_t) p[1];
+        }
+    }
+    return (p != NULL) ? (uint32_t) (p - buffer) : 0;
+}
+
+// Split line in place on spaces, returns the number of words
+static uint32_t splitWords(char * line, char ** words) {
+    uint32_t n = 0;
+    char * save;
+    char * word;
+
+    for (word = strtok_r(line, " \r\n", &save); (word != NULL) && (n < MAX_WORDS);
+         word = strtok_r(NULL, " \r\n", &save)) {
+        words[n++] = word;
+    }
+    return n;
+}
+
+/* ****************************************************************************
+ *
+ * Requests. Each handler writes its reply lines to body and returns the
+ * status line, the caller counts the lines and sends both.
+ *
+ * */
+typedef struct reply {
+    FILE * body;
+    char status[160];
+    uint8_t stop;             // 1 closes the connection, 2 stops the daemon
+    uint8_t deferred;         // The replay worker sends the reply
+} reply;
+
+static void upload(daemonState * state, uint32_t verb, unsigned long count, char * p, const char * end,
+                   reply * out) {
+    uint8_t packet[WINDOP_MAX_PACKET_LENGTH + 1];
+    uint32_t counts[3] = { 0, 0, 0 };
+    const uint8_t raw = (verb == BATCH_UPRAW);
+    const uint8_t hex = (verb == BATCH_UPHEX);
+    unsigned long i;
+    char * device;
+    char * payload;
+    char * next;
+    int32_t length;
+
+    for (i = 0; (i < count) && (p < end); i++) {
+        next = (char *) lineEnd(p, end);
+        next[-1] = '\0';
+        device = p;
+        if (raw) {
+            length = ((uint8_t) next[1] < WINDOP_PACKET_HEADER_SIZE) ? WINDOP_PACKET_HEADER_SIZE : (uint8_t) next[1];
+            memcpy(packet, next, (size_t) length);
+            p = next + length;
+        } else {
+            p = next;
+            payload = strchr(device, ' ');
+            if (payload == NULL) {
+                counts[2]++;
+                state->failed++;
+                continue;
+            }
+            *payload++ = '\0';
+            length = (int32_t) strcspn(payload, "\r");
+            length = hex ? decode_WindOpHex(payload, (uint32_t) length, packet, sizeof(packet))
+                         : decode_WindOpBase64(payload, (uint32_t) length, packet, sizeof(packet));
+            if (length < 0) {
+                counts[2]++;
+                state->failed++;
+                continue;
+            }
+        }
+        ingest(state, device, packet, (uint32_t) length, counts);
+    }
+    snprintf(out->status, sizeof(out->status), "accepted=%u duplicate=%u failed=%u", counts[0], counts[1],
+             counts[2]);
+}
+
+static void decode(unsigned long count, char * p, const char * end, reply * out) {
+    uint8_t packet[WINDOP_MAX_PACKET_LENGTH + 1];
+    WindOpColumns cols;
+    unsigned long i;
+    uint32_t failed = 0;
+    int32_t length;
+    char * next;
+
+    if (init_WindOpColumns(&cols, 256) != WINDOP_OK) {
+        outOfMemory();
+    }
+    for (i = 0; (i < count) && (p < end); i++, p = next) {
+        next = (char *) lineEnd(p, end);
+        length = decode_WindOpBase64(p, (uint32_t) strcspn(p, "\r\n"), packet, sizeof(packet));
+        if ((length < 0) ||
+            (reserve_WindOpColumns(&cols, maxReadings_WindOpPacket(packet, (uint32_t) length)) != WINDOP_OK) ||
+            (decode_WindOpPacketColumns(packet, (uint32_t) length, (uint32_t) i, &cols) != WINDOP_OK)) {
+            failed++;
+        }
+    }
+    if (writeColumns_WindOpCsv(out->body, &cols) != WINDOP_OK) {
+        outOfMemory();
+    }
+    snprintf(out->status, sizeof(out->status), "readings=%u failed=%u", cols.numRows, failed);
+    free_WindOpColumns(&cols);
+}
+
+static void rollupRows(daemonState * state, char ** words, uint32_t numWords, reply * out) {
+    WindOpTimeFormat fmt;
+    WindOpRollupStats * s;
+    char key[WINDOP_TIME_KEY_SIZE];
+    int64_t from = INT64_MIN;
+    int64_t to = INT64_MAX;
+    uint32_t count;
+    uint32_t i;
+    uint8_t level;
+
+    for (level = 0; (level < WINDOP_ROLLUP_LEVELS) && (strcmp(words[2], levelNames[level]) != 0); level++) {
+    }
+    if ((level == WINDOP_ROLLUP_LEVELS) ||
+        ((numWords > 3) && (parseTime_WindOpCsv(words[3], &from) != WINDOP_OK)) ||
+        ((numWords > 4) && (parseTime_WindOpCsv(words[4], &to) != WINDOP_OK))) {
+        snprintf(out->status, sizeof(out->status), "ERR ROLL wants device 10min|hour|day [from to]");
+        return;
+    }
+    count = read_WindOpRollup(&state->rollup, words[1], level, from, to, state->stats, slots_WindOpRollup(level));
+    init_WindOpTimeFormat(&fmt);
+    fprintf(out->body, "device,time,wind_n,ws_mean,ws_min,ws_max,gust,wd,wd_steady,bv_n,bv_mean,bv_min,bv_max,bv_slope\n");
+    for (i = 0; i < count; i++) {
+        s = &state->stats[i];
+        format_WindOpTime(&fmt, s->start, key);
+        fprintf(out->body, "%s,%s,%u,%.2f,%.2f,%.2f,%.2f,%.0f,%.3f,%u,%.3f,%.3f,%.3f,%.4f\n", words[1], key,
+                s->windCount, s->wsMean, s->wsMin, s->wsMax, s->gust, s->wd, s->wdSteadiness, s->bvCount,
+                s->bvMean, s->bvMin, s->bvMax, s->bvSlope);
+    }
+    snprintf(out->status, sizeof(out->status), "buckets=%u", count);
+}
+
+static void gapRows(daemonState * state, const char * device, reply * out) {
+    const WindOpCoverageDevice * dev = NULL;
+    WindOpTimeFormat fmt;
+    char from[WINDOP_TIME_KEY_SIZE];
+    char to[WINDOP_TIME_KEY_SIZE];
+    uint32_t count;
+    uint32_t i;
+
+    for (i = 0; (i < state->cover.numDevices) && (dev == NULL); i++) {
+        dev = (strcmp(state->cover.devices[i].name, device) == 0) ? &state->cover.devices[i] : NULL;
+    }
+    if (dev == NULL) {
+        snprintf(out->status, sizeof(out->status), "ERR no device %.64s", device);
+        return;
+    }
+    count = gaps_WindOpCoverage(dev, state->gaps, MAX_GAPS);
+    count = (count < MAX_GAPS) ? count : MAX_GAPS;
+    init_WindOpTimeFormat(&fmt);
+    fprintf(out->body, "from,to,minutes\n");
+    for (i = 0; i < count; i++) {
+        format_WindOpTime(&fmt, state->gaps[i].from, from);
+        format_WindOpTime(&fmt, state->gaps[i].to, to);
+        fprintf(out->body, "%s,%s,%u\n", from, to, state->gaps[i].minutes);
+    }
+    snprintf(out->status, sizeof(out->status), "minutes=%u covered=%u late=%lu", windowMinutes_WindOpCoverage(dev),
+             count_WindOpCoverage(dev), (unsigned long) dev->late);
+}
+
+static void statRows(const daemonState * state, reply * out) {
+    fprintf(out->body, "uplinks=%lu\n", (unsigned long) state->uplinks);
+    fprintf(out->body, "duplicates=%lu\n", (unsigned long) state->duplicates);
+    fprintf(out->body, "failed=%lu\n", (unsigned long) state->failed);
+    fprintf(out->body, "devices=%u\n", state->rollup.numDevices);
+    fprintf(out->body, "readings=%lu\n", (unsigned long) state->rollup.readings);
+    fprintf(out->body, "late=%lu\n", (unsigned long) state->rollup.late);
+    fprintf(out->body, "dedup_bytes=%lu\n", (unsigned long) bytes_WindOpDedup(&state->dedup));
+    fprintf(out->body, "requests=%lu\n", (unsigned long) state->requests);
+    fprintf(out->body, "service_mean_us=%.1f\n",
+            (state->requests != 0) ? state->serviceNs / 1e3 / (double) state->requests : 0.0);
+    fprintf(out->body, "service_max_us=%.1f\n", state->maxServiceNs / 1e3);
+}
+
+static void metricRows(reply * out) {
+    WindOpMetrics m;
+
+    snapshot_WindOpMetrics(&m);
+    write_WindOpMetrics(out->body, &m);
+}
+
+// A worker replays while the loop serves, only the asking client waits for it
+static void replayRequest(daemonState * state, const char * path, reply * out) {
+    replayJob * job = state->job;
+    uint32_t counts[3];
+
+    if (job == NULL) {
+        if (replay(state, path, NULL, counts) != WINDOP_OK) {
+            snprintf(out->status, sizeof(out->status), "ERR can't replay %.64s", path);
+        } else {
+            snprintf(out->status, sizeof(out->status), "accepted=%u duplicate=%u failed=%u", counts[0], counts[1],
+                     counts[2]);
+        }
+    } else if (job->running) {
+        snprintf(out->status, sizeof(out->status), "ERR a replay is already running");
+    } else if (strlen(path) >= sizeof(job->path)) {
+        snprintf(out->status, sizeof(out->status), "ERR replay path is too long");
+    } else {
+        strcpy(job->path, path);
+        if (pthread_create(&job->thread, NULL, replayWorker, job) != 0) {
+            snprintf(out->status, sizeof(out->status), "ERR can't start a replay");
+        } else {
+            job->running = 1;
+            out->deferred = 1;
+        }
+    }
+}
+
+static void handle(daemonState * state, char * frame, uint32_t length, reply * out) {
+    char * end = frame + length;
+    char * body = (char *) lineEnd(frame, end);
+    char * words[MAX_WORDS];
+    unsigned long count = 0;
+    uint32_t verb = batchCount(frame, body, &count);
+    uint32_t numWords;
+
+    body[-1] = '\0';
+    numWords = splitWords(frame, words);
+    out->status[0] = '\0';
+    if (numWords == 0) {
+        snprintf(out->status, sizeof(out->status), "ERR empty request");
+    } else if (verb == BATCH_DECODE) {
+        decode(count, body, end, out);
+    } else if (verb != NUM_BATCH_VERBS) {
+        upload(state, verb, count, body, end, out);
+    } else if (batchVerb(words[0], strlen(words[0])) != NUM_BATCH_VERBS) {
+        snprintf(out->status, sizeof(out->status), "ERR %s wants a count and nothing more", words[0]);
+    } else if ((numWords >= 3) && (strcmp(words[0], "ROLL") == 0)) {
+        rollupRows(state, words, numWords, out);
+    } else if ((numWords == 2) && (strcmp(words[0], "GAPS") == 0)) {
+        gapRows(state, words[1], out);
+    } else if ((numWords == 2) && (strcmp(words[0], "REPLAY") == 0)) {
+        replayRequest(state, words[1], out);
+    } else if ((numWords == 1) && (strcmp(words[0], "STATS") == 0)) {
+        statRows(state, out);
+    } else if ((numWords == 1) && (strcmp(words[0], "METRICS") == 0)) {
+        metricRows(out);
+    } else if ((numWords == 1) && (strcmp(words[0], "SAVE") == 0)) {
+        if (saveState(state) != WINDOP_OK) {
+            snprintf(out->status, sizeof(out->status), "ERR can't save, is -state given");
+        }
+    } else if ((numWords == 1) && (strcmp(words[0], "PING") == 0)) {
+    } else if ((numWords == 1) && (strcmp(words[0], "QUIT") == 0)) {
+        out->stop = 1;
+    } else if ((numWords == 1) && (strcmp(words[0], "SHUTDOWN") == 0)) {
+        out->stop = 2;
+    } else {
+        snprintf(out->status, sizeof(out->status), "ERR unknown request %.32s", words[0]);
+    }
+}
+
+/* ****************************************************************************
+ *
+ * Replies queue on the client and go out as its socket takes them, so a
+ * client that stops reading holds up only itself
+ *
+ * */
+static size_t pendingBytes(const client * c) {
+    return c->pendingLength - c->pendingSent;
+}
+
+static void queueBytes(client * c, const char * data, size_t size) {
+    char * grown;
+    size_t capacity;
+
+    if (c->pendingSent != 0) {
+        memmove(c->pending, &c->pending[c->pendingSent], pendingBytes(c));
+        c->pendingLength -= c->pendingSent;
+        c->pendingSent = 0;
+    }
+    if (c->pendingCapacity - c->pendingLength < size) {
+        for (capacity = c->pendingCapacity ? c->pendingCapacity : 65536; capacity - c->pendingLength < size;
+             capacity *= 2) {
+        }
+        if ((grown = realloc(c->pending, capacity)) == NULL) {
+            outOfMemory();
+        }
+        c->pending = grown;
+        c->pendingCapacity = capacity;
+    }
+    memcpy(&c->pending[c->pendingLength], data, size);
+    c->pendingLength += size;
+}
+
+// The status line and, unless it is an ERR, the size bytes of lines in text
+static void queueReply(client * c, const char * status, const char * text, size_t size) {
+    char head[200];
+    uint32_t lines;
+    size_t i;
+
+    if (strncmp(status, "ERR", 3) == 0) {
+        snprintf(head, sizeof(head), "%s\n", status);
+        size = 0;
+    } else {
+        for (i = 0, lines = 0; i < size; i++) {
+            lines += (text[i] == '\n');
+        }
+        snprintf(head, sizeof(head), "OK %u%s%s\n", lines, status[0] ? " " : "", status);
+    }
+    queueBytes(c, head, strlen(head));
+    queueBytes(c, text, size);
+}
+
+// Write what the client's socket takes, WINDOP_OK unless the connection is gone
+static uint8_t flushClient(client * c) {
+    ssize_t written;
+
+    while (pendingBytes(c) > 0) {
+        written = write(c->out, &c->pending[c->pendingSent], pendingBytes(c));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? WINDOP_OK : WINDOP_ERR_FORMAT;
+        }
+        c->pendingSent += (size_t) written;
+    }
+    c->pendingLength = 0;
+    c->pendingSent = 0;
+    return WINDOP_OK;
+}
+
+// Serve the complete requests in the client's buffer while its replies fit, returns reply.stop
+static uint8_t serve(daemonState * state, client * c) {
+    reply out;
+    char * text;
+    size_t size;
+    uint64_t start;
+    uint64_t elapsed;
+    uint32_t used = 0;
+    uint32_t frame;
+
+    memset(&out, 0, sizeof(out));
+    while ((out.stop == 0) && !c->waiting && (pendingBytes(c) < MAX_PENDING_BYTES) &&
+           ((frame = frameLength(&c->buffer[used], c->length - used)) != 0)) {
+        start = nowNs();
+        text = NULL;
+        size = 0;
+        if ((out.body = open_memstream(&text, &size)) == NULL) {
+            outOfMemory();
+        }
+        pthread_mutex_lock(&state->lock);
+        handle(state, &c->buffer[used], frame, &out);
+        elapsed = nowNs() - start;
+        state->requests++;
+        state->serviceNs += elapsed;
+        state->maxServiceNs = (elapsed > state->maxServiceNs) ? elapsed : state->maxServiceNs;
+        pthread_mutex_unlock(&state->lock);
+        fclose(out.body);
+        used += frame;
+
+        if (out.deferred) {
+            state->job->client = c->id;
+            c->waiting = 1;
+            out.deferred = 0;
+        } else {
+            queueReply(c, out.status, text, size);
+        }
+        free(text);
+    }
+    memmove(c->buffer, &c->buffer[used], c->length - used);
+    c->length -= used;
+    return out.stop;
+}
+
+/* Serve and write replies until the client's requests run out, it waits on
+ * a replay or its socket is full. Returns 2 to stop the daemon.
+ * */
+static uint8_t pump(daemonState * state, client * c) {
+    uint8_t stop = 0;
+
+    for (;;) {
+        if (!c->closing) {
+            stop = serve(state, c);
+            c->closing = (stop != 0);
+        }
+        if (flushClient(c) != WINDOP_OK) {
+            c->pendingLength = 0;
+            c->pendingSent = 0;
+            c->closing = 1;
+        }
+        if (c->closing || c->waiting || (pendingBytes(c) >= MAX_PENDING_BYTES) ||
+            (frameLength(c->buffer, c->length) == 0)) {
+            return stop;
+        }
+    }
+}
+
+// Read what the client has sent. Returns 0 to keep it, 1 to close it
+static uint8_t readClient(client * c) {
+    static const char tooLong[] = "ERR request over the size limit\n";
+    ssize_t got;
+    char * grown;
+
+    if (c->capacity - c->length < 4096) {
+        if (c->capacity >= MAX_REQUEST_BYTES) {
+            queueBytes(c, tooLong, sizeof(tooLong) - 1);
+            return 1;
+        }
+        grown = realloc(c->buffer, c->capacity ? 2 * c->capacity : 65536);
+        if (grown == NULL) {
+            outOfMemory();
+        }
+        c->buffer = grown;
+        c->capacity = c->capacity ? 2 * c->capacity : 65536;
+    }
+    got = read(c->in, &c->buffer[c->length], c->capacity - c->length);
+    if (got < 0) {
+        return ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : 1;
+    }
+    if (got == 0) {
+        return 1;
+    }
+    c->length += (uint32_t) got;
+    return 0;
+}
+
+static void freeClient(client * c) {
+    free(c->buffer);
+    free(c->pending);
+}
+
+/* ****************************************************************************
+ *
+ * Serving loops
+ *
+ * */
+static void serveStdio(daemonState * state) {
+    client c;
+
+    memset(&c, 0, sizeof(c));
+    c.out = 1;
+    while (!stopping && (pump(state, &c) == 0) && !c.closing && (readClient(&c) == 0)) {
+    }
+    flushClient(&c);
+    freeClient(&c);
+}
+
+static int listenOn(const char * path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "ERROR socket path %s is too long\n", path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((fd < 0) || (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) || (listen(fd, 16) != 0)) {
+        fprintf(stderr, "Can't listen on %s, %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+static int listenMetrics(uint16_t port) {
+    struct sockaddr_in addr;
+    int fd;
+    int on = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if ((fd < 0) || (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0) ||
+        (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) || (listen(fd, 16) != 0)) {
+        fprintf(stderr, "Can't listen on port %u, %s\n", port, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+static atomic_uint scrapes;   // Scrape threads running
+
+/* One scrape per connection, whatever was asked for gets the metrics. It
+ * runs on its own thread so waiting on the scraper never holds up the loop,
+ * snapshot_WindOpMetrics reads the counters from any thread.
+ * */
+static void * scrape(void * arg) {
+    static const char head[] = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n";
+    const int fd = (int) (intptr_t) arg;
+    struct pollfd request = { fd, POLLIN, 0 };
+    WindOpMetrics m;
+    char ignored[4096];
+    char * text = NULL;
+    size_t size = 0;
+    FILE * body;
+
+    if ((poll(&request, 1, SCRAPE_WAIT_MS) <= 0) || (read(fd, ignored, sizeof(ignored)) >= 0)) {
+        if ((body = open_memstream(&text, &size)) == NULL) {
+            outOfMemory();
+        }
+        snapshot_WindOpMetrics(&m);
+        write_WindOpMetrics(body, &m);
+        fclose(body);
+        if (writeAll(fd, head, sizeof(head) - 1) == WINDOP_OK) {
+            writeAll(fd, text, size);
+        }
+        free(text);
+    }
+    close(fd);
+    atomic_fetch_sub_explicit(&scrapes, 1, memory_order_relaxed);
+    return NULL;
+}
+
+static void startScrape(int fd) {
+    pthread_attr_t attr;
+    pthread_t thread;
+
+    if (atomic_fetch_add_explicit(&scrapes, 1, memory_order_relaxed) >= MAX_SCRAPES) {
+        atomic_fetch_sub_explicit(&scrapes, 1, memory_order_relaxed);
+        close(fd);
+        return;
+    }
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, scrape, (void *) (intptr_t) fd) != 0) {
+        atomic_fetch_sub_explicit(&scrapes, 1, memory_order_relaxed);
+        close(fd);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static void saveMetrics(const daemonCfg * cfg) {
+    if ((cfg->metricsFile != NULL) && (save_WindOpMetrics(cfg->metricsFile) != WINDOP_OK)) {
+        fprintf(stderr, "ERROR writing %s\n", cfg->metricsFile);
+    }
+}
+
+// Hand the finished replay's reply to the client that asked, if it is still here
+static void finishReplay(replayJob * job, client * clients, uint32_t numClients, struct pollfd * fds) {
+    char status[160];
+    char done;
+    uint32_t i;
+
+    while ((read(job->wake[0], &done, 1) < 0) && (errno == EINTR)) {
+    }
+    pthread_join(job->thread, NULL);
+    job->running = 0;
+    if (job->status != WINDOP_OK) {
+        snprintf(status, sizeof(status), "ERR can't replay %.64s", job->path);
+    } else {
+        snprintf(status, sizeof(status), "accepted=%u duplicate=%u failed=%u", job->counts[0], job->counts[1],
+                 job->counts[2]);
+    }
+    for (i = 0; i < numClients; i++) {
+        if (clients[i].waiting && (clients[i].id == job->client)) {
+            queueReply(&clients[i], status, NULL, 0);
+            clients[i].waiting = 0;
+            fds[i + 3].revents |= POLLOUT; // Pumped below with the clients that polled
+        }
+    }
+}
+
+/* fds[0] is the socket, fds[1] the metrics port or -1, fds[2] the replay
+ * wake pipe, clients follow. Client sockets never block, a client is only
+ * polled for requests while its replies fit under MAX_PENDING_BYTES.
+ * */
+static void serveSocket(daemonState * state, const char * path) {
+    struct pollfd fds[MAX_CLIENTS + 3];
+    client clients[MAX_CLIENTS];
+    replayJob job;
+    client * c;
+    const uint64_t every = (uint64_t) state->cfg->metricsEvery * 1000000000u;
+    uint64_t nextSave = nowNs() + every;
+    uint64_t nextId = 1;
+    uint64_t now;
+    uint32_t numClients = 0;
+    uint32_t i;
+    uint8_t stop = 0;
+    uint8_t gone;
+    int timeout = -1;
+    int fd;
+
+    memset(&job, 0, sizeof(job));
+    job.state = state;
+    if (pipe(job.wake) != 0) {
+        fprintf(stderr, "Can't make the replay pipe, %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    state->job = &job;
+    fds[0].fd = listenOn(path);
+    fds[0].events = POLLIN;
+    fds[1].fd = (state->cfg->metricsPort != 0) ? listenMetrics(state->cfg->metricsPort) : -1;
+    fds[1].events = POLLIN;
+    fds[2].fd = job.wake[0];
+    fds[2].events = POLLIN;
+    fprintf(stderr, "---Serving on %s\n", path);
+    while (!stopping && (stop < 2)) {
+        for (i = 0; i < numClients; i++) {
+            c = &clients[i];
+            fds[i + 3].fd = c->in;
+            fds[i + 3].events = (pendingBytes(c) > 0) ? POLLOUT : 0;
+            if (!c->closing && !c->waiting && (pendingBytes(c) < MAX_PENDING_BYTES)) {
+                fds[i + 3].events |= POLLIN;
+            }
+            fds[i + 3].revents = 0;
+        }
+        if (state->cfg->metricsFile != NULL) {
+            now = nowNs();
+            if (now >= nextSave) {
+                saveMetrics(state->cfg);
+                nextSave = now + every;
+            }
+            timeout = (int) ((nextSave - now) / 1000000u) + 1;
+        }
+        if (poll(fds, numClients + 3, timeout) <= 0) {
+            continue; // Timeout or EINTR, stopping is checked above
+        }
+        if (fds[2].revents & POLLIN) {
+            finishReplay(&job, clients, numClients, fds);
+        }
+        for (i = numClients; (i > 0) && (stop < 2); i--) {
+            c = &clients[i - 1];
+            if (fds[i + 2].revents == 0) {
+                continue;
+            }
+            gone = !(fds[i + 2].revents & (POLLIN | POLLOUT)); // Hung up, nothing more gets to it
+            if (fds[i + 2].revents & POLLIN) {
+                c->closing |= readClient(c);
+            }
+            if (!gone) {
+                stop = pump(state, c);
+            }
+            if (gone || (c->closing && !c->waiting && (pendingBytes(c) == 0))) {
+                close(c->in);
+                freeClient(c);
+                clients[i - 1] = clients[--numClients];
+            }
+        }
+        if ((fds[1].revents & POLLIN) && ((fd = accept(fds[1].fd, NULL, NULL)) >= 0)) {
+            startScrape(fd);
+        }
+        if ((fds[0].revents & POLLIN) && ((fd = accept(fds[0].fd, NULL, NULL)) >= 0)) {
+            if ((numClients == MAX_CLIENTS) || (fcntl(fd, F_SETFL, O_NONBLOCK) != 0)) {
+                close(fd);
+            } else {
+                memset(&clients[numClients], 0, sizeof(client));
+                clients[numClients].in = fd;
+                clients[numClients].out = fd;
+                clients[numClients].id = nextId++;
+                numClients++;
+            }
+        }
+    }
+    if (job.running) {
+        fprintf(stderr, "---Waiting for the replay of %s\n", job.path);
+        pthread_join(job.thread, NULL);
+    }
+    for (i = 0; i < numClients; i++) {
+        flushClient(&clients[i]); // The SHUTDOWN reply, if the socket takes it
+        close(clients[i].in);
+        freeClient(&clients[i]);
+    }
+    state->job = NULL;
+    close(job.wake[0]);
+    close(job.wake[1]);
+    if (fds[1].fd >= 0) {
+        close(fds[1].fd);
+    }
+    close(fds[0].fd);
+    unlink(path);
+}
+
+/* ****************************************************************************
+ *
+ * -send, a client that frames stdin into requests with the daemon's own
+ * rule and times each round trip
+ *
+ * */
+static void sendRequests(const char * path) {
+    struct sockaddr_un addr;
+    client in;
+    FILE * replies;
+    char * line = NULL;
+    size_t lineCapacity = 0;
+    uint64_t start;
+    uint64_t elapsed;
+    uint64_t total = 0;
+    uint64_t slowest = 0;
+    uint32_t requests = 0;
+    uint32_t frame;
+    uint32_t lines;
+    ssize_t got;
+    int fd;
+
+    memset(&in, 0, sizeof(in));
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((fd < 0) || (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0)) {
+        fprintf(stderr, "Can't connect to %s, %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if ((replies = fdopen(fd, "r")) == NULL) {
+        outOfMemory();
+    }
+
+    for (;;) {
+        frame = frameLength(in.buffer, in.length);
+        if (frame == 0) {
+            if (in.capacity - in.length < 4096) {
+                in.capacity = in.capacity ? 2 * in.capacity : 65536;
+                if ((in.buffer = realloc(in.buffer, in.capacity)) == NULL) {
+                    outOfMemory();
+                }
+            }
+            got = read(0, &in.buffer[in.length], in.capacity - in.length);
+            if (got <= 0) {
+                break;
+            }
+            in.length += (uint32_t) got;
+            continue;
+        }
+
+        start = nowNs();
+        if ((writeAll(fd, in.buffer, frame) != WINDOP_OK) || (getline(&line, &lineCapacity, replies) < 0)) {
+            fprintf(stderr, "ERROR the daemon closed the connection\n");
+            exit(EXIT_FAILURE);
+        }
+        fputs(line, stdout);
+        lines = (strncmp(line, "OK ", 3) == 0) ? (uint32_t) strtoul(&line[3], NULL, 10) : 0;
+        while ((lines-- > 0) && (getline(&line, &lineCapacity, replies) >= 0)) {
+            fputs(line, stdout);
+        }
+        elapsed = nowNs() - start;
+        total += elapsed;
+        slowest = (elapsed > slowest) ? elapsed : slowest;
+        requests++;
+
+        memmove(in.buffer, &in.buffer[frame], in.length - frame);
+        in.length -= frame;
+    }
+    fprintf(stderr, "---Sent %u requests, round trip mean %.1f us, max %.1f us\n", requests,
+            requests ? total / 1e3 / requests : 0.0, slowest / 1e3);
+    free(line);
+    free(in.buffer);
+    fclose(replies);
+}
+
+static void processCommandLine(int argc, char ** argv, daemonCfg * cfg) {
+    int i;
+    for (i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-socket") == 0) && (i + 1 < argc)) {
+            cfg->socketPath = argv[++i];
+        } else if ((strcmp(argv[i], "-send") == 0) && (i + 1 < argc)) {
+            cfg->sendPath = argv[++i];
+        } else if ((strcmp(argv[i], "-state") == 0) && (i + 1 < argc)) {
+            cfg->stateFile = argv[++i];
+        } else if ((strcmp(argv[i], "-replay") == 0) && (i + 1 < argc)) {
+            cfg->replayFile = argv[++i];
+        } else if ((strcmp(argv[i], "-metrics") == 0) && (i + 1 < argc)) {
+            cfg->metricsPort = (uint16_t) strtoul(argv[++i], NULL, 10);
+        } else if ((strcmp(argv[i], "-metrics-file") == 0) && (i + 1 < argc)) {
+            cfg->metricsFile = argv[++i];
+        } else if ((strcmp(argv[i], "-metrics-every") == 0) && (i + 1 < argc)) {
+            cfg->metricsEvery = (uint32_t) strtoul(argv[++i], NULL, 10);
+            cfg->metricsEvery = (cfg->metricsEvery != 0) ? cfg->metricsEvery : 1;
+        } else if ((strcmp(argv[i], "-dedup") == 0) && (i + 1 < argc)) {
+            cfg->dedup = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else {
+            printf("%s", helpText);
+            exit(EXIT_SUCCESS);
+        }
+    }
+}
+
+int main(int argc, char ** argv) {
+    daemonCfg cfg;
+    daemonState state;
+    struct sigaction action;
+    uint32_t counts[3];
+    FILE * file;
+    clock_t start;
+    uint32_t slots = 0;
+    uint8_t level;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.dedup = DEFAULT_DEDUP;
+    cfg.metricsEvery = DEFAULT_METRICS_EVERY;
+    processCommandLine(argc, argv, &cfg);
+    if (cfg.sendPath != NULL) {
+        sendRequests(cfg.sendPath);
+        return EXIT_SUCCESS;
+    }
+
+    memset(&state, 0, sizeof(state));
+    state.cfg = &cfg;
+    pthread_mutex_init(&state.lock, NULL);
+    if ((cfg.dedup != 0) && (init_WindOpDedup(&state.dedup, cfg.dedup) != WINDOP_OK)) {
+        outOfMemory();
+    }
+    init_WindOpCoverage(&state.cover);
+    init_WindOpRollup(&state.rollup);
+    for (level = 0; level < WINDOP_ROLLUP_LEVELS; level++) {
+        slots = (slots_WindOpRollup(level) > slots) ? slots_WindOpRollup(level) : slots;
+    }
+    state.stats = malloc(slots * sizeof(WindOpRollupStats));
+    state.gaps = malloc(MAX_GAPS * sizeof(WindOpGap));
+    if ((state.stats == NULL) || (state.gaps == NULL)) {
+        outOfMemory();
+    }
+
+    if ((cfg.stateFile != NULL) && ((file = fopen(cfg.stateFile, "rb")) != NULL)) {
+        if (restore_WindOpRollup(&state.rollup, file) != WINDOP_OK) {
+            fprintf(stderr, "ERROR %s is not a rollup snapshot\n", cfg.stateFile);
+            return EXIT_FAILURE;
+        }
+        fclose(file);
+        fprintf(stderr, "---Restored %u devices, %lu readings from %s\n", state.rollup.numDevices,
+                (unsigned long) state.rollup.readings, cfg.stateFile);
+    }
+    if (cfg.replayFile != NULL) {
+        start = clock();
+        if (replay(&state, cfg.replayFile, NULL, counts) != WINDOP_OK) {
+            fprintf(stderr, "ERROR %s stopped early\n", cfg.replayFile);
+        }
+        fprintf(stderr, "---Replayed %u uplinks, %u duplicates, %u failed in %.3f s\n", counts[0], counts[1],
+                counts[2], (double) (clock() - start) / CLOCKS_PER_SEC);
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (cfg.socketPath != NULL) {
+        serveSocket(&state, cfg.socketPath);
+    } else {
+        serveStdio(&state);
+    }
+
+    if ((cfg.stateFile != NULL) && (saveState(&state) != WINDOP_OK)) {
+        fprintf(stderr, "ERROR writing %s\n", cfg.stateFile);
+    }
+    saveMetrics(&cfg);
+    fprintf(stderr, "---Served %lu requests, %lu uplinks, %lu duplicates, %lu failed\n",
+            (unsigned long) state.requests, (unsigned long) state.uplinks, (unsigned long) state.duplicates,
+            (unsigned long) state.failed);
+    free(state.stats);
+    free(state.gaps);
+    free_WindOpRollup(&state.rollup);
+    free_WindOpCoverage(&state.cover);
+    free_WindOpDedup(&state.dedup);
+    pthread_mutex_destroy(&state.lock);
+    return EXIT_SUCCESS;
+}
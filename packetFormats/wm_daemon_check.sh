@@ -0,0 +1,94 @@
+#!/bin/sh
+# ============================================================================
+# Name        : wm_daemon_check.sh
+# Description : wm_daemon framing check, run by make check
+#
+#   wm_daemon_check.sh build
+#
+#   Pipes requests through the daemon on stdin and over its socket and
+#   compares every reply line, so a request that takes the wrong number of
+#   body lines shows up as replies out of step.
+# ============================================================================
+
+BUILD=${1:-build}
+DAEMON=$BUILD/wm_daemon
+WORK=$BUILD/daemon_check
+failed=0
+
+rm -rf "$WORK"
+mkdir -p "$WORK"
+
+# compare name expected actual
+compare() {
+    if cmp -s "$2" "$3"; then
+        echo "$1 : PASS"
+    else
+        echo "$1 : FAIL"
+        diff "$2" "$3"
+        failed=1
+    fi
+}
+
+"$BUILD"/wm_fleet -packets 3 -f b64 -o "$WORK"/up.b64 > /dev/null 2>&1
+"$BUILD"/wm_fleet -packets 50 -f json -o "$WORK"/replay.json > /dev/null 2>&1
+
+# A count line with anything more is a request on its own, its body lines
+# then come in as requests of their own and each is refused
+{
+    echo "UP 1 extra"
+    echo "node-a AQID"
+    echo "PING"
+    echo "DECODE"
+    echo "PING"
+    echo "UPHEX x"
+    echo "PING"
+    echo "UP 3"
+    sed 's/^/node-a /' "$WORK"/up.b64
+    echo "UP 3"
+    sed 's/^/node-a /' "$WORK"/up.b64
+    echo "UP 0"
+    echo "GAPS nobody"
+    echo "PING"
+} > "$WORK"/requests.txt
+
+cat > "$WORK"/expected.txt << EOF
+ERR UP wants a count and nothing more
+ERR unknown request node-a
+OK 0
+ERR DECODE wants a count and nothing more
+OK 0
+ERR UPHEX wants a count and nothing more
+OK 0
+OK 0 accepted=3 duplicate=0 failed=0
+OK 0 accepted=0 duplicate=3 failed=0
+OK 0 accepted=0 duplicate=0 failed=0
+ERR no device nobody
+OK 0
+EOF
+
+"$DAEMON" < "$WORK"/requests.txt > "$WORK"/stdio.txt 2> /dev/null
+compare "stdio framing" "$WORK"/expected.txt "$WORK"/stdio.txt
+
+# The same over the socket, framed by -send, then a replay on the worker
+"$DAEMON" -socket "$WORK"/daemon.sock 2> /dev/null &
+pid=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "$WORK"/daemon.sock ] && break
+    sleep 0.1
+done
+"$DAEMON" -send "$WORK"/daemon.sock < "$WORK"/requests.txt > "$WORK"/socket.txt 2> /dev/null
+compare "socket framing" "$WORK"/expected.txt "$WORK"/socket.txt
+
+printf 'REPLAY %s\nREPLAY %s\nPING\n' "$WORK"/replay.json "$WORK"/replay.json | \
+    "$DAEMON" -send "$WORK"/daemon.sock > "$WORK"/replay.txt 2> /dev/null
+printf 'OK 0 accepted=50 duplicate=0 failed=0\nOK 0 accepted=0 duplicate=50 failed=0\nOK 0\n' > "$WORK"/replayExpected.txt
+compare "socket replay" "$WORK"/replayExpected.txt "$WORK"/replay.txt
+
+echo "SHUTDOWN" | "$DAEMON" -send "$WORK"/daemon.sock > /dev/null 2>&1
+wait $pid
+
+if [ $failed -ne 0 ]; then
+    echo "** DAEMON TEST FAILED"
+    exit 1
+fi
+echo "** DAEMON TEST PASSED"
@@ -0,0 +1,281 @@
+/*
+ ============================================================================
+ Name        : wm_decode.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Command line batch decoder, packets in, CSV out
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_codec.h"
+#include "wm_batch.h"
+#include "wm_base64.h"
+#include "wm_csv.h"
+
+static const char * helpText =
+"\n"
+"   WindOp batch packet decoder\n"
+"\n"
+"   Reads one packet per line, as the hex string shown in the TTN data window\n"
+"   or the raw base64 payload, and writes the CSV produced by the\n"
+"   s1_wm_*_fetchUnpack.pl scripts. Readings sharing a time stamp are merged.\n"
+"\n"
+"      wm_decode [options] [file]     : Reads stdin when no file is given\n"
+"\n"
+"      -b64                   : Lines are base64, default is hex\n"
+"      -o file                : Write the CSV to file, default stdout\n"
+"      -quiet                 : Dont report packets that fail to decode\n"
+"      -schema                : Write the packet layouts and scales from\n"
+"                               wm_schema.h as a Perl module and exit\n"
+"      -help                  : Prints this\n"
+"\n";
+
+typedef struct decodeCfg {
+    const char * inFile;
+    const char * outFile;
+    uint8_t base64;
+    uint8_t quiet;
+    uint8_t schema;
+} decodeCfg;
+
+/* ****************************************************************************
+ *
+ * Packets loaded back to back with the offsets table the batch API wants.
+ *
+ * */
+typedef struct packetSet {
+    uint8_t * bytes;
+    uint32_t * offsets;
+    uint32_t numPackets;
+    uint32_t byteCapacity;
+    uint32_t packetCapacity;
+    uint32_t maxRows;
+} packetSet;
+
+static void * growArray(void * ptr, uint32_t * capacity, uint32_t needed, size_t elemSize) {
+    uint32_t newCapacity = *capacity ? *capacity : 1024;
+    while (newCapacity < needed) {
+        newCapacity *= 2;
+    }
+    if (newCapacity != *capacity) {
+        ptr = realloc(ptr, newCapacity * elemSize);
+        if (ptr == NULL) {
+            fprintf(stderr, "ERROR out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        *capacity = newCapacity;
+    }
+    return ptr;
+}
+
+static void loadPackets(decodeCfg * cfg, FILE * in, packetSet * set) {
+    char * line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t lineLength;
+    uint32_t lineNo = 0;
+    uint32_t start;
+    int32_t length;
+
+    set->offsets = growArray(set->offsets, &set->packetCapacity, 1, sizeof(uint32_t));
+    set->offsets[0] = 0;
+
+    while ((lineLength = getline(&line, &lineCapacity, in)) >= 0) {
+        lineNo++;
+        while ((lineLength > 0) && ((line[lineLength - 1] == '\n') || (line[lineLength - 1] == '\r') || (line[lineLength - 1] == ' '))) {
+            lineLength--;
+        }
+        if (lineLength == 0) {
+            continue;
+        }
+
+        // A line never decodes to more bytes than it has characters
+        start = set->offsets[set->numPackets];
+        set->bytes = growArray(set->bytes, &set->byteCapacity, start + (uint32_t) lineLength, 1);
+        if (cfg->base64) {
+            length = decode_WindOpBase64(line, (uint32_t) lineLength, &set->bytes[start], (uint32_t) lineLength);
+        } else {
+            length = decode_WindOpHex(line, (uint32_t) lineLength, &set->bytes[start], (uint32_t) lineLength);
+        }
+        if (length < 0) {
+            if (!cfg->quiet) {
+                fprintf(stderr, "Line %u is not a valid %s packet\n", lineNo, cfg->base64 ? "base64" : "hex");
+            }
+            continue;
+        }
+
+        set->offsets = growArray(set->offsets, &set->packetCapacity, set->numPackets + 2, sizeof(uint32_t));
+        set->offsets[++set->numPackets] = start + (uint32_t) length;
+        set->maxRows += maxReadings_WindOpPacket(&set->bytes[start], (uint32_t) length);
+    }
+    free(line);
+}
+
+/* ****************************************************************************
+ *
+ * The type table as the Perl hash the s1_wm_*_fetchUnpack.pl scripts load,
+ * keyed by the packet type byte. Fields are in packet order, key is the
+ * result hash key the scripts use, offset is within the reading. Text
+ * fields, the T7 coordinates, are left out.
+ *
+ * */
+static void writeSchema(FILE * out) {
+    const WindOpTypeInfo * info;
+    const WindOpFieldInfo * field;
+    uint32_t dataType;
+    uint8_t i;
+
+    fprintf(out, "## Generated by wm_decode -schema from packetFormats/wm_schema.h, do not edit\n");
+    fprintf(out, "package wm_schema;\n\nuse strict;\nuse warnings;\n\n");
+    fprintf(out, "our %%windOpSchema = (\n");
+    for (dataType = 0; dataType < 256; dataType++) {
+        // Fixed layouts only, the scripts have no T8 delta decoder
+        if (((info = info_WindOpDataType((uint8_t) dataType)) == NULL) || (info->readingSize == 0)) {
+            continue;
+        }
+        fprintf(out, "   0x%02x => {\n", dataType);
+        fprintf(out, "      name        => '%s',\n", info->name);
+        fprintf(out, "      readingSize => %u,\n", info->readingSize);
+        fprintf(out, "      firstOffset => %u,\n", info->firstOffset);
+        fprintf(out, "      fields      => [\n");
+        for (i = 0; i < info->numFields; i++) {
+            field = &info->fields[i];
+            fprintf(out, "         { key => '%s', offset => %u, bytes => %u, signed => %u, scale => %.15g },\n",
+                    key_WindOpChannel(field->channel), field->offset, field->bytes, field->isSigned, field->scale);
+        }
+        fprintf(out, "      ],\n   },\n");
+    }
+    fprintf(out, ");\n\n");
+
+    // One decoder over the table, so the scripts hold no layouts of their own
+    fprintf(out, "## Decode the reading of type $type at $base into $readingRef, keyed as the\n"
+                 "## CSV columns. Returns the reading size, 0 for a type with no layout.\n"
+                 "sub unpackReading {\n"
+                 "   my ( $type, $byteRef, $base, $readingRef ) = @_;\n"
+                 "   my $layout = $windOpSchema{$type} or return 0;\n\n"
+                 "   foreach my $field (@{$layout->{fields}}) {\n"
+                 "      my $raw = 0;\n"
+                 "      for (my $i = $field->{bytes} - 1; $i >= 0; $i--) {\n"
+                 "         $raw = ($raw << 8) + $byteRef->[$base + $field->{offset} + $i];\n"
+                 "      }\n"
+                 "      $raw -= 1 << (8 * $field->{bytes}) if ($field->{signed} && ($raw >> (8 * $field->{bytes} - 1)));\n"
+                 "      $readingRef->{$field->{key}} = $field->{scale} * $raw;\n"
+                 "   }\n"
+                 "   return $layout->{readingSize};\n"
+                 "}\n\n1;\n");
+}
+
+static void processCommandLine(int argc, char ** argv, decodeCfg * cfg) {
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b64") == 0) {
+            cfg->base64 = 1;
+        } else if (strcmp(argv[i], "-quiet") == 0) {
+            cfg->quiet = 1;
+        } else if (strcmp(argv[i], "-schema") == 0) {
+            cfg->schema = 1;
+        } else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+            cfg->outFile = argv[++i];
+        } else if ((strcmp(argv[i], "-help") == 0) || (argv[i][0] == '-')) {
+            printf("%s", helpText);
+            exit(EXIT_SUCCESS);
+        } else {
+            cfg->inFile = argv[i];
+        }
+    }
+}
+
+int main(int argc, char ** argv) {
+    decodeCfg cfg = { NULL, NULL, 0, 0, 0 };
+    packetSet set = { NULL, NULL, 0, 0, 0, 0 };
+    WindOpColumns cols;
+    uint8_t * status;
+    FILE * in = stdin;
+    FILE * out = stdout;
+    uint32_t failed = 0;
+    uint32_t i;
+
+    processCommandLine(argc, argv, &cfg);
+
+    if (cfg.schema) {
+        if ((cfg.outFile != NULL) && ((out = fopen(cfg.outFile, "w")) == NULL)) {
+            fprintf(stderr, "Can't open %s\n", cfg.outFile);
+            return EXIT_FAILURE;
+        }
+        writeSchema(out);
+        if (out != stdout) {
+            fclose(out);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if ((cfg.inFile != NULL) && ((in = fopen(cfg.inFile, "r")) == NULL)) {
+        fprintf(stderr, "Can't open %s\n", cfg.inFile);
+        return EXIT_FAILURE;
+    }
+    loadPackets(&cfg, in, &set);
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    // Size every column for the worst case so the decode never runs out
+    if (init_WindOpColumns(&cols, set.maxRows) != WINDOP_OK) {
+        fprintf(stderr, "ERROR out of memory\n");
+        return EXIT_FAILURE;
+    }
+    status = malloc(set.numPackets + 1);
+
+    decode_WindOpBatch(set.bytes, set.offsets, set.numPackets, &cols, status);
+
+    for (i = 0; i < set.numPackets; i++) {
+        if (status[i] != WINDOP_OK) {
+            failed++;
+            if (!cfg.quiet) {
+                fprintf(stderr, "Packet %u failed to decode, error %u\n", i, status[i]);
+            }
+        }
+    }
+
+    if ((cfg.outFile != NULL) && ((out = fopen(cfg.outFile, "w")) == NULL)) {
+        fprintf(stderr, "Can't open %s\n", cfg.outFile);
+        return EXIT_FAILURE;
+    }
+    if (writeColumns_WindOpCsv(out, &cols) != WINDOP_OK) {
+        fprintf(stderr, "ERROR out of memory\n");
+        return EXIT_FAILURE;
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    fprintf(stderr, "---Decoded %u packets, %u readings, %u failed\n", set.numPackets, cols.numRows, failed);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,384 @@
+/*
+ ============================================================================
+ Name        : wm_dedup.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Duplicate uplink filter and per device minute coverage
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_dedup.h"
+#include "wm_view.h"
+
+/* ****************************************************************************
+ *
+ * Duplicate uplinks
+ *
+ * */
+static uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+ * FNV-1a over the device name, then the packet a word at a time. The
+ * packet is hashed whole, type and length bytes included, so a payload
+ * differing only in its time header is a different key.
+ */
+uint64_t key_WindOpDedup(const char * device, const uint8_t * packet, uint32_t length) {
+    uint64_t h = 14695981039346656037ull;
+    uint64_t word;
+    uint32_t i;
+
+    for (i = 0; device[i]; i++) {
+        h = (h ^ (uint8_t) device[i]) * 1099511628211ull;
+    }
+    for (; length >= 8; packet += 8, length -= 8) {
+        memcpy(&word, packet, 8);
+        h = (h ^ word) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+    }
+    word = 0;
+    memcpy(&word, packet, length);
+    h = (h ^ word ^ ((uint64_t) length << 56)) * 0x9E3779B97F4A7C15ull;
+    return mix64(h);
+}
+
+static void clearSet(WindOpDedup * dedup, WindOpDedupSet * set) {
+    memset(set->filter, 0, ((size_t) dedup->filterMask + 1) * sizeof(uint64_t));
+    memset(set->keys, 0, ((size_t) dedup->keyMask + 1) * sizeof(uint64_t));
+    set->count = 0;
+}
+
+uint8_t init_WindOpDedup(WindOpDedup * dedup, uint32_t capacity) {
+    uint32_t size = 64;
+    uint8_t s;
+
+    memset(dedup, 0, sizeof(*dedup));
+    if ((capacity == 0) || (capacity > (1u << 30))) {
+        return WINDOP_ERR_CAPACITY;
+    }
+    while (size < capacity) {
+        size *= 2;
+    }
+    dedup->capacity = size;
+    dedup->filterMask = size / 4 - 1;
+    dedup->keyMask = 2 * size - 1; // Tables at most half full
+    for (s = 0; s < 2; s++) {
+        dedup->sets[s].filter = calloc((size_t) dedup->filterMask + 1, sizeof(uint64_t));
+        dedup->sets[s].keys = calloc((size_t) dedup->keyMask + 1, sizeof(uint64_t));
+        if ((dedup->sets[s].filter == NULL) || (dedup->sets[s].keys == NULL)) {
+            free_WindOpDedup(dedup);
+            return WINDOP_ERR_MEMORY;
+        }
+    }
+    return WINDOP_OK;
+}
+
+void free_WindOpDedup(WindOpDedup * dedup) {
+    uint8_t s;
+    for (s = 0; s < 2; s++) {
+        free(dedup->sets[s].filter);
+        free(dedup->sets[s].keys);
+    }
+    memset(dedup, 0, sizeof(*dedup));
+}
+
+size_t bytes_WindOpDedup(const WindOpDedup * dedup) {
+    if (dedup->capacity == 0) {
+        return 0;
+    }
+    return 2 * (((size_t) dedup->filterMask + 1) + ((size_t) dedup->keyMask + 1)) * sizeof(uint64_t);
+}
+
+// Word of the filter and the 4 bits in it, from bits the table slot does not use
+static inline uint64_t filterBits(uint64_t key) {
+    return (1ull << (key & 63)) | (1ull << ((key >> 6) & 63)) | (1ull << ((key >> 12) & 63)) |
+           (1ull << ((key >> 18) & 63));
+}
+
+static inline uint32_t filterWord(const WindOpDedup * dedup, uint64_t key) {
+    return (uint32_t) (key >> 32) & dedup->filterMask;
+}
+
+static inline uint32_t keySlot(const WindOpDedup * dedup, uint64_t key) {
+    return (uint32_t) (key >> 24) & dedup->keyMask;
+}
+
+static uint8_t inSet(WindOpDedup * dedup, const WindOpDedupSet * set, uint64_t key) {
+    const uint64_t bits = filterBits(key);
+    uint32_t slot;
+
+    if ((set->filter[filterWord(dedup, key)] & bits) != bits) {
+        return 0;
+    }
+    dedup->probes++;
+    for (slot = keySlot(dedup, key); set->keys[slot] != 0; slot = (slot + 1) & dedup->keyMask) {
+        if (set->keys[slot] == key) {
+            return 1;
+        }
+    }
+    dedup->falsePositives++;
+    return 0;
+}
+
+uint8_t check_WindOpDedup(WindOpDedup * dedup, uint64_t key) {
+    WindOpDedupSet * set = &dedup->sets[dedup->newer];
+    uint32_t slot;
+
+    key += (key == 0); // 0 marks a free slot
+    dedup->seen++;
+    if (inSet(dedup, set, key) || inSet(dedup, &dedup->sets[dedup->newer ^ 1], key)) {
+        dedup->duplicates++;
+        return 1;
+    }
+
+    if (set->count == dedup->capacity) {
+        dedup->newer ^= 1;
+        set = &dedup->sets[dedup->newer];
+        clearSet(dedup, set);
+        dedup->turnovers++;
+    }
+    set->filter[filterWord(dedup, key)] |= filterBits(key);
+    for (slot = keySlot(dedup, key); set->keys[slot] != 0; slot = (slot + 1) & dedup->keyMask) {
+    }
+    set->keys[slot] = key;
+    set->count++;
+    return 0;
+}
+
+/* ****************************************************************************
+ *
+ * Minute coverage, the device table as in wm_rollup.c
+ *
+ * */
+static inline int64_t minuteOf(int64_t time) {
+    return (time >= 0) ? time / 60 : -((-time + 59) / 60);
+}
+
+static inline uint32_t bitOf(int64_t minute) {
+    int64_t bit = minute % WINDOP_COVERAGE_MINUTES;
+    return (uint32_t) ((bit < 0) ? bit + WINDOP_COVERAGE_MINUTES : bit);
+}
+
+static inline uint8_t testBit(const WindOpCoverageDevice * dev, int64_t minute) {
+    const uint32_t bit = bitOf(minute);
+    return (dev->bits[bit / 64] >> (bit % 64)) & 1;
+}
+
+void init_WindOpCoverage(WindOpCoverage * cover) {
+    memset(cover, 0, sizeof(*cover));
+}
+
+void free_WindOpCoverage(WindOpCoverage * cover) {
+    free(cover->devices);
+    free(cover->hash);
+    memset(cover, 0, sizeof(*cover));
+}
+
+// Names are checked shorter than WINDOP_COVERAGE_DEVICE_SIZE on the way in and
+// kept whole, so the stored copy hashes and compares as the id did
+static uint32_t nameHash(const char * name) {
+    uint32_t h = 2166136261u;
+    uint32_t i;
+    for (i = 0; name[i]; i++) {
+        h = (h ^ (uint8_t) name[i]) * 16777619u;
+    }
+    return h;
+}
+
+static uint32_t * findSlot(const WindOpCoverage * cover, const char * name) {
+    uint32_t mask = cover->hashSize - 1;
+    uint32_t h = nameHash(name) & mask;
+
+    while ((cover->hash[h] != 0) &&
+           (strcmp(cover->devices[cover->hash[h] - 1].name, name) != 0)) {
+        h = (h + 1) & mask;
+    }
+    return &cover->hash[h];
+}
+
+static uint8_t growHash(WindOpCoverage * cover) {
+    uint32_t size = cover->hashSize ? 2 * cover->hashSize : 64;
+    uint32_t i;
+
+    free(cover->hash);
+    cover->hash = calloc(size, sizeof(uint32_t));
+    if (cover->hash == NULL) {
+        cover->hashSize = 0;
+        return WINDOP_ERR_MEMORY;
+    }
+    cover->hashSize = size;
+    for (i = 0; i < cover->numDevices; i++) {
+        *findSlot(cover, cover->devices[i].name) = i + 1;
+    }
+    return WINDOP_OK;
+}
+
+static WindOpCoverageDevice * deviceFor(WindOpCoverage * cover, const char * name, int64_t minute) {
+    WindOpCoverageDevice * dev;
+    uint32_t * slot;
+    uint32_t capacity;
+
+    if (2 * (cover->numDevices + 1) > cover->hashSize) {
+        if (growHash(cover) != WINDOP_OK) {
+            return NULL;
+        }
+    }
+    slot = findSlot(cover, name);
+    if (*slot != 0) {
+        return &cover->devices[*slot - 1];
+    }
+
+    if (cover->numDevices == cover->deviceCapacity) {
+        capacity = cover->deviceCapacity ? 2 * cover->deviceCapacity : 16;
+        dev = realloc(cover->devices, capacity * sizeof(WindOpCoverageDevice));
+        if (dev == NULL) {
+            return NULL;
+        }
+        cover->devices = dev;
+        cover->deviceCapacity = capacity;
+    }
+    dev = &cover->devices[cover->numDevices];
+    memset(dev, 0, sizeof(*dev));
+    strcpy(dev->name, name);
+    dev->first = minute;
+    dev->newest = minute;
+    *slot = ++cover->numDevices;
+    return dev;
+}
+
+uint8_t add_WindOpCoverage(WindOpCoverage * cover, const char * device, int64_t time) {
+    const int64_t minute = minuteOf(time);
+    WindOpCoverageDevice * dev;
+    uint32_t bit;
+    int64_t m;
+
+    if (strlen(device) >= WINDOP_COVERAGE_DEVICE_SIZE) {
+        return WINDOP_ERR_LENGTH;
+    }
+    if ((dev = deviceFor(cover, device, minute)) == NULL) {
+        return WINDOP_ERR_MEMORY;
+    }
+    if (minute > dev->newest) {
+        // Minutes coming into the window start empty
+        if (minute - dev->newest >= WINDOP_COVERAGE_MINUTES) {
+            memset(dev->bits, 0, sizeof(dev->bits));
+        } else {
+            for (m = dev->newest + 1; m <= minute; m++) {
+                bit = bitOf(m);
+                dev->bits[bit / 64] &= ~(1ull << (bit % 64));
+            }
+        }
+        dev->newest = minute;
+    } else if (minute <= dev->newest - WINDOP_COVERAGE_MINUTES) {
+        dev->late++;
+        return WINDOP_OK;
+    }
+    dev->first = (minute < dev->first) ? minute : dev->first;
+    bit = bitOf(minute);
+    dev->bits[bit / 64] |= 1ull << (bit % 64);
+    dev->readings++;
+    return WINDOP_OK;
+}
+
+uint8_t addPacket_WindOpCoverage(WindOpCoverage * cover, const char * device, const uint8_t * packet,
+                                 uint32_t length) {
+    WindOpPacketView view;
+    int64_t time;
+    uint16_t n;
+    uint8_t status;
+
+    if ((status = open_WindOpPacketView(&view, packet, length)) != WINDOP_OK) {
+        return status;
+    }
+    if ((status = readingTime_WindOpPacketView(&view, 0, &time)) != WINDOP_OK) {
+        return status;
+    }
+    for (n = 0; (n < view.numReadings) && (status == WINDOP_OK); n++) {
+        status = add_WindOpCoverage(cover, device, time + 60 * (int64_t) n);
+    }
+    return status;
+}
+
+int64_t windowStart_WindOpCoverage(const WindOpCoverageDevice * dev) {
+    const int64_t oldest = dev->newest - WINDOP_COVERAGE_MINUTES + 1;
+    return 60 * ((dev->first > oldest) ? dev->first : oldest);
+}
+
+uint32_t windowMinutes_WindOpCoverage(const WindOpCoverageDevice * dev) {
+    return (uint32_t) (dev->newest - windowStart_WindOpCoverage(dev) / 60 + 1);
+}
+
+uint8_t covered_WindOpCoverage(const WindOpCoverageDevice * dev, int64_t time) {
+    const int64_t minute = minuteOf(time);
+
+    if ((minute > dev->newest) || (minute < windowStart_WindOpCoverage(dev) / 60)) {
+        return 0;
+    }
+    return testBit(dev, minute);
+}
+
+uint32_t count_WindOpCoverage(const WindOpCoverageDevice * dev) {
+    const int64_t start = windowStart_WindOpCoverage(dev) / 60;
+    uint32_t count = 0;
+    int64_t m;
+
+    for (m = start; m <= dev->newest; m++) {
+        count += testBit(dev, m);
+    }
+    return count;
+}
+
+uint32_t gaps_WindOpCoverage(const WindOpCoverageDevice * dev, WindOpGap * out, uint32_t max) {
+    const int64_t start = windowStart_WindOpCoverage(dev) / 60;
+    uint32_t count = 0;
+    int64_t m;
+    int64_t from;
+
+    for (m = start; m <= dev->newest; m++) {
+        if (testBit(dev, m)) {
+            continue;
+        }
+        for (from = m; (m < dev->newest) && !testBit(dev, m + 1); m++) {
+        }
+        if (count < max) {
+            out[count].from = 60 * from;
+            out[count].to = 60 * m;
+            out[count].minutes = (uint32_t) (m - from + 1);
+        }
+        count++;
+    }
+    return count;
+}
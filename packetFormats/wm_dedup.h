@@ -0,0 +1,160 @@
+/*
+ ============================================================================
+ Name        : wm_dedup.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Duplicate uplink filter and per device minute coverage
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+
+#ifndef WM_DEDUP_H
+#define WM_DEDUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wm_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ****************************************************************************
+ *
+ * Duplicate uplinks. Overlapping fetches and retransmits deliver the same
+ * packet more than once. An uplink is keyed by a 64 bit hash of its device,
+ * packed time header and payload, and looked up in two generations of
+ * keys, each a Bloom filter in front of an exact open addressed table.
+ *
+ * Most uplinks are new, and a new key costs a filter test per generation,
+ * one 64 bit word each, before it is added. A table is only probed when its
+ * filter says maybe. When the newer generation holds capacity keys the older
+ * one is cleared and takes its place, so memory is fixed at init, about 36
+ * bytes a key of capacity. A duplicate is caught as long as it arrives within
+ * capacity uplinks of the original, and may be caught up to 2 * capacity.
+ *
+ * Two different uplinks sharing a 64 bit key would be taken as duplicates,
+ * about one in 10^7 over 10^6 uplinks.
+ *
+ * */
+typedef struct WindOpDedupSet {
+    uint64_t * filter;        // One word per 4 keys of capacity, 4 bits set a key
+    uint64_t * keys;          // 0 marks a free slot
+    uint32_t count;
+} WindOpDedupSet;
+
+typedef struct WindOpDedup {
+    WindOpDedupSet sets[2];
+    uint8_t newer;            // Index of the set being filled
+    uint32_t capacity;        // Keys per set before the sets turn over
+    uint32_t filterMask;
+    uint32_t keyMask;
+    uint64_t seen;
+    uint64_t duplicates;
+    uint64_t probes;          // Table lookups the filters let through
+    uint64_t falsePositives;  // Lookups that found nothing
+    uint64_t turnovers;
+} WindOpDedup;
+
+// capacity is rounded up to a power of 2, returns a WINDOP_* code
+uint8_t init_WindOpDedup(WindOpDedup * dedup, uint32_t capacity);
+void free_WindOpDedup(WindOpDedup * dedup);
+
+// Bytes allocated, fixed from init
+size_t bytes_WindOpDedup(const WindOpDedup * dedup);
+
+uint64_t key_WindOpDedup(const char * device, const uint8_t * packet, uint32_t length);
+
+// 1 when key was seen before, otherwise adds it and returns 0
+uint8_t check_WindOpDedup(WindOpDedup * dedup, uint64_t key);
+
+/* ****************************************************************************
+ *
+ * Minute coverage. Each device keeps a ring bitmap of the last
+ * WINDOP_COVERAGE_MINUTES minutes, a bit set when any reading fell in that
+ * minute. Readings older than the ring are counted as late and dropped.
+ * Gaps are runs of clear bits between the first minute seen and the newest.
+ *
+ * */
+#define WINDOP_COVERAGE_MINUTES    10080 // A week, 1260 bytes a device
+#define WINDOP_COVERAGE_WORDS      ((WINDOP_COVERAGE_MINUTES + 63) / 64)
+#define WINDOP_COVERAGE_DEVICE_SIZE 64   // Device id bytes, as in the archive
+
+typedef struct WindOpCoverageDevice {
+    char name[WINDOP_COVERAGE_DEVICE_SIZE];
+    int64_t first;            // Earliest minute seen, epoch minutes
+    int64_t newest;           // Latest minute seen
+    uint64_t readings;
+    uint64_t late;
+    uint64_t bits[WINDOP_COVERAGE_WORDS]; // Minute m at bit m % WINDOP_COVERAGE_MINUTES
+} WindOpCoverageDevice;
+
+typedef struct WindOpCoverage {
+    WindOpCoverageDevice * devices;
+    uint32_t numDevices;
+    uint32_t deviceCapacity;
+    uint32_t * hash;          // Device index + 1 by name hash, 0 for free
+    uint32_t hashSize;
+} WindOpCoverage;
+
+typedef struct WindOpGap {
+    int64_t from;             // Epoch seconds of the first and last missing minute
+    int64_t to;
+    uint32_t minutes;
+} WindOpGap;
+
+void init_WindOpCoverage(WindOpCoverage * cover);
+void free_WindOpCoverage(WindOpCoverage * cover);
+
+// Mark the minute of time, returns a WINDOP_* code, WINDOP_ERR_LENGTH for an
+// id of WINDOP_COVERAGE_DEVICE_SIZE bytes or more
+uint8_t add_WindOpCoverage(WindOpCoverage * cover, const char * device, int64_t time);
+
+// Mark the minute of every reading of the packet, returns a WINDOP_* code
+uint8_t addPacket_WindOpCoverage(WindOpCoverage * cover, const char * device, const uint8_t * packet,
+                                 uint32_t length);
+
+// Start of the ring window and minutes in it, from the first minute seen to the newest
+int64_t windowStart_WindOpCoverage(const WindOpCoverageDevice * dev);
+uint32_t windowMinutes_WindOpCoverage(const WindOpCoverageDevice * dev);
+
+// 1 when the minute holding time has a reading
+uint8_t covered_WindOpCoverage(const WindOpCoverageDevice * dev, int64_t time);
+
+// Minutes of the window with a reading
+uint32_t count_WindOpCoverage(const WindOpCoverageDevice * dev);
+
+// Gaps of the window oldest first, up to max of them. Returns the number of
+// gaps, which may be more than max
+uint32_t gaps_WindOpCoverage(const WindOpCoverageDevice * dev, WindOpGap * out, uint32_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_DEDUP_H
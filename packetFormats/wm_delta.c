@@ -0,0 +1,330 @@
+/*
+ ============================================================================
+ Name        : wm_delta.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Delta coded T8 readings
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <string.h>
+
+#include "wm_codec.h"
+#include "wm_delta.h"
+#include "wm_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WINDOP_DELTA_X86 1
+#include <immintrin.h>
+#endif
+
+// Deltas of the largest packet, with slack for the four byte loads
+#define MAX_DELTA_BYTES          (WINDOP_DELTA_MAX_READINGS * 2 + 4)
+
+static inline uint32_t deltaBytes(uint8_t numReadings, uint8_t width) {
+    return ((uint32_t) (numReadings - 1) * width + 7) / 8;
+}
+
+uint32_t size_WindOpDeltaLayout(uint8_t numReadings, uint8_t channels, const uint8_t * widths) {
+    uint32_t size = WINDOP_DELTA_HEADER_SIZE;
+    uint8_t ch;
+
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        if (channels & (1 << ch)) {
+            size += WINDOP_DELTA_CHANNEL_SIZE + deltaBytes(numReadings, widths[ch]);
+        }
+    }
+    return size;
+}
+
+uint32_t check_WindOpDeltaReadings(const uint8_t * in, uint32_t length, uint8_t * numReadings, uint8_t * channels) {
+    uint8_t widths[WINDOP_NUM_CHANNELS];
+    const uint8_t * p;
+    uint32_t size;
+    uint8_t ch;
+
+    if ((length < WINDOP_DELTA_HEADER_SIZE) || (in[0] == 0) || (in[1] == 0)) {
+        return 0;
+    }
+    p = &in[WINDOP_DELTA_HEADER_SIZE];
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        if (!(in[1] & (1 << ch))) {
+            continue;
+        }
+        if ((uint32_t) (p + WINDOP_DELTA_CHANNEL_SIZE - in) > length) {
+            return 0;
+        }
+        widths[ch] = p[2];
+        if (widths[ch] > 16) {
+            return 0;
+        }
+        p += WINDOP_DELTA_CHANNEL_SIZE;
+    }
+
+    size = size_WindOpDeltaLayout(in[0], in[1], widths);
+    if (size > length) {
+        return 0;
+    }
+    if (numReadings != NULL) {
+        *numReadings = in[0];
+    }
+    if (channels != NULL) {
+        *channels = in[1];
+    }
+    return size;
+}
+
+/* ****************************************************************************
+ *
+ * Per channel kernels. The scalar versions are the reference and finish the
+ * tail of the vector ones.
+ *
+ * Decode reads each delta on its own from the bytes holding its bits, so
+ * there is no carry from one to the next and eight go through a gather,
+ * variable shift and mask at once, followed by an in register running sum.
+ * Sums are kept unwrapped in 32 bits and cut back to the 16 bit field as
+ * they are stored, they cannot overflow in 255 readings.
+ *
+ * */
+static inline int32_t widen(int32_t raw, uint8_t isSigned) {
+    return isSigned ? (int16_t) raw : (uint16_t) raw;
+}
+
+static uint32_t encodeRun_scalar(const int32_t * values, uint32_t from, uint32_t count, uint16_t * zz) {
+    uint32_t all = 0;
+    uint16_t delta;
+    uint32_t i;
+
+    for (i = from; i < count; i++) {
+        delta = (uint16_t) (values[i + 1] - values[i]);
+        zz[i] = (uint16_t) ((delta << 1) ^ (0u - (delta >> 15)));
+        all |= zz[i];
+    }
+    return all;
+}
+
+static int32_t decodeRun_scalar(const uint8_t * padded, uint32_t from, uint32_t count, uint8_t width,
+                                uint8_t isSigned, int32_t value, int32_t * out) {
+    const uint32_t mask = (1u << width) - 1;
+    uint32_t bit;
+    uint32_t word;
+    uint32_t zz;
+    uint32_t i;
+
+    for (i = from; i < count; i++) {
+        bit = i * width;
+        word = padded[bit >> 3] | (padded[(bit >> 3) + 1] << 8) | ((uint32_t) padded[(bit >> 3) + 2] << 16);
+        zz = (word >> (bit & 7)) & mask;
+        value += (int32_t) ((zz >> 1) ^ (0u - (zz & 1)));
+        out[i + 1] = widen(value, isSigned);
+    }
+    return value;
+}
+
+#ifdef WINDOP_DELTA_X86
+__attribute__((target("avx2")))
+static uint32_t encodeRun_avx2(const int32_t * values, uint32_t count, uint16_t * zz, uint32_t * all) {
+    const __m256i low16 = _mm256_set1_epi32(0xFFFF);
+    __m256i acc = _mm256_setzero_si256();
+    __m256i d;
+    __m256i z;
+    __m128i or4;
+    uint32_t i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        d = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *) &values[i + 1]),
+                             _mm256_loadu_si256((const __m256i *) &values[i]));
+        d = _mm256_srai_epi32(_mm256_slli_epi32(d, 16), 16); // mod 2^16, as a signed 16 bit delta
+        z = _mm256_and_si256(_mm256_xor_si256(_mm256_slli_epi32(d, 1), _mm256_srai_epi32(d, 31)), low16);
+        acc = _mm256_or_si256(acc, z);
+        z = _mm256_permute4x64_epi64(_mm256_packus_epi32(z, z), 0x08);
+        _mm_storeu_si128((__m128i *) &zz[i], _mm256_castsi256_si128(z));
+    }
+    or4 = _mm_or_si128(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    or4 = _mm_or_si128(or4, _mm_shuffle_epi32(or4, 0x4E));
+    or4 = _mm_or_si128(or4, _mm_shuffle_epi32(or4, 0xB1));
+    *all = (uint32_t) _mm_cvtsi128_si32(or4);
+    return i;
+}
+
+__attribute__((target("avx2")))
+static uint32_t decodeRun_avx2(const uint8_t * padded, uint32_t count, uint8_t width, uint8_t isSigned,
+                               int32_t * value, int32_t * out) {
+    const __m256i laneBits = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(width));
+    const __m256i mask = _mm256_set1_epi32((int32_t) ((1u << width) - 1));
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i seven = _mm256_set1_epi32(7);
+    __m256i base = _mm256_set1_epi32(*value);
+    __m256i bit;
+    __m256i zz;
+    __m256i d;
+    __m256i carry;
+    uint32_t i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        bit = _mm256_add_epi32(_mm256_set1_epi32((int32_t) (i * width)), laneBits);
+        zz = _mm256_i32gather_epi32((const int *) padded, _mm256_srli_epi32(bit, 3), 1);
+        zz = _mm256_and_si256(_mm256_srlv_epi32(zz, _mm256_and_si256(bit, seven)), mask);
+        d = _mm256_xor_si256(_mm256_srli_epi32(zz, 1), _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(zz, one)));
+
+        // Running sum within each half, then the low half's total into the high
+        d = _mm256_add_epi32(d, _mm256_slli_si256(d, 4));
+        d = _mm256_add_epi32(d, _mm256_slli_si256(d, 8));
+        carry = _mm256_shuffle_epi32(d, 0xFF);
+        d = _mm256_add_epi32(d, _mm256_permute2x128_si256(carry, carry, 0x08));
+        d = _mm256_add_epi32(d, base);
+        base = _mm256_permutevar8x32_epi32(d, seven);
+
+        if (isSigned) {
+            d = _mm256_srai_epi32(_mm256_slli_epi32(d, 16), 16);
+        } else {
+            d = _mm256_and_si256(d, _mm256_set1_epi32(0xFFFF));
+        }
+        _mm256_storeu_si256((__m256i *) &out[i + 1], d);
+    }
+    *value = _mm256_cvtsi256_si32(base);
+    return i;
+}
+#endif
+
+// Zig-zag deltas of count + 1 values, returns the bits the largest needs
+static uint8_t encodeDeltas(const int32_t * values, uint32_t count, uint16_t * zz) {
+    uint32_t all = 0;
+    uint32_t done = 0;
+
+#ifdef WINDOP_DELTA_X86
+    if (level_WindOpSimd() >= WINDOP_SIMD_AVX2) {
+        done = encodeRun_avx2(values, count, zz, &all);
+    }
+#endif
+    all |= encodeRun_scalar(values, done, count, zz);
+    return all ? (uint8_t) (32 - __builtin_clz(all)) : 0;
+}
+
+// Rebuild count + 1 values from the first and the packed deltas
+static void decodeDeltas(const uint8_t * bits, uint32_t count, uint8_t width, uint8_t isSigned, int32_t first,
+                         int32_t * out) {
+    uint8_t padded[MAX_DELTA_BYTES];
+    uint32_t used = (count * width + 7) / 8;
+    uint32_t done = 0;
+
+    // Copied so the last multi byte load never runs past the packet
+    memcpy(padded, bits, used);
+    memset(&padded[used], 0, 4);
+
+    out[0] = widen(first, isSigned);
+#ifdef WINDOP_DELTA_X86
+    if (level_WindOpSimd() >= WINDOP_SIMD_AVX2) {
+        done = decodeRun_avx2(padded, count, width, isSigned, &first, out);
+    }
+#endif
+    decodeRun_scalar(padded, done, count, width, isSigned, first, out);
+}
+
+static uint8_t * packBits(const uint16_t * zz, uint32_t count, uint8_t width, uint8_t * out) {
+    uint32_t acc = 0;
+    uint32_t bits = 0;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        acc |= (uint32_t) zz[i] << bits;
+        bits += width;
+        while (bits >= 8) {
+            *out++ = (uint8_t) acc;
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+    if (bits > 0) {
+        *out++ = (uint8_t) acc;
+    }
+    return out;
+}
+
+uint32_t pack_WindOpDeltaReadings(int32_t * const * channel, uint32_t row, uint8_t numReadings, uint8_t channels,
+                                  uint8_t * outBuffer, uint32_t capacity) {
+    uint16_t zz[WINDOP_NUM_CHANNELS][WINDOP_DELTA_MAX_READINGS];
+    uint8_t widths[WINDOP_NUM_CHANNELS];
+    uint8_t * p;
+    uint32_t size;
+    uint8_t ch;
+
+    if ((numReadings == 0) || (channels == 0)) {
+        return 0;
+    }
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        if (channels & (1 << ch)) {
+            widths[ch] = encodeDeltas(&channel[ch][row], numReadings - 1, zz[ch]);
+        }
+    }
+    size = size_WindOpDeltaLayout(numReadings, channels, widths);
+    if (size > capacity) {
+        return 0;
+    }
+
+    outBuffer[0] = numReadings;
+    outBuffer[1] = channels;
+    p = &outBuffer[WINDOP_DELTA_HEADER_SIZE];
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        if (channels & (1 << ch)) {
+            p[0] = (uint8_t) channel[ch][row];
+            p[1] = (uint8_t) (channel[ch][row] >> 8);
+            p[2] = widths[ch];
+            p += WINDOP_DELTA_CHANNEL_SIZE;
+        }
+    }
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        if (channels & (1 << ch)) {
+            p = packBits(zz[ch], numReadings - 1, widths[ch], p);
+        }
+    }
+
+    return size;
+}
+
+uint8_t unpack_WindOpDeltaReadings(const uint8_t * inBuffer, int32_t * const * channel, uint32_t row) {
+    const WindOpTypeInfo * info = info_WindOpDataType(WINDOPDATAPACKET_T8_TYPE);
+    const uint8_t numReadings = inBuffer[0];
+    const uint8_t channels = inBuffer[1];
+    const uint8_t * head = &inBuffer[WINDOP_DELTA_HEADER_SIZE];
+    const uint8_t * bits;
+    uint8_t ch;
+
+    bits = head + WINDOP_DELTA_CHANNEL_SIZE * __builtin_popcount(channels);
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        if (!(channels & (1 << ch))) {
+            memset(&channel[ch][row], 0, numReadings * sizeof(int32_t));
+            continue;
+        }
+        decodeDeltas(bits, numReadings - 1, head[2], info->byChannel[ch].isSigned, head[0] | (head[1] << 8),
+                     &channel[ch][row]);
+        bits += deltaBytes(numReadings, head[2]);
+        head += WINDOP_DELTA_CHANNEL_SIZE;
+    }
+
+    return numReadings;
+}
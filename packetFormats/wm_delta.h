@@ -0,0 +1,100 @@
+/*
+ ============================================================================
+ Name        : wm_delta.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Delta coded T8 readings
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_DELTA_H
+#define WM_DELTA_H
+
+#include <stdint.h>
+
+#include "wm_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ****************************************************************************
+ *
+ * T8 packs the T3 fields, all 16 bit, as differences from the minute before.
+ * Wind and battery readings move slowly, so most differences need a few
+ * bits rather than 16. After the usual type, length and time stamp
+ *
+ *     count      1 byte    readings in the packet, 1...255
+ *     mask       1 byte    bit n set when channel n is carried
+ *     per carried channel, in channel order
+ *       first    2 bytes   raw value of reading 0, little endian
+ *       width    1 byte    bits per difference, 0...16
+ *     per carried channel, in channel order
+ *       deltas   (count - 1) * width bits, rounded up to a whole byte
+ *
+ * Each delta is the next value less the one before, taken mod 2^16 so every
+ * series is exact, then zig-zag mapped (0, -1, 1, -2 ... to 0, 1, 2, 3 ...)
+ * and stored least significant bit first. width is the fewest bits that hold
+ * the largest delta of the channel, 0 for a channel that does not change.
+ *
+ * The packet time stamps reading 0, readings are 60 s apart as in every
+ * other type.
+ *
+ * */
+#define WINDOP_DELTA_HEADER_SIZE       2
+#define WINDOP_DELTA_CHANNEL_SIZE      3
+#define WINDOP_DELTA_MAX_READINGS      255
+
+// Bytes taken by numReadings readings of the given channels at the widths
+uint32_t size_WindOpDeltaLayout(uint8_t numReadings, uint8_t channels, const uint8_t * widths);
+
+/*
+ * Bytes the readings at in take, checked against length, or 0 when the
+ * header is malformed or the data runs past length. numReadings and
+ * channels (optional) are filled in from the header.
+ */
+uint32_t check_WindOpDeltaReadings(const uint8_t * in, uint32_t length, uint8_t * numReadings, uint8_t * channels);
+
+/*
+ * Pack numReadings rows of the given channels starting at row. Returns the
+ * bytes written, or 0 when they would not fit capacity.
+ */
+uint32_t pack_WindOpDeltaReadings(int32_t * const * channel, uint32_t row, uint8_t numReadings, uint8_t channels,
+                                  uint8_t * outBuffer, uint32_t capacity);
+
+/*
+ * Unpack readings checked by check_WindOpDeltaReadings into rows from row
+ * on. Channels the packet does not carry read back as 0. Returns the
+ * number of readings written.
+ */
+uint8_t unpack_WindOpDeltaReadings(const uint8_t * inBuffer, int32_t * const * channel, uint32_t row);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_DELTA_H
@@ -0,0 +1,361 @@
+/*
+ ============================================================================
+ Name        : wm_fleet.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Generate simulated fleet uplinks as raw, text, JSON or archive
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "wm_codec.h"
+#include "wm_archive.h"
+#include "wm_base64.h"
+#include "wm_serlog.h"
+#include "wm_sim.h"
+
+static const char * helpText =
+"\n"
+"   WindOp fleet simulator\n"
+"\n"
+"   Generates the uplinks of n simulated nodes sending mixed T3, T4, T5 and\n"
+"   T6 packets of wind, temperature, pressure and battery readings, for\n"
+"   feeding the decoders and benchmarks. The same seed gives the same bytes.\n"
+"\n"
+"      wm_fleet [options]\n"
+"\n"
+"      -nodes n               : Simulated nodes, default 100\n"
+"      -minutes n             : Minutes simulated, default 1440\n"
+"      -packets n             : Stop after n uplinks instead\n"
+"      -seed n                : Random seed, default 1\n"
+"      -start YYYYMMDDhhmm    : First reading, default 201712010000\n"
+"      -readings n            : Readings per packet, default 10\n"
+"      -profiles list         : Comma list of t3,t4t5,t4t6,t6, default all\n"
+"      -corrupt pct           : Percentage of uplinks damaged, default 0\n"
+"      -dup pct               : Percentage of uplinks repeated, default 0\n"
+"      -f format              : raw     packets back to back (default)\n"
+"                               hex     one hex packet per line, for wm_decode\n"
+"                               b64     one base64 packet per line\n"
+"                               json    TTN storage dump, for wm_ttn\n"
+"                               arc     wm_arc archive, needs -o\n"
+"                               rn      RN2483 radio_rx lines as a wm_serial\n"
+"                                       log, paced at 57600 baud, needs -o\n"
+"                               none    generate only, for timing\n"
+"      -o file                : Write to file, default stdout\n"
+"      -help                  : Prints this\n"
+"\n";
+
+#define FORMAT_RAW               0
+#define FORMAT_HEX               1
+#define FORMAT_B64               2
+#define FORMAT_JSON              3
+#define FORMAT_ARC               4
+#define FORMAT_RN                5
+#define FORMAT_NONE              6
+
+#define RN_BAUD                  57600
+
+static const char * formatNames[] = { "raw", "hex", "b64", "json", "arc", "rn", "none" };
+static const char * profileNames[WINDOP_SIM_PROFILES] = { "t3", "t4t5", "t4t6", "t6" };
+
+typedef struct fleetCfg {
+    WindOpSimConfig sim;
+    uint32_t minutes;
+    uint64_t packets;
+    uint8_t format;
+    const char * outFile;
+} fleetCfg;
+
+static void printHelp(void) {
+    printf("%s", helpText);
+    exit(EXIT_SUCCESS);
+}
+
+static int64_t parseStart(const char * text) {
+    Calendar cal;
+    unsigned year, month, day, hour, minute;
+
+    if (sscanf(text, "%4u%2u%2u%2u%2u", &year, &month, &day, &hour, &minute) != 5) {
+        printHelp();
+    }
+    memset(&cal, 0, sizeof(cal));
+    cal.Year = (uint16_t) year;
+    cal.Month = (uint8_t) month;
+    cal.DayOfMonth = (uint8_t) day;
+    cal.Hours = (uint8_t) hour;
+    cal.Minutes = (uint8_t) minute;
+    if (check_WindOpMinuteTime(&cal) != WINDOP_OK) {
+        printHelp();
+    }
+    return epoch_WindOpCalendar(&cal);
+}
+
+static uint8_t parseProfiles(const char * text) {
+    char list[64];
+    char * name;
+    uint8_t mask = 0;
+    uint8_t p;
+
+    snprintf(list, sizeof(list), "%s", text);
+    for (name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+        for (p = 0; (p < WINDOP_SIM_PROFILES) && (strcmp(name, profileNames[p]) != 0); p++) {
+        }
+        if (p == WINDOP_SIM_PROFILES) {
+            printHelp();
+        }
+        mask |= (uint8_t) (1u << p);
+    }
+    return mask;
+}
+
+static void processCommandLine(int argc, char ** argv, fleetCfg * cfg) {
+    int i;
+    uint8_t f;
+
+    for (i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-nodes") == 0) && (i + 1 < argc)) {
+            cfg->sim.numNodes = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if ((strcmp(argv[i], "-minutes") == 0) && (i + 1 < argc)) {
+            cfg->minutes = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if ((strcmp(argv[i], "-packets") == 0) && (i + 1 < argc)) {
+            cfg->packets = strtoull(argv[++i], NULL, 10);
+        } else if ((strcmp(argv[i], "-seed") == 0) && (i + 1 < argc)) {
+            cfg->sim.seed = strtoull(argv[++i], NULL, 10);
+        } else if ((strcmp(argv[i], "-start") == 0) && (i + 1 < argc)) {
+            cfg->sim.start = parseStart(argv[++i]);
+        } else if ((strcmp(argv[i], "-readings") == 0) && (i + 1 < argc)) {
+            cfg->sim.readings = (uint8_t) strtoul(argv[++i], NULL, 10);
+        } else if ((strcmp(argv[i], "-profiles") == 0) && (i + 1 < argc)) {
+            cfg->sim.profiles = parseProfiles(argv[++i]);
+        } else if ((strcmp(argv[i], "-corrupt") == 0) && (i + 1 < argc)) {
+            cfg->sim.corruptPpm = (uint32_t) (atof(argv[++i]) * 10000);
+        } else if ((strcmp(argv[i], "-dup") == 0) && (i + 1 < argc)) {
+            cfg->sim.duplicatePpm = (uint32_t) (atof(argv[++i]) * 10000);
+        } else if ((strcmp(argv[i], "-f") == 0) && (i + 1 < argc)) {
+            i++;
+            for (f = 0; (f <= FORMAT_NONE) && (strcmp(argv[i], formatNames[f]) != 0); f++) {
+            }
+            if (f > FORMAT_NONE) {
+                printHelp();
+            }
+            cfg->format = f;
+        } else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+            cfg->outFile = argv[++i];
+        } else {
+            printHelp();
+        }
+    }
+}
+
+static void writeHex(FILE * out, const uint8_t * bytes, uint32_t length) {
+    static const char digits[] = "0123456789ABCDEF";
+    char line[2 * WINDOP_MAX_PACKET_LENGTH + 1];
+    uint32_t i;
+
+    for (i = 0; i < length; i++) {
+        line[2 * i] = digits[bytes[i] >> 4];
+        line[2 * i + 1] = digits[bytes[i] & 0x0F];
+    }
+    line[2 * length] = '\n';
+    fwrite(line, 1, 2 * length + 1, out);
+}
+
+// One record in the shape the storage integration returns, 2017-12-01T10:02:07Z
+static void writeJson(FILE * out, const WindOpSimUplink * up, uint64_t count) {
+    char device[WINDOP_SIM_NAME_SIZE];
+    char raw[4 * (WINDOP_MAX_PACKET_LENGTH + 2) / 3 + 1];
+    Calendar cal;
+
+    name_WindOpSimNode(up->node, device);
+    encode_WindOpBase64(up->bytes, up->length, raw);
+    calendar_WindOpEpoch(&cal, up->time);
+    fprintf(out, "%s{\"device_id\":\"%s\",\"raw\":\"%s\",\"time\":\"%04u-%02u-%02uT%02u:%02u:%02uZ\"}",
+            count ? ",\n" : "", device, raw, cal.Year, cal.Month, cal.DayOfMonth, cal.Hours, cal.Minutes,
+            cal.Seconds);
+}
+
+/*
+ * The line the module prints for the uplink, at the time the gateway got
+ * it, or once the line before has gone out over the UART when a burst
+ * arrives faster than the baud rate clears it.
+ */
+static uint8_t writeRn(WindOpSerialLogWriter * log, const WindOpSimUplink * up, int64_t start, uint64_t * lineEnd) {
+    static const char digits[] = "0123456789ABCDEF";
+    char line[2 * WINDOP_MAX_PACKET_LENGTH + 16];
+    uint64_t time = (up->time > start) ? (uint64_t) (up->time - start) * 1000000000u : 0;
+    uint32_t length = 10;
+    uint32_t i;
+
+    memcpy(line, "radio_rx  ", length);
+    for (i = 0; i < up->length; i++) {
+        line[length++] = digits[up->bytes[i] >> 4];
+        line[length++] = digits[up->bytes[i] & 0x0F];
+    }
+    line[length++] = '\r';
+    line[length++] = '\n';
+
+    time = (time > *lineEnd) ? time : *lineEnd;
+    *lineEnd = time + (uint64_t) length * 10 * 1000000000u / RN_BAUD;
+    return append_WindOpSerialLog(log, WINDOP_SERLOG_RX, time, line, length);
+}
+
+int main(int argc, char ** argv) {
+    static char outBuffer[1 << 20];
+    fleetCfg cfg;
+    WindOpSim sim;
+    WindOpArchiveWriter writer;
+    WindOpSerialLogWriter log;
+    const WindOpSimUplink * up;
+    char device[WINDOP_SIM_NAME_SIZE];
+    char line[4 * (WINDOP_MAX_PACKET_LENGTH + 2) / 3 + 2];
+    FILE * out = stdout;
+    uint64_t failed = 0;
+    uint64_t lineEnd = 0;
+    uint32_t length;
+    int64_t end;
+    clock_t start;
+    double seconds;
+    uint32_t t;
+    int result = EXIT_SUCCESS;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.sim.seed = 1;
+    cfg.sim.numNodes = 100;
+    cfg.sim.readings = 10;
+    cfg.sim.start = parseStart("201712010000");
+    cfg.minutes = 1440;
+    processCommandLine(argc, argv, &cfg);
+
+    if (cfg.format == FORMAT_ARC) {
+        if (cfg.outFile == NULL) {
+            printHelp();
+        }
+        if (open_WindOpArchiveWriter(&writer, cfg.outFile) != WINDOP_OK) {
+            fprintf(stderr, "Can't open %s\n", cfg.outFile);
+            return EXIT_FAILURE;
+        }
+    } else if (cfg.format == FORMAT_RN) {
+        if (cfg.outFile == NULL) {
+            printHelp();
+        }
+        if (open_WindOpSerialLogWriter(&log, cfg.outFile, cfg.sim.start * 1000000000, RN_BAUD) != WINDOP_OK) {
+            fprintf(stderr, "Can't open %s\n", cfg.outFile);
+            return EXIT_FAILURE;
+        }
+    } else if ((cfg.format != FORMAT_NONE) && (cfg.outFile != NULL) && ((out = fopen(cfg.outFile, "wb")) == NULL)) {
+        fprintf(stderr, "Can't open %s\n", cfg.outFile);
+        return EXIT_FAILURE;
+    }
+    setvbuf(out, outBuffer, _IOFBF, sizeof(outBuffer));
+
+    switch (init_WindOpSim(&sim, &cfg.sim)) {
+    case WINDOP_OK:
+        break;
+    case WINDOP_ERR_MEMORY:
+        fprintf(stderr, "ERROR out of memory\n");
+        return EXIT_FAILURE;
+    default:
+        printHelp();
+    }
+    end = sim.minute + 60 * (int64_t) cfg.minutes;
+
+    if (cfg.format == FORMAT_JSON) {
+        fprintf(out, "[");
+    }
+    start = clock();
+    while ((cfg.packets != 0) ? (sim.uplinks < cfg.packets) : (sim.minute <= end)) {
+        up = next_WindOpSim(&sim);
+        switch (cfg.format) {
+        case FORMAT_RAW:
+            fwrite(up->bytes, 1, up->length, out);
+            break;
+        case FORMAT_HEX:
+            writeHex(out, up->bytes, up->length);
+            break;
+        case FORMAT_B64:
+            length = encode_WindOpBase64(up->bytes, up->length, line);
+            line[length] = '\n';
+            fwrite(line, 1, length + 1, out);
+            break;
+        case FORMAT_JSON:
+            writeJson(out, up, sim.uplinks - 1);
+            break;
+        case FORMAT_ARC:
+            name_WindOpSimNode(up->node, device);
+            if (append_WindOpArchive(&writer, device, up->bytes, up->length) != WINDOP_OK) {
+                failed++;
+            }
+            break;
+        case FORMAT_RN:
+            if (writeRn(&log, up, cfg.sim.start, &lineEnd) != WINDOP_OK) {
+                failed++;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    if (cfg.format == FORMAT_JSON) {
+        fprintf(out, "\n]\n");
+    }
+    if ((cfg.format == FORMAT_ARC) && (close_WindOpArchiveWriter(&writer) != WINDOP_OK)) {
+        fprintf(stderr, "ERROR writing %s\n", cfg.outFile);
+        result = EXIT_FAILURE;
+    }
+    if ((cfg.format == FORMAT_RN) && ((close_WindOpSerialLogWriter(&log) != WINDOP_OK) || (failed != 0))) {
+        fprintf(stderr, "ERROR writing %s\n", cfg.outFile);
+        result = EXIT_FAILURE;
+    }
+    if (fflush(out) != 0) {
+        fprintf(stderr, "ERROR writing output\n");
+        result = EXIT_FAILURE;
+    }
+    seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    fprintf(stderr, "---Generated %lu uplinks from %u nodes in %.3f s, %.2f M uplinks/s\n",
+            (unsigned long) sim.uplinks, cfg.sim.numNodes, seconds,
+            (seconds > 0) ? sim.uplinks / seconds / 1e6 : 0.0);
+    fprintf(stderr, "%lu readings, %lu corrupt, %lu duplicate", (unsigned long) sim.readings,
+            (unsigned long) sim.corrupt, (unsigned long) sim.duplicates);
+    for (t = 3; t <= 6; t++) {
+        fprintf(stderr, ", %lu T%u", (unsigned long) sim.byType[t], t);
+    }
+    if (cfg.format == FORMAT_ARC) {
+        fprintf(stderr, ", %lu not archived", (unsigned long) failed);
+    }
+    fprintf(stderr, "\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    free_WindOpSim(&sim);
+    return result;
+}
@@ -0,0 +1,299 @@
+/*
+ ============================================================================
+ Name        : wm_fuzz.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : libFuzzer harness for the packet decoders
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_batch.h"
+#include "wm_codec.h"
+#include "wm_gps.h"
+#include "wm_view.h"
+
+/* ****************************************************************************
+ *
+ * Every decoder that takes bytes off the air is run over the input, with the
+ * input length as the only bound. A packet the bounded unpack accepts must
+ * also pack back and unpack to the same readings.
+ *
+ *   make fuzz       : libFuzzer build, needs clang, then
+ *                     ./build/wm_fuzz -max_len=300 corpus/
+ *   make fuzzcheck  : the same harness under ASan and UBSan with the
+ *                     mutating driver at the end of this file, any compiler
+ *
+ * Any crash or sanitizer report is a bug, abort() marks a failed round trip.
+ *
+ * */
+static void fuzzBounded(const uint8_t * data, uint32_t size) {
+    static packCtrl in;
+    static packCtrl out;
+    uint8_t packet[WINDOP_MAX_PACKET_LENGTH];
+    uint32_t length;
+    uint8_t i;
+
+    if (unpackBounded_WindOpDataPacket(&in, data, size) != WINDOP_OK) {
+        return;
+    }
+    if (in.numOfReadings > READINGS_BUFFER_SIZE) {
+        abort();
+    }
+    // T8 packs every channel back, that need not fit where a subset did
+    if (packBounded_WindOpDataPacket(&in, packet, sizeof(packet), &length) != WINDOP_OK) {
+        if (data[0] != WINDOPDATAPACKET_T8_TYPE) {
+            abort();
+        }
+        return;
+    }
+    if ((unpackBounded_WindOpDataPacket(&out, packet, length) != WINDOP_OK) ||
+        (out.numOfReadings != in.numOfReadings) ||
+        (memcmp(&out.time, &in.time, sizeof(in.time)) != 0)) {
+        abort();
+    }
+    for (i = 0; i < in.numOfReadings; i++) {
+        if (memcmp(&out.readings[i], &in.readings[i], sizeof(in.readings[i])) != 0) {
+            abort();
+        }
+    }
+}
+
+static void fuzzColumns(const uint8_t * data, uint32_t size) {
+    static WindOpColumns cols;
+
+    if ((cols.capacity == 0) && (init_WindOpColumns(&cols, 256) != WINDOP_OK)) {
+        abort();
+    }
+    cols.numRows = 0;
+    if (maxReadings_WindOpPacket(data, size) > cols.capacity) {
+        abort(); // The length byte limits any packet to 255 readings
+    }
+    decode_WindOpPacketColumns(data, size, 0, &cols);
+}
+
+// Walk the input as a raw capture, touching every field of every view
+static void fuzzViews(const uint8_t * data, uint32_t size) {
+    WindOpPacketView view;
+    uint32_t offset = 0;
+    volatile int32_t sink = 0;
+    int64_t epoch;
+    uint16_t r;
+    uint8_t ch;
+
+    while (offset < size) {
+        if (next_WindOpPacketView(&view, data, size, &offset) != WINDOP_OK) {
+            continue;
+        }
+        for (r = 0; r < view.numReadings; r++) {
+            readingTime_WindOpPacketView(&view, r, &epoch);
+            for (ch = 0; (view.info->readingSize != 0) && (ch < WINDOP_NUM_CHANNELS); ch++) {
+                if (carries_WindOpPacketView(&view, ch)) {
+                    sink += field_WindOpPacketView(&view, r, ch);
+                }
+            }
+        }
+    }
+}
+
+// T7 fixes, the coordinate text is whatever the receiver sent
+static void fuzzGps(const uint8_t * data, uint32_t size) {
+    static WindOpGpsTrack track;
+    static WindOpGeofence fence;
+
+    if ((track.capacity == 0) && (init_WindOpGpsTrack(&track, 256) != WINDOP_OK)) {
+        abort();
+    }
+    init_WindOpGeofence(&fence, WINDOP_GPS_HOME_LAT, WINDOP_GPS_HOME_LON, 5000);
+    track.numFixes = 0;
+    decode_WindOpGpsPacket(data, size, 0, &fence, &track);
+    decode_WindOpGpsPacket(data, size, 0, NULL, &track);
+    if (track.numFixes > track.capacity) {
+        abort();
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+    // Copied so reads past size land in the sanitizer red zone
+    uint8_t * copy = malloc(size ? size : 1);
+
+    if (copy == NULL) {
+        return 0;
+    }
+    memcpy(copy, data, size);
+    fuzzBounded(copy, (uint32_t) size);
+    fuzzColumns(copy, (uint32_t) size);
+    fuzzViews(copy, (uint32_t) size);
+    fuzzGps(copy, (uint32_t) size);
+    free(copy);
+    return 0;
+}
+
+#ifndef WINDOP_LIBFUZZER
+/* ****************************************************************************
+ *
+ * Stand in for libFuzzer where clang is not available. Runs the files given
+ * as inputs, then mutates packets of every type built by the codec: bit
+ * flips, random bytes, a new length byte, truncation and packets run
+ * together.
+ *
+ *      wm_fuzz_asan [-n iterations] [-seed n] [file...]
+ *
+ * */
+static uint32_t fuzzRandom(uint32_t * seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static uint32_t seedPacket(uint8_t dataType, uint8_t incSeconds, uint8_t numReadings, uint8_t * out) {
+    packCtrl pack;
+    uint32_t length;
+    uint8_t i;
+
+    memset(&pack, 0, sizeof(pack));
+    pack.time.Year = 2017;
+    pack.time.Month = 12;
+    pack.time.DayOfMonth = 31;
+    pack.time.Hours = 23;
+    pack.time.Minutes = 59;
+    pack.time.Seconds = 30;
+    pack.dataType = dataType;
+    pack.incSeconds = incSeconds;
+    pack.numOfReadings = numReadings;
+    for (i = 0; i < numReadings; i++) {
+        pack.readings[i].ws = (uint16_t) (500 + 7 * i);
+        pack.readings[i].wsx = (uint16_t) (900 - 3 * i);
+        pack.readings[i].wsm = 100;
+        pack.readings[i].wd = (uint16_t) (355 + 2 * i) % 360;
+        pack.readings[i].tmp = (int16_t) (20 - 5 * i);
+        pack.readings[i].press = 40000;
+        pack.readings[i].hum = (uint16_t) (65530 + i);
+        pack.readings[i].bv = 3900;
+    }
+    if (packBounded_WindOpDataPacket(&pack, out, WINDOP_MAX_PACKET_LENGTH, &length) != WINDOP_OK) {
+        return 0;
+    }
+    return length;
+}
+
+static uint32_t mutate(uint8_t * data, uint32_t size, uint32_t capacity, uint32_t * seed) {
+    uint32_t edits = 1 + fuzzRandom(seed) % 4;
+
+    while (edits-- > 0) {
+        switch (fuzzRandom(seed) % 6) {
+        case 0:
+            data[fuzzRandom(seed) % size] ^= (uint8_t) (1 << (fuzzRandom(seed) % 8));
+            break;
+        case 1:
+            data[fuzzRandom(seed) % size] = (uint8_t) fuzzRandom(seed);
+            break;
+        case 2:
+            data[1] = (uint8_t) fuzzRandom(seed);
+            break;
+        case 3:
+            data[0] = (uint8_t) (fuzzRandom(seed) % 10);
+            break;
+        case 4:
+            size = 1 + fuzzRandom(seed) % size;
+            break;
+        default:
+            if (size * 2 <= capacity) {
+                memcpy(&data[size], data, size);
+                size *= 2;
+            }
+            break;
+        }
+    }
+    return size;
+}
+
+static int runFile(const char * path) {
+    uint8_t data[4096];
+    size_t size;
+    FILE * in;
+
+    if ((in = fopen(path, "rb")) == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        return 1;
+    }
+    size = fread(data, 1, sizeof(data), in);
+    fclose(in);
+    LLVMFuzzerTestOneInput(data, size);
+    return 0;
+}
+
+int main(int argc, char ** argv) {
+    uint8_t seeds[32][WINDOP_MAX_PACKET_LENGTH];
+    uint32_t seedSize[32];
+    uint8_t data[4 * WINDOP_MAX_PACKET_LENGTH];
+    uint32_t iterations = 1000000;
+    uint32_t numSeeds = 0;
+    uint32_t seed = 1;
+    uint32_t size;
+    uint32_t n;
+    uint8_t dataType;
+    int files = 0;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+            iterations = (uint32_t) strtoul(argv[++i], NULL, 0);
+        } else if ((strcmp(argv[i], "-seed") == 0) && (i + 1 < argc)) {
+            seed = (uint32_t) strtoul(argv[++i], NULL, 0);
+        } else if (runFile(argv[i]) == 0) {
+            files++;
+        } else {
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (dataType = WINDOPDATAPACKET_T3_TYPE; dataType <= WINDOPDATAPACKET_T8_TYPE; dataType++) {
+        for (n = 0; (n < 4) && (info_WindOpDataType(dataType) != NULL); n++) {
+            seedSize[numSeeds] = seedPacket(dataType, n & 1, (uint8_t) (1 + 4 * n), seeds[numSeeds]);
+            numSeeds += (seedSize[numSeeds] != 0);
+        }
+    }
+    for (n = 0; n < 2; n++) {
+        pack_WindOpGpsPacket(1514764770, WINDOP_GPS_HOME_LAT - 90.0 * n, WINDOP_GPS_HOME_LON + 170.0 * n, 3900,
+                             seeds[numSeeds], WINDOP_MAX_PACKET_LENGTH, &seedSize[numSeeds]);
+        numSeeds++;
+    }
+
+    for (n = 0; n < iterations; n++) {
+        i = (int) (fuzzRandom(&seed) % numSeeds);
+        memcpy(data, seeds[i], seedSize[i]);
+        size = mutate(data, seedSize[i], sizeof(data), &seed);
+        LLVMFuzzerTestOneInput(data, size);
+    }
+
+    fprintf(stderr, "--- %d files, %u mutations of %u seed packets, no faults\n", files, iterations, numSeeds);
+    return EXIT_SUCCESS;
+}
+#endif
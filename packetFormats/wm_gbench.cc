@@ -0,0 +1,295 @@
+/*
+ ============================================================================
+ Name        : wm_gbench.cc
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Google Benchmark suite for the packet codecs and time stamps
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+/*
+ * Google Benchmark suite. make gbench runs it and leaves the results as
+ * JSON in build/wm_gbench.json for regression tracking. The readings come
+ * from the fleet simulator so the packed values look like real uplinks.
+ *
+ * The legacy pack and unpack_WindOpDataPacket cases show the cost of the
+ * trace printf when the library is built with make TRACE=1.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "wm_codec.h"
+#include "wm_sim.h"
+
+#define SIM_READINGS             (2 * 15) // Two T3 packets worth
+
+static packCtrl simReadings;
+
+// Readings of one T3 node, two full packets after its short first one
+static void setupReadings() {
+    static bool done = false;
+    WindOpSimConfig config;
+    WindOpSim sim;
+    packCtrl pack;
+    uint32_t have = 0;
+    const WindOpSimUplink * up;
+
+    if (done) {
+        return;
+    }
+    memset(&config, 0, sizeof(config));
+    config.seed = 1;
+    config.numNodes = 1;
+    config.start = 1512086400; // 2017-12-01
+    config.readings = 15;
+    config.profiles = 1u << WINDOP_SIM_T3;
+    init_WindOpSim(&sim, &config);
+    next_WindOpSim(&sim);
+    while (have < SIM_READINGS) {
+        up = next_WindOpSim(&sim);
+        unpackBounded_WindOpDataPacket(&pack, up->bytes, up->length);
+        memcpy(&simReadings.readings[have], pack.readings, pack.numOfReadings * sizeof(pack.readings[0]));
+        have += pack.numOfReadings;
+    }
+    simReadings.time = pack.time;
+    free_WindOpSim(&sim);
+    done = true;
+}
+
+static packCtrl makePack(uint8_t dataType, uint8_t numReadings, uint8_t incSeconds) {
+    packCtrl pack;
+
+    setupReadings();
+    pack = simReadings;
+    pack.dataType = dataType;
+    pack.numOfReadings = numReadings;
+    pack.incSeconds = incSeconds;
+    return pack;
+}
+
+static void setCounters(benchmark::State & state, uint64_t bytes, uint64_t readings) {
+    state.SetBytesProcessed((int64_t) (state.iterations() * bytes));
+    state.SetItemsProcessed((int64_t) (state.iterations() * readings));
+}
+
+/* ****************************************************************************
+ * Per type, args are the type and readings per packet
+ * */
+static void BM_PackPacket(benchmark::State & state) {
+    packCtrl pack = makePack((uint8_t) state.range(0), (uint8_t) state.range(1), 0);
+    uint8_t out[WINDOP_MAX_PACKET_LENGTH];
+    uint32_t length = 0;
+
+    for (auto _ : state) {
+        packBounded_WindOpDataPacket(&pack, out, sizeof(out), &length);
+        benchmark::DoNotOptimize(out);
+        benchmark::ClobberMemory();
+    }
+    setCounters(state, length, pack.numOfReadings);
+}
+
+static void BM_UnpackPacket(benchmark::State & state) {
+    packCtrl pack = makePack((uint8_t) state.range(0), (uint8_t) state.range(1), 0);
+    uint8_t in[WINDOP_MAX_PACKET_LENGTH];
+    uint32_t length = 0;
+
+    if (packBounded_WindOpDataPacket(&pack, in, sizeof(in), &length) != WINDOP_OK) {
+        state.SkipWithError("packet does not pack");
+        return;
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(unpackBounded_WindOpDataPacket(&pack, in, length));
+        benchmark::ClobberMemory();
+    }
+    setCounters(state, length, pack.numOfReadings);
+}
+
+static void BM_PackPacketLegacy(benchmark::State & state) {
+    packCtrl pack = makePack((uint8_t) state.range(0), (uint8_t) state.range(1), 0);
+    uint8_t out[BYTEBUFFERSIZE];
+    uint16_t length = 0;
+
+    for (auto _ : state) {
+        length = pack_WindOpDataPacket(&pack, out);
+        benchmark::DoNotOptimize(out);
+        benchmark::ClobberMemory();
+    }
+    setCounters(state, length, pack.numOfReadings);
+}
+
+static void BM_UnpackPacketLegacy(benchmark::State & state) {
+    packCtrl pack = makePack((uint8_t) state.range(0), (uint8_t) state.range(1), 0);
+    uint8_t in[BYTEBUFFERSIZE];
+    uint32_t length = 0;
+
+    packBounded_WindOpDataPacket(&pack, in, WINDOP_MAX_PACKET_LENGTH, &length);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(unpack_WindOpDataPacket(&pack, in));
+        benchmark::ClobberMemory();
+    }
+    setCounters(state, length, pack.numOfReadings);
+}
+
+// 1, 8 and as many readings as fit the type
+static void packetArgs(benchmark::internal::Benchmark * b) {
+    static const uint8_t types[] = {
+        WINDOPDATAPACKET_T3_TYPE, WINDOPDATAPACKET_T4_TYPE, WINDOPDATAPACKET_T5_TYPE, WINDOPDATAPACKET_T6_TYPE,
+        WINDOPDATAPACKET_T8_TYPE
+    };
+    const WindOpTypeInfo * info;
+    uint32_t most;
+
+    b->ArgNames({ "type", "readings" });
+    for (uint8_t type : types) {
+        info = info_WindOpDataType(type);
+        most = (info->readingSize == 0) ? READINGS_BUFFER_SIZE
+            : (WINDOP_MAX_PACKET_LENGTH - WINDOP_PACKET_HEADER_SIZE - WINDOP_TIME_SIZE) / info->readingSize;
+        most = (most < READINGS_BUFFER_SIZE) ? most : READINGS_BUFFER_SIZE;
+        b->Args({ type, 1 });
+        b->Args({ type, 8 });
+        b->Args({ type, (int64_t) most });
+    }
+}
+
+BENCHMARK(BM_PackPacket)->Apply(packetArgs);
+BENCHMARK(BM_UnpackPacket)->Apply(packetArgs);
+BENCHMARK(BM_PackPacketLegacy)->ArgNames({ "type", "readings" })->Args({ WINDOPDATAPACKET_T3_TYPE, 8 });
+BENCHMARK(BM_UnpackPacketLegacy)->ArgNames({ "type", "readings" })->Args({ WINDOPDATAPACKET_T3_TYPE, 8 });
+
+/* ****************************************************************************
+ * Time stamps, the arg is 0 for the 4 byte form, 1 for 5 bytes with seconds
+ * */
+static void BM_PackMinuteTime(benchmark::State & state) {
+    packCtrl pack = makePack(WINDOPDATAPACKET_T3_TYPE, 1, 0);
+    uint8_t out[WINDOP_TIME_EXT_SIZE];
+    uint16_t length = 0;
+
+    for (auto _ : state) {
+        length = pack_WindOpMinuteTime(&pack.time, out, (uint8_t) state.range(0));
+        benchmark::DoNotOptimize(out);
+        benchmark::ClobberMemory();
+    }
+    setCounters(state, length, 1);
+}
+
+static void BM_UnpackMinuteTime(benchmark::State & state) {
+    packCtrl pack = makePack(WINDOPDATAPACKET_T3_TYPE, 1, 0);
+    Calendar cal;
+    uint8_t in[WINDOP_TIME_EXT_SIZE];
+    uint16_t length = pack_WindOpMinuteTime(&pack.time, in, (uint8_t) state.range(0));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(unpack_WindOpMinuteTime(&cal, in));
+        benchmark::DoNotOptimize(cal);
+    }
+    setCounters(state, length, 1);
+}
+
+static void BM_PackEpochTime(benchmark::State & state) {
+    int64_t epoch = 1512086400;
+    uint8_t out[WINDOP_TIME_EXT_SIZE];
+    uint16_t length = 0;
+
+    for (auto _ : state) {
+        length = pack_WindOpEpochTime(epoch, out, (uint8_t) state.range(0));
+        benchmark::DoNotOptimize(out);
+        benchmark::ClobberMemory();
+        epoch += 61;
+    }
+    setCounters(state, length, 1);
+}
+
+static void BM_UnpackEpochTime(benchmark::State & state) {
+    uint8_t in[WINDOP_TIME_EXT_SIZE];
+    uint16_t length = pack_WindOpEpochTime(1512086417, in, (uint8_t) state.range(0));
+    int64_t epoch;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(unpack_WindOpEpochTime(in, &epoch));
+        benchmark::DoNotOptimize(epoch);
+    }
+    setCounters(state, length, 1);
+}
+
+BENCHMARK(BM_PackMinuteTime)->ArgName("incSecs")->Arg(0)->Arg(1);
+BENCHMARK(BM_UnpackMinuteTime)->ArgName("incSecs")->Arg(0)->Arg(1);
+BENCHMARK(BM_PackEpochTime)->ArgName("incSecs")->Arg(0)->Arg(1);
+BENCHMARK(BM_UnpackEpochTime)->ArgName("incSecs")->Arg(0)->Arg(1);
+
+/* ****************************************************************************
+ * Round trips over a batch of the simulator's mixed T3 to T6 uplinks,
+ * unpacked and packed again. The arg is the packets per batch.
+ * */
+static void BM_RoundTrip(benchmark::State & state) {
+    const uint32_t batch = (uint32_t) state.range(0);
+    std::vector<uint8_t> bytes(batch * WINDOP_MAX_PACKET_LENGTH);
+    std::vector<packCtrl> packs(batch);
+    WindOpSimConfig config;
+    WindOpSim sim;
+    const WindOpSimUplink * up;
+    uint64_t totalBytes = 0;
+    uint64_t readings = 0;
+    uint32_t length;
+    uint32_t i;
+
+    memset(&config, 0, sizeof(config));
+    config.seed = 1;
+    config.numNodes = 64;
+    config.start = 1512086400;
+    config.readings = 8;
+    config.profiles = (1u << WINDOP_SIM_T3) | (1u << WINDOP_SIM_T4_T5);
+    init_WindOpSim(&sim, &config);
+    while (sim.minute < config.start + 60 * config.readings) {
+        next_WindOpSim(&sim); // Past the short first packets
+    }
+    for (i = 0; i < batch; i++) {
+        up = next_WindOpSim(&sim);
+        memcpy(&bytes[i * WINDOP_MAX_PACKET_LENGTH], up->bytes, up->length);
+        unpackBounded_WindOpDataPacket(&packs[i], up->bytes, up->length);
+        totalBytes += up->length;
+        readings += packs[i].numOfReadings;
+    }
+    free_WindOpSim(&sim);
+
+    for (auto _ : state) {
+        for (i = 0; i < batch; i++) {
+            uint8_t * packet = &bytes[i * WINDOP_MAX_PACKET_LENGTH];
+            unpackBounded_WindOpDataPacket(&packs[i], packet, packet[1]);
+            packBounded_WindOpDataPacket(&packs[i], packet, WINDOP_MAX_PACKET_LENGTH, &length);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.counters["packets/s"] = benchmark::Counter((double) batch, benchmark::Counter::kIsIterationInvariantRate);
+    setCounters(state, totalBytes, readings);
+}
+
+BENCHMARK(BM_RoundTrip)->ArgName("batch")->RangeMultiplier(8)->Range(1, 4096);
+
+BENCHMARK_MAIN();
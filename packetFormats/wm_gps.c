@@ -0,0 +1,315 @@
+/*
+ ============================================================================
+ Name        : wm_gps.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : GPS fixes from T7 packets, distance and geofence
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_codec.h"
+#include "wm_gps.h"
+
+#define DEG_TO_RAD               (M_PI / 180.0)
+#define GPS_READING_SIZE         (2 * WINDOP_GPS_TEXT_SIZE + 2)
+
+static const double pow10Table[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12 };
+
+/* ****************************************************************************
+ *
+ * One pass, digits into an integer, the point and hemisphere noted as they
+ * go by. Padding is allowed before the first digit and after the letter,
+ * anything else is a format error, as is a missing letter, fewer than
+ * three whole digits (ddmm needs the minutes) or no fraction. Lower case
+ * letters are taken as the scripts did.
+ *
+ * */
+uint8_t parse_WindOpNmeaCoordinate(const uint8_t * text, uint32_t length, double * degrees) {
+    uint64_t value = 0;
+    uint32_t digits = 0;
+    uint32_t whole = 0;
+    uint8_t havePoint = 0;
+    uint8_t hemisphere = 0;
+    uint64_t scale;
+    uint64_t wholeMinutes;
+    double deg;
+    double minutes;
+    uint32_t i;
+
+    for (i = 0; i < length; i++) {
+        const uint8_t c = text[i];
+        const uint8_t d = (uint8_t) (c - '0');
+
+        if (d < 10) {
+            value = value * 10 + d;
+            digits++;
+        } else if ((c == '.') && !havePoint && digits) {
+            havePoint = 1;
+            whole = digits;
+        } else if ((c == ' ') || (c == 0)) {
+            if (digits) {
+                return WINDOP_ERR_FORMAT;
+            }
+        } else {
+            hemisphere = c | 0x20;
+            break;
+        }
+    }
+    for (i++; i < length; i++) {
+        if ((text[i] != ' ') && (text[i] != 0)) {
+            return WINDOP_ERR_FORMAT;
+        }
+    }
+    if (!havePoint || (whole < 3) || (digits == whole) || (digits >= sizeof(pow10Table) / sizeof(pow10Table[0]))) {
+        return WINDOP_ERR_FORMAT;
+    }
+
+    // ddmm.mmmm is value / 10^fraction, the last two whole digits the minutes
+    scale = (uint64_t) pow10Table[digits - whole];
+    wholeMinutes = value / scale;
+    deg = (double) (wholeMinutes / 100);
+    minutes = (double) (value - (wholeMinutes / 100) * 100 * scale) / (double) scale;
+    if (minutes >= 60.0) {
+        return WINDOP_ERR_FORMAT;
+    }
+    deg += minutes / 60.0;
+
+    switch (hemisphere) {
+    case 'n':
+    case 's':
+        if (deg > 90.0) {
+            return WINDOP_ERR_FORMAT;
+        }
+        break;
+    case 'e':
+    case 'w':
+        if (deg > 180.0) {
+            return WINDOP_ERR_FORMAT;
+        }
+        break;
+    default:
+        return WINDOP_ERR_FORMAT;
+    }
+    *degrees = ((hemisphere == 's') || (hemisphere == 'w')) ? -deg : deg;
+    return WINDOP_OK;
+}
+
+/* ****************************************************************************
+ * Fixes as columns
+ * */
+uint8_t init_WindOpGpsTrack(WindOpGpsTrack * track, uint32_t capacity) {
+    memset(track, 0, sizeof(*track));
+    return reserve_WindOpGpsTrack(track, capacity ? capacity : 1);
+}
+
+void free_WindOpGpsTrack(WindOpGpsTrack * track) {
+    free(track->time);
+    free(track->lat);
+    free(track->lon);
+    free(track->bv);
+    free(track->packet);
+    memset(track, 0, sizeof(*track));
+}
+
+static uint8_t growColumn(void ** column, uint32_t capacity, size_t elemSize) {
+    void * grown = realloc(*column, capacity * elemSize);
+    if (grown == NULL) {
+        return WINDOP_ERR_MEMORY;
+    }
+    *column = grown;
+    return WINDOP_OK;
+}
+
+uint8_t reserve_WindOpGpsTrack(WindOpGpsTrack * track, uint32_t fixes) {
+    uint32_t capacity = track->capacity ? track->capacity : 256;
+    uint8_t result = WINDOP_OK;
+
+    if (fixes <= track->capacity - track->numFixes) {
+        return WINDOP_OK;
+    }
+    while (capacity - track->numFixes < fixes) {
+        capacity *= 2;
+    }
+    result |= growColumn((void **) &track->time, capacity, sizeof(int64_t));
+    result |= growColumn((void **) &track->lat, capacity, sizeof(double));
+    result |= growColumn((void **) &track->lon, capacity, sizeof(double));
+    result |= growColumn((void **) &track->bv, capacity, sizeof(uint16_t));
+    result |= growColumn((void **) &track->packet, capacity, sizeof(uint32_t));
+    if (result != WINDOP_OK) {
+        return WINDOP_ERR_MEMORY;
+    }
+    track->capacity = capacity;
+    return WINDOP_OK;
+}
+
+/* ****************************************************************************
+ * Distance and geofence
+ * */
+void init_WindOpGeofence(WindOpGeofence * fence, double lat, double lon, double radius) {
+    const double half = sin(0.5 * radius / WINDOP_GPS_EARTH_RADIUS);
+
+    fence->lat = lat;
+    fence->lon = lon;
+    fence->radius = radius;
+    fence->latRad = lat * DEG_TO_RAD;
+    fence->lonRad = lon * DEG_TO_RAD;
+    fence->cosLat = cos(fence->latRad);
+    // Past half way round every fix is inside
+    fence->limit = (radius >= M_PI * WINDOP_GPS_EARTH_RADIUS) ? 1.0 : half * half;
+}
+
+/*
+ * Straight line loops over the arrays, the reference point hoisted out.
+ * fmin keeps rounding from pushing the term past 1 without a branch.
+ */
+void distance_WindOpGps(const double * restrict lat, const double * restrict lon, uint32_t n, double lat0,
+                        double lon0, double * restrict metres) {
+    const double lat0Rad = lat0 * DEG_TO_RAD;
+    const double lon0Rad = lon0 * DEG_TO_RAD;
+    const double cosLat0 = cos(lat0Rad);
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        const double a = haversine_WindOpGps(lat0Rad, cosLat0, lon0Rad, lat[i] * DEG_TO_RAD, lon[i] * DEG_TO_RAD);
+        metres[i] = 2.0 * WINDOP_GPS_EARTH_RADIUS * asin(sqrt(fmin(a, 1.0)));
+    }
+}
+
+uint32_t within_WindOpGeofence(const WindOpGeofence * fence, const double * restrict lat,
+                               const double * restrict lon, uint32_t n, uint8_t * restrict inside) {
+    const double lat0 = fence->latRad;
+    const double lon0 = fence->lonRad;
+    const double cosLat0 = fence->cosLat;
+    const double limit = fence->limit;
+    uint32_t count = 0;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        inside[i] = haversine_WindOpGps(lat0, cosLat0, lon0, lat[i] * DEG_TO_RAD, lon[i] * DEG_TO_RAD) <= limit;
+        count += inside[i];
+    }
+    return count;
+}
+
+/* ****************************************************************************
+ * T7 packets
+ * */
+uint8_t decode_WindOpGpsPacket(const uint8_t * packet, uint32_t length, uint32_t packetIndex,
+                               const WindOpGeofence * fence, WindOpGpsTrack * track) {
+    WindOpPacketHeader hdr;
+    const uint8_t * p;
+    double lat;
+    double lon;
+    uint32_t row;
+    uint8_t status;
+    uint16_t i;
+
+    status = parse_WindOpPacketHeader(&hdr, packet, length);
+    if (status != WINDOP_OK) {
+        return status;
+    }
+    if (hdr.info->dataType != WINDOPDATAPACKET_T7_TYPE) {
+        return WINDOP_ERR_TYPE;
+    }
+    if (reserve_WindOpGpsTrack(track, hdr.numReadings) != WINDOP_OK) {
+        return WINDOP_ERR_MEMORY;
+    }
+
+    p = &packet[hdr.dataOffset];
+    row = track->numFixes;
+    for (i = 0; i < hdr.numReadings; i++, p += GPS_READING_SIZE) {
+        if ((parse_WindOpNmeaCoordinate(p, WINDOP_GPS_TEXT_SIZE, &lat) != WINDOP_OK) ||
+            (parse_WindOpNmeaCoordinate(p + WINDOP_GPS_TEXT_SIZE, WINDOP_GPS_TEXT_SIZE, &lon) != WINDOP_OK)) {
+            track->noFix++;
+            continue;
+        }
+        if ((fence != NULL) && (haversine_WindOpGps(fence->latRad, fence->cosLat, fence->lonRad, lat * DEG_TO_RAD,
+                                                    lon * DEG_TO_RAD) > fence->limit)) {
+            track->outside++;
+            continue;
+        }
+        track->time[row] = hdr.firstTime + (int64_t) i * 60;
+        track->lat[row] = lat;
+        track->lon[row] = lon;
+        track->bv[row] = (uint16_t) (p[2 * WINDOP_GPS_TEXT_SIZE] | (p[2 * WINDOP_GPS_TEXT_SIZE + 1] << 8));
+        track->packet[row] = packetIndex;
+        row++;
+    }
+    track->numFixes = row;
+
+    return WINDOP_OK;
+}
+
+/*
+ * NMEA form, four places of minutes as the receivers give, rounded up
+ * into the next minute or degree when they carry.
+ */
+static void formatCoordinate(double degrees, uint8_t degreeDigits, char positive, char negative, uint8_t * out) {
+    const char hemisphere = (degrees < 0) ? negative : positive;
+    uint64_t tenThousandths = (uint64_t) llround(fabs(degrees) * 60.0 * 10000.0);
+    const uint32_t deg = (uint32_t) (tenThousandths / 600000);
+    const uint32_t minutes = (uint32_t) (tenThousandths % 600000);
+    char text[WINDOP_GPS_TEXT_SIZE + 8];
+    int n;
+
+    n = snprintf(text, sizeof(text), "%0*u%02u.%04u%c", degreeDigits, deg, minutes / 10000, minutes % 10000,
+                 hemisphere);
+    memset(out, ' ', WINDOP_GPS_TEXT_SIZE);
+    memcpy(out, text, (n < WINDOP_GPS_TEXT_SIZE) ? (size_t) n : WINDOP_GPS_TEXT_SIZE);
+}
+
+uint8_t pack_WindOpGpsPacket(int64_t time, double lat, double lon, uint16_t bv, uint8_t * out, uint32_t capacity,
+                             uint32_t * length) {
+    const uint32_t size = WINDOP_PACKET_HEADER_SIZE + WINDOP_TIME_SIZE + GPS_READING_SIZE;
+    uint8_t * p = &out[WINDOP_PACKET_HEADER_SIZE + WINDOP_TIME_SIZE];
+
+    *length = 0;
+    if (capacity < size) {
+        return WINDOP_ERR_CAPACITY;
+    }
+    if (!(fabs(lat) <= 90.0) || !(fabs(lon) <= 180.0)) {
+        return WINDOP_ERR_FORMAT;
+    }
+    if (pack_WindOpEpochTime(time, &out[WINDOP_PACKET_HEADER_SIZE], 0) == 0) {
+        return WINDOP_ERR_TIME;
+    }
+    out[0] = WINDOPDATAPACKET_T7_TYPE;
+    out[1] = (uint8_t) size;
+    formatCoordinate(lat, 2, 'N', 'S', p);
+    formatCoordinate(lon, 3, 'E', 'W', p + WINDOP_GPS_TEXT_SIZE);
+    p[2 * WINDOP_GPS_TEXT_SIZE] = (uint8_t) bv;
+    p[2 * WINDOP_GPS_TEXT_SIZE + 1] = (uint8_t) (bv >> 8);
+
+    *length = size;
+    return WINDOP_OK;
+}
@@ -0,0 +1,136 @@
+/*
+ ============================================================================
+ Name        : wm_gps.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : GPS fixes from T7 packets, distance and geofence
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+
+#ifndef WM_GPS_H
+#define WM_GPS_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include "wm_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ****************************************************************************
+ *
+ * T7 readings are a GPS fix, the latitude then the longitude as the NMEA
+ * text the receiver gave, ddmm.mmmm and dddmm.mmmm then N, S, E or W in 13
+ * bytes each, space or NUL padded, then bv. See WINDOP_SCHEMA_T7.
+ *
+ * The coordinates parse in one pass over the bytes into an integer, no
+ * regex or string building. Distances are haversine over a spherical
+ * earth of the radius GIS::Distance used in the scripts, the batch kernel
+ * runs over plain arrays with no branches. A geofence compares the
+ * haversine term against its radius, so fixes are kept or dropped with no
+ * square root or arcsine.
+ *
+ * */
+#define WINDOP_GPS_TEXT_SIZE       13
+#define WINDOP_GPS_EARTH_RADIUS    6371640.0   // Metres
+#define WINDOP_GPS_HOME_LAT        55.8592955  // The reference point of s1_wm_node_fetchUnpack.pl
+#define WINDOP_GPS_HOME_LON        -3.1618687
+
+// text of length bytes to signed degrees, returns WINDOP_OK or WINDOP_ERR_FORMAT
+uint8_t parse_WindOpNmeaCoordinate(const uint8_t * text, uint32_t length, double * degrees);
+
+/* ****************************************************************************
+ * Fixes as columns
+ * */
+typedef struct WindOpGpsTrack {
+    uint32_t capacity;
+    uint32_t numFixes;
+    int64_t * time;           // Epoch seconds UTC
+    double * lat;             // Degrees, north positive
+    double * lon;             // Degrees, east positive
+    uint16_t * bv;            // Raw, scale from info_WindOpDataType
+    uint32_t * packet;        // Index of the source packet
+    uint64_t noFix;           // Readings whose coordinates did not parse
+    uint64_t outside;         // Fixes the geofence dropped
+} WindOpGpsTrack;
+
+uint8_t init_WindOpGpsTrack(WindOpGpsTrack * track, uint32_t capacity);
+uint8_t reserve_WindOpGpsTrack(WindOpGpsTrack * track, uint32_t fixes);
+void free_WindOpGpsTrack(WindOpGpsTrack * track);
+
+/* ****************************************************************************
+ * Distance and geofence
+ * */
+typedef struct WindOpGeofence {
+    double lat;               // Centre, degrees
+    double lon;
+    double radius;            // Metres
+    double latRad;
+    double lonRad;
+    double cosLat;
+    double limit;             // Haversine term at radius
+} WindOpGeofence;
+
+void init_WindOpGeofence(WindOpGeofence * fence, double lat, double lon, double radius);
+
+// sin^2(dlat/2) + cos(lat0) cos(lat) sin^2(dlon/2), all in radians
+static inline double haversine_WindOpGps(double lat0, double cosLat0, double lon0, double lat, double lon) {
+    const double sinLat = sin(0.5 * (lat - lat0));
+    const double sinLon = sin(0.5 * (lon - lon0));
+    return sinLat * sinLat + cosLat0 * cos(lat) * sinLon * sinLon;
+}
+
+// Metres from lat0, lon0 to each of n fixes, degrees in
+void distance_WindOpGps(const double * lat, const double * lon, uint32_t n, double lat0, double lon0,
+                        double * metres);
+
+// inside[i] is 1 for a fix within the fence, returns how many are
+uint32_t within_WindOpGeofence(const WindOpGeofence * fence, const double * lat, const double * lon, uint32_t n,
+                               uint8_t * inside);
+
+/* ****************************************************************************
+ *
+ * Append the fixes of a T7 packet to track, one per reading a minute
+ * apart. With a fence, fixes outside it are counted and dropped. Returns
+ * a WINDOP_* code, WINDOP_ERR_TYPE for packets of another type.
+ *
+ * */
+uint8_t decode_WindOpGpsPacket(const uint8_t * packet, uint32_t length, uint32_t packetIndex,
+                               const WindOpGeofence * fence, WindOpGpsTrack * track);
+
+// A T7 packet of one fix, for tests and simulated nodes. Returns a WINDOP_* code
+uint8_t pack_WindOpGpsPacket(int64_t time, double lat, double lon, uint16_t bv, uint8_t * out, uint32_t capacity,
+                             uint32_t * length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_GPS_H
@@ -0,0 +1,522 @@
+/*
+ ============================================================================
+ Name        : wm_ingest.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Multithreaded base64 to columns ingestion pipeline
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "wm_codec.h"
+#include "wm_base64.h"
+#include "wm_batch.h"
+#include "wm_csv.h"
+#include "wm_metrics.h"
+#include "wm_pool.h"
+#include "wm_queue.h"
+
+static const char * helpText =
+"\n"
+"   WindOp ingestion pipeline\n"
+"\n"
+"   Reads one uplink payload per line and runs it through\n"
+"\n"
+"      read -> base64 decode -> packet decode -> aggregate\n"
+"\n"
+"   Batches of lines move between the stages over bounded lock free queues,\n"
+"   the decode stages run on a work stealing pool. Per stage throughput and\n"
+"   queue depth are reported on stderr at the end.\n"
+"\n"
+"      wm_ingest [options] [file]     : Reads stdin when no file is given\n"
+"\n"
+"      -threads n             : Pool workers, default one per CPU\n"
+"      -batch kb              : Input bytes per batch, default 256\n"
+"      -hex                   : Lines are hex, default is base64\n"
+"      -o file                : Write the merged CSV to file\n"
+"      -metrics file          : Write the decode metrics to file at the end,\n"
+"                               Prometheus text format\n"
+"      -help                  : Prints this\n"
+"\n";
+
+#define STAGE_READ               0
+#define STAGE_BASE64             1
+#define STAGE_DECODE             2
+#define STAGE_AGGREGATE          3
+#define NUM_STAGES               4
+
+static const char * stageNames[NUM_STAGES] = { "read", "base64", "decode", "aggregate" };
+
+#define BATCHES_PER_WORKER       4 // In flight batches, bounds memory
+#define WORKER_QUEUE_SIZE        64
+
+/* ****************************************************************************
+ *
+ * A batch carries a block of whole input lines through every stage, each
+ * stage filling in the next set of fields.
+ *
+ * */
+typedef struct ingestBatch {
+    uint64_t sequence;
+    uint8_t stage;            // Stage the batch is waiting for
+
+    char * text;              // Whole lines
+    uint32_t textBytes;
+
+    uint8_t * bytes;          // Packets back to back
+    uint32_t * offsets;
+    uint32_t numPackets;
+    uint32_t badLines;
+
+    WindOpColumns cols;
+    uint32_t failed;
+} ingestBatch;
+
+typedef struct stageStats {
+    atomic_uint_fast64_t batches;
+    atomic_uint_fast64_t items;       // Lines, packets, rows by stage
+    atomic_uint_fast64_t bytes;
+    atomic_uint_fast64_t busyNs;
+    atomic_uint_fast64_t depth;       // Batches queued for the stage now
+    uint64_t maxDepth;
+    uint64_t depthSum;                // Sampled once per batch read
+} stageStats;
+
+typedef struct ingestCfg {
+    const char * inFile;
+    const char * outFile;
+    const char * metricsFile;
+    uint32_t threads;
+    uint32_t batchBytes;
+    uint8_t hex;
+} ingestCfg;
+
+typedef struct ingestCtx {
+    ingestCfg * cfg;
+    WindOpPool pool;
+    WindOpQueue aggregateQueue;
+    stageStats stats[NUM_STAGES];
+    atomic_uint_fast64_t inFlight;
+    uint32_t maxInFlight;
+    atomic_int readDone;
+    uint64_t numBatches;              // Set once reading ends
+
+    WindOpColumns result;
+    uint64_t badLines;
+    uint64_t failed;
+    uint64_t packets;
+} ingestCtx;
+
+static uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void outOfMemory(void) {
+    fprintf(stderr, "ERROR out of memory\n");
+    exit(EXIT_FAILURE);
+}
+
+static void stageDone(stageStats * stats, uint64_t start, uint64_t items, uint64_t bytes) {
+    atomic_fetch_add_explicit(&stats->batches, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->items, items, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->bytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->busyNs, nowNs() - start, memory_order_relaxed);
+}
+
+/* ****************************************************************************
+ *
+ * Stages run on the pool
+ *
+ * */
+static void base64Stage(ingestCtx * ctx, ingestBatch * batch) {
+    uint64_t start = nowNs();
+    char * line = batch->text;
+    char * end = batch->text + batch->textBytes;
+    char * eol;
+    uint32_t lineLength;
+    uint32_t lines = 0;
+    int32_t length;
+
+    // Never more packets than lines or packet bytes than text
+    batch->bytes = malloc(batch->textBytes + 1);
+    batch->offsets = malloc((batch->textBytes / 2 + 2) * sizeof(uint32_t));
+    if ((batch->bytes == NULL) || (batch->offsets == NULL)) {
+        outOfMemory();
+    }
+    batch->offsets[0] = 0;
+
+    for (; line < end; line = eol + 1) {
+        eol = memchr(line, '\n', end - line);
+        eol = (eol != NULL) ? eol : end;
+        lineLength = (uint32_t) (eol - line);
+        while ((lineLength > 0) && ((line[lineLength - 1] == '\r') || (line[lineLength - 1] == ' '))) {
+            lineLength--;
+        }
+        if (lineLength == 0) {
+            continue;
+        }
+        lines++;
+        if (ctx->cfg->hex) {
+            length = decode_WindOpHex(line, lineLength, &batch->bytes[batch->offsets[batch->numPackets]], lineLength);
+        } else {
+            length = decode_WindOpBase64(line, lineLength, &batch->bytes[batch->offsets[batch->numPackets]], lineLength);
+        }
+        if (length < 0) {
+            batch->badLines++;
+            continue;
+        }
+        batch->offsets[batch->numPackets + 1] = batch->offsets[batch->numPackets] + (uint32_t) length;
+        batch->numPackets++;
+    }
+
+    stageDone(&ctx->stats[STAGE_BASE64], start, lines, batch->textBytes);
+    free(batch->text);
+    batch->text = NULL;
+}
+
+static void decodeStage(ingestCtx * ctx, ingestBatch * batch) {
+    uint64_t start = nowNs();
+    uint32_t rows = 0;
+    uint32_t i;
+
+    for (i = 0; i < batch->numPackets; i++) {
+        rows += maxReadings_WindOpPacket(&batch->bytes[batch->offsets[i]], batch->offsets[i + 1] - batch->offsets[i]);
+    }
+    if (init_WindOpColumns(&batch->cols, rows) != WINDOP_OK) {
+        outOfMemory();
+    }
+    for (i = 0; i < batch->numPackets; i++) {
+        if (decode_WindOpPacketColumns(&batch->bytes[batch->offsets[i]], batch->offsets[i + 1] - batch->offsets[i],
+                                       i, &batch->cols) != WINDOP_OK) {
+            batch->failed++;
+        }
+    }
+
+    stageDone(&ctx->stats[STAGE_DECODE], start, batch->numPackets, batch->offsets[batch->numPackets]);
+    free(batch->bytes);
+    batch->bytes = NULL;
+}
+
+static void queueForStage(ingestCtx * ctx, uint8_t stage) {
+    stageStats * stats = &ctx->stats[stage];
+    uint64_t depth = atomic_fetch_add_explicit(&stats->depth, 1, memory_order_relaxed) + 1;
+
+    if (depth > stats->maxDepth) {
+        stats->maxDepth = depth; // Racy high water mark, good enough for a report
+    }
+}
+
+static void runTask(WindOpPool * pool, uint32_t worker, void * task) {
+    ingestCtx * ctx = pool->context;
+    ingestBatch * batch = task;
+
+    atomic_fetch_sub_explicit(&ctx->stats[batch->stage].depth, 1, memory_order_relaxed);
+    if (batch->stage == STAGE_BASE64) {
+        base64Stage(ctx, batch);
+        batch->stage = STAGE_DECODE;
+        queueForStage(ctx, STAGE_DECODE);
+        // Keep the batch on this worker while its bytes are in cache
+        if (!submit_WindOpPool(pool, worker, batch)) {
+            runTask(pool, worker, batch);
+        }
+        return;
+    }
+
+    decodeStage(ctx, batch);
+    batch->stage = STAGE_AGGREGATE;
+    queueForStage(ctx, STAGE_AGGREGATE);
+    while (!push_WindOpQueue(&ctx->aggregateQueue, batch)) {
+        sched_yield();
+    }
+}
+
+/* ****************************************************************************
+ *
+ * Aggregation, on its own thread. Batches are folded in input order so equal
+ * time stamps resolve as a single threaded decode would.
+ *
+ * */
+static void aggregateBatch(ingestCtx * ctx, ingestBatch * batch) {
+    uint64_t start = nowNs();
+    uint32_t row = ctx->result.numRows;
+
+    if (append_WindOpColumns(&ctx->result, &batch->cols) != WINDOP_OK) {
+        outOfMemory();
+    }
+    for (; row < ctx->result.numRows; row++) {
+        ctx->result.packet[row] += (uint32_t) ctx->packets;
+    }
+    ctx->packets += batch->numPackets;
+    ctx->badLines += batch->badLines;
+    ctx->failed += batch->failed;
+    stageDone(&ctx->stats[STAGE_AGGREGATE], start, batch->cols.numRows, 0);
+
+    free(batch->offsets);
+    free_WindOpColumns(&batch->cols);
+    free(batch);
+    atomic_fetch_sub_explicit(&ctx->inFlight, 1, memory_order_acq_rel);
+}
+
+static void * aggregateMain(void * arg) {
+    ingestCtx * ctx = arg;
+    ingestBatch ** window;
+    ingestBatch * batch;
+    uint64_t next = 0;
+    void * item;
+
+    // In flight batches are bounded, so sequence numbers fit the window
+    window = calloc(ctx->maxInFlight, sizeof(ingestBatch *));
+    if (window == NULL) {
+        outOfMemory();
+    }
+    for (;;) {
+        if (pop_WindOpQueue(&ctx->aggregateQueue, &item)) {
+            batch = item;
+            atomic_fetch_sub_explicit(&ctx->stats[STAGE_AGGREGATE].depth, 1, memory_order_relaxed);
+            window[batch->sequence % ctx->maxInFlight] = batch;
+            while ((batch = window[next % ctx->maxInFlight]) != NULL) {
+                window[next % ctx->maxInFlight] = NULL;
+                aggregateBatch(ctx, batch);
+                next++;
+            }
+        } else if (atomic_load_explicit(&ctx->readDone, memory_order_acquire) && (next == ctx->numBatches)) {
+            break;
+        } else {
+            sched_yield();
+        }
+    }
+    free(window);
+    return NULL;
+}
+
+/* ****************************************************************************
+ *
+ * Reader, on the calling thread. Cuts the input into batches of whole lines.
+ *
+ * */
+static void submitBatch(ingestCtx * ctx, ingestBatch * batch) {
+    uint8_t stage;
+
+    while (atomic_load_explicit(&ctx->inFlight, memory_order_acquire) >= ctx->maxInFlight) {
+        sched_yield();
+    }
+    atomic_fetch_add_explicit(&ctx->inFlight, 1, memory_order_acq_rel);
+    for (stage = STAGE_BASE64; stage < NUM_STAGES; stage++) {
+        ctx->stats[stage].depthSum += atomic_load_explicit(&ctx->stats[stage].depth, memory_order_relaxed);
+    }
+
+    batch->stage = STAGE_BASE64;
+    queueForStage(ctx, STAGE_BASE64);
+    while (!submit_WindOpPool(&ctx->pool, (uint32_t) (batch->sequence % ctx->pool.numWorkers), batch)) {
+        sched_yield();
+    }
+}
+
+static void readInput(ingestCtx * ctx, FILE * in) {
+    char * block;
+    uint32_t used = 0;
+    uint32_t keep;
+    size_t got;
+    uint64_t start;
+    char * lastEol;
+    ingestBatch * batch;
+
+    block = malloc(ctx->cfg->batchBytes);
+    if (block == NULL) {
+        outOfMemory();
+    }
+    for (;;) {
+        start = nowNs();
+        got = fread(&block[used], 1, ctx->cfg->batchBytes - used, in);
+        used += (uint32_t) got;
+        if (used == 0) {
+            break;
+        }
+
+        // Cut after the last newline, the tail starts the next batch
+        lastEol = NULL;
+        if (got != 0) {
+            for (keep = used; keep > 0; keep--) {
+                if (block[keep - 1] == '\n') {
+                    lastEol = &block[keep - 1];
+                    break;
+                }
+            }
+        }
+        keep = (lastEol != NULL) ? (uint32_t) (&block[used] - (lastEol + 1)) : 0;
+        if ((lastEol == NULL) && (got != 0) && (used == ctx->cfg->batchBytes)) {
+            fprintf(stderr, "ERROR line longer than the %u byte batch\n", ctx->cfg->batchBytes);
+            exit(EXIT_FAILURE);
+        }
+        if ((lastEol == NULL) && (got != 0)) {
+            continue; // Partial line, read more
+        }
+
+        batch = calloc(1, sizeof(ingestBatch));
+        if ((batch == NULL) || ((batch->text = malloc(used - keep + 1)) == NULL)) {
+            outOfMemory();
+        }
+        memcpy(batch->text, block, used - keep);
+        batch->textBytes = used - keep;
+        batch->sequence = ctx->numBatches++;
+        memmove(block, &block[used - keep], keep);
+        used = keep;
+        stageDone(&ctx->stats[STAGE_READ], start, 1, batch->textBytes);
+
+        submitBatch(ctx, batch);
+    }
+    free(block);
+}
+
+/* ****************************************************************************
+ *
+ * Report
+ *
+ * */
+static void report(ingestCtx * ctx, double wallSeconds) {
+    static const char * itemNames[NUM_STAGES] = { "blocks", "lines", "packets", "rows" };
+    stageStats * stats;
+    double busy;
+    uint8_t stage;
+    uint32_t i;
+    uint64_t steals = 0;
+    uint64_t tasks = 0;
+
+    fprintf(stderr, "---Ingested %lu packets, %u readings, %lu bad lines, %lu failed in %.3f s\n",
+            (unsigned long) ctx->packets, ctx->result.numRows, (unsigned long) ctx->badLines,
+            (unsigned long) ctx->failed, wallSeconds);
+    fprintf(stderr, "%-10s %10s %-8s %12s %10s %12s %10s %10s\n", "stage", "items", "", "items/s", "MB/s",
+            "busy s", "max depth", "mean depth");
+    for (stage = 0; stage < NUM_STAGES; stage++) {
+        stats = &ctx->stats[stage];
+        busy = atomic_load(&stats->busyNs) * 1e-9;
+        fprintf(stderr, "%-10s %10lu %-8s %12.0f %10.1f %12.3f %10lu %10.2f\n", stageNames[stage],
+                (unsigned long) atomic_load(&stats->items), itemNames[stage],
+                atomic_load(&stats->items) / wallSeconds, atomic_load(&stats->bytes) / wallSeconds / 1e6, busy,
+                (unsigned long) stats->maxDepth, ctx->numBatches ? (double) stats->depthSum / ctx->numBatches : 0.0);
+    }
+    for (i = 0; i < ctx->pool.numWorkers; i++) {
+        tasks += atomic_load(&ctx->pool.workers[i].tasks);
+        steals += atomic_load(&ctx->pool.workers[i].steals);
+    }
+    fprintf(stderr, "%u workers ran %lu tasks, %lu stolen\n", ctx->pool.numWorkers, (unsigned long) tasks,
+            (unsigned long) steals);
+}
+
+static void processCommandLine(int argc, char ** argv, ingestCfg * cfg) {
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-hex") == 0) {
+            cfg->hex = 1;
+        } else if ((strcmp(argv[i], "-threads") == 0) && (i + 1 < argc)) {
+            cfg->threads = (uint32_t) atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "-batch") == 0) && (i + 1 < argc)) {
+            cfg->batchBytes = (uint32_t) atoi(argv[++i]) * 1024;
+        } else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+            cfg->outFile = argv[++i];
+        } else if ((strcmp(argv[i], "-metrics") == 0) && (i + 1 < argc)) {
+            cfg->metricsFile = argv[++i];
+        } else if ((strcmp(argv[i], "-help") == 0) || (argv[i][0] == '-')) {
+            printf("%s", helpText);
+            exit(EXIT_SUCCESS);
+        } else {
+            cfg->inFile = argv[i];
+        }
+    }
+    if (cfg->batchBytes < 1024) {
+        cfg->batchBytes = 1024;
+    }
+}
+
+int main(int argc, char ** argv) {
+    ingestCfg cfg = { NULL, NULL, NULL, 0, 256 * 1024, 0 };
+    ingestCtx * ctx;
+    pthread_t aggregator;
+    FILE * in = stdin;
+    FILE * out;
+    uint64_t start;
+
+    processCommandLine(argc, argv, &cfg);
+    if ((cfg.inFile != NULL) && ((in = fopen(cfg.inFile, "r")) == NULL)) {
+        fprintf(stderr, "Can't open %s\n", cfg.inFile);
+        return EXIT_FAILURE;
+    }
+
+    ctx = calloc(1, sizeof(ingestCtx));
+    if (ctx == NULL) {
+        outOfMemory();
+    }
+    ctx->cfg = &cfg;
+    if (start_WindOpPool(&ctx->pool, cfg.threads, WORKER_QUEUE_SIZE, runTask, ctx) != WINDOP_OK) {
+        outOfMemory();
+    }
+    ctx->maxInFlight = BATCHES_PER_WORKER * ctx->pool.numWorkers;
+    if (init_WindOpQueue(&ctx->aggregateQueue, ctx->maxInFlight) != WINDOP_OK) {
+        outOfMemory();
+    }
+
+    start = nowNs();
+    pthread_create(&aggregator, NULL, aggregateMain, ctx);
+    readInput(ctx, in);
+    atomic_store_explicit(&ctx->readDone, 1, memory_order_release);
+    pthread_join(aggregator, NULL);
+    report(ctx, (nowNs() - start) * 1e-9);
+    stop_WindOpPool(&ctx->pool);
+
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    if (cfg.outFile != NULL) {
+        if ((out = fopen(cfg.outFile, "w")) == NULL) {
+            fprintf(stderr, "Can't open %s\n", cfg.outFile);
+            return EXIT_FAILURE;
+        }
+        if (writeColumns_WindOpCsv(out, &ctx->result) != WINDOP_OK) {
+            outOfMemory();
+        }
+        fclose(out);
+    }
+
+    if ((cfg.metricsFile != NULL) && (save_WindOpMetrics(cfg.metricsFile) != WINDOP_OK)) {
+        fprintf(stderr, "ERROR writing %s\n", cfg.metricsFile);
+    }
+
+    free_WindOpQueue(&ctx->aggregateQueue);
+    free_WindOpColumns(&ctx->result);
+    free(ctx);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,349 @@
+/*
+ ============================================================================
+ Name        : wm_json.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Streaming reader for TTN storage integration JSON
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_codec.h"
+#include "wm_json.h"
+
+#define KEY_SIZE                 16 // Longer keys are never ones we want
+
+uint8_t init_WindOpJsonReader(WindOpJsonReader * reader, FILE * file, const char * data, uint64_t size) {
+    memset(reader, 0, sizeof(*reader));
+    reader->file = file;
+    if (file != NULL) {
+        reader->buffer = malloc(WINDOP_JSON_BUFFER_SIZE);
+        if (reader->buffer == NULL) {
+            return WINDOP_ERR_MEMORY;
+        }
+        data = reader->buffer;
+        size = 0;
+    }
+    reader->start = data;
+    reader->p = data;
+    reader->end = data + size;
+    return WINDOP_OK;
+}
+
+void free_WindOpJsonReader(WindOpJsonReader * reader) {
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
+
+static int refill(WindOpJsonReader * reader) {
+    size_t got;
+
+    if (reader->file == NULL) {
+        return 0;
+    }
+    reader->base += (uint64_t) (reader->end - reader->start);
+    got = fread(reader->buffer, 1, WINDOP_JSON_BUFFER_SIZE, reader->file);
+    reader->start = reader->buffer;
+    reader->p = reader->buffer;
+    reader->end = reader->buffer + got;
+    return got > 0;
+}
+
+// Next character without consuming it, -1 at the end of input
+static inline int peekChar(WindOpJsonReader * reader) {
+    if ((reader->p == reader->end) && !refill(reader)) {
+        return -1;
+    }
+    return (unsigned char) *reader->p;
+}
+
+static inline int nextChar(WindOpJsonReader * reader) {
+    int c = peekChar(reader);
+    if (c >= 0) {
+        reader->p++;
+    }
+    return c;
+}
+
+static int skipSpace(WindOpJsonReader * reader) {
+    int c;
+
+    while (((c = peekChar(reader)) == ' ') || (c == '\n') || (c == '\r') || (c == '\t')) {
+        reader->p++;
+    }
+    return c;
+}
+
+static int hexValue(int c) {
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    }
+    c |= 0x20;
+    return ((c >= 'a') && (c <= 'f')) ? c - 'a' + 10 : -1;
+}
+
+/* ****************************************************************************
+ *
+ * Read a string, the opening quote already consumed. Up to size - 1 bytes go
+ * to out (NULL to skip), *length gets the full decoded length so a caller
+ * can tell it was cut short. Escapes beyond ASCII become '?', none of the
+ * fields we keep can hold them.
+ *
+ * */
+static uint8_t readString(WindOpJsonReader * reader, char * out, uint32_t size, uint32_t * length) {
+    const char * stop;
+    uint32_t n = 0;
+    uint32_t run;
+    int c;
+    int code;
+    int digit;
+    uint8_t i;
+
+    for (;;) {
+        if ((reader->p == reader->end) && !refill(reader)) {
+            return WINDOP_ERR_FORMAT;
+        }
+
+        // Copy the plain run up to the next quote or escape in one go
+        for (stop = reader->p; (stop < reader->end) && (*stop != '"') && (*stop != '\\'); stop++) {
+        }
+        run = (uint32_t) (stop - reader->p);
+        if ((out != NULL) && (n < size - 1)) {
+            memcpy(&out[n], reader->p, (run < size - 1 - n) ? run : size - 1 - n);
+        }
+        n += run;
+        reader->p = stop;
+        if (stop == reader->end) {
+            continue;
+        }
+
+        c = *reader->p++;
+        if (c == '"') {
+            break;
+        }
+        c = nextChar(reader);
+        switch (c) {
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case '"': case '\\': case '/': break;
+        case 'u':
+            code = 0;
+            for (i = 0; i < 4; i++) {
+                if ((digit = hexValue(nextChar(reader))) < 0) {
+                    return WINDOP_ERR_FORMAT;
+                }
+                code = (code << 4) | digit;
+            }
+            c = (code < 0x80) ? code : '?';
+            break;
+        default:
+            return WINDOP_ERR_FORMAT;
+        }
+        if ((out != NULL) && (n < size - 1)) {
+            out[n] = (char) c;
+        }
+        n++;
+    }
+
+    if (out != NULL) {
+        out[(n < size - 1) ? n : size - 1] = '\0';
+    }
+    if (length != NULL) {
+        *length = n;
+    }
+    return WINDOP_OK;
+}
+
+// Skip any value, nested containers included, without storing it
+static uint8_t skipValue(WindOpJsonReader * reader) {
+    uint32_t depth = 0;
+    int c;
+
+    do {
+        c = skipSpace(reader);
+        if (c < 0) {
+            return WINDOP_ERR_FORMAT;
+        }
+        reader->p++;
+        if (c == '"') {
+            if (readString(reader, NULL, 0, NULL) != WINDOP_OK) {
+                return WINDOP_ERR_FORMAT;
+            }
+        } else if ((c == '{') || (c == '[')) {
+            depth++;
+        } else if ((c == '}') || (c == ']')) {
+            if (depth == 0) {
+                return WINDOP_ERR_FORMAT;
+            }
+            depth--;
+        } else if ((c == ',') || (c == ':')) {
+            if (depth == 0) {
+                return WINDOP_ERR_FORMAT;
+            }
+        } else {
+            // Number, true, false or null, runs to the next delimiter
+            while (((c = peekChar(reader)) >= 0) && (c != ',') && (c != '}') && (c != ']') &&
+                   (c != ' ') && (c != '\n') && (c != '\r') && (c != '\t')) {
+                reader->p++;
+            }
+        }
+    } while (depth > 0);
+
+    return WINDOP_OK;
+}
+
+static uint8_t readField(WindOpJsonReader * reader, WindOpUplink * uplink, const char * key) {
+    char * out = NULL;
+    uint32_t size = 0;
+    uint32_t length;
+    uint8_t flag = 0;
+
+    if (strcmp(key, "device_id") == 0) {
+        out = uplink->device, size = sizeof(uplink->device), flag = WINDOP_JSON_HAS_DEVICE;
+    } else if (strcmp(key, "time") == 0) {
+        out = uplink->time, size = sizeof(uplink->time), flag = WINDOP_JSON_HAS_TIME;
+    } else if (strcmp(key, "raw") == 0) {
+        out = uplink->raw, size = sizeof(uplink->raw), flag = WINDOP_JSON_HAS_RAW;
+    }
+    if ((out == NULL) || (skipSpace(reader) != '"')) {
+        return skipValue(reader);
+    }
+
+    reader->p++;
+    if (readString(reader, out, size, &length) != WINDOP_OK) {
+        return WINDOP_ERR_FORMAT;
+    }
+    if (length < size) {
+        uplink->fields |= flag; // A cut short field is as good as missing
+    }
+    if (flag == WINDOP_JSON_HAS_RAW) {
+        uplink->rawLength = length;
+    }
+    return WINDOP_OK;
+}
+
+// One array element, the opening brace already consumed
+static uint8_t readElement(WindOpJsonReader * reader, WindOpUplinkFn fn, void * context) {
+    WindOpUplink uplink;
+    char key[KEY_SIZE];
+    uint32_t keyLength;
+    int c;
+
+    uplink.fields = 0;
+    uplink.rawLength = 0;
+    if (skipSpace(reader) == '}') {
+        reader->p++;
+        reader->skipped++;
+        return WINDOP_OK;
+    }
+    for (;;) {
+        if (nextChar(reader) != '"') {
+            return WINDOP_ERR_FORMAT;
+        }
+        if (readString(reader, key, sizeof(key), &keyLength) != WINDOP_OK) {
+            return WINDOP_ERR_FORMAT;
+        }
+        if (skipSpace(reader) != ':') {
+            return WINDOP_ERR_FORMAT;
+        }
+        reader->p++;
+        if (((keyLength < sizeof(key)) ? readField(reader, &uplink, key) : skipValue(reader)) != WINDOP_OK) {
+            return WINDOP_ERR_FORMAT;
+        }
+
+        // Only a separator is consumed, so an error offset is the byte that broke
+        c = skipSpace(reader);
+        if ((c != '}') && (c != ',')) {
+            return WINDOP_ERR_FORMAT;
+        }
+        reader->p++;
+        if (c == '}') {
+            break;
+        }
+        if (skipSpace(reader) < 0) {
+            return WINDOP_ERR_FORMAT;
+        }
+    }
+
+    if (uplink.fields == WINDOP_JSON_HAS_ALL) {
+        reader->uplinks++;
+        fn(context, &uplink);
+    } else {
+        reader->skipped++;
+    }
+    return WINDOP_OK;
+}
+
+uint8_t read_WindOpTtnJson(WindOpJsonReader * reader, WindOpUplinkFn fn, void * context) {
+    uint8_t inArray = 0;
+    int c;
+
+    for (;;) {
+        c = skipSpace(reader);
+        if (c < 0) {
+            return inArray ? WINDOP_ERR_FORMAT : WINDOP_OK;
+        }
+        if ((c == '[') && !inArray) {
+            reader->p++;
+            inArray = 1;
+            if (skipSpace(reader) == ']') {
+                reader->p++;
+                inArray = 0;
+            }
+            continue;
+        }
+
+        if (c == '{') {
+            reader->p++;
+            if (readElement(reader, fn, context) != WINDOP_OK) {
+                return WINDOP_ERR_FORMAT;
+            }
+        } else if (inArray) {
+            // Not an object, nothing we can use
+            if (skipValue(reader) != WINDOP_OK) {
+                return WINDOP_ERR_FORMAT;
+            }
+            reader->skipped++;
+        } else {
+            return WINDOP_ERR_FORMAT;
+        }
+
+        if (inArray) {
+            c = skipSpace(reader);
+            if ((c != ']') && (c != ',')) {
+                return WINDOP_ERR_FORMAT;
+            }
+            reader->p++;
+            inArray = (c == ',');
+        }
+    }
+}
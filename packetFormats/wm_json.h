@@ -0,0 +1,106 @@
+/*
+ ============================================================================
+ Name        : wm_json.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Streaming reader for TTN storage integration JSON
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_JSON_H
+#define WM_JSON_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WINDOP_JSON_BUFFER_SIZE  65536
+#define WINDOP_JSON_DEVICE_SIZE  64
+#define WINDOP_JSON_TIME_SIZE    48
+#define WINDOP_JSON_RAW_SIZE     384 // base64 of the largest packet is 340
+
+#define WINDOP_JSON_HAS_DEVICE   0x01
+#define WINDOP_JSON_HAS_TIME     0x02
+#define WINDOP_JSON_HAS_RAW      0x04
+#define WINDOP_JSON_HAS_ALL      0x07
+
+/* ****************************************************************************
+ *
+ * The storage integration query returns
+ *
+ *     [{"device_id":"00","raw":"BC670hh+...","time":"2017-08-26T11:05:01Z",...},...]
+ *
+ * The reader walks the text once, a buffer at a time, keeping only the three
+ * fields of the element in hand. Other members, nested or not, are skipped
+ * without being stored, so memory does not grow with the query length.
+ *
+ * */
+typedef struct WindOpUplink {
+    char device[WINDOP_JSON_DEVICE_SIZE];
+    char time[WINDOP_JSON_TIME_SIZE];
+    char raw[WINDOP_JSON_RAW_SIZE];
+    uint32_t rawLength;
+    uint8_t fields;           // WINDOP_JSON_HAS_* found in the element
+} WindOpUplink;
+
+// Called for every element carrying all three fields
+typedef void (*WindOpUplinkFn)(void * context, const WindOpUplink * uplink);
+
+typedef struct WindOpJsonReader {
+    FILE * file;              // NULL when reading from memory
+    const char * p;
+    const char * end;
+    const char * start;       // Start of the text in hand
+    char * buffer;
+    uint64_t base;            // Input offset of start
+    uint32_t uplinks;         // Elements handed to the callback
+    uint32_t skipped;         // Elements missing a field or too long
+} WindOpJsonReader;
+
+// Read from file, or from size bytes at data when file is NULL
+uint8_t init_WindOpJsonReader(WindOpJsonReader * reader, FILE * file, const char * data, uint64_t size);
+void free_WindOpJsonReader(WindOpJsonReader * reader);
+
+/*
+ * Parse the whole input calling fn per uplink. Accepts a top level array
+ * or objects back to back. Returns WINDOP_OK or WINDOP_ERR_FORMAT, with
+ * offset_WindOpJsonReader giving the byte where parsing stopped.
+ */
+uint8_t read_WindOpTtnJson(WindOpJsonReader * reader, WindOpUplinkFn fn, void * context);
+
+static inline uint64_t offset_WindOpJsonReader(const WindOpJsonReader * reader) {
+    return reader->base + (uint64_t) (reader->p - reader->start);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_JSON_H
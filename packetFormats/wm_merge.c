@@ -0,0 +1,404 @@
+/*
+ ============================================================================
+ Name        : wm_merge.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Streaming k way merge of time ordered CSV and packet captures
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_codec.h"
+#include "wm_batch.h"
+#include "wm_csv.h"
+
+static const char * helpText =
+"\n"
+"   WindOp streaming merge\n"
+"\n"
+"   Merges time ordered inputs into one Perl CSV, as s2_wm_csv_merge.pl does,\n"
+"   without holding the history in memory. Each input is either a CSV from\n"
+"   the s1 scripts or wm_decode, or a raw capture of packets back to back.\n"
+"   Rows sharing a time stamp are fused per channel, so wind from a T4 and\n"
+"   environment from a T5 land on one line. Where inputs disagree on a\n"
+"   channel the input given later wins.\n"
+"\n"
+"      wm_merge [options] file...\n"
+"\n"
+"      -o file                : Write the CSV to file, default stdout\n"
+"      -quiet                 : Dont report rows out of order or failing\n"
+"      -help                  : Prints this\n"
+"\n";
+
+#define RAW_BUFFER_SIZE          65536
+#define RAW_PENDING_ROWS         1024 // Reorder window for overlapping packets
+
+typedef struct mergeRow {
+    int64_t time;
+    uint8_t valid;
+    double value[WINDOP_NUM_CHANNELS];
+} mergeRow;
+
+/* ****************************************************************************
+ *
+ * One sorted run. CSV inputs give a row per line. Raw captures decode a
+ * packet at a time into a small sorted window: readings of a packet are never
+ * earlier than its time stamp, so a pending row can go once a later packet
+ * starts after it.
+ *
+ * */
+typedef struct mergeSource {
+    const char * path;
+    FILE * file;
+    uint8_t isCsv;
+    uint8_t atEnd;
+
+    char * line;
+    size_t lineCapacity;
+
+    uint8_t * buffer;
+    uint32_t bufferStart;
+    uint32_t bufferEnd;
+    WindOpColumns packetCols; // One packet's readings, at most WINDOP_MAX_PACKET_LENGTH
+    mergeRow * pending;
+    uint32_t numPending;
+    int64_t frontier;         // Time stamp of the last packet decoded
+
+    mergeRow head;            // Next row of the run
+    int64_t lastTime;
+    uint32_t rows;
+    uint32_t outOfOrder;
+    uint32_t failed;
+} mergeSource;
+
+typedef struct mergeCfg {
+    const char * outFile;
+    uint8_t quiet;
+    char ** inFiles;
+    uint32_t numInFiles;
+} mergeCfg;
+
+static uint8_t nextCsvRow(mergeSource * src) {
+    while (getline(&src->line, &src->lineCapacity, src->file) >= 0) {
+        if (parseRow_WindOpCsv(src->line, &src->head.time, &src->head.valid, src->head.value) == WINDOP_OK) {
+            return 1;
+        }
+        src->failed += (src->line[0] != 't') && (src->line[0] != '\n'); // Header and blank lines are expected
+    }
+    return 0;
+}
+
+// Make sure length bytes are buffered from bufferStart, 0 at the end of file
+static uint8_t fillRaw(mergeSource * src, uint32_t length) {
+    size_t got;
+
+    if (src->bufferEnd - src->bufferStart >= length) {
+        return 1;
+    }
+    memmove(src->buffer, &src->buffer[src->bufferStart], src->bufferEnd - src->bufferStart);
+    src->bufferEnd -= src->bufferStart;
+    src->bufferStart = 0;
+    got = fread(&src->buffer[src->bufferEnd], 1, RAW_BUFFER_SIZE - src->bufferEnd, src->file);
+    src->bufferEnd += (uint32_t) got;
+    return src->bufferEnd - src->bufferStart >= length;
+}
+
+static void addPending(mergeSource * src, const mergeRow * row) {
+    uint32_t i = src->numPending;
+
+    // Insert after any equal time so packet order decides overwrites
+    while ((i > 0) && (src->pending[i - 1].time > row->time)) {
+        src->pending[i] = src->pending[i - 1];
+        i--;
+    }
+    src->pending[i] = *row;
+    src->numPending++;
+}
+
+/*
+ * Decode the next packet of the capture into the pending window. Returns 0,
+ * leaving the packet buffered, when the window has no room yet for as many
+ * readings as it may hold.
+ */
+static uint8_t decodeRawPacket(mergeSource * src) {
+    WindOpColumns * cols = &src->packetCols;
+    const WindOpTypeInfo * info;
+    mergeRow row;
+    const uint8_t * packet;
+    uint32_t length;
+    uint32_t r;
+    uint8_t ch;
+
+    if (!fillRaw(src, WINDOP_PACKET_HEADER_SIZE)) {
+        src->atEnd = 1;
+        return 1;
+    }
+    packet = &src->buffer[src->bufferStart];
+    length = packet[1];
+    if ((length < WINDOP_PACKET_HEADER_SIZE + WINDOP_TIME_SIZE) || !fillRaw(src, length)) {
+        // Without a usable length byte there is no next packet to find
+        src->failed++;
+        src->atEnd = 1;
+        return 1;
+    }
+    packet = &src->buffer[src->bufferStart];
+    if (maxReadings_WindOpPacket(packet, length) > RAW_PENDING_ROWS - src->numPending) {
+        return 0;
+    }
+    src->bufferStart += length;
+
+    // The batch decode handles every type, T8 readings included
+    cols->numRows = 0;
+    if ((decode_WindOpPacketColumns(packet, length, 0, cols) != WINDOP_OK) || (cols->numRows == 0)) {
+        src->failed++;
+        return 1;
+    }
+    info = info_WindOpDataType(packet[0]);
+    src->frontier = cols->time[0] - info->firstOffset;
+
+    for (r = 0; r < cols->numRows; r++) {
+        row.time = cols->time[r];
+        row.valid = cols->valid[r];
+        for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+            row.value[ch] = ((row.valid >> ch) & 1) ? info->scale[ch] * cols->channel[ch][r] : 0.0;
+        }
+        addPending(src, &row);
+    }
+    return 1;
+}
+
+static uint8_t nextRawRow(mergeSource * src) {
+    while (!src->atEnd && ((src->numPending == 0) || (src->pending[0].time >= src->frontier))) {
+        if (!decodeRawPacket(src)) {
+            break; // Window full, let the front go first
+        }
+    }
+    if (src->numPending == 0) {
+        return 0;
+    }
+    src->head = src->pending[0];
+    src->numPending--;
+    memmove(&src->pending[0], &src->pending[1], src->numPending * sizeof(mergeRow));
+    return 1;
+}
+
+static uint8_t advanceSource(mergeSource * src) {
+    uint8_t more = src->isCsv ? nextCsvRow(src) : nextRawRow(src);
+
+    if (more) {
+        if ((src->rows > 0) && (src->head.time < src->lastTime)) {
+            src->outOfOrder++;
+        }
+        src->lastTime = src->head.time;
+        src->rows++;
+    }
+    return more;
+}
+
+static void openSource(mergeSource * src, const char * path) {
+    char magic[5] = { 0 };
+
+    memset(src, 0, sizeof(*src));
+    src->path = path;
+    src->file = fopen(path, "rb");
+    if (src->file == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    // CSV inputs start with the header line, anything else is a capture
+    src->isCsv = (fread(magic, 1, 5, src->file) == 5) && (memcmp(magic, "time,", 5) == 0);
+    rewind(src->file);
+    if (!src->isCsv) {
+        src->buffer = malloc(RAW_BUFFER_SIZE);
+        src->pending = malloc(RAW_PENDING_ROWS * sizeof(mergeRow));
+        if ((src->buffer == NULL) || (src->pending == NULL) ||
+            (init_WindOpColumns(&src->packetCols, WINDOP_MAX_PACKET_LENGTH) != WINDOP_OK)) {
+            fprintf(stderr, "ERROR out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void closeSource(mergeSource * src) {
+    fclose(src->file);
+    free(src->line);
+    free(src->buffer);
+    free(src->pending);
+    free_WindOpColumns(&src->packetCols);
+}
+
+/* ****************************************************************************
+ *
+ * Min heap of source indices ordered by head time, then input order.
+ *
+ * */
+static mergeSource * heapSources;
+
+static int heapLess(uint32_t a, uint32_t b) {
+    if (heapSources[a].head.time != heapSources[b].head.time) {
+        return heapSources[a].head.time < heapSources[b].head.time;
+    }
+    return a < b;
+}
+
+static void heapDown(uint32_t * heap, uint32_t size, uint32_t i) {
+    uint32_t child;
+    uint32_t tmp;
+
+    while ((child = 2 * i + 1) < size) {
+        if ((child + 1 < size) && heapLess(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!heapLess(heap[child], heap[i])) {
+            break;
+        }
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+}
+
+static void mergeSources(FILE * out, mergeSource * sources, uint32_t numSources, uint32_t * written) {
+    uint32_t * heap;
+    uint32_t size = 0;
+    uint32_t i;
+    uint8_t ch;
+    mergeRow row;
+    mergeSource * src;
+    WindOpTimeFormat fmt;
+
+    heap = malloc((numSources + 1) * sizeof(uint32_t));
+    if (heap == NULL) {
+        fprintf(stderr, "ERROR out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    heapSources = sources;
+    init_WindOpTimeFormat(&fmt);
+    for (i = 0; i < numSources; i++) {
+        if (advanceSource(&sources[i])) {
+            heap[size++] = i;
+        }
+    }
+    for (i = size / 2; i-- > 0;) {
+        heapDown(heap, size, i);
+    }
+
+    writeHeader_WindOpCsv(out);
+    while (size > 0) {
+        // Fuse every row at the top time stamp, later inputs overwriting
+        row.time = sources[heap[0]].head.time;
+        row.valid = 0;
+        while ((size > 0) && (sources[heap[0]].head.time == row.time)) {
+            src = &sources[heap[0]];
+            for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+                if (src->head.valid & (1 << ch)) {
+                    row.value[ch] = src->head.value[ch];
+                }
+            }
+            row.valid |= src->head.valid;
+
+            if (!advanceSource(src)) {
+                heap[0] = heap[--size];
+            }
+            heapDown(heap, size, 0);
+        }
+        writeRow_WindOpCsv(out, &fmt, row.time, row.valid, row.value);
+        (*written)++;
+    }
+
+    free(heap);
+}
+
+static void processCommandLine(int argc, char ** argv, mergeCfg * cfg) {
+    int i;
+
+    cfg->inFiles = malloc(argc * sizeof(char *));
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-quiet") == 0) {
+            cfg->quiet = 1;
+        } else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+            cfg->outFile = argv[++i];
+        } else if ((strcmp(argv[i], "-help") == 0) || (argv[i][0] == '-')) {
+            printf("%s", helpText);
+            exit(EXIT_SUCCESS);
+        } else {
+            cfg->inFiles[cfg->numInFiles++] = argv[i];
+        }
+    }
+    if (cfg->numInFiles == 0) {
+        printf("%s", helpText);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char ** argv) {
+    mergeCfg cfg = { NULL, 0, NULL, 0 };
+    mergeSource * sources;
+    FILE * out = stdout;
+    uint32_t written = 0;
+    uint32_t rows = 0;
+    uint32_t i;
+
+    processCommandLine(argc, argv, &cfg);
+
+    sources = malloc(cfg.numInFiles * sizeof(mergeSource));
+    if (sources == NULL) {
+        fprintf(stderr, "ERROR out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < cfg.numInFiles; i++) {
+        openSource(&sources[i], cfg.inFiles[i]);
+    }
+
+    if ((cfg.outFile != NULL) && ((out = fopen(cfg.outFile, "w")) == NULL)) {
+        fprintf(stderr, "Can't open %s\n", cfg.outFile);
+        return EXIT_FAILURE;
+    }
+    mergeSources(out, sources, cfg.numInFiles, &written);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    for (i = 0; i < cfg.numInFiles; i++) {
+        if (!cfg.quiet && (sources[i].outOfOrder || sources[i].failed)) {
+            fprintf(stderr, "%s : %u rows out of time order, %u failed\n", sources[i].path,
+                    sources[i].outOfOrder, sources[i].failed);
+        }
+        rows += sources[i].rows;
+        closeSource(&sources[i]);
+    }
+    fprintf(stderr, "---Merged %u files and %u rows into %u rows\n", cfg.numInFiles, rows, written);
+
+    free(sources);
+    free(cfg.inFiles);
+    return EXIT_SUCCESS;
+}
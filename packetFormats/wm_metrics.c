@@ -0,0 +1,221 @@
+/*
+ ============================================================================
+ Name        : wm_metrics.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Per thread decode counters and latency histograms
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_codec.h"
+#include "wm_metrics.h"
+
+__thread WindOpMetricsThread * windOpMetricsSelf;
+
+static WindOpMetricsThread * threads;   // Every registered block, newest first
+static WindOpMetricsThread spare = {.shared = 1};   // Shared by threads that could not get a block of their own
+
+static const char * const statusNames[WINDOP_METRICS_STATUS] = {
+    "ok", "short", "length", "type", "time", "capacity", "memory", "format"
+};
+
+static const char * const stageNames[WINDOP_NUM_STAGES] = {
+    "unpack", "header", "time", "columns"
+};
+
+WindOpMetricsThread * register_WindOpMetrics(void) {
+    WindOpMetricsThread * self = calloc(1, sizeof(WindOpMetricsThread));
+    WindOpMetricsThread * head;
+    uint32_t i;
+
+    if (self == NULL) {
+        for (i = 0; i < 256; i++) {
+            __atomic_store_n(&spare.batch[i], WINDOP_METRICS_BATCH - 1, __ATOMIC_RELAXED);
+        }
+        windOpMetricsSelf = &spare;
+        return &spare;
+    }
+    head = __atomic_load_n(&threads, __ATOMIC_ACQUIRE);
+    do {
+        self->next = head;
+    } while (!__atomic_compare_exchange_n(&threads, &head, self, 1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+    windOpMetricsSelf = self;
+    return self;
+}
+
+/*
+ * A sequence lock against flush_WindOpMetrics, which alone writes counts
+ * and batch together. The hot path stores between flushes touch one word
+ * each and are read whole.
+ */
+void flush_WindOpMetrics(WindOpMetricsThread * self, uint8_t dataType, uint64_t batch) {
+    WindOpMetrics * m = &self->counts;
+    const uint32_t sequence = self->sequence;
+
+    // The spare's batch never moves, it holds one packet short of full
+    if (self->shared) {
+        __atomic_fetch_add(&m->packets[dataType], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&m->readings[dataType], (batch >> 12) & 0xFFFFF, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&m->bytes, batch >> 32, __ATOMIC_RELAXED);
+        return;
+    }
+
+    __atomic_store_n(&self->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&m->packets[dataType], m->packets[dataType] + (batch & 0xFFF), __ATOMIC_RELAXED);
+    __atomic_store_n(&m->readings[dataType], m->readings[dataType] + ((batch >> 12) & 0xFFFFF), __ATOMIC_RELAXED);
+    __atomic_store_n(&m->bytes, m->bytes + (batch >> 32), __ATOMIC_RELAXED);
+    __atomic_store_n(&self->batch[dataType], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&self->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+static void addCounts(WindOpMetrics * out, const WindOpMetricsThread * t) {
+    const uint64_t * from = (const uint64_t *) &t->counts;
+    uint64_t counts[sizeof(WindOpMetrics) / sizeof(uint64_t)];
+    uint64_t batch[256];
+    uint64_t * to = (uint64_t *) out;
+    uint32_t sequence;
+    size_t i;
+
+    // All uint64_t, each loaded whole while its thread may be storing
+    do {
+        while ((sequence = __atomic_load_n(&t->sequence, __ATOMIC_ACQUIRE)) & 1) {
+        }
+        for (i = 0; i < sizeof(WindOpMetrics) / sizeof(uint64_t); i++) {
+            counts[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+        }
+        for (i = 0; i < 256; i++) {
+            batch[i] = t->shared ? 0 : __atomic_load_n(&t->batch[i], __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&t->sequence, __ATOMIC_RELAXED) != sequence);
+
+    for (i = 0; i < sizeof(WindOpMetrics) / sizeof(uint64_t); i++) {
+        to[i] += counts[i];
+    }
+    for (i = 0; i < 256; i++) {
+        out->packets[i] += batch[i] & 0xFFF;
+        out->readings[i] += (batch[i] >> 12) & 0xFFFFF;
+        out->bytes += batch[i] >> 32;
+    }
+}
+
+void snapshot_WindOpMetrics(WindOpMetrics * out) {
+    const WindOpMetricsThread * t;
+
+    memset(out, 0, sizeof(*out));
+    for (t = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); t != NULL; t = t->next) {
+        addCounts(out, t);
+    }
+    addCounts(out, &spare);
+}
+
+/* ****************************************************************************
+ *
+ * Prometheus text format 0.0.4. Types never seen are left out, the stage
+ * histograms always carry every bucket so the series stay the same from
+ * one scrape to the next.
+ *
+ * */
+void write_WindOpMetrics(FILE * out, const WindOpMetrics * m) {
+    const WindOpStageHistogram * h;
+    uint64_t cumulative;
+    uint32_t i;
+    uint8_t s;
+
+    fprintf(out, "# HELP windop_metrics_enabled 1 when built with WINDOP_METRICS\n");
+    fprintf(out, "# TYPE windop_metrics_enabled gauge\n");
+    fprintf(out, "windop_metrics_enabled %d\n", WINDOP_METRICS ? 1 : 0);
+
+    fprintf(out, "# HELP windop_packets_total Packets decoded, by type\n");
+    fprintf(out, "# TYPE windop_packets_total counter\n");
+    for (i = 0; i < 256; i++) {
+        if (m->packets[i] != 0) {
+            fprintf(out, "windop_packets_total{type=\"0x%02x\"} %llu\n", i, (unsigned long long) m->packets[i]);
+        }
+    }
+    fprintf(out, "# HELP windop_readings_total Readings decoded, by type\n");
+    fprintf(out, "# TYPE windop_readings_total counter\n");
+    for (i = 0; i < 256; i++) {
+        if (m->packets[i] != 0) {
+            fprintf(out, "windop_readings_total{type=\"0x%02x\"} %llu\n", i, (unsigned long long) m->readings[i]);
+        }
+    }
+    fprintf(out, "# HELP windop_bytes_total Bytes of packets decoded\n");
+    fprintf(out, "# TYPE windop_bytes_total counter\n");
+    fprintf(out, "windop_bytes_total %llu\n", (unsigned long long) m->bytes);
+
+    fprintf(out, "# HELP windop_decode_failures_total Packets refused, by reason\n");
+    fprintf(out, "# TYPE windop_decode_failures_total counter\n");
+    for (i = 1; i < WINDOP_METRICS_STATUS; i++) {
+        fprintf(out, "windop_decode_failures_total{reason=\"%s\"} %llu\n", statusNames[i],
+                (unsigned long long) m->failures[i]);
+    }
+
+    fprintf(out, "# HELP windop_stage_seconds Sampled decode stage latency, 1 call in %d\n", WINDOP_METRICS_SAMPLE);
+    fprintf(out, "# TYPE windop_stage_seconds histogram\n");
+    for (s = 0; s < WINDOP_NUM_STAGES; s++) {
+        h = &m->stages[s];
+        cumulative = 0;
+        for (i = 0; i < WINDOP_METRICS_BUCKETS; i++) {
+            cumulative += h->buckets[i];
+            fprintf(out, "windop_stage_seconds_bucket{stage=\"%s\",le=\"%.3e\"} %llu\n", stageNames[s],
+                    (double) (1u << (i + 5)) * 1e-9, (unsigned long long) cumulative);
+        }
+        fprintf(out, "windop_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n", stageNames[s],
+                (unsigned long long) h->count);
+        fprintf(out, "windop_stage_seconds_sum{stage=\"%s\"} %.9f\n", stageNames[s], h->nanos * 1e-9);
+        fprintf(out, "windop_stage_seconds_count{stage=\"%s\"} %llu\n", stageNames[s],
+                (unsigned long long) h->count);
+    }
+}
+
+uint8_t save_WindOpMetrics(const char * path) {
+    WindOpMetrics m;
+    char temp[4096];
+    FILE * out;
+    int failed;
+
+    if (snprintf(temp, sizeof(temp), "%s.tmp", path) >= (int) sizeof(temp)) {
+        return WINDOP_ERR_FORMAT;
+    }
+    if ((out = fopen(temp, "w")) == NULL) {
+        return WINDOP_ERR_FORMAT;
+    }
+    snapshot_WindOpMetrics(&m);
+    write_WindOpMetrics(out, &m);
+    failed = ferror(out);
+    failed |= fclose(out);
+    if (failed || (rename(temp, path) != 0)) {
+        remove(temp);
+        return WINDOP_ERR_FORMAT;
+    }
+    return WINDOP_OK;
+}
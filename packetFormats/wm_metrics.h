@@ -0,0 +1,211 @@
+/*
+ ============================================================================
+ Name        : wm_metrics.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Per thread decode counters and latency histograms
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+
+#ifndef WM_METRICS_H
+#define WM_METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ****************************************************************************
+ *
+ * Decode metrics. Each thread counts into its own block, registered the
+ * first time it counts, with plain stores no other thread writes, so the
+ * hot path takes no lock and shares no cache line. A reader walks the
+ * blocks and sums them, a snapshot is exact to within the packets in
+ * flight. Blocks outlive their threads so nothing counted is lost. A
+ * thread that cannot get a block counts into a shared spare with atomic
+ * adds.
+ *
+ * A packet's type, readings and bytes go into one packed word per type,
+ * a single store where three counters took three, and every
+ * WINDOP_METRICS_BATCH packets the word moves into the counters under a
+ * sequence count the reader retries on. A call decodes one packet in
+ * some 25 ns, so each store shows.
+ *
+ * Counted where packets are decoded, unpackBounded_WindOpDataPacket and
+ * decode_WindOpPacketColumns: packets and readings per type, bytes and
+ * failures per WINDOP_* status. Stage latencies go into log2 histograms
+ * from 32 ns to 1 ms. One call in WINDOP_METRICS_SAMPLE per thread and
+ * stage is timed, a clock read is some 20 to 40 ns and the time stage
+ * alone is less, so the sampled spans carry that much on top.
+ *
+ * Built with WINDOP_METRICS 0 (make METRICS=0) the hooks are constant ifs
+ * the compiler drops, as WINDOP_TRACE, and the snapshot reads all zero.
+ *
+ * */
+#ifndef WINDOP_METRICS
+#define WINDOP_METRICS 1
+#endif
+
+#define WINDOP_METRICS_SAMPLE      64
+#define WINDOP_METRICS_BATCH       4095 // Packets of a type held packed, 12 bits, so readings fit 20 and bytes 32
+#define WINDOP_METRICS_BUCKETS     16  // Bucket i is under 2^(i+5) ns, over 2^20 ns only counts in the total
+#define WINDOP_METRICS_STATUS      8   // WINDOP_OK to WINDOP_ERR_FORMAT
+
+#define WINDOP_STAGE_UNPACK        0   // unpackBounded_WindOpDataPacket
+#define WINDOP_STAGE_HEADER        1   // parse_WindOpPacketHeader
+#define WINDOP_STAGE_TIME          2   // The time stamp decode inside parse_WindOpPacketHeader
+#define WINDOP_STAGE_COLUMNS       3   // decode_WindOpPacketColumns
+#define WINDOP_NUM_STAGES          4
+
+typedef struct WindOpStageHistogram {
+    uint64_t count;           // Timed calls
+    uint64_t nanos;
+    uint64_t buckets[WINDOP_METRICS_BUCKETS];
+} WindOpStageHistogram;
+
+typedef struct WindOpMetrics {
+    uint64_t packets[256];    // Packets decoded, by type byte
+    uint64_t readings[256];
+    uint64_t bytes;
+    uint64_t failures[WINDOP_METRICS_STATUS];
+    WindOpStageHistogram stages[WINDOP_NUM_STAGES];
+} WindOpMetrics;
+
+typedef struct WindOpMetricsThread {
+    WindOpMetrics counts;
+    uint64_t batch[256];                   // By type: packets bits 0-11, readings 12-31, bytes 32-63,
+                                           // held one short of full on the spare so each packet flushes
+    uint32_t sequence;                     // Odd while a batch moves into counts
+    uint32_t ticks[WINDOP_NUM_STAGES];     // Only pick the samples, a lost tick on the spare does no harm
+    uint32_t shared;                       // Set on the spare
+    struct WindOpMetricsThread * next;
+} WindOpMetricsThread;
+
+extern __thread WindOpMetricsThread * windOpMetricsSelf;
+
+// Register the calling thread's block, never NULL
+WindOpMetricsThread * register_WindOpMetrics(void);
+
+// Move a full batch of dataType into self's counts
+void flush_WindOpMetrics(WindOpMetricsThread * self, uint8_t dataType, uint64_t batch);
+
+// Sum every thread's counts into out
+void snapshot_WindOpMetrics(WindOpMetrics * out);
+
+// The Prometheus text exposition of m
+void write_WindOpMetrics(FILE * out, const WindOpMetrics * m);
+
+// Snapshot to path by way of a rename, for a textfile collector. Returns a WINDOP_* code
+uint8_t save_WindOpMetrics(const char * path);
+
+/* ****************************************************************************
+ *
+ * Hot path hooks. A decode call looks its block up once with
+ * self_WindOpMetrics and hands it to each hook, the thread local lookup
+ * costs more than the counting. NULL when built with WINDOP_METRICS 0.
+ *
+ * */
+static inline WindOpMetricsThread * self_WindOpMetrics(void) {
+    WindOpMetricsThread * self;
+
+    if (!WINDOP_METRICS) {
+        return NULL;
+    }
+    self = windOpMetricsSelf;
+    return (self != NULL) ? self : register_WindOpMetrics();
+}
+
+/*
+ * A block only its thread writes takes a relaxed store, which keeps a
+ * concurrent read whole at the cost of a plain add. The shared spare needs
+ * the atomic add, some three times slower, so only it pays for one.
+ */
+static inline void add_WindOpMetric(WindOpMetricsThread * self, uint64_t * counter, uint64_t n) {
+    if (__builtin_expect(self->shared, 0)) {
+        __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+    } else {
+        __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void countPacket_WindOpMetrics(WindOpMetricsThread * self, uint8_t dataType, uint32_t bytes,
+                                             uint32_t readings) {
+    if (WINDOP_METRICS) {
+        const uint64_t batch = self->batch[dataType] + (1 | ((uint64_t) readings << 12) | ((uint64_t) bytes << 32));
+
+        if (__builtin_expect((batch & 0xFFF) == WINDOP_METRICS_BATCH, 0)) {
+            flush_WindOpMetrics(self, dataType, batch);
+        } else {
+            __atomic_store_n(&self->batch[dataType], batch, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static inline void countFailure_WindOpMetrics(WindOpMetricsThread * self, uint8_t status) {
+    if (WINDOP_METRICS) {
+        add_WindOpMetric(self, &self->counts.failures[status & (WINDOP_METRICS_STATUS - 1)], 1);
+    }
+}
+
+static inline uint64_t nanos_WindOpMetrics(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+// The clock when this call of stage is sampled, else 0
+static inline uint64_t start_WindOpStage(WindOpMetricsThread * self, uint8_t stage) {
+    if (WINDOP_METRICS && ((++self->ticks[stage] % WINDOP_METRICS_SAMPLE) == 0)) {
+        return nanos_WindOpMetrics();
+    }
+    return 0;
+}
+
+static inline void end_WindOpStage(WindOpMetricsThread * self, uint8_t stage, uint64_t start) {
+    if (WINDOP_METRICS && (start != 0)) {
+        WindOpStageHistogram * h = &self->counts.stages[stage];
+        const uint64_t nanos = nanos_WindOpMetrics() - start;
+        const int32_t bits = 64 - __builtin_clzll(nanos | 1);
+        const int32_t bucket = (bits > 5) ? bits - 5 : 0;
+
+        add_WindOpMetric(self, &h->count, 1);
+        add_WindOpMetric(self, &h->nanos, nanos);
+        if (bucket < WINDOP_METRICS_BUCKETS) {
+            add_WindOpMetric(self, &h->buckets[bucket], 1);
+        }
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_METRICS_H
@@ -0,0 +1,188 @@
+/*
+ ============================================================================
+ Name        : wm_pool.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Work stealing thread pool
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wm_codec.h"
+#include "wm_pool.h"
+
+#define IDLE_SPINS               64   // Empty polls before yielding
+#define IDLE_YIELDS              256  // Yields before sleeping between polls
+#define IDLE_SLEEP_NS            50000
+
+static void idle(uint32_t * misses) {
+    struct timespec ts = { 0, IDLE_SLEEP_NS };
+
+    (*misses)++;
+    if (*misses < IDLE_SPINS) {
+        return;
+    }
+    if (*misses < IDLE_SPINS + IDLE_YIELDS) {
+        sched_yield();
+    } else {
+        nanosleep(&ts, NULL);
+    }
+}
+
+static uint8_t takeTask(WindOpWorker * self, void ** task) {
+    WindOpPool * pool = self->pool;
+    uint32_t i;
+
+    if (pop_WindOpQueue(&self->queue, task)) {
+        return 1;
+    }
+    for (i = 1; i < pool->numWorkers; i++) {
+        if (pop_WindOpQueue(&pool->workers[(self->index + i) % pool->numWorkers].queue, task)) {
+            atomic_fetch_add_explicit(&self->steals, 1, memory_order_relaxed);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void * workerMain(void * arg) {
+    WindOpWorker * self = arg;
+    WindOpPool * pool = self->pool;
+    uint32_t misses = 0;
+    void * task;
+
+    while (!atomic_load_explicit(&pool->stop, memory_order_acquire)) {
+        if (!takeTask(self, &task)) {
+            idle(&misses);
+            continue;
+        }
+        misses = 0;
+        pool->run(pool, self->index, task);
+        atomic_fetch_add_explicit(&self->tasks, 1, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&pool->pending, 1, memory_order_acq_rel);
+    }
+    return NULL;
+}
+
+/*
+ * Undo a start that failed part way, numThreads workers running. The
+ * workers are calloc'ed so queues never allocated free as NULL.
+ */
+static uint8_t unwind(WindOpPool * pool, uint32_t numThreads) {
+    uint32_t i;
+
+    atomic_store_explicit(&pool->stop, 1, memory_order_release);
+    for (i = 0; i < numThreads; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    for (i = 0; i < pool->numWorkers; i++) {
+        free_WindOpQueue(&pool->workers[i].queue);
+    }
+    free(pool->workers);
+    memset(pool, 0, sizeof(*pool));
+    return WINDOP_ERR_MEMORY;
+}
+
+uint8_t start_WindOpPool(WindOpPool * pool, uint32_t numWorkers, uint32_t queueCapacity, WindOpTaskFn run,
+                         void * context) {
+    long cpus;
+    uint32_t i;
+
+    if (numWorkers == 0) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        numWorkers = (cpus > 0) ? (uint32_t) cpus : 1;
+    }
+    memset(pool, 0, sizeof(*pool));
+    pool->workers = calloc(numWorkers, sizeof(WindOpWorker));
+    if (pool->workers == NULL) {
+        return WINDOP_ERR_MEMORY;
+    }
+    pool->numWorkers = numWorkers;
+    pool->run = run;
+    pool->context = context;
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->stop, 0);
+
+    for (i = 0; i < numWorkers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        atomic_init(&pool->workers[i].tasks, 0);
+        atomic_init(&pool->workers[i].steals, 0);
+        if (init_WindOpQueue(&pool->workers[i].queue, queueCapacity) != WINDOP_OK) {
+            return unwind(pool, 0);
+        }
+    }
+    for (i = 0; i < numWorkers; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, workerMain, &pool->workers[i]) != 0) {
+            return unwind(pool, i);
+        }
+    }
+    return WINDOP_OK;
+}
+
+uint8_t submit_WindOpPool(WindOpPool * pool, uint32_t worker, void * task) {
+    uint32_t i;
+
+    // Count first so a fast worker can never take pending below zero
+    atomic_fetch_add_explicit(&pool->pending, 1, memory_order_acq_rel);
+    for (i = 0; i < pool->numWorkers; i++) {
+        if (push_WindOpQueue(&pool->workers[(worker + i) % pool->numWorkers].queue, task)) {
+            return 1;
+        }
+    }
+    atomic_fetch_sub_explicit(&pool->pending, 1, memory_order_acq_rel);
+    return 0;
+}
+
+void wait_WindOpPool(WindOpPool * pool) {
+    uint32_t misses = IDLE_SPINS;
+
+    while (atomic_load_explicit(&pool->pending, memory_order_acquire) != 0) {
+        idle(&misses);
+    }
+}
+
+void stop_WindOpPool(WindOpPool * pool) {
+    uint32_t i;
+
+    wait_WindOpPool(pool);
+    atomic_store_explicit(&pool->stop, 1, memory_order_release);
+    for (i = 0; i < pool->numWorkers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    // Only once all are joined, a worker still running may be stealing from any queue
+    for (i = 0; i < pool->numWorkers; i++) {
+        free_WindOpQueue(&pool->workers[i].queue);
+    }
+    free(pool->workers);
+    pool->workers = NULL;
+}
@@ -0,0 +1,98 @@
+/*
+ ============================================================================
+ Name        : wm_pool.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Work stealing thread pool
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_POOL_H
+#define WM_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "wm_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ****************************************************************************
+ *
+ * Fixed set of worker threads, each with its own bounded task queue. A
+ * worker runs its own tasks first and steals from the other queues when it
+ * runs dry, so a burst landing on one worker spreads over the pool. Tasks
+ * are opaque pointers handed to the pool's run function, which may submit
+ * follow on tasks, normally to its own worker to keep the data in cache.
+ *
+ * */
+struct WindOpPool;
+typedef void (*WindOpTaskFn)(struct WindOpPool * pool, uint32_t worker, void * task);
+
+typedef struct WindOpWorker {
+    WindOpQueue queue;
+    pthread_t thread;
+    struct WindOpPool * pool;
+    uint32_t index;
+    atomic_uint_fast64_t tasks;     // Tasks run by this worker
+    atomic_uint_fast64_t steals;    // Of which taken from another queue
+} WindOpWorker;
+
+typedef struct WindOpPool {
+    WindOpWorker * workers;
+    uint32_t numWorkers;
+    WindOpTaskFn run;
+    void * context;                 // For the run function
+    atomic_uint_fast64_t pending;   // Submitted and not yet finished
+    atomic_int stop;
+} WindOpPool;
+
+// numWorkers 0 uses one worker per online CPU. Returns a WINDOP_* code, after
+// a failure the pool holds no threads or memory
+uint8_t start_WindOpPool(WindOpPool * pool, uint32_t numWorkers, uint32_t queueCapacity, WindOpTaskFn run,
+                         void * context);
+
+/*
+ * Queue task on worker, or on the next worker with room. Returns 0 when
+ * every queue is full, the caller can back off or run the task itself.
+ */
+uint8_t submit_WindOpPool(WindOpPool * pool, uint32_t worker, void * task);
+
+// Block until every submitted task, and the tasks they submit, has run
+void wait_WindOpPool(WindOpPool * pool);
+
+// Wait, then stop and join the workers
+void stop_WindOpPool(WindOpPool * pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_POOL_H
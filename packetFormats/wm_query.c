@@ -0,0 +1,330 @@
+/*
+ ============================================================================
+ Name        : wm_query.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Minute index builder and predicate scans
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "wm_codec.h"
+#include "wm_archive.h"
+#include "wm_batch.h"
+#include "wm_csv.h"
+#include "wm_tindex.h"
+
+static const char * helpText =
+"\n"
+"   WindOp minute index\n"
+"\n"
+"   Builds a per device, per minute index of decoded readings from a packet\n"
+"   archive and scans it by time range and channel predicates. Blocks hold a\n"
+"   day of minutes with min and max per channel, blocks that can't match a\n"
+"   predicate are skipped unread.\n"
+"\n"
+"      wm_query build index archive   : Index every device of the archive\n"
+"      wm_query scan index [options]  : Write matching minutes as CSV\n"
+"      wm_query list index            : List devices and blocks\n"
+"\n"
+"      -d device              : scan, device id, required\n"
+"      -from YYYYMMDDhhmmss   : scan, first minute to keep\n"
+"      -to YYYYMMDDhhmmss     : scan, last minute to keep\n"
+"      -where pred            : scan, keep rows where pred holds, eg ws>5 or\n"
+"                               tmp<=0. Repeat for several, all must hold\n"
+"      -cols ws,wd,...        : scan, channels to write, default all\n"
+"      -o file                : scan, write to file, default stdout\n"
+"      -help                  : Prints this\n"
+"\n"
+"   Predicate and CSV values are in units, ws in m/s, tmp in C, pres in hPa.\n"
+"\n";
+
+typedef struct queryCfg {
+    const char * command;
+    const char * index;
+    const char * archive;
+    const char * outFile;
+    WindOpQuery query;
+} queryCfg;
+
+static void usageError(const char * message) {
+    fprintf(stderr, "ERROR %s\n%s", message, helpText);
+    exit(EXIT_FAILURE);
+}
+
+static void outOfMemory(void) {
+    fprintf(stderr, "ERROR out of memory\n");
+    exit(EXIT_FAILURE);
+}
+
+static double elapsedMs(clock_t start) {
+    return 1000.0 * (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* ****************************************************************************
+ *
+ * build, one archive device at a time so only its readings are held
+ *
+ * */
+static void buildIndex(queryCfg * cfg) {
+    WindOpArchiveReader reader;
+    WindOpTimeIndexWriter writer;
+    WindOpColumns cols;
+    clock_t start = clock();
+    uint64_t rows = 0;
+    uint32_t needed;
+    uint32_t failed = 0;
+    uint32_t device;
+    uint32_t i;
+
+    if (open_WindOpArchiveReader(&reader, cfg->archive) != WINDOP_OK) {
+        fprintf(stderr, "Can't open %s as an archive\n", cfg->archive);
+        exit(EXIT_FAILURE);
+    }
+    if (open_WindOpTimeIndexWriter(&writer, cfg->index) != WINDOP_OK) {
+        fprintf(stderr, "Can't open %s\n", cfg->index);
+        exit(EXIT_FAILURE);
+    }
+    if (init_WindOpColumns(&cols, 0) != WINDOP_OK) {
+        outOfMemory();
+    }
+    for (device = 0; device < reader.numDevices; device++) {
+        needed = 0;
+        for (i = 0; i < reader.numChunks; i++) {
+            needed += (reader.chunks[i].device == device) ? chunkRows_WindOpArchive(&reader, i) : 0;
+        }
+        cols.numRows = 0;
+        if (reserve_WindOpColumns(&cols, needed) != WINDOP_OK) {
+            outOfMemory();
+        }
+        for (i = 0; i < reader.numChunks; i++) {
+            if (reader.chunks[i].device == device) {
+                failed += decodeChunk_WindOpArchive(&reader, i, &cols);
+            }
+        }
+        if (addDevice_WindOpTimeIndex(&writer, device_WindOpArchive(&reader, device), &cols) != WINDOP_OK) {
+            fprintf(stderr, "ERROR indexing %s\n", device_WindOpArchive(&reader, device));
+            exit(EXIT_FAILURE);
+        }
+        rows += cols.numRows;
+    }
+    if (close_WindOpTimeIndexWriter(&writer) != WINDOP_OK) {
+        fprintf(stderr, "ERROR writing %s\n", cfg->index);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "---Indexed %llu readings of %u devices in %.0f ms, %u packets failed\n",
+            (unsigned long long) rows, reader.numDevices, elapsedMs(start), failed);
+    free_WindOpColumns(&cols);
+    close_WindOpArchiveReader(&reader);
+}
+
+/* ****************************************************************************
+ *
+ * scan and list
+ *
+ * */
+static void openIndex(queryCfg * cfg, WindOpTimeIndexReader * reader) {
+    if (open_WindOpTimeIndexReader(reader, cfg->index) != WINDOP_OK) {
+        fprintf(stderr, "Can't open %s as an index\n", cfg->index);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void scanIndex(queryCfg * cfg) {
+    WindOpTimeIndexReader reader;
+    WindOpQueryResult result;
+    WindOpTimeFormat fmt;
+    FILE * out = stdout;
+    char key[WINDOP_TIME_KEY_SIZE];
+    clock_t start;
+    double scanMs;
+    uint32_t row;
+    uint8_t ch;
+
+    if (cfg->query.device == NULL) {
+        usageError("-d device is needed to scan");
+    }
+    openIndex(cfg, &reader);
+    if (findDevice_WindOpTimeIndex(&reader, cfg->query.device) < 0) {
+        fprintf(stderr, "No device %s in %s\n", cfg->query.device, cfg->index);
+        exit(EXIT_FAILURE);
+    }
+    init_WindOpQueryResult(&result);
+    start = clock();
+    if (query_WindOpTimeIndex(&reader, &cfg->query, &result) != WINDOP_OK) {
+        outOfMemory();
+    }
+    scanMs = elapsedMs(start);
+
+    if ((cfg->outFile != NULL) && ((out = fopen(cfg->outFile, "w")) == NULL)) {
+        fprintf(stderr, "Can't open %s\n", cfg->outFile);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(out, "time");
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        if (cfg->query.channels & (1u << ch)) {
+            fprintf(out, ",%s", key_WindOpChannel(ch));
+        }
+    }
+    fprintf(out, "\n");
+    init_WindOpTimeFormat(&fmt);
+    for (row = 0; row < result.numRows; row++) {
+        format_WindOpTime(&fmt, result.time[row], key);
+        fprintf(out, "%s", key);
+        for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+            if (!(cfg->query.channels & (1u << ch))) {
+                continue;
+            }
+            if (result.valid[row] & (1u << ch)) {
+                fprintf(out, ",%g", result.value[ch][row]);
+            } else {
+                fprintf(out, ",");
+            }
+        }
+        fprintf(out, "\n");
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    fprintf(stderr, "---Scanned %u blocks, skipped %u, %llu rows read, %u matched in %.3f ms\n",
+            result.blocksInRange, result.blocksSkipped, (unsigned long long) result.rowsScanned, result.numRows, scanMs);
+    free_WindOpQueryResult(&result);
+    close_WindOpTimeIndexReader(&reader);
+}
+
+static void listIndex(queryCfg * cfg) {
+    WindOpTimeIndexReader reader;
+    const WindOpTimeIndexDevice * dev;
+    WindOpTimeFormat fmt;
+    char first[WINDOP_TIME_KEY_SIZE];
+    char last[WINDOP_TIME_KEY_SIZE];
+    uint32_t i;
+
+    openIndex(cfg, &reader);
+    init_WindOpTimeFormat(&fmt);
+    printf("%u devices, %u blocks\n", reader.numDevices, reader.numBlocks);
+    printf("%-24s %-14s %-14s %8s %10s\n", "device", "first", "last", "blocks", "minutes");
+    for (i = 0; i < reader.numDevices; i++) {
+        dev = &reader.devices[i];
+        if (dev->numBlocks == 0) {
+            printf("%-24s %-14s %-14s %8u %10u\n", dev->name, "-", "-", 0u, 0u);
+            continue;
+        }
+        format_WindOpTime(&fmt, (int64_t) reader.blocks[dev->firstBlock].firstMinute * 60, first);
+        format_WindOpTime(&fmt, (int64_t) reader.blocks[dev->firstBlock + dev->numBlocks - 1].lastMinute * 60, last);
+        printf("%-24s %-14s %-14s %8u %10llu\n", dev->name, first, last, dev->numBlocks,
+               (unsigned long long) dev->rows);
+    }
+    close_WindOpTimeIndexReader(&reader);
+}
+
+static uint8_t parseChannels(char * list) {
+    uint8_t channels = 0;
+    char * name;
+    uint8_t ch;
+
+    for (name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+        for (ch = 0; (ch < WINDOP_NUM_CHANNELS) && (strcmp(name, key_WindOpChannel(ch)) != 0); ch++) {
+        }
+        if (ch == WINDOP_NUM_CHANNELS) {
+            usageError("-cols wants channel keys, ws,wsa,wsm,wd,tmp,pres,hum,bv");
+        }
+        channels |= (uint8_t) (1u << ch);
+    }
+    return channels;
+}
+
+static void processCommandLine(int argc, char ** argv, queryCfg * cfg) {
+    WindOpQuery * query = &cfg->query;
+    int i;
+    for (i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-d") == 0) && (i + 1 < argc)) {
+            query->device = argv[++i];
+        } else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+            cfg->outFile = argv[++i];
+        } else if ((strcmp(argv[i], "-from") == 0) && (i + 1 < argc)) {
+            if (parseTime_WindOpCsv(argv[++i], &query->from) != WINDOP_OK) {
+                usageError("-from wants YYYYMMDDhhmmss");
+            }
+        } else if ((strcmp(argv[i], "-to") == 0) && (i + 1 < argc)) {
+            if (parseTime_WindOpCsv(argv[++i], &query->to) != WINDOP_OK) {
+                usageError("-to wants YYYYMMDDhhmmss");
+            }
+        } else if ((strcmp(argv[i], "-where") == 0) && (i + 1 < argc)) {
+            if ((query->numPredicates == WINDOP_MAX_PREDICATES) ||
+                (parse_WindOpPredicate(argv[++i], &query->predicates[query->numPredicates++]) != WINDOP_OK)) {
+                usageError("-where wants up to 8 predicates like ws>5, ops are < <= > >=");
+            }
+        } else if ((strcmp(argv[i], "-cols") == 0) && (i + 1 < argc)) {
+            query->channels = parseChannels(argv[++i]);
+        } else if ((strcmp(argv[i], "-help") == 0) || (argv[i][0] == '-')) {
+            printf("%s", helpText);
+            exit(EXIT_SUCCESS);
+        } else if (cfg->command == NULL) {
+            cfg->command = argv[i];
+        } else if (cfg->index == NULL) {
+            cfg->index = argv[i];
+        } else {
+            cfg->archive = argv[i];
+        }
+    }
+    if ((cfg->command == NULL) || (cfg->index == NULL)) {
+        usageError("a command and an index are needed");
+    }
+}
+
+int main(int argc, char ** argv) {
+    queryCfg cfg;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.query.from = INT64_MIN;
+    cfg.query.to = INT64_MAX;
+    cfg.query.channels = 0xFF;
+    processCommandLine(argc, argv, &cfg);
+
+    if (strcmp(cfg.command, "build") == 0) {
+        if (cfg.archive == NULL) {
+            usageError("build wants an archive");
+        }
+        buildIndex(&cfg);
+    } else if (strcmp(cfg.command, "scan") == 0) {
+        scanIndex(&cfg);
+    } else if (strcmp(cfg.command, "list") == 0) {
+        listIndex(&cfg);
+    } else {
+        usageError("unknown command");
+    }
+
+    return EXIT_SUCCESS;
+}
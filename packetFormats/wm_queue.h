@@ -0,0 +1,129 @@
+/*
+ ============================================================================
+ Name        : wm_queue.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Bounded lock free multi producer multi consumer queue
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_QUEUE_H
+#define WM_QUEUE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WINDOP_CACHE_LINE        64
+
+/* ****************************************************************************
+ *
+ * Bounded queue of pointers, after D. Vyukov's MPMC array queue. Each cell
+ * carries a sequence number telling producers and consumers whose turn it
+ * is, so a push or pop is one compare and swap on the shared position with
+ * no lock. Capacity is rounded up to a power of two.
+ *
+ * push fails when the queue is full and pop when it is empty, the caller
+ * decides whether to spin, yield or do something else.
+ *
+ * */
+typedef struct WindOpQueueCell {
+    atomic_size_t sequence;
+    void * data;
+} WindOpQueueCell;
+
+typedef struct WindOpQueue {
+    WindOpQueueCell * cells;
+    size_t mask;
+    _Alignas(WINDOP_CACHE_LINE) atomic_size_t enqueuePos;
+    _Alignas(WINDOP_CACHE_LINE) atomic_size_t dequeuePos;
+} WindOpQueue;
+
+// Returns a WINDOP_* code
+uint8_t init_WindOpQueue(WindOpQueue * queue, size_t capacity);
+void free_WindOpQueue(WindOpQueue * queue);
+
+static inline uint8_t push_WindOpQueue(WindOpQueue * queue, void * data) {
+    WindOpQueueCell * cell;
+    size_t pos = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+    size_t seq;
+    intptr_t diff;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueuePos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0; // Full
+        } else {
+            pos = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+        }
+    }
+    cell->data = data;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return 1;
+}
+
+static inline uint8_t pop_WindOpQueue(WindOpQueue * queue, void ** data) {
+    WindOpQueueCell * cell;
+    size_t pos = atomic_load_explicit(&queue->dequeuePos, memory_order_relaxed);
+    size_t seq;
+    intptr_t diff;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        diff = (intptr_t) seq - (intptr_t) (pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->dequeuePos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0; // Empty
+        } else {
+            pos = atomic_load_explicit(&queue->dequeuePos, memory_order_relaxed);
+        }
+    }
+    *data = cell->data;
+    atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+    return 1;
+}
+
+// Entries queued at the moment of the call, only a hint under concurrency
+static inline size_t depth_WindOpQueue(WindOpQueue * queue) {
+    size_t in = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+    size_t out = atomic_load_explicit(&queue->dequeuePos, memory_order_relaxed);
+    return (in > out) ? in - out : 0;
+}
+
+#endif // WM_QUEUE_H
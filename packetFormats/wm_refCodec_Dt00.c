@@ -31,93 +31,27 @@
 
  */
 
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
-
-#define READINGS_BUFFER_SIZE     30
-#define BYTEBUFFERSIZE           1000 // Note this example has no byte overrun protection
-
-#define WINDOPDATAPACKET_T3_TYPE 0x02
-#define WINDOPDATAPACKET_T4_TYPE 0x03
-#define WINDOPDATAPACKET_T5_TYPE 0x04
-#define WINDOPDATAPACKET_T6_TYPE 0x06
-
-//*****************************************************************************
-//
-//! \brief Used in the RTC_C_initCalendar() function as the CalendarTime
-//! parameter. (TI Header)
-//
-//*****************************************************************************
-typedef struct Calendar {
-    //! Seconds of minute between 0-59
-    uint8_t Seconds;
-    //! Minutes of hour between 0-59
-    uint8_t Minutes;
-    //! Hour of day between 0-23
-    uint8_t Hours;
-    //! Day of week between 0-6
-    uint8_t DayOfWeek;
-    //! Day of month between 1-31
-    uint8_t DayOfMonth;
-    //! Month between 0-11
-    uint8_t Month;
-    //! Year between 0-4095
-    uint16_t Year;
-} Calendar;
-
-/* ****************************************************************************
- *
- * Define struct of reading types
- *
- * */
-typedef struct WindOpDataPacket_t3 {
-    uint16_t ws; // Average minute windspeed
-    uint16_t wsx; // Second max speed windspeed
-    uint16_t wsm; // Second min windspeed
-    uint16_t wd;  // Wind direction
-    int16_t tmp; // temperature
-    uint16_t press; // Pressure
-    uint16_t hum; // Humidity
-    uint16_t bv; // Battery Voltage
-} WindOpDataPacket_t3;
-
-
-/*
- * Optional data structs that can be used.
- *
- * */
-typedef struct WindOpDataPacket_t4 {
-    uint16_t ws; // Average minute windspeed
-    uint16_t wsx; // Second max speed windspeed
-    uint16_t wsm; // Second min windspeed
-    uint16_t wd;  // Wind direction
-} WindOpDataPacket_t4;
-
-typedef struct WindOpDataPacket_t5 {
-    int16_t tmp; // temperature
-    uint16_t press; // Pressure
-    uint16_t hum; // Humidity
-    uint16_t bv; // Battery Voltage
-} WindOpDataPacket_t5;
-
-/* ****************************************************************************
- *
- * Packet packing control struct
- *
- * */
-typedef struct packCtrl {
-    Calendar time;
-    uint8_t incSeconds;
-    uint8_t numOfReadings;
-    uint8_t extendedTimeFormat;
-    uint8_t dataType;
-    uint8_t packetLength;
-
-    // Note as T3 & T4 are subsets we simple reuse the T2 structure.
-    //
-    WindOpDataPacket_t3 readings[READINGS_BUFFER_SIZE];
-
-} packCtrl;
+#include <string.h>
+#include <unistd.h>
+
+#include "wm_codec.h"
+#include "wm_archive.h"
+#include "wm_arrow.h"
+#include "wm_dedup.h"
+#include "wm_gps.h"
+#include "wm_json.h"
+#include "wm_metrics.h"
+#include "wm_pool.h"
+#include "wm_rollup.h"
+#include "wm_serlog.h"
+#include "wm_sim.h"
+#include "wm_store.h"
+#include "wm_tindex.h"
+#include "wm_view.h"
 
 /* ****************************************************************************
  * Pretty print helper functions
@@ -167,14 +101,15 @@ uint16_t testValue(char * str, uint16_t v1, uint16_t v2) {
 uint16_t test_WindOpDataReadings(WindOpDataPacket_t3 * readingsIn1, WindOpDataPacket_t3 * readingsIn2, uint8_t dataType) {
     uint16_t error = 0;
 
-    if ((dataType == WINDOPDATAPACKET_T3_TYPE) | (dataType == WINDOPDATAPACKET_T4_TYPE)) {
+    if ((dataType == WINDOPDATAPACKET_T3_TYPE) | (dataType == WINDOPDATAPACKET_T4_TYPE) | (dataType == WINDOPDATAPACKET_T8_TYPE)) {
 
         error += testValue("ws ", readingsIn1->ws, readingsIn2->ws);
         error += testValue("wsx", readingsIn1->wsx, readingsIn2->wsx);
         error += testValue("wsx", readingsIn1->wsm, readingsIn2->wsm);
         error += testValue("wd ", readingsIn1->wd, readingsIn2->wd);
     }
-    if ((dataType == WINDOPDATAPACKET_T3_TYPE) | (dataType == WINDOPDATAPACKET_T5_TYPE)) {
+    if ((dataType == WINDOPDATAPACKET_T3_TYPE) | (dataType == WINDOPDATAPACKET_T5_TYPE) | (dataType == WINDOPDATAPACKET_T6_TYPE) |
+        (dataType == WINDOPDATAPACKET_T8_TYPE)) {
         error += testValue("tmp", readingsIn1->tmp, readingsIn2->tmp);
         error += testValue("prs", readingsIn1->press, readingsIn2->press);
         error += testValue("hum", readingsIn1->hum, readingsIn2->hum);
@@ -219,276 +154,387 @@ void setdataPoint(WindOpDataPacket_t3 * data, uint16_t ws, uint16_t wsx, uint16_
     data->wsm = wsm;
 }
 
-/* ****************************************************************************
- * ****************************************************************************
- * ***              PACKING FUNCTIONS OF INTEREST START                 *******
- * ****************************************************************************
- * ****************************************************************************
- * */
+
+typedef struct testCtrl {
+
+    packCtrl dataIn;
+    packCtrl dataOut;
+
+} testCtrl;
 
 /* ****************************************************************************
  *
- * Pack the time stamp. 4 & 5 Byte version
- *
- * EYYY_YYYY___YYYY_MMMM___DDDD_DHHH___HHmm_mmmm
+ * Unpack a packet into the columnar store enough times to grow it past the
+ * packCtrl buffer, then pack each copy back out of the store. The bytes
+ * must match the original packet.
  *
- * E     : If set use extended second format, addition byte containing seconds
- * Year  : 11 bits contain the year, 0...2047
- * Month :  4 bits contain the Month, 1...12
- * Day   :  5 bits contain the day of the Month 1...31
- * Hour  :  5 bits contain the hour 0...23
- * Minute:  6 bits contain the minute 0...59
+ * */
+#define STORE_TEST_COPIES 16
+
+uint16_t runStoreTest(uint8_t * byteBuffer, uint8_t bufferLength, uint8_t incSeconds, uint8_t numOfReadings) {
+    WindOpColumns store;
+    uint8_t storeBuffer[BYTEBUFFERSIZE];
+    uint16_t error = 0;
+    uint16_t length;
+    uint8_t i;
+
+    init_WindOpColumns(&store, 0);
+    for (i = 0; i < STORE_TEST_COPIES; i++) {
+        reserve_WindOpColumns(&store, maxReadings_WindOpPacket(byteBuffer, bufferLength));
+        error += testValue("store unpack", decode_WindOpPacketColumns(byteBuffer, bufferLength, i, &store), WINDOP_OK);
+    }
+    error += testValue("store rows", (uint16_t) store.numRows, numOfReadings * STORE_TEST_COPIES);
+    error += testValue("store aligned", ((uintptr_t) store.channel[WINDOP_CH_BV] % WINDOP_COLUMNS_ALIGN) == 0, 1);
+
+    for (i = 0; (i < STORE_TEST_COPIES) && (store.numRows == numOfReadings * STORE_TEST_COPIES); i++) {
+        length = pack_WindOpDataPacketFromColumns(&store, i * numOfReadings, numOfReadings, byteBuffer[0], incSeconds,
+                                                  storeBuffer);
+        if ((length != bufferLength) || (memcmp(storeBuffer, byteBuffer, bufferLength) != 0)) {
+            printf("Store copy %d does not match the packet .... ERROR\n", i);
+            error++;
+        }
+    }
+
+    free_WindOpColumns(&store);
+    return error;
+}
+
+/* ****************************************************************************
  *
- * If Extended
- * Seconds: 6 bits contain the seconds 0...59
- * Year   : 2 bits added to the MSB of the Year, becomes 13 bits instead of 11.
- *          Am I being serious here? These could be used for something else.
+ * Walk two back to back copies of the packet with the zero copy view and
+ * check every field against the channel unpack.
  *
  * */
-uint16_t pack_WindOpMinuteTime(Calendar * timeIn, uint8_t * outBuffer, uint8_t incSecs) {
-    uint8_t working1;
-    uint8_t working2;
-
-    // Remember LSByte first
-    // HHmm_mmmm
-    working2 = (timeIn->Hours & 0x03) << 6;
-    outBuffer[0] = timeIn->Minutes + working2;
-
-    // DDDD_DHHH
-    working2 = (timeIn->Hours & 0x1F) >> 2;
-    working1 = (timeIn->DayOfMonth & 0x1F) << 3;
-    outBuffer[1] = working1 + working2;
-
-    // YYYY_MMMM
-    working2 = (timeIn->Month & 0x0F);
-    working1 = (timeIn->Year & 0x0F) << 4;
-    outBuffer[2] = working1 + working2;
-
-    // EYYY_YYYY
-    working2 = ((timeIn->Year >> 4) & 0x7F);
-    outBuffer[3] = working2;
-
-    // Extended format, extra byte with seconds
-    if (incSecs) {
-        outBuffer[3] |= 0x80;
-        outBuffer[4] = ((timeIn->Year & 0x1800) >> 5);
-        outBuffer[4] += (timeIn->Seconds & 0x3F);
-        return 5;
-    } else {
-        return 4;
+uint16_t runViewTest(uint8_t * byteBuffer, uint8_t bufferLength, uint8_t numOfReadings) {
+    WindOpPacketView view;
+    Calendar time;
+    uint8_t capture[2 * BYTEBUFFERSIZE];
+    int32_t values[WINDOP_NUM_CHANNELS];
+    int32_t * channel[WINDOP_NUM_CHANNELS];
+    uint16_t error = 0;
+    uint32_t offset = 0;
+    uint16_t reading;
+    uint8_t packets = 0;
+    uint8_t ch;
+
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        channel[ch] = &values[ch];
     }
+    memcpy(&capture[0], byteBuffer, bufferLength);
+    memcpy(&capture[bufferLength], byteBuffer, bufferLength);
+
+    while (next_WindOpPacketView(&view, capture, 2 * bufferLength, &offset) == WINDOP_OK) {
+        packets++;
+        error += testValue("view readings", view.numReadings, numOfReadings);
+        error += testValue("view time", time_WindOpPacketView(&view, &time), WINDOP_OK);
+        if (view.info->readingSize == 0) {
+            continue; // Delta readings have no fixed place, the store test covers them
+        }
+        for (reading = 0; reading < view.numReadings; reading++) {
+            unpack_WindOpReadingChannels(view.info, channel, 0, &byteBuffer[view.dataOffset + reading * view.info->readingSize]);
+            for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+                if (carries_WindOpPacketView(&view, ch) && (field_WindOpPacketView(&view, reading, ch) != values[ch])) {
+                    printf("View reading %d channel %d does not match .... ERROR\n", reading, ch);
+                    error++;
+                }
+            }
+        }
+    }
+    error += testValue("view packets", packets, 2);
 
+    return error;
 }
 
 /* ****************************************************************************
  *
- * Reverse the PACK routine
+ * Check the epoch time codec against the Calendar one over the full 11 bit
+ * and 13 bit year ranges, first, middle and last day of every month, and
+ * the time keys against the Calendar fields.
  *
  * */
-uint16_t unpack_WindOpMinuteTime(Calendar * timeIn, uint8_t * outBuffer) {
+static uint32_t checkEpochTime(Calendar * cal, uint8_t incSeconds, WindOpTimeFormat * fmt) {
+    uint8_t expect[WINDOP_TIME_EXT_SIZE];
+    uint8_t packed[WINDOP_TIME_EXT_SIZE];
+    char key[WINDOP_TIME_KEY_SIZE];
+    char expectKey[32];
+    uint16_t expectSize;
+    uint16_t size;
+    int64_t epoch;
+    int64_t decoded;
+    uint32_t error = 0;
+
+    expectSize = pack_WindOpMinuteTime(cal, expect, incSeconds);
+    epoch = epoch_WindOpCalendar(cal);
+    size = pack_WindOpEpochTime(epoch, packed, incSeconds);
+    if ((size != expectSize) || (memcmp(packed, expect, size) != 0)) {
+        error++;
+    }
 
-    // Remember LSByte first
-    // HHmm_mmmm
-    timeIn->Minutes = outBuffer[0] & 0x3F;
-    timeIn->Hours = (outBuffer[0] & 0xC0) >> 6;
+    if (!incSeconds) {
+        epoch -= cal->Seconds;
+    }
+    if ((unpack_WindOpEpochTime(expect, &decoded) != expectSize) || (decoded != epoch)) {
+        error++;
+    }
 
-    // DDDD_DHHH
-    timeIn->Hours += ((outBuffer[1] & 0x7) << 2);
-    timeIn->DayOfMonth = (outBuffer[1] & 0xF8) >> 3;
+    format_WindOpTime(fmt, decoded, key);
+    snprintf(expectKey, sizeof(expectKey), "%04u%02u%02u%02u%02u%02u", cal->Year, cal->Month, cal->DayOfMonth,
+             cal->Hours, cal->Minutes, incSeconds ? cal->Seconds : 0);
+    if (strcmp(key, expectKey) != 0) {
+        error++;
+    }
 
-    // YYYY_MMMM
-    timeIn->Month = (outBuffer[2] & 0x0F);
-    timeIn->Year = (outBuffer[2] & 0xF0) >> 4;
+    if (error) {
+        printf("Epoch time %s != %s size %d .... ERROR\n", key, expectKey, size);
+    }
+    return error;
+}
 
-    // EYYY_YYYY
-    timeIn->Year += (outBuffer[3] & 0x7F) << 4;
+uint16_t runEpochTimeTest(void) {
+    WindOpTimeFormat fmt;
+    Calendar cal;
+    Calendar next;
+    uint8_t bytes[WINDOP_TIME_EXT_SIZE];
+    char key[WINDOP_TIME_KEY_SIZE];
+    int64_t epoch;
+    uint32_t error = 0;
+    uint32_t stamps = 0;
+    uint32_t year;
+    uint8_t month;
+    uint8_t days;
+    uint8_t d;
+    uint8_t incSeconds;
+    uint8_t reading;
+    const uint8_t dayOfMonth[3] = { 1, 15, 0 }; // 0 is the last day
+
+    init_WindOpTimeFormat(&fmt);
+    for (year = 0; year <= 0x1FFF; year++) {
+        for (month = 1; month <= 12; month++) {
+            setExampleTime(&cal, year, month, 1, 0, 0, 0);
+            setExampleTime(&next, year + (month == 12), (month % 12) + 1, 1, 0, 0, 0);
+            days = (uint8_t) ((epoch_WindOpCalendar(&next) - epoch_WindOpCalendar(&cal)) / 86400);
+            for (d = 0; d < 3; d++) {
+                setExampleTime(&cal, year, month, dayOfMonth[d] ? dayOfMonth[d] : days,
+                               (year + d) % 24, (year + month) % 60, (month * 7 + d) % 60);
+                if (d == 2) {
+                    setExampleTime(&cal, year, month, days, 23, 59, 59);
+                }
+                for (incSeconds = (year > 0x7FF); incSeconds < 2; incSeconds++) {
+                    error += checkEpochTime(&cal, incSeconds, &fmt);
+                    stamps++;
+                }
+            }
+        }
+    }
 
-    if ((outBuffer[3] & 0x80) == 0x80) {
-        timeIn->Year += (outBuffer[4] & 0xC0) << 5;
-        timeIn->Seconds = outBuffer[4] & 0x3F;
-        return 5;
-    } else {
-        return 4;
+    // Years that do not fit, and fields out of range
+    setExampleTime(&cal, 0x800, 1, 1, 0, 0, 0);
+    error += testValue("epoch 11 bit year", pack_WindOpEpochTime(epoch_WindOpCalendar(&cal), bytes, 0), 0);
+    setExampleTime(&cal, 0x2000, 1, 1, 0, 0, 0);
+    error += testValue("epoch 13 bit year", pack_WindOpEpochTime(epoch_WindOpCalendar(&cal), bytes, 1), 0);
+    error += testValue("epoch before year 0", pack_WindOpEpochTime(-62167219201LL, bytes, 1), 0);
+    setExampleTime(&cal, 2017, 12, 1, 12, 3, 0);
+    pack_WindOpMinuteTime(&cal, bytes, 0);
+    bytes[2] = (bytes[2] & 0xF0) | 13;
+    error += testValue("epoch bad month", unpack_WindOpEpochTime(bytes, &epoch), 0);
+    bytes[2] &= 0xF0;
+    error += testValue("epoch month 0", unpack_WindOpEpochTime(bytes, &epoch), 0);
+    pack_WindOpMinuteTime(&cal, bytes, 0);
+    bytes[0] |= 0x3F;
+    error += testValue("epoch bad minute", unpack_WindOpEpochTime(bytes, &epoch), 0);
+
+    // Per reading keys across midnight and a year end from one cached formatter
+    setExampleTime(&cal, 2017, 12, 31, 23, 58, 0);
+    epoch = epoch_WindOpCalendar(&cal);
+    for (reading = 0; reading < 4; reading++) {
+        calendar_WindOpEpoch(&next, epoch + 60 * reading);
+        error += checkEpochTime(&next, 0, &fmt);
+    }
+    format_WindOpTime(&fmt, epoch + 120, key);
+    if (strcmp(key, "20180101000000") != 0) {
+        printf("Epoch time key %s .... ERROR\n", key);
+        error++;
     }
 
-}
-/* ****************************************************************************
- *
- * Pack a data reading.
- *
- * */
-uint16_t pack_WindOpDataReadings_t3(struct WindOpDataPacket_t3 * readingsIn, uint8_t * outBuffer) {
-    outBuffer[0] = readingsIn->ws & 0x00FF;            // LSB Wind speed, Average over 1 minute
-    outBuffer[1] = (readingsIn->ws & 0xFF00) >> 8;     // MSB
-    outBuffer[2] = readingsIn->wsx & 0x00FF;           // Wind speed max measured over 1 second
-    outBuffer[3] = (readingsIn->wsx & 0xFF00) >> 8;    // during the last averaging period
-    outBuffer[4] = readingsIn->wsm & 0x00FF;           // Wind speed min measured over 1 second
-    outBuffer[5] = (readingsIn->wsm & 0xFF00) >> 8;    // during the last averaging period
-    outBuffer[6] = readingsIn->wd & 0x00FF;            // Wind Direction
-    outBuffer[7] = (readingsIn->wd & 0xFF00) >> 8;     //
-    outBuffer[8] = readingsIn->tmp & 0x00FF;           // Temperature
-    outBuffer[9] = (readingsIn->tmp & 0xFF00) >> 8;    //
-    outBuffer[10] = readingsIn->press & 0x00FF;        // Pressure
-    outBuffer[11] = (readingsIn->press & 0xFF00) >> 8; //
-    outBuffer[12] = readingsIn->hum & 0x00FF;          // Humidity
-    outBuffer[13] = (readingsIn->hum & 0xFF00) >> 8;   //
-    outBuffer[14] = readingsIn->bv & 0x00FF;           // Battery voltage
-    outBuffer[15] = (readingsIn->bv & 0xFF00) >> 8;    //
-
-    return 16;
-}
-uint16_t pack_WindOpDataReadings_t4(struct WindOpDataPacket_t3 * readingsIn, uint8_t * outBuffer) {
-    outBuffer[0] = readingsIn->ws & 0x00FF;            // LSB Wind speed, Average over 1 minute
-    outBuffer[1] = (readingsIn->ws & 0xFF00) >> 8;     // MSB
-    outBuffer[2] = readingsIn->wsx & 0x00FF;           // Wind speed max measured over 1 second
-    outBuffer[3] = (readingsIn->wsx & 0xFF00) >> 8;    // during the last averaging period
-    outBuffer[4] = readingsIn->wsm & 0x00FF;           // Wind speed min measured over 1 second
-    outBuffer[5] = (readingsIn->wsm & 0xFF00) >> 8;    // during the last averaging period
-    outBuffer[6] = readingsIn->wd & 0x00FF;            // Wind Direction
-    outBuffer[7] = (readingsIn->wd & 0xFF00) >> 8;     //
-
-    return 8;
-}
-
-uint16_t pack_WindOpDataReadings_t5(struct WindOpDataPacket_t3 * readingsIn, uint8_t * outBuffer) {
-    outBuffer[0] = readingsIn->tmp & 0x00FF;          // Temperature
-    outBuffer[1] = (readingsIn->tmp & 0xFF00) >> 8;   //
-    outBuffer[2] = readingsIn->press & 0x00FF;        // Pressure
-    outBuffer[3] = (readingsIn->press & 0xFF00) >> 8; //
-    outBuffer[4] = readingsIn->hum & 0x00FF;          // Humidity
-    outBuffer[5] = (readingsIn->hum & 0xFF00) >> 8;   //
-    outBuffer[6] = readingsIn->bv & 0x00FF;           // Battery voltage
-    outBuffer[7] = (readingsIn->bv & 0xFF00) >> 8;    //
-
-    return 8;
+    printf("Epoch time round trip over %u stamps, %u errors\n", stamps, error);
+    return (error > 0xFFFF) ? 0xFFFF : (uint16_t) error;
 }
 
 /* ****************************************************************************
  *
- * Reverse the PACK
+ * The bounded codecs against short, lying and oversized packets, then
+ * random bytes, none of which may read or write out of bounds.
  *
  * */
-uint16_t unpack_WindOpDataReadings_t3(struct WindOpDataPacket_t3 * readingsIn, uint8_t * outBuffer) {
-    readingsIn->ws = ((outBuffer[1] & 0xFF) << 8) + (outBuffer[0] & 0xFF);
-    readingsIn->wsx = ((outBuffer[3] & 0xFF) << 8) + (outBuffer[2] & 0xFF);
-    readingsIn->wsm = ((outBuffer[5] & 0xFF) << 8) + (outBuffer[4] & 0xFF);
-    readingsIn->wd = ((outBuffer[7] & 0xFF) << 8) + (outBuffer[6] & 0xFF);
-    readingsIn->tmp = ((outBuffer[9] & 0xFF) << 8) + (outBuffer[8] & 0xFF);
-    readingsIn->press = ((outBuffer[11] & 0xFF) << 8) + (outBuffer[10] & 0xFF);
-    readingsIn->hum = ((outBuffer[13] & 0xFF) << 8) + (outBuffer[12] & 0xFF);
-    readingsIn->bv = ((outBuffer[15] & 0xFF) << 8) + (outBuffer[14] & 0xFF);
-    return 16;
-}
-
-uint16_t unpack_WindOpDataReadings_t4(struct WindOpDataPacket_t3 * readingsIn, uint8_t * outBuffer) {
-    readingsIn->ws = ((outBuffer[1] & 0xFF) << 8) + (outBuffer[0] & 0xFF);
-    readingsIn->wsx = ((outBuffer[3] & 0xFF) << 8) + (outBuffer[2] & 0xFF);
-    readingsIn->wsm = ((outBuffer[5] & 0xFF) << 8) + (outBuffer[4] & 0xFF);
-    readingsIn->wd = ((outBuffer[7] & 0xFF) << 8) + (outBuffer[6] & 0xFF);
-    return 8;
-}
-
-uint16_t unpack_WindOpDataReadings_t5(struct WindOpDataPacket_t3 * readingsIn, uint8_t * outBuffer) {
-    readingsIn->tmp = ((outBuffer[1] & 0xFF) << 8) + (outBuffer[0] & 0xFF);
-    readingsIn->press = ((outBuffer[3] & 0xFF) << 8) + (outBuffer[2] & 0xFF);
-    readingsIn->hum = ((outBuffer[5] & 0xFF) << 8) + (outBuffer[4] & 0xFF);
-    readingsIn->bv = ((outBuffer[7] & 0xFF) << 8) + (outBuffer[6] & 0xFF);
-    return 8;
-}
-
 /* ****************************************************************************
  *
- * Full packet packing procedure.
+ * Write a small archive and read it back, then damage its index the way a
+ * crafted file would. The reader must refuse it. A delta packet of 255
+ * readings in 11 bytes checks the chunk row bound.
  *
  * */
-uint16_t pack_WindOpDataPacket(struct packCtrl * pack, uint8_t * outBuffer) {
+uint16_t runArchiveTest(void) {
+    WindOpArchiveWriter writer;
+    WindOpArchiveReader reader;
+    WindOpArchiveFooter footer;
+    WindOpArchiveChunk chunk;
+    WindOpColumns cols;
+    char path[] = "/tmp/wm_refCodecXXXXXX";
+    char deltaPath[] = "/tmp/wm_refCodecXXXXXX";
+    const uint8_t delta[] = {0x08, 0x0b, 0x8d, 0x75, 0x7b, 0x7e, 0xff, 0x01, 0x64, 0x00, 0x00};
+    uint8_t packet[BYTEBUFFERSIZE];
+    uint32_t length;
+    packCtrl in;
+    FILE * file;
+    uint16_t error = 0;
     uint8_t i;
-    uint8_t * bufferSize;
-
-    // Write the packet type
-    outBuffer[0] = pack->dataType;
-
-    bufferSize = &outBuffer[1]; // Create a pointer to the BufferSize location
-    *bufferSize = 2;            // Set the size as the packet so far
-
-    // Pack the TIME
-    *bufferSize += pack_WindOpMinuteTime(&pack->time, &outBuffer[*bufferSize], pack->incSeconds);
-
-    // Iterate over the readings adding them to the byte buffer
-    for (i = 0; i < pack->numOfReadings; i++) {
-        printf("Buffer %3d start location is %4d\n", i, *bufferSize);
-        switch (pack->dataType) {
-        case WINDOPDATAPACKET_T3_TYPE:
-            *bufferSize += pack_WindOpDataReadings_t3(&pack->readings[i], &outBuffer[*bufferSize]);
-            break;
-        case WINDOPDATAPACKET_T4_TYPE:
-            *bufferSize += pack_WindOpDataReadings_t4(&pack->readings[i], &outBuffer[*bufferSize]);
-            break;
-        case WINDOPDATAPACKET_T5_TYPE:
-            *bufferSize += pack_WindOpDataReadings_t5(&pack->readings[i], &outBuffer[*bufferSize]);
-            break;
-        case WINDOPDATAPACKET_T6_TYPE:
-            *bufferSize += pack_WindOpDataReadings_t6(&pack->readings[i], &outBuffer[*bufferSize]);
-            break;
-        default:
-            printf("ERROR data type %d is not supported\n", pack->dataType);
-        }
-    }
+    int fd;
 
-    return *bufferSize; // This contains the packet length
+    memset(&in, 0, sizeof(in));
+    setExampleTime(&in.time, 2017, 12, 1, 12, 3, 0);
+    for (i = 0; i < 3; i++) {
+        setdataPoint(&in.readings[i], 5000 + i, 5500, 4500);
+    }
+    in.dataType = WINDOPDATAPACKET_T4_TYPE;
+    in.numOfReadings = 3;
+    packBounded_WindOpDataPacket(&in, packet, sizeof(packet), &length);
+
+    fd = mkstemp(path);
+    close(fd);
+    error += testValue("archive open", open_WindOpArchiveWriter(&writer, path), WINDOP_OK);
+    error += testValue("archive append", append_WindOpArchive(&writer, "node-a", packet, length), WINDOP_OK);
+    error += testValue("archive close", close_WindOpArchiveWriter(&writer), WINDOP_OK);
+
+    error += testValue("archive read", open_WindOpArchiveReader(&reader, path), WINDOP_OK);
+    error += testValue("archive chunks", (uint16_t) reader.numChunks, 1);
+    init_WindOpColumns(&cols, chunkRows_WindOpArchive(&reader, 0));
+    error += testValue("archive decode", (uint16_t) decodeChunk_WindOpArchive(&reader, 0, &cols), 0);
+    error += testValue("archive rows", (uint16_t) cols.numRows, 3);
+    free_WindOpColumns(&cols);
+    close_WindOpArchiveReader(&reader);
+
+    // A TTN id past 32 bytes must find its own entry again, one too long to keep is refused
+    error += testValue("archive reopen", open_WindOpArchiveWriter(&writer, path), WINDOP_OK);
+    for (i = 0; i < 3; i++) {
+        error += testValue("archive long id", append_WindOpArchive(&writer, "eui-70b3d57ed0001234-windop-node-01",
+                                                                   packet, length), WINDOP_OK);
+    }
+    error += testValue("archive id too long", append_WindOpArchive(&writer, "node-a-with-an-id-of-64-bytes-or-more-"
+                       "that-cannot-be-stored-whole", packet, length), WINDOP_ERR_LENGTH);
+    error += testValue("archive long close", close_WindOpArchiveWriter(&writer), WINDOP_OK);
+    error += testValue("archive long read", open_WindOpArchiveReader(&reader, path), WINDOP_OK);
+    error += testValue("archive long devices", (uint16_t) reader.numDevices, 2);
+    error += testValue("archive long find", (uint16_t) findDevice_WindOpArchive(&reader,
+                       "eui-70b3d57ed0001234-windop-node-01"), 1);
+    close_WindOpArchiveReader(&reader);
+
+    fd = mkstemp(deltaPath);
+    close(fd);
+    error += testValue("archive T8 open", open_WindOpArchiveWriter(&writer, deltaPath), WINDOP_OK);
+    error += testValue("archive T8 append", append_WindOpArchive(&writer, "node-b", delta, sizeof(delta)), WINDOP_OK);
+    error += testValue("archive T8 close", close_WindOpArchiveWriter(&writer), WINDOP_OK);
+    error += testValue("archive T8 read", open_WindOpArchiveReader(&reader, deltaPath), WINDOP_OK);
+    error += testValue("archive T8 bound", (uint16_t) chunkRows_WindOpArchive(&reader, 0), 255);
+    init_WindOpColumns(&cols, chunkRows_WindOpArchive(&reader, 0));
+    error += testValue("archive T8 decode", (uint16_t) decodeChunk_WindOpArchive(&reader, 0, &cols), 0);
+    error += testValue("archive T8 rows", (uint16_t) cols.numRows, 255);
+    error += testValue("archive T8 last", (uint16_t) cols.channel[0][254], 100);
+    free_WindOpColumns(&cols);
+    close_WindOpArchiveReader(&reader);
+    unlink(deltaPath);
+
+    // A chunk offset near 2^64 wraps offset + bytes back inside the file
+    file = fopen(path, "r+b");
+    fseek(file, -(long) sizeof(footer), SEEK_END);
+    fread(&footer, sizeof(footer), 1, file);
+    fseek(file, (long) footer.indexOffset, SEEK_SET);
+    fread(&chunk, sizeof(chunk), 1, file);
+    chunk.offset = UINT64_MAX - chunk.bytes + 9;
+    fseek(file, (long) footer.indexOffset, SEEK_SET);
+    fwrite(&chunk, sizeof(chunk), 1, file);
+    fclose(file);
+    error += testValue("archive wrapped chunk", open_WindOpArchiveReader(&reader, path), WINDOP_ERR_FORMAT);
+
+    unlink(path);
+    return error;
 }
 
-/* ****************************************************************************
- *
- * The unpack
- *
- * */
-uint16_t unpack_WindOpDataPacket(struct packCtrl * pack, uint8_t * outBuffer) {
+uint16_t runBoundedTest(void) {
+    packCtrl in;
+    packCtrl out;
+    uint8_t packet[BYTEBUFFERSIZE];
+    uint32_t length;
+    uint32_t cut;
+    uint32_t trial;
+    uint32_t seed = 12345;
+    uint32_t accepted = 0;
+    uint16_t error = 0;
     uint8_t i;
-    uint8_t bufferSize;
-    uint8_t bufferAddress;
-
-    pack->dataType = outBuffer[0];
-    bufferSize = outBuffer[1];
-
-    bufferAddress = 2;
-    bufferAddress += unpack_WindOpMinuteTime(&pack->time, &outBuffer[bufferAddress]);
-
-    i = 0;
-    while (bufferAddress < bufferSize) {
-        printf("Buffer %3d location is %4d Size: %4d\n", i, bufferAddress, bufferSize);
-        switch (pack->dataType) {
-        case WINDOPDATAPACKET_T3_TYPE:
-            bufferAddress += unpack_WindOpDataReadings_t3(&pack->readings[i++], &outBuffer[bufferAddress]);
-            break;
-        case WINDOPDATAPACKET_T4_TYPE:
-            bufferAddress += unpack_WindOpDataReadings_t4(&pack->readings[i++], &outBuffer[bufferAddress]);
-            break;
-        case WINDOPDATAPACKET_T5_TYPE:
-            bufferAddress += unpack_WindOpDataReadings_t5(&pack->readings[i++], &outBuffer[bufferAddress]);
-            break;
-        default:
-            printf("ERROR data type %d is not supported\n", pack->dataType);
+
+    memset(&in, 0, sizeof(in));
+    setExampleTime(&in.time, 2017, 12, 1, 12, 3, 0);
+    for (i = 0; i < 3; i++) {
+        setdataPoint(&in.readings[i], 5000 + i, 5500, 4500);
+    }
+    in.dataType = WINDOPDATAPACKET_T4_TYPE;
+    in.numOfReadings = 3;
+    error += testValue("bounded pack", packBounded_WindOpDataPacket(&in, packet, sizeof(packet), &length), WINDOP_OK);
+    error += testValue("bounded length", length, 30);
+    error += testValue("bounded unpack", unpackBounded_WindOpDataPacket(&out, packet, length), WINDOP_OK);
+    error += testValue("bounded readings", out.numOfReadings, 3);
+    error += test_WindOpDataReadings(&in.readings[2], &out.readings[2], in.dataType);
+    for (cut = 0; cut < length; cut++) {
+        if (unpackBounded_WindOpDataPacket(&out, packet, cut) == WINDOP_OK) {
+            printf("Bounded unpack of %u of %u bytes .... ERROR\n", cut, length);
+            error++;
+        }
+    }
+    packet[0] = 0x7F;
+    error += testValue("bounded unknown type", unpackBounded_WindOpDataPacket(&out, packet, length), WINDOP_ERR_TYPE);
+    error += testValue("legacy unknown type", unpack_WindOpDataPacket(&out, packet), 0);
+    packet[0] = WINDOPDATAPACKET_T4_TYPE;
+    packet[1] = 31;
+    error += testValue("bounded long length", unpackBounded_WindOpDataPacket(&out, packet, length), WINDOP_ERR_LENGTH);
+
+    // 31 T4 readings fit the length byte but not readings[30]
+    packet[1] = WINDOP_PACKET_HEADER_SIZE + WINDOP_TIME_SIZE + 31 * 8;
+    error += testValue("bounded 31 readings", unpackBounded_WindOpDataPacket(&out, packet, packet[1]), WINDOP_ERR_CAPACITY);
+
+    error += testValue("bounded capacity", packBounded_WindOpDataPacket(&in, packet, 29, &length), WINDOP_ERR_CAPACITY);
+    error += testValue("bounded capacity length", length, 0);
+    in.dataType = WINDOPDATAPACKET_T3_TYPE;
+    in.numOfReadings = READINGS_BUFFER_SIZE;
+    error += testValue("bounded over 255", packBounded_WindOpDataPacket(&in, packet, sizeof(packet), &length), WINDOP_ERR_LENGTH);
+    in.numOfReadings = READINGS_BUFFER_SIZE + 1;
+    error += testValue("bounded readings[30]", packBounded_WindOpDataPacket(&in, packet, sizeof(packet), &length), WINDOP_ERR_CAPACITY);
+    in.numOfReadings = 1;
+    in.time.Month = 13;
+    error += testValue("bounded bad month", packBounded_WindOpDataPacket(&in, packet, sizeof(packet), &length), WINDOP_ERR_TIME);
+    in.time.Month = 12;
+    in.dataType = 0;
+    error += testValue("bounded type 0", packBounded_WindOpDataPacket(&in, packet, sizeof(packet), &length), WINDOP_ERR_TYPE);
+
+    // Random bytes with a known type, time and plausible length
+    for (trial = 0; trial < 200000; trial++) {
+        for (cut = 0; cut < WINDOP_MAX_PACKET_LENGTH; cut++) {
+            seed = seed * 1103515245 + 12345;
+            packet[cut] = (uint8_t) (seed >> 16);
+        }
+        packet[0] = 3 + (packet[0] % 6);
+        packet[3] = (packet[3] & 0xF0) | 1;
+        length = packet[1] + (trial & 3);
+        if (unpackBounded_WindOpDataPacket(&out, packet, length) == WINDOP_OK) {
+            accepted++;
+            if (out.numOfReadings > READINGS_BUFFER_SIZE) {
+                error++;
+            }
         }
     }
 
-    return i; // return the number of received packets
+    printf("Bounded codec, %u of 200000 random packets accepted, %u errors\n", accepted, error);
+    return error;
 }
 
-/* ****************************************************************************
- * ****************************************************************************
- * ***              PACKING FUNCTIONS OF INTEREST END                   *******
- * ****************************************************************************
- * ****************************************************************************
- * */
-
-typedef struct testCtrl {
-
-    packCtrl dataIn;
-    packCtrl dataOut;
-
-} testCtrl;
-
 /* ****************************************************************************
  *
  * Pack and unpack the data checking the result
@@ -521,6 +567,733 @@ uint16_t runTest(struct testCtrl * tstCtrl) {
         error += test_WindOpDataReadings(&tstCtrl->dataIn.readings[i], &tstCtrl->dataOut.readings[i], tstCtrl->dataIn.dataType);
     }
 
+    dump_StrWithBreaker("Columnar store round trip");
+    error += runStoreTest(byteBuffer, bufferLength, tstCtrl->dataIn.incSeconds, tstCtrl->dataIn.numOfReadings);
+
+    dump_StrWithBreaker("Zero copy view");
+    error += runViewTest(byteBuffer, bufferLength, tstCtrl->dataIn.numOfReadings);
+
+    return error;
+}
+
+/* ****************************************************************************
+ *
+ * Rollups, one 10 minute bucket checked by hand, then late and out of
+ * order readings, a T6 packet and a snapshot round trip
+ *
+ * */
+uint16_t runRollupTest(void) {
+    WindOpRollup rollup;
+    WindOpRollup restored;
+    WindOpRollupStats stats[4];
+    WindOpRollupStats again[4];
+    WindOpDataPacket_t3 r;
+    packCtrl pack;
+    uint8_t packet[BYTEBUFFERSIZE];
+    uint32_t length;
+    uint32_t count;
+    FILE * file;
+    const int64_t noon = 1512129600; // 2017-12-01 12:00
+    uint16_t error = 0;
+    uint8_t i;
+    char name[16];
+
+    init_WindOpRollup(&rollup);
+    memset(&r, 0, sizeof(r));
+    for (i = 0; i < 10; i++) {
+        r.ws = (uint16_t) (100 * (i + 1));
+        r.wsx = (uint16_t) (r.ws + 50);
+        r.wd = (i & 1) ? 10 : 350;
+        r.bv = (uint16_t) (4000 + i);
+        add_WindOpRollup(&rollup, "node-a", noon + 60 * i, &r, WINDOP_WIND_CHANNELS | WINDOP_ENV_CHANNELS);
+    }
+    count = read_WindOpRollup(&rollup, "node-a", WINDOP_ROLLUP_10MIN, noon, noon + 600, stats, 4);
+    error += testValue("rollup buckets", count, 1);
+    error += testValue("rollup wind n", stats[0].windCount, 10);
+    error += testValue("rollup ws mean", (uint16_t) (stats[0].wsMean * 100 + 0.5), 550);
+    error += testValue("rollup ws min", (uint16_t) (stats[0].wsMin * 100 + 0.5), 100);
+    error += testValue("rollup ws max", (uint16_t) (stats[0].wsMax * 100 + 0.5), 1000);
+    error += testValue("rollup gust", (uint16_t) (stats[0].gust * 100 + 0.5), 1050);
+    error += testValue("rollup wd north", (uint16_t) ((uint32_t) (stats[0].wd + 0.5) % 360), 0);
+    error += testValue("rollup steadiness", (uint16_t) (stats[0].wdSteadiness * 1000 + 0.5), 985);
+    error += testValue("rollup bv mean", (uint16_t) (stats[0].bvMean * 10000 + 0.5), 40045);
+    error += testValue("rollup bv slope", (uint16_t) (stats[0].bvSlope * 10000 + 0.5), 600);
+
+    // Out of order lands in its own bucket, 3 days back is past the 10 minute ring
+    add_WindOpRollup(&rollup, "node-a", noon - 300, &r, WINDOP_WIND_CHANNELS);
+    add_WindOpRollup(&rollup, "node-a", noon - 3 * 86400, &r, WINDOP_WIND_CHANNELS);
+    count = read_WindOpRollup(&rollup, "node-a", WINDOP_ROLLUP_10MIN, noon - 4 * 86400, noon + 86400, stats, 4);
+    error += testValue("rollup out of order", count, 2);
+    error += testValue("rollup late", (uint16_t) rollup.late, 1);
+    count = read_WindOpRollup(&rollup, "node-a", WINDOP_ROLLUP_HOUR, noon - 4 * 86400, noon + 86400, stats, 4);
+    error += testValue("rollup hours", count, 3);
+    error += testValue("rollup day n", stats[1].windCount, 1);
+
+    // T6 battery is 10 mV a count
+    memset(&pack, 0, sizeof(pack));
+    setExampleTime(&pack.time, 2017, 12, 1, 12, 0, 0);
+    pack.dataType = WINDOPDATAPACKET_T6_TYPE;
+    pack.numOfReadings = 2;
+    pack.readings[0].bv = 400;
+    pack.readings[1].bv = 402;
+    packBounded_WindOpDataPacket(&pack, packet, sizeof(packet), &length);
+    error += testValue("rollup T6 packet", addPacket_WindOpRollup(&rollup, "node-b", packet, length), WINDOP_OK);
+    count = read_WindOpRollup(&rollup, "node-b", WINDOP_ROLLUP_DAY, 0, INT64_MAX, stats, 4);
+    error += testValue("rollup T6 bv", (uint16_t) (stats[0].bvMean * 1000 + 0.5), 4010);
+    error += testValue("rollup T6 wind n", stats[0].windCount, 0);
+
+    // A long TTN id keeps one device across a hash grow and a restore
+    add_WindOpRollup(&rollup, "eui-70b3d57ed0001234-windop-node-01", noon, &r, WINDOP_WIND_CHANNELS);
+    for (i = 0; i < 40; i++) {
+        snprintf(name, sizeof(name), "node-%u", i);
+        add_WindOpRollup(&rollup, name, noon, &r, WINDOP_WIND_CHANNELS);
+    }
+    add_WindOpRollup(&rollup, "eui-70b3d57ed0001234-windop-node-01", noon + 60, &r, WINDOP_WIND_CHANNELS);
+    error += testValue("rollup long id", (uint16_t) rollup.numDevices, 43);
+    error += testValue("rollup id too long", add_WindOpRollup(&rollup, "node-a-with-an-id-of-64-bytes-or-more-"
+                       "that-cannot-be-stored-whole", noon, &r, WINDOP_WIND_CHANNELS), WINDOP_ERR_LENGTH);
+
+    file = tmpfile();
+    init_WindOpRollup(&restored);
+    error += testValue("rollup save", save_WindOpRollup(&rollup, file), WINDOP_OK);
+    rewind(file);
+    error += testValue("rollup restore", restore_WindOpRollup(&restored, file), WINDOP_OK);
+    fclose(file);
+    count = read_WindOpRollup(&rollup, "node-a", WINDOP_ROLLUP_10MIN, 0, INT64_MAX, stats, 4);
+    error += testValue("rollup restored", read_WindOpRollup(&restored, "node-a", WINDOP_ROLLUP_10MIN, 0, INT64_MAX,
+                                                           again, 4), count);
+    error += testValue("rollup same stats", memcmp(stats, again, count * sizeof(stats[0])) == 0, 1);
+    error += testValue("rollup same late", (uint16_t) restored.late, (uint16_t) rollup.late);
+    count = read_WindOpRollup(&restored, "eui-70b3d57ed0001234-windop-node-01", WINDOP_ROLLUP_10MIN, 0, INT64_MAX,
+                              stats, 4);
+    error += testValue("rollup restored long id", (count == 1) ? (uint16_t) stats[0].windCount : 0, 2);
+
+    free_WindOpRollup(&restored);
+    free_WindOpRollup(&rollup);
+    return error;
+}
+
+uint16_t runTimeIndexTest(void) {
+    WindOpColumns cols;
+    WindOpTimeIndexWriter writer;
+    WindOpTimeIndexReader reader;
+    WindOpQuery query;
+    WindOpQueryResult result;
+    char path[] = "/tmp/wm_refCodecXXXXXX";
+    char part[] = "/tmp/wm_refCodecXXXXXX";
+    char merged[] = "/tmp/wm_refCodecXXXXXX";
+    const char * parts[2];
+    const int64_t noon = 1512129600; // 2017-12-01 12:00
+    uint16_t error = 0;
+    uint32_t row;
+    int fd;
+
+    // Three blocks of minutes, ws 0-0.99, 5-5.99 then 10-10.99, last minute twice
+    init_WindOpColumns(&cols, 3001);
+    for (row = 0; row < 3000; row++) {
+        cols.time[row] = noon + 60 * (int64_t) row;
+        cols.dataType[row] = WINDOPDATAPACKET_T4_TYPE;
+        cols.valid[row] = WINDOP_WIND_CHANNELS;
+        cols.channel[WINDOP_CH_WS][row] = (int32_t) (500 * (row / 1440) + row % 100);
+        cols.channel[WINDOP_CH_WSX][row] = 0;
+        cols.channel[WINDOP_CH_WSM][row] = 0;
+        cols.channel[WINDOP_CH_WD][row] = 90;
+    }
+    cols.time[row] = cols.time[row - 1] + 30;
+    cols.dataType[row] = WINDOPDATAPACKET_T5_TYPE;
+    cols.valid[row] = WINDOP_ENV_CHANNELS;
+    cols.channel[WINDOP_CH_TMP][row] = -25;
+    cols.channel[WINDOP_CH_PRESS][row] = 101325;
+    cols.channel[WINDOP_CH_HUM][row] = 5000;
+    cols.channel[WINDOP_CH_BV][row] = 4100;
+    cols.numRows = row + 1;
+
+    fd = mkstemp(path);
+    close(fd);
+    error += testValue("index open", open_WindOpTimeIndexWriter(&writer, path), WINDOP_OK);
+    error += testValue("index add", addDevice_WindOpTimeIndex(&writer, "node-a", &cols), WINDOP_OK);
+    error += testValue("index add twice", addDevice_WindOpTimeIndex(&writer, "node-a", &cols), WINDOP_ERR_FORMAT);
+    error += testValue("index long id", addDevice_WindOpTimeIndex(&writer, "node-a-with-an-id-of-64-bytes-or-more-"
+                       "that-cannot-be-stored-whole", &cols), WINDOP_ERR_LENGTH);
+    error += testValue("index close", close_WindOpTimeIndexWriter(&writer), WINDOP_OK);
+    error += testValue("index read", open_WindOpTimeIndexReader(&reader, path), WINDOP_OK);
+    error += testValue("index blocks", (uint16_t) reader.numBlocks, 3);
+    error += testValue("index minutes", (uint16_t) reader.devices[0].rows, 3000);
+
+    memset(&query, 0, sizeof(query));
+    query.device = "node-a";
+    query.from = INT64_MIN;
+    query.to = INT64_MAX;
+    query.channels = (1 << WINDOP_CH_WS) | (1 << WINDOP_CH_TMP);
+    query.numPredicates = 1;
+    parse_WindOpPredicate("ws>10.5", &query.predicates[0]);
+    init_WindOpQueryResult(&result);
+    error += testValue("index scan", query_WindOpTimeIndex(&reader, &query, &result), WINDOP_OK);
+    error += testValue("index skipped", (uint16_t) result.blocksSkipped, 2);
+    error += testValue("index rows read", (uint16_t) result.rowsScanned, 120);
+    error += testValue("index matched", (uint16_t) result.numRows, 69);
+
+    // The doubled minute carries both groups, the range ends are whole minutes
+    query.from = noon + 60 * 2999 - 59;
+    query.to = noon + 60 * 2999;
+    query.numPredicates = 0;
+    query_WindOpTimeIndex(&reader, &query, &result);
+    error += testValue("index range", (uint16_t) result.numRows, 1);
+    error += testValue("index merged", result.valid[0], (1 << WINDOP_CH_WS) | (1 << WINDOP_CH_TMP));
+    error += testValue("index tmp", (uint16_t) (result.value[WINDOP_CH_TMP][0] * -10 + 0.5), 25);
+
+    // Reusing the result for a channel it has no array for yet
+    query.channels = 1 << WINDOP_CH_WD;
+    error += testValue("index reuse", query_WindOpTimeIndex(&reader, &query, &result), WINDOP_OK);
+    error += testValue("index reuse array", result.value[WINDOP_CH_WD] != NULL, 1);
+    error += testValue("index bad predicate", parse_WindOpPredicate("wsx=3", &query.predicates[0]),
+                       WINDOP_ERR_FORMAT);
+    close_WindOpTimeIndexReader(&reader);
+
+    // Joined with a part of its own, as shards build them, node-a's blocks move
+    fd = mkstemp(part);
+    close(fd);
+    fd = mkstemp(merged);
+    close(fd);
+    cols.numRows = 100;
+    open_WindOpTimeIndexWriter(&writer, part);
+    addDevice_WindOpTimeIndex(&writer, "node-b", &cols);
+    close_WindOpTimeIndexWriter(&writer);
+    parts[0] = part;
+    parts[1] = path;
+    error += testValue("index merge", merge_WindOpTimeIndex(merged, parts, 2), WINDOP_OK);
+    parts[0] = path;
+    error += testValue("index merge repeat", merge_WindOpTimeIndex(part, parts, 2), WINDOP_ERR_FORMAT);
+    error += testValue("index merged read", open_WindOpTimeIndexReader(&reader, merged), WINDOP_OK);
+    error += testValue("index merged devices", (uint16_t) reader.numDevices, 2);
+    error += testValue("index merged blocks", (uint16_t) reader.numBlocks, 4);
+    query.from = INT64_MIN;
+    query.to = INT64_MAX;
+    query.numPredicates = 1;
+    parse_WindOpPredicate("ws>10.5", &query.predicates[0]);
+    query_WindOpTimeIndex(&reader, &query, &result);
+    error += testValue("index merged scan", (uint16_t) result.numRows, 69);
+    query.device = "node-b";
+    parse_WindOpPredicate("ws>0.5", &query.predicates[0]);
+    query_WindOpTimeIndex(&reader, &query, &result);
+    error += testValue("index merged part", (uint16_t) result.numRows, 49);
+
+    free_WindOpQueryResult(&result);
+    close_WindOpTimeIndexReader(&reader);
+    free_WindOpColumns(&cols);
+    unlink(path);
+    unlink(part);
+    unlink(merged);
+    return error;
+}
+
+uint16_t runDedupTest(void) {
+    WindOpDedup dedup;
+    WindOpCoverage cover;
+    WindOpGap gaps[4];
+    packCtrl pack;
+    uint8_t packet[BYTEBUFFERSIZE];
+    uint32_t length;
+    uint32_t i;
+    uint32_t again = 0;
+    const int64_t noon = 1512129600; // 2017-12-01 12:00
+    uint16_t error = 0;
+    char name[16];
+
+    memset(&pack, 0, sizeof(pack));
+    setExampleTime(&pack.time, 2017, 12, 1, 12, 0, 0);
+    pack.dataType = WINDOPDATAPACKET_T5_TYPE;
+    pack.numOfReadings = 5;
+    packBounded_WindOpDataPacket(&pack, packet, sizeof(packet), &length);
+
+    error += testValue("dedup init", init_WindOpDedup(&dedup, 64), WINDOP_OK);
+    error += testValue("dedup first", check_WindOpDedup(&dedup, key_WindOpDedup("node-a", packet, length)), 0);
+    error += testValue("dedup repeat", check_WindOpDedup(&dedup, key_WindOpDedup("node-a", packet, length)), 1);
+    error += testValue("dedup device", check_WindOpDedup(&dedup, key_WindOpDedup("node-b", packet, length)), 0);
+    packet[length - 1] ^= 1;
+    error += testValue("dedup payload", check_WindOpDedup(&dedup, key_WindOpDedup("node-a", packet, length)), 0);
+
+    // Keys go after two turnovers, never before one
+    for (i = 0; i < 200; i++) {
+        check_WindOpDedup(&dedup, 1000 + i);
+    }
+    for (i = 136; i < 200; i++) {
+        again += check_WindOpDedup(&dedup, 1000 + i);
+    }
+    error += testValue("dedup held", (uint16_t) again, 64);
+    error += testValue("dedup turned", check_WindOpDedup(&dedup, key_WindOpDedup("node-b", packet, length)), 0);
+    error += testValue("dedup count", (uint16_t) dedup.duplicates, 65);
+    free_WindOpDedup(&dedup);
+
+    // 5 minutes from the packet, 2 missing, 3 more, then one too old for the ring
+    init_WindOpCoverage(&cover);
+    packet[length - 1] ^= 1;
+    error += testValue("cover packet", addPacket_WindOpCoverage(&cover, "node-a", packet, length), WINDOP_OK);
+    for (i = 7; i < 10; i++) {
+        add_WindOpCoverage(&cover, "node-a", noon + 60 * i + 59);
+    }
+    add_WindOpCoverage(&cover, "node-a", noon - 60 * WINDOP_COVERAGE_MINUTES);
+    error += testValue("cover minutes", (uint16_t) windowMinutes_WindOpCoverage(&cover.devices[0]), 10);
+    error += testValue("cover covered", (uint16_t) count_WindOpCoverage(&cover.devices[0]), 8);
+    error += testValue("cover late", (uint16_t) cover.devices[0].late, 1);
+    error += testValue("cover gaps", (uint16_t) gaps_WindOpCoverage(&cover.devices[0], gaps, 4), 1);
+    error += testValue("cover gap start", (uint16_t) ((gaps[0].from - noon) / 60), 5);
+    error += testValue("cover gap length", (uint16_t) gaps[0].minutes, 2);
+    error += testValue("cover minute", covered_WindOpCoverage(&cover.devices[0], noon + 60 * 4 + 30), 1);
+
+    // A long TTN id keeps one device across a hash grow, one too long to keep is refused
+    add_WindOpCoverage(&cover, "eui-70b3d57ed0001234-windop-node-01", noon);
+    for (i = 0; i < 40; i++) {
+        snprintf(name, sizeof(name), "node-%u", i);
+        add_WindOpCoverage(&cover, name, noon);
+    }
+    add_WindOpCoverage(&cover, "eui-70b3d57ed0001234-windop-node-01", noon + 60);
+    error += testValue("cover long id", (uint16_t) cover.numDevices, 42);
+    error += testValue("cover id too long", add_WindOpCoverage(&cover, "node-a-with-an-id-of-64-bytes-or-more-"
+                       "that-cannot-be-stored-whole", noon), WINDOP_ERR_LENGTH);
+    free_WindOpCoverage(&cover);
+
+    return error;
+}
+
+uint16_t runArrowTest(void) {
+    WindOpColumns cols;
+    WindOpArrowWriter writer;
+    char path[] = "/tmp/wm_refCodecXXXXXX";
+    uint8_t tail[10];
+    uint8_t head[8];
+    int32_t footer;
+    long size;
+    FILE * in;
+    uint16_t error = 0;
+    int fd;
+
+    // A wind row and an environment row, the second device's rows reuse the dictionary entry
+    init_WindOpColumns(&cols, 2);
+    cols.time[0] = 1512129600;
+    cols.dataType[0] = WINDOPDATAPACKET_T4_TYPE;
+    cols.valid[0] = WINDOP_WIND_CHANNELS;
+    cols.channel[WINDOP_CH_WS][0] = 512;
+    cols.time[1] = 1512129660;
+    cols.dataType[1] = WINDOPDATAPACKET_T5_TYPE;
+    cols.valid[1] = WINDOP_ENV_CHANNELS;
+    cols.channel[WINDOP_CH_TMP][1] = -25;
+    cols.numRows = 2;
+
+    fd = mkstemp(path);
+    close(fd);
+    error += testValue("arrow open", open_WindOpArrowWriter(&writer, path), WINDOP_OK);
+    error += testValue("arrow append", append_WindOpArrow(&writer, "node-a", &cols), WINDOP_OK);
+    append_WindOpArrow(&writer, "node-b", &cols);
+    append_WindOpArrow(&writer, "node-a", &cols);
+    error += testValue("arrow devices", (uint16_t) writer.numDevices, 2);
+    error += testValue("arrow rows", (uint16_t) writer.batchRows, 6);
+    error += testValue("arrow ws", (uint16_t) (writer.value[WINDOP_CH_WS][0] * 100 + 0.5), 512);
+    error += testValue("arrow null", (uint16_t) (writer.valid[1] & WINDOP_WIND_CHANNELS), 0);
+    error += testValue("arrow close", close_WindOpArrowWriter(&writer), WINDOP_OK);
+
+    // Magic at both ends, the footer length just before the last one
+    in = fopen(path, "rb");
+    fread(head, 1, sizeof(head), in);
+    fseek(in, -(long) sizeof(tail), SEEK_END);
+    size = ftell(in) + (long) sizeof(tail);
+    fread(tail, 1, sizeof(tail), in);
+    fclose(in);
+    memcpy(&footer, tail, 4);
+    error += testValue("arrow magic", memcmp(head, "ARROW1\0\0", 8) == 0, 1);
+    error += testValue("arrow end", memcmp(&tail[4], "ARROW1", 6) == 0, 1);
+    error += testValue("arrow footer", (footer > 0) && (footer < size), 1);
+    error += testValue("arrow padded", (uint16_t) ((size - footer - 10) % 8), 0);
+    error += testValue("arrow bad path", open_WindOpArrowWriter(&writer, "/nonexistent/x.arrow"), WINDOP_ERR_FORMAT);
+
+    free_WindOpColumns(&cols);
+    unlink(path);
+    return error;
+}
+
+static uint8_t metricsPacket[BYTEBUFFERSIZE];
+static uint32_t metricsLength;
+
+static void * metricsThread(void * arg) {
+    const uint32_t packets = *(const uint32_t *) arg;
+    packCtrl out;
+    uint32_t i;
+
+    for (i = 0; i < packets; i++) {
+        unpackBounded_WindOpDataPacket(&out, metricsPacket, metricsLength);
+    }
+    return NULL;
+}
+
+uint16_t runMetricsTest(void) {
+    WindOpMetrics before;
+    WindOpMetrics after;
+    packCtrl pack;
+    packCtrl out;
+    pthread_t thread;
+    char * text = NULL;
+    size_t size = 0;
+    FILE * body;
+    const uint16_t on = WINDOP_METRICS ? 1 : 0;
+    uint32_t threadPackets = WINDOP_METRICS_BATCH + 5;
+    uint16_t error = 0;
+
+    memset(&pack, 0, sizeof(pack));
+    setExampleTime(&pack.time, 2017, 12, 1, 12, 0, 0);
+    pack.dataType = WINDOPDATAPACKET_T5_TYPE;
+    pack.numOfReadings = 5;
+    packBounded_WindOpDataPacket(&pack, metricsPacket, sizeof(metricsPacket), &metricsLength);
+
+    // One packet here, more than a batch on a thread of its own, then an unknown type
+    snapshot_WindOpMetrics(&before);
+    unpackBounded_WindOpDataPacket(&out, metricsPacket, metricsLength);
+    pthread_create(&thread, NULL, metricsThread, &threadPackets);
+    pthread_join(thread, NULL);
+    metricsPacket[0] = 0x7F;
+    unpackBounded_WindOpDataPacket(&out, metricsPacket, metricsLength);
+    metricsPacket[0] = WINDOPDATAPACKET_T5_TYPE;
+    snapshot_WindOpMetrics(&after);
+
+    error += testValue("metrics packets",
+                       (uint16_t) (after.packets[WINDOPDATAPACKET_T5_TYPE] - before.packets[WINDOPDATAPACKET_T5_TYPE]),
+                       (uint16_t) ((1 + threadPackets) * on));
+    error += testValue("metrics readings",
+                       (uint16_t) (after.readings[WINDOPDATAPACKET_T5_TYPE] - before.readings[WINDOPDATAPACKET_T5_TYPE]),
+                       (uint16_t) (5 * (1 + threadPackets) * on));
+    error += testValue("metrics bytes", (uint16_t) (after.bytes - before.bytes),
+                       (uint16_t) ((1 + threadPackets) * metricsLength * on));
+    error += testValue("metrics failures",
+                       (uint16_t) (after.failures[WINDOP_ERR_TYPE] - before.failures[WINDOP_ERR_TYPE]), on);
+
+    body = open_memstream(&text, &size);
+    write_WindOpMetrics(body, &after);
+    fclose(body);
+    error += testValue("metrics text", strstr(text, "windop_decode_failures_total{reason=\"type\"}") != NULL, 1);
+    error += testValue("metrics histogram", strstr(text, "windop_stage_seconds_count{stage=\"unpack\"}") != NULL, 1);
+    free(text);
+
+    return error;
+}
+
+static uint16_t nearDegrees(const char * text, double expected) {
+    double degrees = 0;
+    return (parse_WindOpNmeaCoordinate((const uint8_t *) text, (uint32_t) strlen(text), &degrees) == WINDOP_OK) &&
+           (fabs(degrees - expected) < 1e-7);
+}
+
+static uint8_t parseStatus(const char * text) {
+    double degrees;
+    return parse_WindOpNmeaCoordinate((const uint8_t *) text, (uint32_t) strlen(text), &degrees);
+}
+
+uint16_t runGpsTest(void) {
+    const int64_t epoch = 1512129600; // 2017-12-01 12:00
+    uint8_t packet[BYTEBUFFERSIZE];
+    WindOpGpsTrack track;
+    WindOpGeofence fence;
+    packCtrl pack;
+    uint8_t inside[3];
+    double metres[3];
+    uint32_t length;
+    uint16_t error = 0;
+
+    error += testValue("nmea lat", nearDegrees("5551.55773N  ", 55.8592955), 1);
+    error += testValue("nmea lon", nearDegrees("00309.71212W ", -3.1618687), 1);
+    error += testValue("nmea south", nearDegrees("  3354.0000s", -33.9), 1);
+    error += testValue("nmea no hemisphere", parseStatus("5551.5577    "), WINDOP_ERR_FORMAT);
+    error += testValue("nmea no minutes", parseStatus("55.5N"), WINDOP_ERR_FORMAT);
+    error += testValue("nmea minutes", parseStatus("5561.0000N"), WINDOP_ERR_FORMAT);
+    error += testValue("nmea latitude", parseStatus("9100.0000N"), WINDOP_ERR_FORMAT);
+    error += testValue("nmea gap", parseStatus("55 51.5577N"), WINDOP_ERR_FORMAT);
+    error += testValue("nmea trailing", parseStatus("5551.5577N 1"), WINDOP_ERR_FORMAT);
+
+    // Home, a mile or so north then a fix with no lock, the fence keeps home
+    init_WindOpGpsTrack(&track, 1);
+    init_WindOpGeofence(&fence, WINDOP_GPS_HOME_LAT, WINDOP_GPS_HOME_LON, 1000);
+    pack_WindOpGpsPacket(epoch, WINDOP_GPS_HOME_LAT, WINDOP_GPS_HOME_LON, 3700, packet, sizeof(packet), &length);
+    error += testValue("gps length", (uint16_t) length, 34);
+    error += testValue("gps decode", decode_WindOpGpsPacket(packet, length, 0, &fence, &track), WINDOP_OK);
+    pack_WindOpGpsPacket(epoch + 60, WINDOP_GPS_HOME_LAT + 0.015, WINDOP_GPS_HOME_LON, 3690, packet, sizeof(packet),
+                         &length);
+    error += testValue("gps fenced", decode_WindOpGpsPacket(packet, length, 1, &fence, &track), WINDOP_OK);
+    memset(&packet[WINDOP_PACKET_HEADER_SIZE + WINDOP_TIME_SIZE], ' ', WINDOP_GPS_TEXT_SIZE);
+    error += testValue("gps no fix", decode_WindOpGpsPacket(packet, length, 2, NULL, &track), WINDOP_OK);
+    error += testValue("gps fixes", (uint16_t) track.numFixes, 1);
+    error += testValue("gps outside", (uint16_t) track.outside, 1);
+    error += testValue("gps no fixes", (uint16_t) track.noFix, 1);
+    error += testValue("gps time", track.time[0] == epoch, 1);
+    error += testValue("gps bv", track.bv[0], 3700);
+    memset(&pack, 0, sizeof(pack));
+    setExampleTime(&pack.time, 2017, 12, 1, 12, 0, 0);
+    pack.dataType = WINDOPDATAPACKET_T5_TYPE;
+    pack.numOfReadings = 1;
+    packBounded_WindOpDataPacket(&pack, packet, sizeof(packet), &length);
+    error += testValue("gps type", decode_WindOpGpsPacket(packet, length, 3, NULL, &track), WINDOP_ERR_TYPE);
+
+    // Nothing, a degree of latitude, then nearly the far side
+    {
+        const double lat[3] = { WINDOP_GPS_HOME_LAT, WINDOP_GPS_HOME_LAT + 1, -WINDOP_GPS_HOME_LAT };
+        const double lon[3] = { WINDOP_GPS_HOME_LON, WINDOP_GPS_HOME_LON, WINDOP_GPS_HOME_LON + 180 };
+
+        distance_WindOpGps(lat, lon, 3, WINDOP_GPS_HOME_LAT, WINDOP_GPS_HOME_LON, metres);
+        error += testValue("gps zero", metres[0] < 1e-6, 1);
+        error += testValue("gps degree", (uint16_t) lround(metres[1] / 10), 11121);
+        error += testValue("gps antipode", (uint16_t) lround(metres[2] / 1000), 20017);
+        error += testValue("gps within", (uint16_t) within_WindOpGeofence(&fence, lat, lon, 3, inside), 1);
+        error += testValue("gps inside", inside[0], 1);
+    }
+    free_WindOpGpsTrack(&track);
+
+    return error;
+}
+
+uint16_t runSerialLogTest(void) {
+    static const char reply[] = "radio_rx  050E00081C7E63002828331F2F0E\r\n";
+    WindOpSerialLogWriter writer;
+    WindOpSerialLogReader reader;
+    WindOpSerialRecord rec;
+    const uint8_t * data;
+    char path[] = "/tmp/wm_refCodecXXXXXX";
+    uint8_t packet[BYTEBUFFERSIZE];
+    FILE * out;
+    uint16_t error = 0;
+    int fd;
+
+    fd = mkstemp(path);
+    close(fd);
+    error += testValue("serlog open", open_WindOpSerialLogWriter(&writer, path, 1512129600000000000, 57600), WINDOP_OK);
+    append_WindOpSerialLog(&writer, WINDOP_SERLOG_TX, 1000, "radio rx 0\r\n", 12);
+    append_WindOpSerialLog(&writer, WINDOP_SERLOG_RX, 2000, reply, sizeof(reply) - 1);
+    error += testValue("serlog close", close_WindOpSerialLogWriter(&writer), WINDOP_OK);
+
+    error += testValue("serlog read", open_WindOpSerialLogReader(&reader, path), WINDOP_OK);
+    error += testValue("serlog baud", (uint16_t) (reader.header->baud / 100), 576);
+    error += testValue("serlog tx", next_WindOpSerialLog(&reader, &rec, &data), WINDOP_OK);
+    error += testValue("serlog tx dir", rec.direction, WINDOP_SERLOG_TX);
+    error += testValue("serlog rx", next_WindOpSerialLog(&reader, &rec, &data), WINDOP_OK);
+    error += testValue("serlog rx time", (uint16_t) rec.time, 2000);
+    error += testValue("serlog rx data", (rec.length == sizeof(reply) - 1) && (memcmp(data, reply, rec.length) == 0), 1);
+    error += testValue("serlog end", next_WindOpSerialLog(&reader, &rec, &data), WINDOP_ERR_SHORT);
+    close_WindOpSerialLogReader(&reader);
+
+    // A record cut short by a capture that died reads as the end
+    out = fopen(path, "ab");
+    fwrite(&rec, 1, sizeof(rec), out);
+    fclose(out);
+    open_WindOpSerialLogReader(&reader, path);
+    next_WindOpSerialLog(&reader, &rec, &data);
+    next_WindOpSerialLog(&reader, &rec, &data);
+    error += testValue("serlog cut", next_WindOpSerialLog(&reader, &rec, &data), WINDOP_ERR_SHORT);
+    close_WindOpSerialLogReader(&reader);
+    unlink(path);
+
+    error += testValue("rn radio_rx", (uint16_t) parseRx_WindOpRn2483(reply, sizeof(reply) - 3, packet, sizeof(packet)), 14);
+    error += testValue("rn type", packet[0], WINDOPDATAPACKET_T5_TYPE);
+    error += testValue("rn mac_rx", (uint16_t) parseRx_WindOpRn2483("mac_rx 1 0102", 13, packet, sizeof(packet)), 2);
+    error += testValue("rn other", parseRx_WindOpRn2483("ok", 2, packet, sizeof(packet)) < 0, 1);
+    error += testValue("rn bad hex", parseRx_WindOpRn2483("radio_rx  0G", 12, packet, sizeof(packet)) < 0, 1);
+
+    return error;
+}
+
+/* ****************************************************************************
+ *
+ * TTN JSON reader, escapes and nesting in one element, then input cut short,
+ * broken and too long for the fields we keep
+ *
+ * */
+typedef struct jsonSeen {
+    uint32_t uplinks;
+    WindOpUplink last;
+} jsonSeen;
+
+static void onJsonUplink(void * context, const WindOpUplink * uplink) {
+    jsonSeen * seen = context;
+
+    seen->uplinks++;
+    seen->last = *uplink;
+}
+
+// Parse text from memory, or through a file when padding puts it across a buffer boundary
+static uint8_t readJson(const char * text, uint32_t padding, jsonSeen * seen, WindOpJsonReader * reader) {
+    FILE * file = NULL;
+    uint32_t i;
+    uint8_t status;
+
+    memset(seen, 0, sizeof(*seen));
+    if (padding != 0) {
+        file = tmpfile();
+        for (i = 0; i < padding; i++) {
+            fputc(' ', file);
+        }
+        fputs(text, file);
+        rewind(file);
+    }
+    init_WindOpJsonReader(reader, file, text, strlen(text));
+    status = read_WindOpTtnJson(reader, onJsonUplink, seen);
+    free_WindOpJsonReader(reader);
+    if (file != NULL) {
+        fclose(file);
+    }
+    return status;
+}
+
+uint16_t runJsonTest(void) {
+    static const char nested[] =
+        "[{\"device_id\":\"node\\u002da\\\"x\",\"meta\":{\"a\":[1,{\"b\":\"}]\"}],\"c\":null},"
+        "\"time\":\"2017-12-01T12:00:00Z\",\"raw\":\"AQ\\/=\"}, 5, {\"device_id\":\"n\"}]";
+    static const char cut[] = "[{\"device_id\":\"a\",\"time\":\"t\",\"raw\":\"AQ==\"},{\"device_id\":\"b\"";
+    static const char open[] = "[{\"device_id\":\"a\",\"time\":\"t\",\"raw\":\"AQ==\"}";
+    static const char broken[] = "[{\"device_id\":\"a\"} x]";
+    static const char badEscape[] = "[{\"device_id\":\"a\\q\"}]";
+    static const char longId[] =
+        "[{\"device_id\":\"node-a-with-an-id-of-64-bytes-or-more-that-cannot-be-stored-whole\","
+        "\"time\":\"t\",\"raw\":\"AQ==\"}]";
+    WindOpJsonReader reader;
+    jsonSeen seen;
+    uint16_t error = 0;
+
+    error += testValue("json nested", readJson(nested, 0, &seen, &reader), WINDOP_OK);
+    error += testValue("json uplinks", (uint16_t) seen.uplinks, 1);
+    error += testValue("json skipped", (uint16_t) reader.skipped, 2);
+    error += testValue("json escapes", strcmp(seen.last.device, "node-a\"x") == 0, 1);
+    error += testValue("json raw", (seen.last.rawLength == 4) && (strcmp(seen.last.raw, "AQ/=") == 0), 1);
+    error += testValue("json across buffers", readJson(nested, WINDOP_JSON_BUFFER_SIZE - 20, &seen, &reader),
+                       WINDOP_OK);
+    error += testValue("json across escapes", strcmp(seen.last.device, "node-a\"x") == 0, 1);
+
+    // Errors stop at the byte that broke, the end of input for a cut
+    error += testValue("json cut", readJson(cut, 0, &seen, &reader), WINDOP_ERR_FORMAT);
+    error += testValue("json cut uplinks", (uint16_t) seen.uplinks, 1);
+    error += testValue("json cut offset", (uint16_t) offset_WindOpJsonReader(&reader), sizeof(cut) - 1);
+    error += testValue("json open", readJson(open, 0, &seen, &reader), WINDOP_ERR_FORMAT);
+    error += testValue("json open offset", (uint16_t) offset_WindOpJsonReader(&reader), sizeof(open) - 1);
+    error += testValue("json broken", readJson(broken, 0, &seen, &reader), WINDOP_ERR_FORMAT);
+    error += testValue("json broken offset", (uint16_t) offset_WindOpJsonReader(&reader),
+                       (uint16_t) (strchr(broken, 'x') - broken));
+    error += testValue("json bad escape", readJson(badEscape, 0, &seen, &reader), WINDOP_ERR_FORMAT);
+
+    // An id too long to keep whole drops the element rather than cutting the name
+    error += testValue("json long id", readJson(longId, 0, &seen, &reader), WINDOP_OK);
+    error += testValue("json long uplinks", (uint16_t) seen.uplinks, 0);
+    error += testValue("json long skipped", (uint16_t) reader.skipped, 1);
+
+    return error;
+}
+
+/* ****************************************************************************
+ *
+ * Work stealing pool, tasks that submit tasks, with full queues run in line
+ *
+ * */
+#define POOL_TASKS     1000
+#define POOL_CHILDREN  100
+
+static uint32_t poolValues[POOL_TASKS + POOL_CHILDREN];
+static atomic_uint_fast64_t poolSum;
+static atomic_uint_fast64_t poolInline;   // Tasks run by the submitter, not counted by a worker
+
+static void poolTask(WindOpPool * pool, uint32_t worker, void * task);
+
+static void poolSubmit(WindOpPool * pool, uint32_t worker, uint32_t * task) {
+    if (!submit_WindOpPool(pool, worker, task)) {
+        atomic_fetch_add_explicit(&poolInline, 1, memory_order_relaxed);
+        poolTask(pool, worker, task);
+    }
+}
+
+static void poolTask(WindOpPool * pool, uint32_t worker, void * task) {
+    const uint32_t value = *(const uint32_t *) task;
+
+    atomic_fetch_add_explicit(&poolSum, value, memory_order_relaxed);
+    if (value < POOL_CHILDREN) {
+        poolSubmit(pool, worker, &poolValues[POOL_TASKS + value]);
+    }
+}
+
+uint16_t runPoolTest(void) {
+    WindOpPool pool;
+    uint64_t expected = 0;
+    uint64_t tasks = 0;
+    uint32_t i;
+    uint16_t error = 0;
+
+    for (i = 0; i < POOL_TASKS + POOL_CHILDREN; i++) {
+        poolValues[i] = i;
+        expected += i;
+    }
+    atomic_init(&poolSum, 0);
+    atomic_init(&poolInline, 0);
+    error += testValue("pool start", start_WindOpPool(&pool, 4, 64, poolTask, NULL), WINDOP_OK);
+    for (i = 0; i < POOL_TASKS; i++) {
+        poolSubmit(&pool, i % pool.numWorkers, &poolValues[i]);
+    }
+    wait_WindOpPool(&pool);
+    error += testValue("pool every task", atomic_load(&poolSum) == expected, 1);
+    for (i = 0; i < pool.numWorkers; i++) {
+        tasks += atomic_load(&pool.workers[i].tasks);
+    }
+    error += testValue("pool task counts", tasks + atomic_load(&poolInline) == POOL_TASKS + POOL_CHILDREN, 1);
+    stop_WindOpPool(&pool);
+
+    return error;
+}
+
+/* ****************************************************************************
+ *
+ * Fleet simulator, the same seed gives the same bytes and the reading total
+ * matches what the uplinks decode to
+ *
+ * */
+#define SIM_UPLINKS    400
+
+uint16_t runSimTest(void) {
+    WindOpSimConfig config;
+    WindOpSim sim;
+    WindOpSim again;
+    const WindOpSimUplink * up;
+    const WindOpSimUplink * other;
+    packCtrl pack;
+    uint64_t packed = 0;
+    uint32_t same = 0;
+    uint32_t decoded = 0;
+    uint32_t mismatched = 0;
+    uint32_t i;
+    uint16_t error = 0;
+
+    memset(&config, 0, sizeof(config));
+    config.seed = 7;
+    config.numNodes = 20;
+    config.start = 1512129600;
+    config.readings = 10;
+    config.corruptPpm = 50000;
+    config.duplicatePpm = 50000;
+    error += testValue("sim init", init_WindOpSim(&sim, &config), WINDOP_OK);
+    error += testValue("sim init again", init_WindOpSim(&again, &config), WINDOP_OK);
+    for (i = 0; i < SIM_UPLINKS; i++) {
+        up = next_WindOpSim(&sim);
+        other = next_WindOpSim(&again);
+        same += (up->length == other->length) && (memcmp(up->bytes, other->bytes, up->length) == 0);
+        if (up->flags & WINDOP_SIM_DUPLICATE) {
+            mismatched += (up->readings != 0); // Counted when first sent
+        } else if (up->flags & WINDOP_SIM_CORRUPT) {
+            packed += up->readings;
+        } else if (unpackBounded_WindOpDataPacket(&pack, up->bytes, up->length) == WINDOP_OK) {
+            decoded++;
+            packed += pack.numOfReadings;
+            mismatched += (pack.numOfReadings != up->readings);
+        } else {
+            mismatched++;
+        }
+    }
+    error += testValue("sim same bytes", (uint16_t) same, SIM_UPLINKS);
+    error += testValue("sim uplinks", (uint16_t) sim.uplinks, SIM_UPLINKS);
+    error += testValue("sim readings", sim.readings == packed, 1);
+    error += testValue("sim decoded", (decoded > 0) && (mismatched == 0), 1);
+    error += testValue("sim damaged", (sim.corrupt > 0) && (sim.duplicates > 0), 1);
+    free_WindOpSim(&sim);
+    free_WindOpSim(&again);
+
     return error;
 }
 
@@ -536,6 +1309,7 @@ uint16_t runTest(struct testCtrl * tstCtrl) {
 int main(void) {
 
     uint16_t error = 0;
+    uint8_t i;
     testCtrl tstCtrl;
 
     dump_StrWithBreaker("Setup our test data");
@@ -572,8 +1346,73 @@ int main(void) {
 
     error += runTest(&tstCtrl);
 
+    dump_StrWithBreaker("24 bit environment format");
+    setExampleTime(&tstCtrl.dataIn.time, 2017, 12, 1, 12, 31, 00);
+    setdataPoint(&tstCtrl.dataIn.readings[0], 5000, 5500, 4500);
+    setdataPoint(&tstCtrl.dataIn.readings[1], 6000, 6500, 5500);
+    tstCtrl.dataIn.readings[1].tmp = -250;
+    tstCtrl.dataIn.incSeconds = 0;
+    tstCtrl.dataIn.dataType = WINDOPDATAPACKET_T6_TYPE;
+    tstCtrl.dataIn.numOfReadings = 2;
+
+    error += runTest(&tstCtrl);
+
+    dump_StrWithBreaker("Delta format");
+    setExampleTime(&tstCtrl.dataIn.time, 2017, 12, 1, 12, 32, 00);
+    for (i = 0; i < 20; i++) {
+        setdataPoint(&tstCtrl.dataIn.readings[i], 500 + 3 * i, 900 - 40 * i, 120 + (i & 1));
+        tstCtrl.dataIn.readings[i].wd = (uint16_t) (350 + 7 * i) % 360;
+        tstCtrl.dataIn.readings[i].tmp = (int16_t) (30 - 4 * i); // Crosses zero
+        tstCtrl.dataIn.readings[i].hum = (uint16_t) (65530 + i);  // Wraps
+    }
+    tstCtrl.dataIn.incSeconds = 0;
+    tstCtrl.dataIn.dataType = WINDOPDATAPACKET_T8_TYPE;
+    tstCtrl.dataIn.numOfReadings = 20;
+
+    error += runTest(&tstCtrl);
+
+    dump_StrWithBreaker("Packet archive");
+    error += runArchiveTest();
+
+    dump_StrWithBreaker("Bounded codec");
+    error += runBoundedTest();
+
+    dump_StrWithBreaker("Rollups");
+    error += runRollupTest();
+
+    dump_StrWithBreaker("Minute index");
+    error += runTimeIndexTest();
+
+    dump_StrWithBreaker("Duplicates and coverage");
+    error += runDedupTest();
+
+    dump_StrWithBreaker("Arrow file");
+    error += runArrowTest();
+
+    dump_StrWithBreaker("Decode metrics");
+    error += runMetricsTest();
+
+    dump_StrWithBreaker("GPS fixes");
+    error += runGpsTest();
+
+    dump_StrWithBreaker("Serial log");
+    error += runSerialLogTest();
+
+    dump_StrWithBreaker("Worker pool");
+    error += runPoolTest();
+
+    dump_StrWithBreaker("Fleet simulator");
+    error += runSimTest();
+
+    dump_StrWithBreaker("TTN JSON reader");
+    error += runJsonTest();
+
+    dump_StrWithBreaker("Epoch time format");
+    error += runEpochTimeTest();
+
     if (error > 0) {
         dump_StrWithBreaker("TEST FAILED");
+        return EXIT_FAILURE;
     } else {
         dump_StrWithBreaker("TEST PASSED");
     }
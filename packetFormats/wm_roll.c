@@ -0,0 +1,295 @@
+/*
+ ============================================================================
+ Name        : wm_roll.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Rolling 10 minute, hourly and daily wind and battery statistics
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "wm_codec.h"
+#include "wm_base64.h"
+#include "wm_json.h"
+#include "wm_rollup.h"
+
+static const char * helpText =
+"\n"
+"   WindOp rolling statistics\n"
+"\n"
+"   Feeds uplinks into per device 10 minute, hourly and daily rollups of\n"
+"   wind speed, vector averaged direction and battery voltage, and writes\n"
+"   one level as CSV for the plots. With -state the rollups are restored\n"
+"   before and saved after, so only new uplinks need feeding.\n"
+"\n"
+"      wm_roll [options] file...      : Reads stdin when no file is given\n"
+"\n"
+"      -raw device            : Inputs are raw captures from device, default\n"
+"                               is TTN storage JSON\n"
+"      -state file            : Restore from file if it exists, save back\n"
+"      -level 10min|hour|day  : Level written, default hour\n"
+"      -sel device            : Only write device\n"
+"      -o file                : Write the CSV to file, default stdout\n"
+"      -help                  : Prints this\n"
+"\n";
+
+#define MAX_FILES                64
+#define RAW_BUFFER_SIZE          65536
+
+static const char * levelNames[WINDOP_ROLLUP_LEVELS] = { "10min", "hour", "day" };
+
+typedef struct rollCfg {
+    const char * files[MAX_FILES];
+    uint32_t numFiles;
+    const char * rawDevice;
+    const char * stateFile;
+    const char * device;
+    const char * outFile;
+    uint8_t level;
+} rollCfg;
+
+typedef struct rollCtx {
+    WindOpRollup rollup;
+    uint64_t packets;
+    uint64_t failed;
+} rollCtx;
+
+static void outOfMemory(void) {
+    fprintf(stderr, "ERROR out of memory\n");
+    exit(EXIT_FAILURE);
+}
+
+static void addPacket(rollCtx * ctx, const char * device, const uint8_t * packet, uint32_t length) {
+    switch (addPacket_WindOpRollup(&ctx->rollup, device, packet, length)) {
+    case WINDOP_OK:
+        ctx->packets++;
+        break;
+    case WINDOP_ERR_MEMORY:
+        outOfMemory();
+        break;
+    default:
+        ctx->failed++;
+        break;
+    }
+}
+
+static void onUplink(void * context, const WindOpUplink * uplink) {
+    rollCtx * ctx = context;
+    uint8_t packet[WINDOP_JSON_RAW_SIZE];
+    int32_t length;
+
+    length = decode_WindOpBase64(uplink->raw, uplink->rawLength, packet, sizeof(packet));
+    if (length < 0) {
+        ctx->failed++;
+        return;
+    }
+    addPacket(ctx, uplink->device, packet, (uint32_t) length);
+}
+
+static uint8_t readJson(rollCtx * ctx, FILE * in) {
+    WindOpJsonReader reader;
+    uint8_t status;
+
+    if (init_WindOpJsonReader(&reader, in, NULL, 0) != WINDOP_OK) {
+        outOfMemory();
+    }
+    status = read_WindOpTtnJson(&reader, onUplink, ctx);
+    free_WindOpJsonReader(&reader);
+    return status;
+}
+
+// Packets back to back, walked by their length bytes
+static uint8_t readRaw(rollCtx * ctx, FILE * in, const char * device) {
+    static uint8_t buffer[RAW_BUFFER_SIZE];
+    uint32_t start = 0;
+    uint32_t end = 0;
+    uint32_t length;
+
+    for (;;) {
+        if (end - start < WINDOP_MAX_PACKET_LENGTH) {
+            memmove(buffer, &buffer[start], end - start);
+            end -= start;
+            start = 0;
+            end += (uint32_t) fread(&buffer[end], 1, sizeof(buffer) - end, in);
+        }
+        if (end - start < WINDOP_PACKET_HEADER_SIZE) {
+            return (end == start) ? WINDOP_OK : WINDOP_ERR_SHORT;
+        }
+        length = buffer[start + 1];
+        if ((length < WINDOP_PACKET_HEADER_SIZE + WINDOP_TIME_SIZE) || (length > end - start)) {
+            // Without a usable length byte there is no next packet to find
+            ctx->failed++;
+            return WINDOP_ERR_LENGTH;
+        }
+        addPacket(ctx, device, &buffer[start], length);
+        start += length;
+    }
+}
+
+static uint8_t readInput(rollCtx * ctx, const rollCfg * cfg, const char * path) {
+    FILE * in = stdin;
+    uint8_t status;
+
+    if ((path != NULL) && ((in = fopen(path, "rb")) == NULL)) {
+        fprintf(stderr, "Can't open %s\n", path);
+        return WINDOP_ERR_FORMAT;
+    }
+    status = (cfg->rawDevice != NULL) ? readRaw(ctx, in, cfg->rawDevice) : readJson(ctx, in);
+    if (status != WINDOP_OK) {
+        fprintf(stderr, "ERROR %s stopped early, status %d\n", (path != NULL) ? path : "stdin", status);
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+    return status;
+}
+
+static void writeDevice(FILE * out, const WindOpRollup * rollup, const char * device, uint8_t level,
+                        WindOpTimeFormat * fmt, WindOpRollupStats * stats) {
+    char key[WINDOP_TIME_KEY_SIZE];
+    uint32_t count;
+    uint32_t i;
+
+    count = read_WindOpRollup(rollup, device, level, INT64_MIN, INT64_MAX, stats, slots_WindOpRollup(level));
+    for (i = 0; i < count; i++) {
+        format_WindOpTime(fmt, stats[i].start, key);
+        fprintf(out, "%s,%s,%u,%.2f,%.2f,%.2f,%.2f,%.0f,%.3f,%u,%.3f,%.3f,%.3f,%.4f\n", device, key,
+                stats[i].windCount, stats[i].wsMean, stats[i].wsMin, stats[i].wsMax, stats[i].gust, stats[i].wd,
+                stats[i].wdSteadiness, stats[i].bvCount, stats[i].bvMean, stats[i].bvMin, stats[i].bvMax,
+                stats[i].bvSlope);
+    }
+}
+
+static void processCommandLine(int argc, char ** argv, rollCfg * cfg) {
+    uint8_t level;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-raw") == 0) && (i + 1 < argc)) {
+            cfg->rawDevice = argv[++i];
+        } else if ((strcmp(argv[i], "-state") == 0) && (i + 1 < argc)) {
+            cfg->stateFile = argv[++i];
+        } else if ((strcmp(argv[i], "-sel") == 0) && (i + 1 < argc)) {
+            cfg->device = argv[++i];
+        } else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+            cfg->outFile = argv[++i];
+        } else if ((strcmp(argv[i], "-level") == 0) && (i + 1 < argc)) {
+            i++;
+            for (level = 0; (level < WINDOP_ROLLUP_LEVELS) && (strcmp(argv[i], levelNames[level]) != 0); level++) {
+            }
+            if (level == WINDOP_ROLLUP_LEVELS) {
+                printf("%s", helpText);
+                exit(EXIT_SUCCESS);
+            }
+            cfg->level = level;
+        } else if ((strcmp(argv[i], "-help") == 0) || (argv[i][0] == '-')) {
+            printf("%s", helpText);
+            exit(EXIT_SUCCESS);
+        } else if (cfg->numFiles < MAX_FILES) {
+            cfg->files[cfg->numFiles++] = argv[i];
+        }
+    }
+}
+
+int main(int argc, char ** argv) {
+    rollCfg cfg;
+    rollCtx ctx;
+    WindOpTimeFormat fmt;
+    WindOpRollupStats * stats;
+    FILE * file;
+    FILE * out = stdout;
+    clock_t start;
+    double seconds;
+    uint32_t i;
+    int result = EXIT_SUCCESS;
+
+    memset(&cfg, 0, sizeof(cfg));
+    memset(&ctx, 0, sizeof(ctx));
+    cfg.level = WINDOP_ROLLUP_HOUR;
+    processCommandLine(argc, argv, &cfg);
+    init_WindOpRollup(&ctx.rollup);
+
+    if ((cfg.stateFile != NULL) && ((file = fopen(cfg.stateFile, "rb")) != NULL)) {
+        if (restore_WindOpRollup(&ctx.rollup, file) != WINDOP_OK) {
+            fprintf(stderr, "ERROR %s is not a rollup snapshot\n", cfg.stateFile);
+            return EXIT_FAILURE;
+        }
+        fclose(file);
+        fprintf(stderr, "---Restored %u devices, %lu readings from %s\n", ctx.rollup.numDevices,
+                (unsigned long) ctx.rollup.readings, cfg.stateFile);
+    }
+
+    start = clock();
+    if (cfg.numFiles == 0) {
+        result = (readInput(&ctx, &cfg, NULL) == WINDOP_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    for (i = 0; i < cfg.numFiles; i++) {
+        if (readInput(&ctx, &cfg, cfg.files[i]) != WINDOP_OK) {
+            result = EXIT_FAILURE;
+        }
+    }
+    seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    fprintf(stderr, "---Rolled up %lu packets in %.3f s, %lu failed, %lu readings in total, %lu late\n",
+            (unsigned long) ctx.packets, seconds, (unsigned long) ctx.failed, (unsigned long) ctx.rollup.readings,
+            (unsigned long) ctx.rollup.late);
+
+    if (cfg.stateFile != NULL) {
+        if (((file = fopen(cfg.stateFile, "wb")) == NULL) || (save_WindOpRollup(&ctx.rollup, file) != WINDOP_OK)) {
+            fprintf(stderr, "ERROR writing %s\n", cfg.stateFile);
+            result = EXIT_FAILURE;
+        }
+        if (file != NULL) {
+            fclose(file);
+        }
+    }
+
+    if ((cfg.outFile != NULL) && ((out = fopen(cfg.outFile, "w")) == NULL)) {
+        fprintf(stderr, "Can't open %s\n", cfg.outFile);
+        return EXIT_FAILURE;
+    }
+    stats = malloc(slots_WindOpRollup(cfg.level) * sizeof(WindOpRollupStats));
+    if (stats == NULL) {
+        outOfMemory();
+    }
+    init_WindOpTimeFormat(&fmt);
+    fprintf(out, "device,time,wind_n,ws_mean,ws_min,ws_max,gust,wd,wd_steady,bv_n,bv_mean,bv_min,bv_max,bv_slope\n");
+    for (i = 0; i < ctx.rollup.numDevices; i++) {
+        if ((cfg.device == NULL) || (strcmp(cfg.device, ctx.rollup.devices[i].name) == 0)) {
+            writeDevice(out, &ctx.rollup, ctx.rollup.devices[i].name, cfg.level, &fmt, stats);
+        }
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    free(stats);
+    free_WindOpRollup(&ctx.rollup);
+    return result;
+}
@@ -0,0 +1,479 @@
+/*
+ ============================================================================
+ Name        : wm_rollup.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Incremental per device wind and battery rollups
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_rollup.h"
+
+static const uint32_t levelPeriod[WINDOP_ROLLUP_LEVELS] = { 600, 3600, 86400 };
+static const uint32_t levelSlots[WINDOP_ROLLUP_LEVELS] = { 288, 336, 400 };
+#define TOTAL_SLOTS              (288 + 336 + 400)
+
+// Unit vectors per whole degree, built once
+static float dirCos[360];
+static float dirSin[360];
+static pthread_once_t dirOnce = PTHREAD_ONCE_INIT;
+
+static void buildDirections(void) {
+    uint32_t d;
+    for (d = 0; d < 360; d++) {
+        dirCos[d] = (float) cos(d * M_PI / 180.0);
+        dirSin[d] = (float) sin(d * M_PI / 180.0);
+    }
+}
+
+uint32_t period_WindOpRollup(uint8_t level) {
+    return (level < WINDOP_ROLLUP_LEVELS) ? levelPeriod[level] : 0;
+}
+
+uint32_t slots_WindOpRollup(uint8_t level) {
+    return (level < WINDOP_ROLLUP_LEVELS) ? levelSlots[level] : 0;
+}
+
+void init_WindOpRollup(WindOpRollup * rollup) {
+    pthread_once(&dirOnce, buildDirections);
+    memset(rollup, 0, sizeof(*rollup));
+}
+
+void free_WindOpRollup(WindOpRollup * rollup) {
+    uint32_t i;
+    for (i = 0; i < rollup->numDevices; i++) {
+        free(rollup->devices[i].levels[0]);
+    }
+    free(rollup->devices);
+    free(rollup->hash);
+    memset(rollup, 0, sizeof(*rollup));
+}
+
+/* ****************************************************************************
+ * Device table, FNV-1a over the name into an open addressed index. Names
+ * are shorter than WINDOP_ROLLUP_DEVICE_SIZE and kept whole, so the stored
+ * copy hashes and compares as the id did.
+ * */
+static uint32_t nameHash(const char * name) {
+    uint32_t h = 2166136261u;
+    uint32_t i;
+    for (i = 0; name[i]; i++) {
+        h = (h ^ (uint8_t) name[i]) * 16777619u;
+    }
+    return h;
+}
+
+static uint32_t * findSlot(const WindOpRollup * rollup, const char * name) {
+    uint32_t mask = rollup->hashSize - 1;
+    uint32_t h = nameHash(name) & mask;
+
+    while ((rollup->hash[h] != 0) &&
+           (strcmp(rollup->devices[rollup->hash[h] - 1].name, name) != 0)) {
+        h = (h + 1) & mask;
+    }
+    return &rollup->hash[h];
+}
+
+static uint8_t growHash(WindOpRollup * rollup) {
+    uint32_t size = rollup->hashSize ? 2 * rollup->hashSize : 64;
+    uint32_t i;
+
+    free(rollup->hash);
+    rollup->hash = calloc(size, sizeof(uint32_t));
+    if (rollup->hash == NULL) {
+        rollup->hashSize = 0;
+        return WINDOP_ERR_MEMORY;
+    }
+    rollup->hashSize = size;
+    for (i = 0; i < rollup->numDevices; i++) {
+        *findSlot(rollup, rollup->devices[i].name) = i + 1;
+    }
+    return WINDOP_OK;
+}
+
+static int32_t findDevice(const WindOpRollup * rollup, const char * name) {
+    return (rollup->hashSize == 0) ? -1 : (int32_t) *findSlot(rollup, name) - 1;
+}
+
+static int32_t deviceIndex(WindOpRollup * rollup, const char * name) {
+    WindOpRollupDevice * dev;
+    WindOpRollupBucket * buckets;
+    uint32_t * slot;
+    uint32_t i;
+
+    if (2 * (rollup->numDevices + 1) > rollup->hashSize) {
+        if (growHash(rollup) != WINDOP_OK) {
+            return -1;
+        }
+    }
+    slot = findSlot(rollup, name);
+    if (*slot != 0) {
+        return (int32_t) *slot - 1;
+    }
+
+    if (rollup->numDevices == rollup->deviceCapacity) {
+        uint32_t capacity = rollup->deviceCapacity ? 2 * rollup->deviceCapacity : 16;
+        dev = realloc(rollup->devices, capacity * sizeof(WindOpRollupDevice));
+        if (dev == NULL) {
+            return -1;
+        }
+        rollup->devices = dev;
+        rollup->deviceCapacity = capacity;
+    }
+    buckets = malloc(TOTAL_SLOTS * sizeof(WindOpRollupBucket));
+    if (buckets == NULL) {
+        return -1;
+    }
+    for (i = 0; i < TOTAL_SLOTS; i++) {
+        buckets[i].start = INT64_MIN;
+    }
+
+    dev = &rollup->devices[rollup->numDevices];
+    memset(dev, 0, sizeof(*dev));
+    strcpy(dev->name, name);
+    dev->levels[WINDOP_ROLLUP_10MIN] = buckets;
+    dev->levels[WINDOP_ROLLUP_HOUR] = buckets + levelSlots[WINDOP_ROLLUP_10MIN];
+    dev->levels[WINDOP_ROLLUP_DAY] = dev->levels[WINDOP_ROLLUP_HOUR] + levelSlots[WINDOP_ROLLUP_HOUR];
+    dev->newest = INT64_MIN;
+    for (i = 0; i < WINDOP_ROLLUP_LEVELS; i++) {
+        dev->lastStart[i] = INT64_MIN;
+    }
+    *slot = ++rollup->numDevices;
+    return (int32_t) rollup->numDevices - 1;
+}
+
+/* ****************************************************************************
+ * Buckets
+ * */
+
+// Period number of time, rounding down for times before 1970 too
+static inline int64_t periodOf(int64_t time, uint32_t period) {
+    return (time >= 0) ? time / period : -((-time + period - 1) / period);
+}
+
+static inline uint32_t slotOf(int64_t number, uint32_t slots) {
+    return (uint32_t) (((number % slots) + slots) % slots);
+}
+
+static void resetBucket(WindOpRollupBucket * b, int64_t start) {
+    memset(b, 0, sizeof(*b));
+    b->start = start;
+    b->wsMin = UINT16_MAX;
+    b->bvMin = UINT16_MAX;
+}
+
+static void addToBucket(WindOpRollupBucket * b, int64_t time, const WindOpDataPacket_t3 * r, uint8_t channels) {
+    uint32_t wd;
+    uint32_t at;
+
+    if (channels & (1u << WINDOP_CH_WS)) {
+        wd = r->wd % 360;
+        b->windCount++;
+        b->wsSum += r->ws;
+        b->wsMin = (r->ws < b->wsMin) ? r->ws : b->wsMin;
+        b->wsMax = (r->ws > b->wsMax) ? r->ws : b->wsMax;
+        b->gust = (r->wsx > b->gust) ? r->wsx : b->gust;
+        b->dirX += dirCos[wd];
+        b->dirY += dirSin[wd];
+    }
+    if (channels & (1u << WINDOP_CH_BV)) {
+        at = (uint32_t) (time - b->start);
+        if ((b->bvCount == 0) || (at < b->bvFirstAt)) {
+            b->bvFirstAt = at;
+            b->bvFirst = r->bv;
+        }
+        if ((b->bvCount == 0) || (at >= b->bvLastAt)) {
+            b->bvLastAt = at;
+            b->bvLast = r->bv;
+        }
+        b->bvCount++;
+        b->bvSum += r->bv;
+        b->bvMin = (r->bv < b->bvMin) ? r->bv : b->bvMin;
+        b->bvMax = (r->bv > b->bvMax) ? r->bv : b->bvMax;
+    }
+}
+
+static uint8_t addToDevice(WindOpRollup * rollup, WindOpRollupDevice * dev, int64_t time,
+                           const WindOpDataPacket_t3 * reading, uint8_t channels) {
+    WindOpRollupBucket * b;
+    uint32_t period;
+    uint32_t slot;
+    int64_t number;
+    int64_t start;
+    uint8_t late = 0;
+    uint8_t level;
+
+    for (level = 0; level < WINDOP_ROLLUP_LEVELS; level++) {
+        period = levelPeriod[level];
+
+        // Nearly every reading falls in the bucket the one before it did
+        if ((time >= dev->lastStart[level]) && (time < dev->lastStart[level] + period)) {
+            addToBucket(&dev->levels[level][dev->lastSlot[level]], time, reading, channels);
+            continue;
+        }
+        number = periodOf(time, period);
+        start = number * period;
+        slot = slotOf(number, levelSlots[level]);
+        b = &dev->levels[level][slot];
+        if ((dev->newest != INT64_MIN) && (number <= periodOf(dev->newest, period) - levelSlots[level])) {
+            late = 1; // Behind the ring, even where its slot still holds older data
+            continue;
+        }
+        if (b->start != start) {
+            if (b->start > start) {
+                late = 1; // The slot has moved on past this period
+                continue;
+            }
+            resetBucket(b, start);
+        }
+        addToBucket(b, time, reading, channels);
+        dev->lastStart[level] = start;
+        dev->lastSlot[level] = slot;
+    }
+    if (time > dev->newest) {
+        dev->newest = time;
+    }
+    rollup->readings++;
+    rollup->late += late;
+    return WINDOP_OK;
+}
+
+uint8_t add_WindOpRollup(WindOpRollup * rollup, const char * device, int64_t time,
+                         const WindOpDataPacket_t3 * reading, uint8_t channels) {
+    int32_t index;
+
+    if (strlen(device) >= WINDOP_ROLLUP_DEVICE_SIZE) {
+        return WINDOP_ERR_LENGTH;
+    }
+    if ((index = deviceIndex(rollup, device)) < 0) {
+        return WINDOP_ERR_MEMORY;
+    }
+    return addToDevice(rollup, &rollup->devices[index], time, reading, channels);
+}
+
+uint8_t addPacket_WindOpRollup(WindOpRollup * rollup, const char * device, const uint8_t * packet,
+                               uint32_t length) {
+    WindOpPacketHeader hdr;
+    packCtrl pack;
+    WindOpRollupDevice * dev;
+    uint32_t bvFactor;
+    int32_t index;
+    uint8_t status;
+    uint8_t i;
+
+    if (strlen(device) >= WINDOP_ROLLUP_DEVICE_SIZE) {
+        return WINDOP_ERR_LENGTH;
+    }
+    // The unpack first, a packet it refuses is counted once in the decode metrics
+    status = unpackBounded_WindOpDataPacket(&pack, packet, length);
+    if (status == WINDOP_OK) {
+        status = parse_WindOpPacketHeader(&hdr, packet, length);
+    }
+    if (status != WINDOP_OK) {
+        return status;
+    }
+    index = deviceIndex(rollup, device);
+    if (index < 0) {
+        return WINDOP_ERR_MEMORY;
+    }
+    dev = &rollup->devices[index];
+
+    // T6 carries bv in 10 mV, the others in mV
+    bvFactor = (uint32_t) (hdr.info->scale[WINDOP_CH_BV] * 1000 + 0.5);
+    for (i = 0; i < pack.numOfReadings; i++) {
+        if (bvFactor > 1) {
+            pack.readings[i].bv = (uint16_t) (pack.readings[i].bv * bvFactor);
+        }
+        addToDevice(rollup, dev, hdr.firstTime + 60 * i, &pack.readings[i], hdr.channels);
+    }
+    return WINDOP_OK;
+}
+
+/* ****************************************************************************
+ * Queries
+ * */
+static void bucketStats(const WindOpRollupBucket * b, WindOpRollupStats * s) {
+    double length;
+
+    memset(s, 0, sizeof(*s));
+    s->start = b->start;
+    s->windCount = b->windCount;
+    s->bvCount = b->bvCount;
+    if (b->windCount) {
+        s->wsMean = 0.01 * b->wsSum / b->windCount;
+        s->wsMin = 0.01 * b->wsMin;
+        s->wsMax = 0.01 * b->wsMax;
+        s->gust = 0.01 * b->gust;
+        s->wd = atan2(b->dirY, b->dirX) * 180.0 / M_PI;
+        s->wd += (s->wd < 0) ? 360.0 : 0.0;
+        length = sqrt((double) b->dirX * b->dirX + (double) b->dirY * b->dirY);
+        s->wdSteadiness = length / b->windCount;
+    }
+    if (b->bvCount) {
+        s->bvMean = 0.001 * b->bvSum / b->bvCount;
+        s->bvMin = 0.001 * b->bvMin;
+        s->bvMax = 0.001 * b->bvMax;
+        if (b->bvLastAt > b->bvFirstAt) {
+            s->bvSlope = 0.001 * ((int32_t) b->bvLast - b->bvFirst) * 3600.0 / (b->bvLastAt - b->bvFirstAt);
+        }
+    }
+}
+
+uint32_t read_WindOpRollup(const WindOpRollup * rollup, const char * device, uint8_t level, int64_t from,
+                           int64_t to, WindOpRollupStats * out, uint32_t max) {
+    const WindOpRollupDevice * dev;
+    const WindOpRollupBucket * b;
+    uint32_t period;
+    uint32_t slots;
+    int64_t first;
+    int64_t last;
+    int64_t n;
+    int32_t index;
+    uint32_t count = 0;
+
+    index = findDevice(rollup, device);
+    if ((index < 0) || (level >= WINDOP_ROLLUP_LEVELS) || (to <= from)) {
+        return 0;
+    }
+    dev = &rollup->devices[index];
+    period = levelPeriod[level];
+    slots = levelSlots[level];
+
+    // Only the newest slots periods can still be in the ring
+    last = periodOf(dev->newest, period);
+    first = last - slots + 1;
+    if (to - 1 < dev->newest) {
+        last = periodOf(to - 1, period);
+    }
+    if (from > first * period) {
+        first = periodOf(from, period);
+    }
+    for (n = first; (n <= last) && (count < max); n++) {
+        b = &dev->levels[level][slotOf(n, slots)];
+        if ((b->start == n * period) && (b->start >= from)) {
+            bucketStats(b, &out[count++]);
+        }
+    }
+    return count;
+}
+
+/* ****************************************************************************
+ * Snapshot
+ * */
+uint8_t save_WindOpRollup(const WindOpRollup * rollup, FILE * out) {
+    WindOpRollupFileHeader header;
+    const WindOpRollupDevice * dev;
+    const WindOpRollupBucket * b;
+    uint32_t count;
+    uint32_t i;
+    uint32_t s;
+    uint8_t level;
+
+    memset(&header, 0, sizeof(header));
+    header.numDevices = rollup->numDevices;
+    header.bucketSize = sizeof(WindOpRollupBucket);
+    header.readings = rollup->readings;
+    header.late = rollup->late;
+    if ((fwrite(WINDOP_ROLLUP_MAGIC, 8, 1, out) != 1) || (fwrite(&header, sizeof(header), 1, out) != 1)) {
+        return WINDOP_ERR_FORMAT;
+    }
+    for (i = 0; i < rollup->numDevices; i++) {
+        dev = &rollup->devices[i];
+        if ((fwrite(dev->name, WINDOP_ROLLUP_DEVICE_SIZE, 1, out) != 1) ||
+            (fwrite(&dev->newest, sizeof(dev->newest), 1, out) != 1)) {
+            return WINDOP_ERR_FORMAT;
+        }
+        for (level = 0; level < WINDOP_ROLLUP_LEVELS; level++) {
+            for (count = 0, s = 0; s < levelSlots[level]; s++) {
+                count += dev->levels[level][s].start != INT64_MIN;
+            }
+            if (fwrite(&count, sizeof(count), 1, out) != 1) {
+                return WINDOP_ERR_FORMAT;
+            }
+            for (s = 0; s < levelSlots[level]; s++) {
+                b = &dev->levels[level][s];
+                if ((b->start != INT64_MIN) && (fwrite(b, sizeof(*b), 1, out) != 1)) {
+                    return WINDOP_ERR_FORMAT;
+                }
+            }
+        }
+    }
+    return (fflush(out) == 0) ? WINDOP_OK : WINDOP_ERR_FORMAT;
+}
+
+uint8_t restore_WindOpRollup(WindOpRollup * rollup, FILE * in) {
+    WindOpRollupFileHeader header;
+    WindOpRollupDevice * dev;
+    WindOpRollupBucket b;
+    char magic[8];
+    char name[WINDOP_ROLLUP_DEVICE_SIZE];
+    int64_t newest;
+    uint32_t count;
+    uint32_t i;
+    uint32_t k;
+    int32_t index;
+    uint8_t level;
+
+    free_WindOpRollup(rollup);
+    init_WindOpRollup(rollup);
+    if ((fread(magic, 8, 1, in) != 1) || (memcmp(magic, WINDOP_ROLLUP_MAGIC, 8) != 0) ||
+        (fread(&header, sizeof(header), 1, in) != 1) || (header.bucketSize != sizeof(WindOpRollupBucket))) {
+        return WINDOP_ERR_FORMAT;
+    }
+    for (i = 0; i < header.numDevices; i++) {
+        if ((fread(name, sizeof(name), 1, in) != 1) || (fread(&newest, sizeof(newest), 1, in) != 1) ||
+            (name[WINDOP_ROLLUP_DEVICE_SIZE - 1] != '\0')) {
+            return WINDOP_ERR_FORMAT;
+        }
+        index = deviceIndex(rollup, name);
+        if (index < 0) {
+            return WINDOP_ERR_MEMORY;
+        }
+        dev = &rollup->devices[index];
+        dev->newest = newest;
+        for (level = 0; level < WINDOP_ROLLUP_LEVELS; level++) {
+            if ((fread(&count, sizeof(count), 1, in) != 1) || (count > levelSlots[level])) {
+                return WINDOP_ERR_FORMAT;
+            }
+            for (k = 0; k < count; k++) {
+                if ((fread(&b, sizeof(b), 1, in) != 1) || (b.start == INT64_MIN) ||
+                    (b.start % levelPeriod[level] != 0)) {
+                    return WINDOP_ERR_FORMAT;
+                }
+                dev->levels[level][slotOf(b.start / levelPeriod[level], levelSlots[level])] = b;
+            }
+        }
+    }
+    rollup->readings = header.readings;
+    rollup->late = header.late;
+    return WINDOP_OK;
+}
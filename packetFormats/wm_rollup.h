@@ -0,0 +1,185 @@
+/*
+ ============================================================================
+ Name        : wm_rollup.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Incremental per device wind and battery rollups
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_ROLLUP_H
+#define WM_ROLLUP_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wm_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ****************************************************************************
+ *
+ * Rolling statistics per device at three resolutions, each a fixed ring of
+ * buckets. A reading goes into the bucket its time falls in at every
+ * level, so an update is three bucket adds whatever the history.
+ *
+ *   level    bucket   slots   covers
+ *   10 min     600 s    288   2 days
+ *   hour      3600 s    336   2 weeks
+ *   day      86400 s    400   13 months
+ *
+ * The rings take 56 KB a device, allocated when it is first seen.
+ *
+ * A bucket holds the start of the period it sums. A reading newer than the
+ * bucket in its slot reuses the slot, one older than it fell off the ring
+ * and is counted as late. Readings can arrive in any order within the
+ * ring, there is no "current" bucket. Duplicates are counted twice, drop
+ * them before the rollup.
+ *
+ * Readings are WindOpDataPacket_t3 in T3 units, ws cm/s, wd degrees and
+ * bv mV. addPacket_WindOpRollup converts other types.
+ *
+ * */
+#define WINDOP_ROLLUP_10MIN        0
+#define WINDOP_ROLLUP_HOUR         1
+#define WINDOP_ROLLUP_DAY          2
+#define WINDOP_ROLLUP_LEVELS       3
+
+#define WINDOP_ROLLUP_DEVICE_SIZE  64 // Device id bytes, as in the archive
+#define WINDOP_ROLLUP_MAGIC        "WMROL002"
+
+typedef struct WindOpRollupBucket {
+    int64_t start;            // Epoch seconds the period starts, INT64_MIN when empty
+    float dirX;               // Sum of wd unit vectors
+    float dirY;
+    uint32_t windCount;
+    uint32_t wsSum;
+    uint32_t bvCount;
+    uint32_t bvSum;
+    uint32_t bvFirstAt;       // Seconds from start of the earliest and latest
+    uint32_t bvLastAt;        // battery reading, for the trend
+    uint16_t wsMin;
+    uint16_t wsMax;
+    uint16_t gust;            // Largest wsx
+    uint16_t bvMin;
+    uint16_t bvMax;
+    uint16_t bvFirst;
+    uint16_t bvLast;
+    uint16_t reserved;
+} WindOpRollupBucket;
+
+typedef struct WindOpRollupDevice {
+    char name[WINDOP_ROLLUP_DEVICE_SIZE];
+    WindOpRollupBucket * levels[WINDOP_ROLLUP_LEVELS];
+    int64_t newest;           // Latest reading seen
+    int64_t lastStart[WINDOP_ROLLUP_LEVELS]; // Bucket the last reading went into, INT64_MIN for none
+    uint32_t lastSlot[WINDOP_ROLLUP_LEVELS];
+} WindOpRollupDevice;
+
+typedef struct WindOpRollup {
+    WindOpRollupDevice * devices;
+    uint32_t numDevices;
+    uint32_t deviceCapacity;
+    uint32_t * hash;          // Device index + 1 by name hash, 0 for free
+    uint32_t hashSize;        // Power of 2, at least twice numDevices
+    uint64_t readings;
+    uint64_t late;            // Older than the ring at some level
+} WindOpRollup;
+
+/*
+ * Statistics of one bucket in units. wd is the direction of the mean unit
+ * vector, wdSteadiness its length, 1 when the wind held one direction and
+ * near 0 when it went all round. bvSlope is V per hour across the bucket,
+ * 0 with fewer than two battery readings.
+ */
+typedef struct WindOpRollupStats {
+    int64_t start;
+    uint32_t windCount;
+    uint32_t bvCount;
+    double wsMean;            // m/s
+    double wsMin;
+    double wsMax;
+    double gust;
+    double wd;                // degrees, 0...360
+    double wdSteadiness;
+    double bvMean;            // V
+    double bvMin;
+    double bvMax;
+    double bvSlope;
+} WindOpRollupStats;
+
+void init_WindOpRollup(WindOpRollup * rollup);
+void free_WindOpRollup(WindOpRollup * rollup);
+
+// Bucket seconds and ring slots of a level
+uint32_t period_WindOpRollup(uint8_t level);
+uint32_t slots_WindOpRollup(uint8_t level);
+
+/*
+ * Add one reading taken at time. channels says which fields are real,
+ * WINDOP_WIND_CHANNELS for T4, WINDOP_ENV_CHANNELS for T5 and so on.
+ * Both adds return WINDOP_ERR_LENGTH for an id of WINDOP_ROLLUP_DEVICE_SIZE
+ * bytes or more.
+ */
+uint8_t add_WindOpRollup(WindOpRollup * rollup, const char * device, int64_t time,
+                         const WindOpDataPacket_t3 * reading, uint8_t channels);
+
+// Unpack a packet of any type and add its readings. Returns a WINDOP_* code
+uint8_t addPacket_WindOpRollup(WindOpRollup * rollup, const char * device, const uint8_t * packet,
+                               uint32_t length);
+
+/*
+ * Statistics of the buckets of device at level with start in [from, to),
+ * oldest first, up to max. Returns the number written, 0 for an unknown
+ * device.
+ */
+uint32_t read_WindOpRollup(const WindOpRollup * rollup, const char * device, uint8_t level, int64_t from,
+                           int64_t to, WindOpRollupStats * out, uint32_t max);
+
+/*
+ * Snapshot the whole state so a restart can restore it rather than replay
+ * the history. The file is the magic, a WindOpRollupFileHeader, then per
+ * device its name and each level's non empty buckets as a count and the
+ * structs in memory order, so it only reads back on the same byte order.
+ */
+typedef struct WindOpRollupFileHeader {
+    uint32_t numDevices;
+    uint32_t bucketSize;      // sizeof(WindOpRollupBucket), a layout check
+    uint64_t readings;
+    uint64_t late;
+} WindOpRollupFileHeader;
+
+uint8_t save_WindOpRollup(const WindOpRollup * rollup, FILE * out);
+uint8_t restore_WindOpRollup(WindOpRollup * rollup, FILE * in);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_ROLLUP_H
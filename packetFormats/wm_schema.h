@@ -0,0 +1,142 @@
+/*
+ ============================================================================
+ Name        : wm_schema.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Single packet schema, the codecs are generated from it
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_SCHEMA_H
+#define WM_SCHEMA_H
+
+#include <stdint.h>
+
+/* ****************************************************************************
+ *
+ * The one description of every reading layout. Each type lists its fields
+ * in packet order as
+ *
+ *     F(X, name, channel, bytes, signed, scale)
+ *
+ * name    : WindOpDataPacket_t3 member the field maps to
+ * channel : WINDOP_CH_* column of the field
+ * bytes   : 2 or 3, little endian
+ * signed  : 1 for two's complement
+ * scale   : multiplier converting the raw value to units, as the scripts use
+ *
+ * or, for bytes that are not a channel, as
+ *
+ *     F##_TEXT(X, name, bytes)
+ *
+ * which each expansion pairs with a macro of its own name plus _TEXT. The
+ * codec steps over text fields and packs them as spaces, wm_gps.h reads
+ * the coordinates T7 carries in them.
+ *
+ * wm_codec.c expands these into unrolled pack/unpack functions per type,
+ * the type table, and the field descriptors behind wm_decode -schema.
+ *
+ * */
+#define WINDOP_SCHEMA_T3(F, X)                      \
+    F(X, ws,    WINDOP_CH_WS,    2, 0, 0.01)        \
+    F(X, wsx,   WINDOP_CH_WSX,   2, 0, 0.01)        \
+    F(X, wsm,   WINDOP_CH_WSM,   2, 0, 0.01)        \
+    F(X, wd,    WINDOP_CH_WD,    2, 0, 1.0)         \
+    F(X, tmp,   WINDOP_CH_TMP,   2, 1, 0.1)         \
+    F(X, press, WINDOP_CH_PRESS, 2, 0, 0.01)        \
+    F(X, hum,   WINDOP_CH_HUM,   2, 0, 0.01)        \
+    F(X, bv,    WINDOP_CH_BV,    2, 0, 0.001)
+
+#define WINDOP_SCHEMA_T4(F, X)                      \
+    F(X, ws,    WINDOP_CH_WS,    2, 0, 0.01)        \
+    F(X, wsx,   WINDOP_CH_WSX,   2, 0, 0.01)        \
+    F(X, wsm,   WINDOP_CH_WSM,   2, 0, 0.01)        \
+    F(X, wd,    WINDOP_CH_WD,    2, 0, 1.0)
+
+#define WINDOP_SCHEMA_T5(F, X)                      \
+    F(X, tmp,   WINDOP_CH_TMP,   2, 1, 0.1)         \
+    F(X, press, WINDOP_CH_PRESS, 2, 0, 0.01)        \
+    F(X, hum,   WINDOP_CH_HUM,   2, 0, 0.01)        \
+    F(X, bv,    WINDOP_CH_BV,    2, 0, 0.001)
+
+#define WINDOP_SCHEMA_T6(F, X)                      \
+    F(X, tmp,   WINDOP_CH_TMP,   3, 1, 0.01)        \
+    F(X, press, WINDOP_CH_PRESS, 3, 0, 0.01)        \
+    F(X, hum,   WINDOP_CH_HUM,   2, 0, 0.01)        \
+    F(X, bv,    WINDOP_CH_BV,    2, 0, 0.01)
+
+// A GPS fix, NMEA ddmm.mmmm and dddmm.mmmm with the hemisphere letter, space padded
+#define WINDOP_SCHEMA_T7(F, X)                      \
+    F##_TEXT(X, lat, 13)                            \
+    F##_TEXT(X, lon, 13)                            \
+    F(X, bv,    WINDOP_CH_BV,    2, 0, 0.001)
+
+/* ****************************************************************************
+ *
+ * Every packet type as
+ *
+ *     T(suffix, dataType, firstOffset, fields)
+ *
+ * firstOffset : seconds from the packet time to the first reading
+ *
+ * */
+#define WINDOP_SCHEMA_TYPES(T)                      \
+    T(t3, WINDOPDATAPACKET_T3_TYPE, 60, WINDOP_SCHEMA_T3)        \
+    T(t4, WINDOPDATAPACKET_T4_TYPE, 60, WINDOP_SCHEMA_T4)        \
+    T(t5, WINDOPDATAPACKET_T5_TYPE,  0, WINDOP_SCHEMA_T5)        \
+    T(t6, WINDOPDATAPACKET_T6_TYPE,  0, WINDOP_SCHEMA_T6)        \
+    T(t7, WINDOPDATAPACKET_T7_TYPE,  0, WINDOP_SCHEMA_T7)
+
+/* ****************************************************************************
+ *
+ * Field access. bytes and isSigned are constants at every expansion so these
+ * fold down to straight loads, shifts and stores.
+ *
+ * */
+static inline int32_t read_WindOpField(const uint8_t * p, uint8_t bytes, uint8_t isSigned) {
+    int32_t value = p[0] | (p[1] << 8);
+    int32_t sign;
+
+    if (bytes == 3) {
+        value |= p[2] << 16;
+    }
+    if (isSigned) {
+        sign = 1 << (8 * bytes - 1);
+        value = (value ^ sign) - sign;
+    }
+    return value;
+}
+
+static inline void write_WindOpField(uint8_t * p, uint8_t bytes, int32_t value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    if (bytes == 3) {
+        p[2] = (value >> 16) & 0xFF;
+    }
+}
+
+#endif // WM_SCHEMA_H
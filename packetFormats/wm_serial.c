@@ -0,0 +1,826 @@
+/*
+ ============================================================================
+ Name        : wm_serial.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : RN2483 serial traffic capture and replay
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+
+// posix_openpt, grantpt, unlockpt and ptsname
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wm_codec.h"
+#include "wm_batch.h"
+#include "wm_csv.h"
+#include "wm_serlog.h"
+
+static const char * helpText =
+"\n"
+"   WindOp serial capture and replay\n"
+"\n"
+"   capture drives an RN2483 as controlTrafficCODEC.pl does, a -cmd or the\n"
+"   lines of a .seq file, and records every read and write with its time to\n"
+"   a binary log. Reads carry on through sleeps and after a command's reply,\n"
+"   so late lines such as mac_rx or radio_rx land at the time they came.\n"
+"\n"
+"   replay runs a log's received lines through the packet decoder. By\n"
+"   default the bytes are handed straight over, as fast as they decode. With\n"
+"   -pty or -speed they are written into a pseudo terminal, paced as\n"
+"   recorded, and read back from the other side as from the module, so the\n"
+"   decode latency, write to decoded, is measured under the recorded bursts.\n"
+"\n"
+"      wm_serial capture log -port dev [options]\n"
+"      wm_serial replay log [options]\n"
+"      wm_serial dump log\n"
+"\n"
+"      -port dev              : capture, serial port, eg /dev/ttyUSB0\n"
+"      -baud n                : capture, default 57600\n"
+"      -seq file              : capture, run the .seq file, see devScripts/sequences\n"
+"      -cmd string            : capture, send one command, <CR><LF> ended\n"
+"      -loop n                : capture, run the sequence n times, default 1\n"
+"      -listen s              : capture, keep recording s seconds after the\n"
+"                               commands, 0 until interrupted. Default 0\n"
+"                               without -seq or -cmd, otherwise 1\n"
+"      -timeout ms            : capture, wait for a reply line, default 1000\n"
+"      -pty                   : replay, through a pseudo terminal unpaced\n"
+"      -speed x               : replay, through a pseudo terminal at x times\n"
+"                               the recorded pace\n"
+"      -realtime              : replay, the same as -speed 1\n"
+"      -o file                : replay, write the decoded readings as CSV\n"
+"      -help                  : Prints this\n"
+"\n";
+
+#define LINE_SIZE                1024
+#define READ_SIZE                4096
+#define DEFAULT_BAUD             57600
+#define DEFAULT_TIMEOUT_MS       1000
+
+typedef struct serialCfg {
+    const char * command;
+    const char * logFile;
+    const char * port;
+    const char * seqFile;
+    const char * cmd;
+    const char * outFile;
+    uint32_t baud;
+    uint32_t loop;
+    double listen;            // Seconds, negative when not given
+    uint32_t timeoutMs;
+    double speed;             // 0 unpaced
+    uint8_t pty;
+} serialCfg;
+
+static volatile sig_atomic_t stopping;
+
+static void onSignal(int sig) {
+    (void) sig;
+    stopping = 1;
+}
+
+static void usageError(const char * message) {
+    fprintf(stderr, "ERROR %s\n%s", message, helpText);
+    exit(EXIT_FAILURE);
+}
+
+static void outOfMemory(void) {
+    fprintf(stderr, "ERROR out of memory\n");
+    exit(EXIT_FAILURE);
+}
+
+static uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/* ****************************************************************************
+ *
+ * Received bytes to lines. The module ends lines with <CR><LF>, the <CR> is
+ * dropped. Lines longer than LINE_SIZE are counted and skipped.
+ *
+ * */
+typedef void (*lineFn)(void * context, const char * line, uint32_t length, uint64_t position);
+
+typedef struct lineBuffer {
+    char text[LINE_SIZE];
+    uint32_t length;
+    uint8_t overflow;
+    uint64_t position;        // Bytes fed so far
+    uint64_t lines;
+    uint64_t tooLong;
+} lineBuffer;
+
+static void feedLines(lineBuffer * lb, const uint8_t * data, uint32_t length, lineFn fn, void * context) {
+    const uint8_t * end = data + length;
+    const uint8_t * eol;
+    uint32_t n;
+
+    while (data < end) {
+        eol = memchr(data, '\n', (size_t) (end - data));
+        n = (uint32_t) (((eol != NULL) ? eol : end) - data);
+        if (lb->length + n > LINE_SIZE) {
+            lb->overflow = 1;
+        } else {
+            memcpy(&lb->text[lb->length], data, n);
+            lb->length += n;
+        }
+        lb->position += n;
+        data += n;
+        if (eol == NULL) {
+            break;
+        }
+        data++;
+        lb->position++;
+        if (lb->overflow) {
+            lb->tooLong++;
+        } else {
+            n = lb->length - ((lb->length != 0) && (lb->text[lb->length - 1] == '\r'));
+            lb->lines++;
+            fn(context, lb->text, n, lb->position);
+        }
+        lb->length = 0;
+        lb->overflow = 0;
+    }
+}
+
+/* ****************************************************************************
+ *
+ * capture
+ *
+ * */
+typedef struct captureCtx {
+    serialCfg * cfg;
+    int fd;
+    uint64_t start;
+    WindOpSerialLogWriter log;
+    lineBuffer lines;
+    uint64_t linesSeen;       // Complete lines read, for waiting on replies
+    uint8_t failed;
+} captureCtx;
+
+static void printTime(void) {
+    time_t now = time(NULL);
+    struct tm tm;
+    char text[32];
+
+    gmtime_r(&now, &tm);
+    strftime(text, sizeof(text), "[%d%m%Y %H%M%S]", &tm);
+    fputs(text, stdout);
+}
+
+static void onCaptureLine(void * context, const char * line, uint32_t length, uint64_t position) {
+    captureCtx * ctx = context;
+    (void) position;
+
+    ctx->linesSeen++;
+    printTime();
+    printf("IN <<<%.*s\n", (int) length, line);
+}
+
+static void record(captureCtx * ctx, uint8_t direction, const void * data, uint32_t length) {
+    if (append_WindOpSerialLog(&ctx->log, direction, nowNs() - ctx->start, data, length) != WINDOP_OK) {
+        ctx->failed = 1;
+    }
+}
+
+static speed_t baudConstant(uint32_t baud) {
+    switch (baud) {
+    case 9600:
+        return B9600;
+    case 19200:
+        return B19200;
+    case 38400:
+        return B38400;
+    case 57600:
+        return B57600;
+    case 115200:
+        return B115200;
+    case 230400:
+        return B230400;
+    default:
+        return B0;
+    }
+}
+
+// 8N1, no flow control and no line discipline, as setupSerialPort sets up
+static int openPort(const char * path, uint32_t baud) {
+    struct termios tio;
+    const speed_t speed = baudConstant(baud);
+    int fd;
+
+    if (speed == B0) {
+        usageError("-baud wants 9600, 19200, 38400, 57600, 115200 or 230400");
+    }
+    fd = open(path, O_RDWR | O_NOCTTY);
+    if ((fd < 0) || (tcgetattr(fd, &tio) != 0)) {
+        fprintf(stderr, "Can't open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        fprintf(stderr, "Can't open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+/*
+ * Record whatever the port sends until deadline, or until lines complete
+ * lines have been read in all when that is not 0. Returns 0 when interrupted.
+ */
+static uint8_t pump(captureCtx * ctx, uint64_t deadline, uint64_t lines) {
+    uint8_t data[READ_SIZE];
+    struct pollfd pfd;
+    uint64_t now;
+    ssize_t n;
+    int waitMs;
+
+    pfd.fd = ctx->fd;
+    pfd.events = POLLIN;
+    while (!stopping) {
+        now = nowNs();
+        if ((deadline != 0) && (now >= deadline)) {
+            return 1;
+        }
+        waitMs = (deadline == 0) ? 1000 : (int) ((deadline - now + 999999) / 1000000);
+        if (poll(&pfd, 1, waitMs) <= 0) {
+            continue;
+        }
+        n = read(ctx->fd, data, sizeof(data));
+        if (n < 0) {
+            if ((errno == EINTR) || (errno == EAGAIN)) {
+                continue;
+            }
+            fprintf(stderr, "ERROR reading %s\n", ctx->cfg->port);
+            return 0;
+        }
+        if (n == 0) {
+            continue;
+        }
+        record(ctx, WINDOP_SERLOG_RX, data, (uint32_t) n);
+        feedLines(&ctx->lines, data, (uint32_t) n, onCaptureLine, ctx);
+        if ((lines != 0) && (ctx->linesSeen >= lines)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static uint8_t sendCommand(captureCtx * ctx, const char * command, const char * ending) {
+    char text[LINE_SIZE];
+    uint32_t length;
+    uint32_t sent = 0;
+    ssize_t n;
+
+    length = (uint32_t) snprintf(text, sizeof(text), "%s%s", command, ending);
+    length = (length < sizeof(text)) ? length : (uint32_t) sizeof(text) - 1;
+    printTime();
+    printf("OUT>>>%s%s", text, (ending[0] == '\0') ? "\n" : "");
+    record(ctx, WINDOP_SERLOG_TX, text, length);
+    while (sent < length) {
+        n = write(ctx->fd, &text[sent], length - sent);
+        if ((n < 0) && (errno != EINTR)) {
+            fprintf(stderr, "ERROR writing %s\n", ctx->cfg->port);
+            return 0;
+        }
+        sent += (n > 0) ? (uint32_t) n : 0;
+    }
+    return pump(ctx, nowNs() + (uint64_t) ctx->cfg->timeoutMs * 1000000, ctx->linesSeen + 1);
+}
+
+/*
+ * One .seq line, as processExternalCommandsFile reads them. Every line is
+ * kept as a mark so a replay can tell which step traffic belongs to.
+ */
+static uint8_t runSequenceLine(captureCtx * ctx, char * line) {
+    uint32_t length = (uint32_t) strcspn(line, "\r\n");
+    char * type = line;
+    char * arg;
+
+    line[length] = '\0';
+    if (length == 0) {
+        return 1;
+    }
+    record(ctx, WINDOP_SERLOG_MARK, line, length);
+    arg = line + strcspn(line, " \t");
+    if ((line[0] == '#') || (*arg == '\0') || (arg == line)) {
+        printTime();
+        printf("%s\n", line);
+        return 1;
+    }
+    *arg++ = '\0';
+    arg += strspn(arg, " \t");
+
+    if (strcmp(type, "sleep") == 0) {
+        printTime();
+        printf("Sleeping for %s\n", arg);
+        return pump(ctx, nowNs() + (uint64_t) (atof(arg) * 1e9), 0);
+    } else if (strcmp(type, "sendCommandGetResp") == 0) {
+        return sendCommand(ctx, arg, "");
+    } else if (strcmp(type, "sendCommandGetResp_N") == 0) {
+        return sendCommand(ctx, arg, "\n");
+    } else if (strcmp(type, "sendCommandGetResp_RN") == 0) {
+        return sendCommand(ctx, arg, "\r\n");
+    }
+    return 1;
+}
+
+static uint8_t runSequence(captureCtx * ctx, const char * path) {
+    char line[LINE_SIZE];
+    uint8_t running = 1;
+    FILE * in;
+
+    if ((in = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    while (running && (fgets(line, sizeof(line), in) != NULL)) {
+        running = runSequenceLine(ctx, line);
+    }
+    fclose(in);
+    return running;
+}
+
+static void capture(serialCfg * cfg) {
+    captureCtx ctx;
+    struct timespec epoch;
+    struct sigaction action;
+    uint8_t running = 1;
+    uint32_t i;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.cfg = cfg;
+    if (cfg->port == NULL) {
+        usageError("capture wants -port");
+    }
+    ctx.fd = openPort(cfg->port, cfg->baud);
+
+    clock_gettime(CLOCK_REALTIME, &epoch);
+    ctx.start = nowNs();
+    if (open_WindOpSerialLogWriter(&ctx.log, cfg->logFile, (int64_t) epoch.tv_sec * 1000000000 + epoch.tv_nsec,
+                                   cfg->baud) != WINDOP_OK) {
+        fprintf(stderr, "Can't open %s\n", cfg->logFile);
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    if (cfg->cmd != NULL) {
+        running = sendCommand(&ctx, cfg->cmd, "\r\n");
+    }
+    for (i = 0; running && (cfg->seqFile != NULL) && (i < cfg->loop); i++) {
+        printTime();
+        printf("** Iteration %u\n", cfg->loop - i - 1);
+        running = runSequence(&ctx, cfg->seqFile);
+    }
+    if (cfg->listen < 0) {
+        cfg->listen = ((cfg->cmd != NULL) || (cfg->seqFile != NULL)) ? 1 : 0;
+    }
+    if (running) {
+        pump(&ctx, (cfg->listen > 0) ? nowNs() + (uint64_t) (cfg->listen * 1e9) : 0, 0);
+    }
+    close(ctx.fd);
+
+    fflush(stdout);
+    if ((close_WindOpSerialLogWriter(&ctx.log) != WINDOP_OK) || ctx.failed) {
+        fprintf(stderr, "ERROR writing %s\n", cfg->logFile);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "---Captured %lu records, %lu bytes, %lu lines in %.3f s\n", (unsigned long) ctx.log.records,
+            (unsigned long) ctx.log.bytes, (unsigned long) ctx.lines.lines, (nowNs() - ctx.start) / 1e9);
+}
+
+/* ****************************************************************************
+ *
+ * replay
+ *
+ * The RX records are indexed up front, each with the input position it
+ * ends at. Through the pseudo terminal a writer thread sends them at their
+ * recorded offsets, noting when each went, and the decoder reads the other
+ * side. A line's latency runs from the write of the record holding its
+ * last byte to the end of its decode.
+ *
+ * */
+typedef struct rxRecord {
+    const uint8_t * data;
+    uint32_t length;
+    uint64_t time;            // Recorded, ns
+    uint64_t end;             // Input position after the record
+    atomic_uint_fast64_t sent; // When the writer sent it, ns
+} rxRecord;
+
+typedef struct replayCtx {
+    serialCfg * cfg;
+    rxRecord * records;
+    uint32_t numRecords;
+    uint32_t next;            // First record the decoder has not finished
+    uint64_t totalBytes;
+    uint64_t logRecords;      // Of every direction
+    int master;
+    int slave;
+
+    lineBuffer lines;
+    WindOpColumns cols;
+    uint64_t packets;
+    uint64_t failed;
+    uint64_t otherLines;
+    uint64_t decodeNs;
+    uint32_t * latency;       // Per packet, ns
+    uint64_t * lineTime;      // Recorded time per packet, for the burst rate
+    uint32_t numLatency;
+    uint32_t latencyCapacity;
+} replayCtx;
+
+static uint8_t indexRecords(replayCtx * ctx, WindOpSerialLogReader * reader) {
+    WindOpSerialRecord rec;
+    const uint8_t * data;
+    rxRecord * grown;
+    uint32_t capacity = 0;
+    uint8_t status;
+
+    while ((status = next_WindOpSerialLog(reader, &rec, &data)) == WINDOP_OK) {
+        ctx->logRecords++;
+        if ((rec.direction != WINDOP_SERLOG_RX) || (rec.length == 0)) {
+            continue;
+        }
+        if (ctx->numRecords == capacity) {
+            capacity = capacity ? 2 * capacity : 1024;
+            if ((grown = realloc(ctx->records, capacity * sizeof(rxRecord))) == NULL) {
+                outOfMemory();
+            }
+            ctx->records = grown;
+        }
+        ctx->totalBytes += rec.length;
+        ctx->records[ctx->numRecords].data = data;
+        ctx->records[ctx->numRecords].length = rec.length;
+        ctx->records[ctx->numRecords].time = rec.time;
+        ctx->records[ctx->numRecords].end = ctx->totalBytes;
+        atomic_init(&ctx->records[ctx->numRecords].sent, 0);
+        ctx->numRecords++;
+    }
+    return (status == WINDOP_ERR_SHORT) ? WINDOP_OK : status;
+}
+
+static void onReplayLine(void * context, const char * line, uint32_t length, uint64_t position) {
+    replayCtx * ctx = context;
+    uint8_t packet[WINDOP_MAX_PACKET_LENGTH];
+    const rxRecord * rec;
+    uint64_t start = nowNs();
+    uint64_t done;
+    uint32_t * grown;
+    uint64_t * grownTime;
+    int32_t n;
+
+    while (ctx->records[ctx->next].end < position) {
+        ctx->next++;
+    }
+    rec = &ctx->records[ctx->next];
+
+    n = parseRx_WindOpRn2483(line, length, packet, sizeof(packet));
+    if (n < 0) {
+        ctx->otherLines++;
+        return;
+    }
+    if (ctx->cfg->outFile == NULL) {
+        ctx->cols.numRows = 0;
+    }
+    if (reserve_WindOpColumns(&ctx->cols, maxReadings_WindOpPacket(packet, (uint32_t) n)) != WINDOP_OK) {
+        outOfMemory();
+    }
+    if (decode_WindOpPacketColumns(packet, (uint32_t) n, (uint32_t) ctx->packets, &ctx->cols) != WINDOP_OK) {
+        ctx->failed++;
+    }
+    ctx->packets++;
+    done = nowNs();
+    ctx->decodeNs += done - start;
+
+    if (ctx->numLatency == ctx->latencyCapacity) {
+        ctx->latencyCapacity = ctx->latencyCapacity ? 2 * ctx->latencyCapacity : 4096;
+        grown = realloc(ctx->latency, ctx->latencyCapacity * sizeof(uint32_t));
+        grownTime = realloc(ctx->lineTime, ctx->latencyCapacity * sizeof(uint64_t));
+        if ((grown == NULL) || (grownTime == NULL)) {
+            outOfMemory();
+        }
+        ctx->latency = grown;
+        ctx->lineTime = grownTime;
+    }
+    // Straight from the log there is no write, the latency is the decode
+    if (ctx->master >= 0) {
+        start = atomic_load_explicit(&((rxRecord *) rec)->sent, memory_order_acquire);
+    }
+    done -= start;
+    ctx->latency[ctx->numLatency] = (done > UINT32_MAX) ? UINT32_MAX : (uint32_t) done;
+    ctx->lineTime[ctx->numLatency++] = rec->time;
+}
+
+static void * writerMain(void * arg) {
+    replayCtx * ctx = arg;
+    const double speed = ctx->cfg->speed;
+    const uint64_t first = ctx->numRecords ? ctx->records[0].time : 0;
+    const uint64_t base = nowNs();
+    struct timespec at;
+    rxRecord * rec;
+    uint64_t due;
+    uint32_t sent;
+    uint32_t i;
+    ssize_t n;
+
+    for (i = 0; i < ctx->numRecords; i++) {
+        rec = &ctx->records[i];
+        if (speed > 0) {
+            due = base + (uint64_t) ((double) (rec->time - first) / speed);
+            at.tv_sec = (time_t) (due / 1000000000u);
+            at.tv_nsec = (long) (due % 1000000000u);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at, NULL) == EINTR) {
+            }
+        }
+        atomic_store_explicit(&rec->sent, nowNs(), memory_order_release);
+        for (sent = 0; sent < rec->length; sent += (n > 0) ? (uint32_t) n : 0) {
+            n = write(ctx->master, &rec->data[sent], rec->length - sent);
+            if ((n < 0) && (errno != EINTR)) {
+                fprintf(stderr, "ERROR writing the pseudo terminal\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void openPty(replayCtx * ctx) {
+    struct termios tio;
+    const char * name;
+
+    ctx->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((ctx->master < 0) || (grantpt(ctx->master) != 0) || (unlockpt(ctx->master) != 0) ||
+        ((name = ptsname(ctx->master)) == NULL) || ((ctx->slave = open(name, O_RDWR | O_NOCTTY)) < 0) ||
+        (tcgetattr(ctx->slave, &tio) != 0)) {
+        fprintf(stderr, "ERROR can't open a pseudo terminal\n");
+        exit(EXIT_FAILURE);
+    }
+    // Bytes as sent, no echo or <CR> mapping
+    cfmakeraw(&tio);
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(ctx->slave, TCSANOW, &tio);
+}
+
+static int compareLatency(const void * a, const void * b) {
+    const uint32_t la = *(const uint32_t *) a;
+    const uint32_t lb = *(const uint32_t *) b;
+    return (la > lb) - (la < lb);
+}
+
+// Most packets recorded within any one second
+static uint32_t busiestSecond(const uint64_t * times, uint32_t n) {
+    uint32_t best = 0;
+    uint32_t from = 0;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        while (times[i] - times[from] >= 1000000000u) {
+            from++;
+        }
+        best = (i - from + 1 > best) ? i - from + 1 : best;
+    }
+    return best;
+}
+
+static void replay(serialCfg * cfg) {
+    WindOpSerialLogReader reader;
+    replayCtx ctx;
+    pthread_t writer;
+    uint8_t data[READ_SIZE];
+    uint64_t received = 0;
+    uint64_t start;
+    double seconds;
+    FILE * out;
+    ssize_t n;
+    uint32_t i;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.cfg = cfg;
+    ctx.master = -1;
+    ctx.slave = -1;
+    if (open_WindOpSerialLogReader(&reader, cfg->logFile) != WINDOP_OK) {
+        fprintf(stderr, "Can't open %s as a serial log\n", cfg->logFile);
+        exit(EXIT_FAILURE);
+    }
+    if (indexRecords(&ctx, &reader) != WINDOP_OK) {
+        fprintf(stderr, "ERROR %s is damaged after %lu records, replaying those\n", cfg->logFile,
+                (unsigned long) ctx.logRecords);
+    }
+    if (init_WindOpColumns(&ctx.cols, 256) != WINDOP_OK) {
+        outOfMemory();
+    }
+
+    start = nowNs();
+    if (cfg->pty || (cfg->speed > 0)) {
+        openPty(&ctx);
+        if (pthread_create(&writer, NULL, writerMain, &ctx) != 0) {
+            fprintf(stderr, "ERROR can't start the writer\n");
+            exit(EXIT_FAILURE);
+        }
+        while (received < ctx.totalBytes) {
+            n = read(ctx.slave, data, sizeof(data));
+            if (n <= 0) {
+                if ((n < 0) && (errno == EINTR)) {
+                    continue;
+                }
+                fprintf(stderr, "ERROR reading the pseudo terminal\n");
+                exit(EXIT_FAILURE);
+            }
+            received += (uint64_t) n;
+            feedLines(&ctx.lines, data, (uint32_t) n, onReplayLine, &ctx);
+        }
+        pthread_join(writer, NULL);
+        close(ctx.slave);
+        close(ctx.master);
+    } else {
+        for (i = 0; i < ctx.numRecords; i++) {
+            feedLines(&ctx.lines, ctx.records[i].data, ctx.records[i].length, onReplayLine, &ctx);
+        }
+        received = ctx.totalBytes;
+    }
+    seconds = (nowNs() - start) / 1e9;
+
+    fprintf(stderr, "---Replayed %lu records, %lu bytes, %lu lines in %.3f s%s\n", (unsigned long) ctx.logRecords,
+            (unsigned long) received, (unsigned long) ctx.lines.lines, seconds,
+            (ctx.master >= 0) ? " through a pseudo terminal" : "");
+    fprintf(stderr, "Decoded %lu packets, %lu failed, %lu other lines, %lu too long, %.0f packets/s, "
+            "%.0f ns a decode\n", (unsigned long) ctx.packets, (unsigned long) ctx.failed,
+            (unsigned long) ctx.otherLines, (unsigned long) ctx.lines.tooLong,
+            (seconds > 0) ? ctx.packets / seconds : 0.0, ctx.packets ? (double) ctx.decodeNs / ctx.packets : 0.0);
+    if (ctx.numLatency != 0) {
+        fprintf(stderr, "Busiest recorded second %u packets\n", busiestSecond(ctx.lineTime, ctx.numLatency));
+        qsort(ctx.latency, ctx.numLatency, sizeof(uint32_t), compareLatency);
+        fprintf(stderr, "Latency us p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+                ctx.latency[ctx.numLatency / 2] / 1e3, ctx.latency[(uint64_t) ctx.numLatency * 9 / 10] / 1e3,
+                ctx.latency[(uint64_t) ctx.numLatency * 99 / 100] / 1e3,
+                ctx.latency[(uint64_t) ctx.numLatency * 999 / 1000] / 1e3, ctx.latency[ctx.numLatency - 1] / 1e3);
+    }
+
+    if (cfg->outFile != NULL) {
+        if ((out = fopen(cfg->outFile, "w")) == NULL) {
+            fprintf(stderr, "Can't open %s\n", cfg->outFile);
+            exit(EXIT_FAILURE);
+        }
+        if (writeColumns_WindOpCsv(out, &ctx.cols) != WINDOP_OK) {
+            outOfMemory();
+        }
+        fclose(out);
+    }
+    free_WindOpColumns(&ctx.cols);
+    free(ctx.records);
+    free(ctx.latency);
+    free(ctx.lineTime);
+    close_WindOpSerialLogReader(&reader);
+}
+
+/* ****************************************************************************
+ *
+ * dump, one record a line, unprintable bytes as \r, \n or \xHH
+ *
+ * */
+static void dump(serialCfg * cfg) {
+    static const char * directions[] = { "IN <<<", "OUT>>>", "SEQ   " };
+    WindOpSerialLogReader reader;
+    WindOpSerialRecord rec;
+    const uint8_t * data;
+    uint8_t status;
+    uint32_t i;
+
+    if (open_WindOpSerialLogReader(&reader, cfg->logFile) != WINDOP_OK) {
+        fprintf(stderr, "Can't open %s as a serial log\n", cfg->logFile);
+        exit(EXIT_FAILURE);
+    }
+    printf("# start %.3f, baud %u\n", reader.header->startNs / 1e9, reader.header->baud);
+    while ((status = next_WindOpSerialLog(&reader, &rec, &data)) == WINDOP_OK) {
+        printf("%12.6f %s", rec.time / 1e9, directions[rec.direction]);
+        for (i = 0; i < rec.length; i++) {
+            if (data[i] == '\r') {
+                fputs("\\r", stdout);
+            } else if (data[i] == '\n') {
+                fputs("\\n", stdout);
+            } else if ((data[i] < ' ') || (data[i] > '~') || (data[i] == '\\')) {
+                printf("\\x%02X", data[i]);
+            } else {
+                putchar(data[i]);
+            }
+        }
+        putchar('\n');
+    }
+    if (status != WINDOP_ERR_SHORT) {
+        fprintf(stderr, "ERROR %s is damaged at byte %lu\n", cfg->logFile, (unsigned long) reader.offset);
+    }
+    close_WindOpSerialLogReader(&reader);
+}
+
+static void processCommandLine(int argc, char ** argv, serialCfg * cfg) {
+    int i;
+    for (i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-port") == 0) && (i + 1 < argc)) {
+            cfg->port = argv[++i];
+        } else if ((strcmp(argv[i], "-baud") == 0) && (i + 1 < argc)) {
+            cfg->baud = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if ((strcmp(argv[i], "-seq") == 0) && (i + 1 < argc)) {
+            cfg->seqFile = argv[++i];
+        } else if ((strcmp(argv[i], "-cmd") == 0) && (i + 1 < argc)) {
+            cfg->cmd = argv[++i];
+        } else if ((strcmp(argv[i], "-loop") == 0) && (i + 1 < argc)) {
+            cfg->loop = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if ((strcmp(argv[i], "-listen") == 0) && (i + 1 < argc)) {
+            cfg->listen = atof(argv[++i]);
+        } else if ((strcmp(argv[i], "-timeout") == 0) && (i + 1 < argc)) {
+            cfg->timeoutMs = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-pty") == 0) {
+            cfg->pty = 1;
+        } else if ((strcmp(argv[i], "-speed") == 0) && (i + 1 < argc)) {
+            cfg->speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-realtime") == 0) {
+            cfg->speed = 1;
+        } else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+            cfg->outFile = argv[++i];
+        } else if ((strcmp(argv[i], "-help") == 0) || (argv[i][0] == '-')) {
+            printf("%s", helpText);
+            exit(EXIT_SUCCESS);
+        } else if (cfg->command == NULL) {
+            cfg->command = argv[i];
+        } else {
+            cfg->logFile = argv[i];
+        }
+    }
+    if ((cfg->command == NULL) || (cfg->logFile == NULL)) {
+        usageError("a command and a log are needed");
+    }
+}
+
+int main(int argc, char ** argv) {
+    serialCfg cfg;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.baud = DEFAULT_BAUD;
+    cfg.loop = 1;
+    cfg.listen = -1;
+    cfg.timeoutMs = DEFAULT_TIMEOUT_MS;
+    processCommandLine(argc, argv, &cfg);
+
+    if (strcmp(cfg.command, "capture") == 0) {
+        capture(&cfg);
+    } else if (strcmp(cfg.command, "replay") == 0) {
+        replay(&cfg);
+    } else if (strcmp(cfg.command, "dump") == 0) {
+        dump(&cfg);
+    } else {
+        usageError("unknown command");
+    }
+    return EXIT_SUCCESS;
+}
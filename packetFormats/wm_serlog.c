@@ -0,0 +1,192 @@
+/*
+ ============================================================================
+ Name        : wm_serlog.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Timestamped serial traffic log
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "wm_base64.h"
+#include "wm_serlog.h"
+
+#define MAGIC_SIZE               8
+
+/* ****************************************************************************
+ *
+ * Writer
+ *
+ * */
+uint8_t open_WindOpSerialLogWriter(WindOpSerialLogWriter * writer, const char * path, int64_t startNs,
+                                   uint32_t baud) {
+    WindOpSerialLogHeader header;
+
+    memset(writer, 0, sizeof(*writer));
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WINDOP_SERLOG_MAGIC, MAGIC_SIZE);
+    header.startNs = startNs;
+    header.baud = baud;
+
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        return WINDOP_ERR_FORMAT;
+    }
+    if (fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+        fclose(writer->file);
+        writer->file = NULL;
+        return WINDOP_ERR_FORMAT;
+    }
+    return WINDOP_OK;
+}
+
+uint8_t append_WindOpSerialLog(WindOpSerialLogWriter * writer, uint8_t direction, uint64_t time,
+                               const void * data, uint32_t length) {
+    WindOpSerialRecord record;
+
+    if ((length > WINDOP_SERLOG_MAX_RECORD) || (direction > WINDOP_SERLOG_MARK)) {
+        return WINDOP_ERR_LENGTH;
+    }
+    memset(&record, 0, sizeof(record));
+    record.time = time;
+    record.length = length;
+    record.direction = direction;
+    if ((fwrite(&record, sizeof(record), 1, writer->file) != 1) ||
+        ((length != 0) && (fwrite(data, length, 1, writer->file) != 1))) {
+        return WINDOP_ERR_FORMAT;
+    }
+    writer->records++;
+    writer->bytes += length;
+    return WINDOP_OK;
+}
+
+uint8_t close_WindOpSerialLogWriter(WindOpSerialLogWriter * writer) {
+    uint8_t result = ferror(writer->file) ? WINDOP_ERR_FORMAT : WINDOP_OK;
+
+    if (fclose(writer->file) != 0) {
+        result = WINDOP_ERR_FORMAT;
+    }
+    writer->file = NULL;
+    return result;
+}
+
+/* ****************************************************************************
+ *
+ * Reader
+ *
+ * */
+uint8_t open_WindOpSerialLogReader(WindOpSerialLogReader * reader, const char * path) {
+    struct stat st;
+    int fd;
+
+    memset(reader, 0, sizeof(*reader));
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return WINDOP_ERR_FORMAT;
+    }
+    if ((fstat(fd, &st) != 0) || ((size_t) st.st_size < sizeof(WindOpSerialLogHeader))) {
+        close(fd);
+        return WINDOP_ERR_FORMAT;
+    }
+    reader->size = (size_t) st.st_size;
+    reader->map = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (reader->map == MAP_FAILED) {
+        memset(reader, 0, sizeof(*reader));
+        return WINDOP_ERR_MEMORY;
+    }
+    reader->header = (const WindOpSerialLogHeader *) reader->map;
+    if (memcmp(reader->header->magic, WINDOP_SERLOG_MAGIC, MAGIC_SIZE) != 0) {
+        close_WindOpSerialLogReader(reader);
+        return WINDOP_ERR_FORMAT;
+    }
+    reader->offset = sizeof(WindOpSerialLogHeader);
+    return WINDOP_OK;
+}
+
+void close_WindOpSerialLogReader(WindOpSerialLogReader * reader) {
+    if (reader->map != NULL) {
+        munmap((void *) reader->map, reader->size);
+    }
+    memset(reader, 0, sizeof(*reader));
+}
+
+uint8_t next_WindOpSerialLog(WindOpSerialLogReader * reader, WindOpSerialRecord * record, const uint8_t ** data) {
+    if (reader->size - reader->offset < sizeof(WindOpSerialRecord)) {
+        return WINDOP_ERR_SHORT;
+    }
+    memcpy(record, &reader->map[reader->offset], sizeof(*record));
+    if ((record->length > WINDOP_SERLOG_MAX_RECORD) || (record->direction > WINDOP_SERLOG_MARK)) {
+        return WINDOP_ERR_FORMAT;
+    }
+    if (reader->size - reader->offset - sizeof(WindOpSerialRecord) < record->length) {
+        return WINDOP_ERR_SHORT;
+    }
+    *data = &reader->map[reader->offset + sizeof(WindOpSerialRecord)];
+    reader->offset += sizeof(WindOpSerialRecord) + record->length;
+    return WINDOP_OK;
+}
+
+/* ****************************************************************************
+ *
+ * RN2483 receive lines
+ *
+ * */
+int32_t parseRx_WindOpRn2483(const char * line, uint32_t length, uint8_t * packet, uint32_t capacity) {
+    const char * end = line + length;
+    const char * p;
+
+    if ((length > 9) && (memcmp(line, "radio_rx ", 9) == 0)) {
+        p = line + 9;
+    } else if ((length > 7) && (memcmp(line, "mac_rx ", 7) == 0)) {
+        // The port, 1 to 223, then the payload
+        for (p = line + 7; (p < end) && (*p >= '0') && (*p <= '9'); p++) {
+        }
+        if ((p == line + 7) || (p == end) || (*p != ' ')) {
+            return -1;
+        }
+    } else {
+        return -1;
+    }
+    while ((p < end) && (*p == ' ')) {
+        p++;
+    }
+    while ((end > p) && (end[-1] == ' ')) {
+        end--;
+    }
+    if (p == end) {
+        return -1;
+    }
+    return decode_WindOpHex(p, (uint32_t) (end - p), packet, capacity);
+}
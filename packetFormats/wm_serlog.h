@@ -0,0 +1,131 @@
+/*
+ ============================================================================
+ Name        : wm_serlog.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Timestamped serial traffic log
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+
+#ifndef WM_SERLOG_H
+#define WM_SERLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wm_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WINDOP_SERLOG_MAGIC      "WMSER001"
+#define WINDOP_SERLOG_MAX_RECORD 65536
+
+#define WINDOP_SERLOG_RX         0 // Bytes read from the module
+#define WINDOP_SERLOG_TX         1 // Bytes written to it
+#define WINDOP_SERLOG_MARK       2 // A sequence file line, comment or sleep, as text
+
+/* ****************************************************************************
+ *
+ * Serial log layout. Integers are little endian, the structs are written as
+ * they sit in memory.
+ *
+ *   header     WindOpSerialLogHeader
+ *   records    WindOpSerialRecord then length bytes, back to back
+ *
+ * Records are appended as traffic happens and there are no tables, so a
+ * capture cut short by a signal or a full disk still reads up to its last
+ * whole record. RX records hold what each read returned, so lines may
+ * straddle records as they straddled reads.
+ *
+ * */
+typedef struct WindOpSerialLogHeader {
+    char magic[8];
+    int64_t startNs;          // Epoch nanoseconds UTC of time 0
+    uint32_t baud;            // 0 when not a real port
+    uint32_t reserved;
+} WindOpSerialLogHeader;
+
+typedef struct WindOpSerialRecord {
+    uint64_t time;            // Nanoseconds since startNs
+    uint32_t length;
+    uint8_t direction;        // WINDOP_SERLOG_*
+    uint8_t reserved[3];
+} WindOpSerialRecord;
+
+typedef struct WindOpSerialLogWriter {
+    FILE * file;
+    uint64_t records;
+    uint64_t bytes;
+} WindOpSerialLogWriter;
+
+// Returns a WINDOP_* code
+uint8_t open_WindOpSerialLogWriter(WindOpSerialLogWriter * writer, const char * path, int64_t startNs,
+                                   uint32_t baud);
+uint8_t append_WindOpSerialLog(WindOpSerialLogWriter * writer, uint8_t direction, uint64_t time,
+                               const void * data, uint32_t length);
+uint8_t close_WindOpSerialLogWriter(WindOpSerialLogWriter * writer);
+
+/* ****************************************************************************
+ *
+ * Reader over the mmapped file, records walked in place
+ *
+ * */
+typedef struct WindOpSerialLogReader {
+    const uint8_t * map;
+    size_t size;
+    const WindOpSerialLogHeader * header;
+    size_t offset;            // Of the next record
+} WindOpSerialLogReader;
+
+uint8_t open_WindOpSerialLogReader(WindOpSerialLogReader * reader, const char * path);
+void close_WindOpSerialLogReader(WindOpSerialLogReader * reader);
+
+/*
+ * The next record and its bytes. Returns WINDOP_OK, WINDOP_ERR_SHORT at
+ * the end of the log, or at a record cut short, and WINDOP_ERR_FORMAT for
+ * a record that can't be one.
+ */
+uint8_t next_WindOpSerialLog(WindOpSerialLogReader * reader, WindOpSerialRecord * record, const uint8_t ** data);
+
+/* ****************************************************************************
+ *
+ * RN2483 receive lines, "mac_rx <port> <hex>" in LoRaWAN mode and
+ * "radio_rx  <hex>" in radio mode, the line ending already stripped. Writes
+ * the payload to packet and returns its length, or -1 for any other line.
+ *
+ * */
+int32_t parseRx_WindOpRn2483(const char * line, uint32_t length, uint8_t * packet, uint32_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_SERLOG_H
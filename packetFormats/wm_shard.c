@@ -0,0 +1,742 @@
+/*
+ ============================================================================
+ Name        : wm_shard.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Fleet decode sharded by device over a thread per shard
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wm_codec.h"
+#include "wm_base64.h"
+#include "wm_batch.h"
+#include "wm_csv.h"
+#include "wm_dedup.h"
+#include "wm_json.h"
+#include "wm_queue.h"
+#include "wm_tindex.h"
+
+static const char * helpText =
+"\n"
+"   WindOp sharded fleet decoder\n"
+"\n"
+"   Decodes a whole application's TTN storage dumps, or the devices picked\n"
+"   out of them, in one run rather than a fetch per -selectDevice. Uplinks\n"
+"   are dealt to shards by a hash of the device id, each shard a thread of\n"
+"   its own with its own dedup set, decoded columns and output files, so a\n"
+"   device is only ever touched by one thread and no locks are shared.\n"
+"   Each device's uplinks are decoded in input order, the outputs are those\n"
+"   of wm_ttn -sel device.\n"
+"\n"
+"      wm_shard [options] dump.json ... : Reads stdin when no file is given\n"
+"\n"
+"      -threads n             : Shards, default one per CPU\n"
+"      -sel dev,dev,...       : Only decode these devices\n"
+"      -devices file          : Only decode the devices listed, one a line\n"
+"      -dir path              : Write each device's CSV as path/device.csv,\n"
+"                               characters other than letters, digits, - and\n"
+"                               _ become _, two ids that then share a name are\n"
+"                               an error\n"
+"      -index file            : Write one minute index of every device, for\n"
+"                               wm_query scan\n"
+"      -dedup n               : Duplicate window per shard, default 262144\n"
+"                               split over the shards\n"
+"      -keepdup               : Keep duplicate uplinks\n"
+"      -help                  : Prints this\n"
+"\n";
+
+#define MAX_FILES                64
+#define MAX_SHARDS               64
+#define DEFAULT_DEDUP            262144
+#define MIN_SHARD_DEDUP          16384
+#define BATCH_UPLINKS            256
+#define BATCH_TEXT               (BATCH_UPLINKS * 128)
+#define UPLINK_TEXT              (WINDOP_JSON_DEVICE_SIZE + WINDOP_JSON_RAW_SIZE)
+#define BATCHES_PER_SHARD        8 // In flight, bounds memory
+
+/* ****************************************************************************
+ *
+ * The reader packs uplinks for a shard into a batch, device and raw text
+ * back to back, and hands it over on the shard's queue. The shard hands
+ * it back empty on a second queue, so batches are allocated once.
+ *
+ * */
+typedef struct shardBatch {
+    uint32_t count;
+    uint32_t textBytes;
+    uint64_t hash[BATCH_UPLINKS];     // Of the device id
+    uint32_t device[BATCH_UPLINKS];   // Text offsets, NUL terminated
+    uint32_t raw[BATCH_UPLINKS];
+    uint16_t rawLength[BATCH_UPLINKS];
+    char text[BATCH_TEXT];
+} shardBatch;
+
+typedef struct shardDevice {
+    char name[WINDOP_JSON_DEVICE_SIZE];
+    uint64_t hash;
+    WindOpColumns cols;
+    uint64_t packets;
+} shardDevice;
+
+typedef struct shardCfg {
+    const char * files[MAX_FILES];
+    uint32_t numFiles;
+    const char * selected;
+    const char * devicesFile;
+    const char * dir;
+    const char * index;
+    uint32_t threads;
+    uint32_t dedup;           // 0 keeps duplicates
+} shardCfg;
+
+typedef struct shard {
+    uint32_t index;
+    pthread_t thread;
+    const shardCfg * cfg;
+    atomic_int * readDone;
+    WindOpQueue full;         // Reader to shard
+    WindOpQueue empty;        // And back
+    shardBatch * pending;     // Being filled by the reader
+    shardBatch * batches;
+
+    // Shard thread only from here on
+    WindOpDedup dedup;
+    shardDevice * devices;
+    uint32_t numDevices;
+    uint32_t deviceCapacity;
+    uint32_t * table;         // Device index + 1 by hash, 0 for free
+    uint32_t tableMask;
+    char indexPart[PATH_MAX];
+    uint64_t uplinks;
+    uint64_t packets;
+    uint64_t badRaw;
+    uint64_t failed;
+    uint64_t rows;
+    uint64_t busyNs;
+    uint8_t status;
+} shard;
+
+static uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void outOfMemory(void) {
+    fprintf(stderr, "ERROR out of memory\n");
+    exit(EXIT_FAILURE);
+}
+
+// Device ids come off the air, anything but letters, digits, - and _ becomes _ in a file name
+static inline char fileChar(char c) {
+    return ((((c | 0x20) >= 'a') && ((c | 0x20) <= 'z')) || ((c >= '0') && (c <= '9')) || (c == '-') || (c == '_'))
+               ? c
+               : '_';
+}
+
+/*
+ * FNV-1a then a full 64 bit mix, ids often differ only in their last
+ * characters. The low bits pick the slot in a shard's table, the high the
+ * shard. Hashed in file name form, so ids that would write the same CSV
+ * land in one shard and writeOutputs sees them both.
+ */
+static inline uint64_t hashDevice(const char * device) {
+    uint64_t h = 14695981039346656037ull;
+    for (; *device; device++) {
+        h = (h ^ (uint8_t) fileChar(*device)) * 1099511628211ull;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    return h ^ (h >> 33);
+}
+
+static inline uint32_t shardOf(uint64_t hash, uint32_t numShards) {
+    return (uint32_t) (((hash >> 32) * numShards) >> 32);
+}
+
+/* ****************************************************************************
+ *
+ * Shard side
+ *
+ * */
+static shardDevice * findDevice(shard * s, const char * name, uint64_t hash) {
+    shardDevice * dev;
+    uint32_t * table;
+    uint32_t slot;
+    uint32_t i;
+
+    for (slot = (uint32_t) hash & s->tableMask; s->table[slot] != 0; slot = (slot + 1) & s->tableMask) {
+        dev = &s->devices[s->table[slot] - 1];
+        if ((dev->hash == hash) && (strcmp(dev->name, name) == 0)) {
+            return dev;
+        }
+    }
+
+    if (s->numDevices == s->deviceCapacity) {
+        s->deviceCapacity *= 2;
+        if ((dev = realloc(s->devices, s->deviceCapacity * sizeof(shardDevice))) == NULL) {
+            outOfMemory();
+        }
+        s->devices = dev;
+    }
+    dev = &s->devices[s->numDevices++];
+    memset(dev, 0, sizeof(*dev));
+    strncpy(dev->name, name, sizeof(dev->name) - 1);
+    dev->hash = hash;
+    if (init_WindOpColumns(&dev->cols, 256) != WINDOP_OK) {
+        outOfMemory();
+    }
+
+    // Kept under half full, rebuilt at twice the size when it gets there
+    if (2 * s->numDevices > s->tableMask) {
+        if ((table = calloc(2 * ((size_t) s->tableMask + 1), sizeof(uint32_t))) == NULL) {
+            outOfMemory();
+        }
+        free(s->table);
+        s->table = table;
+        s->tableMask = 2 * s->tableMask + 1;
+        for (i = 0; i < s->numDevices; i++) {
+            for (slot = (uint32_t) s->devices[i].hash & s->tableMask; table[slot] != 0;
+                 slot = (slot + 1) & s->tableMask) {
+            }
+            table[slot] = i + 1;
+        }
+    } else {
+        s->table[slot] = s->numDevices;
+    }
+    return dev;
+}
+
+static void decodeBatch(shard * s, const shardBatch * batch) {
+    uint8_t packet[WINDOP_JSON_RAW_SIZE];
+    const char * name;
+    shardDevice * dev;
+    int32_t length;
+    uint32_t i;
+
+    for (i = 0; i < batch->count; i++) {
+        name = &batch->text[batch->device[i]];
+        s->uplinks++;
+        length = decode_WindOpBase64(&batch->text[batch->raw[i]], batch->rawLength[i], packet, sizeof(packet));
+        if (length < 0) {
+            s->badRaw++;
+            continue;
+        }
+        if ((s->cfg->dedup != 0) && check_WindOpDedup(&s->dedup, key_WindOpDedup(name, packet, (uint32_t) length))) {
+            continue;
+        }
+        s->packets++;
+        dev = findDevice(s, name, batch->hash[i]);
+        if (reserve_WindOpColumns(&dev->cols, maxReadings_WindOpPacket(packet, (uint32_t) length)) != WINDOP_OK) {
+            outOfMemory();
+        }
+        if (decode_WindOpPacketColumns(packet, (uint32_t) length, (uint32_t) dev->packets, &dev->cols) != WINDOP_OK) {
+            s->failed++;
+        }
+        dev->packets++;
+    }
+}
+
+static void devicePath(char * path, size_t size, const char * dir, const char * device) {
+    size_t n = (size_t) snprintf(path, size, "%s/", dir);
+
+    for (; *device && (n + 5 < size); device++) {
+        path[n++] = fileChar(*device);
+    }
+    memcpy(&path[n], ".csv", 5);
+}
+
+static int compareHashes(const void * a, const void * b) {
+    const uint64_t ha = (*(const shardDevice * const *) a)->hash;
+    const uint64_t hb = (*(const shardDevice * const *) b)->hash;
+    return (ha > hb) - (ha < hb);
+}
+
+static int sameFile(const char * a, const char * b) {
+    for (; *a && *b && (fileChar(*a) == fileChar(*b)); a++, b++) {
+    }
+    return (*a == '\0') && (*b == '\0');
+}
+
+/*
+ * Two ids that differ only where devicePath writes _, a.b and a_b, would
+ * write one CSV. They hash alike, so sorting by hash puts them side by side.
+ */
+static uint8_t checkPaths(shard * s) {
+    shardDevice ** byHash;
+    char path[PATH_MAX];
+    uint8_t status = WINDOP_OK;
+    uint32_t i;
+
+    if ((byHash = malloc(((size_t) s->numDevices + 1) * sizeof(shardDevice *))) == NULL) {
+        outOfMemory();
+    }
+    for (i = 0; i < s->numDevices; i++) {
+        byHash[i] = &s->devices[i];
+    }
+    qsort(byHash, s->numDevices, sizeof(shardDevice *), compareHashes);
+    for (i = 1; (i < s->numDevices) && (status == WINDOP_OK); i++) {
+        if ((byHash[i]->hash == byHash[i - 1]->hash) && sameFile(byHash[i]->name, byHash[i - 1]->name)) {
+            devicePath(path, sizeof(path), s->cfg->dir, byHash[i]->name);
+            fprintf(stderr, "ERROR devices %s and %s would both write %s\n", byHash[i - 1]->name, byHash[i]->name,
+                    path);
+            status = WINDOP_ERR_FORMAT;
+        }
+    }
+    free(byHash);
+    return status;
+}
+
+static uint8_t writeOutputs(shard * s) {
+    WindOpTimeIndexWriter writer;
+    char path[PATH_MAX];
+    FILE * out;
+    uint32_t i;
+    uint8_t status;
+
+    if ((s->cfg->dir != NULL) && (checkPaths(s) != WINDOP_OK)) {
+        return WINDOP_ERR_FORMAT;
+    }
+    for (i = 0; (s->cfg->dir != NULL) && (i < s->numDevices); i++) {
+        devicePath(path, sizeof(path), s->cfg->dir, s->devices[i].name);
+        if ((out = fopen(path, "w")) == NULL) {
+            fprintf(stderr, "Can't open %s\n", path);
+            return WINDOP_ERR_FORMAT;
+        }
+        if (writeColumns_WindOpCsv(out, &s->devices[i].cols) != WINDOP_OK) {
+            outOfMemory();
+        }
+        if (fclose(out) != 0) {
+            fprintf(stderr, "ERROR writing %s\n", path);
+            return WINDOP_ERR_FORMAT;
+        }
+    }
+
+    // This shard's part of the index, merged with the others once all are done
+    if (s->cfg->index != NULL) {
+        snprintf(s->indexPart, sizeof(s->indexPart), "%s.part%u", s->cfg->index, s->index);
+        if (open_WindOpTimeIndexWriter(&writer, s->indexPart) != WINDOP_OK) {
+            fprintf(stderr, "Can't open %s\n", s->indexPart);
+            return WINDOP_ERR_FORMAT;
+        }
+        for (i = 0; i < s->numDevices; i++) {
+            status = addDevice_WindOpTimeIndex(&writer, s->devices[i].name, &s->devices[i].cols);
+            if (status == WINDOP_ERR_MEMORY) {
+                outOfMemory();
+            }
+            if (status != WINDOP_OK) {
+                fprintf(stderr, "ERROR indexing %s\n", s->devices[i].name);
+                close_WindOpTimeIndexWriter(&writer);
+                return WINDOP_ERR_FORMAT;
+            }
+        }
+        if (close_WindOpTimeIndexWriter(&writer) != WINDOP_OK) {
+            fprintf(stderr, "ERROR writing %s\n", s->indexPart);
+            return WINDOP_ERR_FORMAT;
+        }
+    }
+    return WINDOP_OK;
+}
+
+static void * shardMain(void * arg) {
+    shard * s = arg;
+    uint64_t start;
+    uint32_t i;
+    void * item;
+    int done;
+
+    for (;;) {
+        // The reader pushes its last batches before setting readDone, so
+        // once it is seen set an empty queue stays empty
+        done = atomic_load_explicit(s->readDone, memory_order_acquire);
+        if (pop_WindOpQueue(&s->full, &item)) {
+            start = nowNs();
+            decodeBatch(s, item);
+            ((shardBatch *) item)->count = 0;
+            ((shardBatch *) item)->textBytes = 0;
+            push_WindOpQueue(&s->empty, item); // Never full, it holds every batch
+            s->busyNs += nowNs() - start;
+        } else if (done) {
+            break;
+        } else {
+            sched_yield();
+        }
+    }
+
+    start = nowNs();
+    s->status = writeOutputs(s);
+    for (i = 0; i < s->numDevices; i++) {
+        s->rows += s->devices[i].cols.numRows;
+    }
+    s->busyNs += nowNs() - start;
+    return NULL;
+}
+
+static void startShard(shard * s, uint32_t index, const shardCfg * cfg, atomic_int * readDone) {
+    uint32_t dedup = cfg->dedup / cfg->threads;
+    uint32_t i;
+
+    memset(s, 0, sizeof(*s));
+    s->index = index;
+    s->cfg = cfg;
+    s->readDone = readDone;
+    s->deviceCapacity = 64;
+    s->tableMask = 127;
+    s->devices = malloc(s->deviceCapacity * sizeof(shardDevice));
+    s->table = calloc((size_t) s->tableMask + 1, sizeof(uint32_t));
+    s->batches = malloc(BATCHES_PER_SHARD * sizeof(shardBatch));
+    if ((s->devices == NULL) || (s->table == NULL) || (s->batches == NULL) ||
+        (init_WindOpQueue(&s->full, BATCHES_PER_SHARD) != WINDOP_OK) ||
+        (init_WindOpQueue(&s->empty, BATCHES_PER_SHARD) != WINDOP_OK) ||
+        ((cfg->dedup != 0) && (init_WindOpDedup(&s->dedup, (dedup < MIN_SHARD_DEDUP) ? MIN_SHARD_DEDUP : dedup) !=
+                               WINDOP_OK))) {
+        outOfMemory();
+    }
+    for (i = 1; i < BATCHES_PER_SHARD; i++) {
+        s->batches[i].count = 0;
+        s->batches[i].textBytes = 0;
+        push_WindOpQueue(&s->empty, &s->batches[i]);
+    }
+    s->pending = &s->batches[0];
+    s->pending->count = 0;
+    s->pending->textBytes = 0;
+    if (pthread_create(&s->thread, NULL, shardMain, s) != 0) {
+        fprintf(stderr, "ERROR can't start shard %u\n", index);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void freeShard(shard * s) {
+    uint32_t i;
+
+    for (i = 0; i < s->numDevices; i++) {
+        free_WindOpColumns(&s->devices[i].cols);
+    }
+    free(s->devices);
+    free(s->table);
+    free(s->batches);
+    free_WindOpQueue(&s->full);
+    free_WindOpQueue(&s->empty);
+    if (s->cfg->dedup != 0) {
+        free_WindOpDedup(&s->dedup);
+    }
+}
+
+/* ****************************************************************************
+ *
+ * Reader side, on the calling thread
+ *
+ * */
+typedef struct shardCtx {
+    shardCfg * cfg;
+    shard * shards;
+    uint32_t numShards;
+    atomic_int readDone;
+    char ** selected;         // Sorted, NULL for every device
+    uint32_t numSelected;
+    uint64_t otherDevice;
+} shardCtx;
+
+static void handOver(shard * s) {
+    void * item;
+
+    while (!push_WindOpQueue(&s->full, s->pending)) {
+        sched_yield();
+    }
+    while (!pop_WindOpQueue(&s->empty, &item)) {
+        sched_yield();
+    }
+    s->pending = item;
+}
+
+static int compareNames(const void * a, const void * b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static void onUplink(void * context, const WindOpUplink * uplink) {
+    shardCtx * ctx = context;
+    const char * device = uplink->device;
+    const size_t deviceBytes = strlen(device) + 1;
+    shardBatch * batch;
+    uint64_t hash;
+    shard * s;
+
+    if ((ctx->selected != NULL) &&
+        (bsearch(&device, ctx->selected, ctx->numSelected, sizeof(char *), compareNames) == NULL)) {
+        ctx->otherDevice++;
+        return;
+    }
+    hash = hashDevice(device);
+    s = &ctx->shards[shardOf(hash, ctx->numShards)];
+    if ((s->pending->count == BATCH_UPLINKS) || (s->pending->textBytes + UPLINK_TEXT > BATCH_TEXT)) {
+        handOver(s);
+    }
+    batch = s->pending;
+    batch->hash[batch->count] = hash;
+    batch->device[batch->count] = batch->textBytes;
+    memcpy(&batch->text[batch->textBytes], device, deviceBytes);
+    batch->textBytes += (uint32_t) deviceBytes;
+    batch->raw[batch->count] = batch->textBytes;
+    batch->rawLength[batch->count] = (uint16_t) uplink->rawLength;
+    memcpy(&batch->text[batch->textBytes], uplink->raw, uplink->rawLength);
+    batch->textBytes += uplink->rawLength;
+    batch->count++;
+}
+
+static uint8_t readDump(shardCtx * ctx, const char * path, WindOpJsonReader * total) {
+    WindOpJsonReader reader;
+    FILE * in = stdin;
+    uint8_t status;
+
+    if ((path != NULL) && ((in = fopen(path, "r")) == NULL)) {
+        fprintf(stderr, "Can't open %s\n", path);
+        return WINDOP_ERR_FORMAT;
+    }
+    if (init_WindOpJsonReader(&reader, in, NULL, 0) != WINDOP_OK) {
+        outOfMemory();
+    }
+    status = read_WindOpTtnJson(&reader, onUplink, ctx);
+    if (status != WINDOP_OK) {
+        fprintf(stderr, "ERROR %s does not parse as JSON near byte %lu\n", (path != NULL) ? path : "stdin",
+                (unsigned long) offset_WindOpJsonReader(&reader));
+    }
+    total->uplinks += reader.uplinks;
+    total->skipped += reader.skipped;
+    total->base += offset_WindOpJsonReader(&reader);
+
+    free_WindOpJsonReader(&reader);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return status;
+}
+
+/* ****************************************************************************
+ *
+ * Device selection, -sel and -devices add to the one sorted list
+ *
+ * */
+static void selectDevice(shardCtx * ctx, const char * device, size_t length) {
+    char ** grown;
+
+    if (length == 0) {
+        return;
+    }
+    if ((grown = realloc(ctx->selected, (ctx->numSelected + 1) * sizeof(char *))) == NULL) {
+        outOfMemory();
+    }
+    ctx->selected = grown;
+    if ((ctx->selected[ctx->numSelected] = strndup(device, length)) == NULL) {
+        outOfMemory();
+    }
+    ctx->numSelected++;
+}
+
+static void loadSelection(shardCtx * ctx) {
+    const char * p = ctx->cfg->selected;
+    char line[WINDOP_JSON_DEVICE_SIZE + 2];
+    size_t length;
+    FILE * in;
+
+    while ((p != NULL) && (*p != '\0')) {
+        length = strcspn(p, ",");
+        selectDevice(ctx, p, length);
+        p += length + (p[length] == ',');
+    }
+    if (ctx->cfg->devicesFile != NULL) {
+        if ((in = fopen(ctx->cfg->devicesFile, "r")) == NULL) {
+            fprintf(stderr, "Can't open %s\n", ctx->cfg->devicesFile);
+            exit(EXIT_FAILURE);
+        }
+        while (fgets(line, sizeof(line), in) != NULL) {
+            selectDevice(ctx, line, strcspn(line, " \t\r\n"));
+        }
+        fclose(in);
+    }
+    if (ctx->selected != NULL) {
+        qsort(ctx->selected, ctx->numSelected, sizeof(char *), compareNames);
+    }
+}
+
+static void processCommandLine(int argc, char ** argv, shardCfg * cfg) {
+    int i;
+    for (i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-threads") == 0) && (i + 1 < argc)) {
+            cfg->threads = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if ((strcmp(argv[i], "-sel") == 0) && (i + 1 < argc)) {
+            cfg->selected = argv[++i];
+        } else if ((strcmp(argv[i], "-devices") == 0) && (i + 1 < argc)) {
+            cfg->devicesFile = argv[++i];
+        } else if ((strcmp(argv[i], "-dir") == 0) && (i + 1 < argc)) {
+            cfg->dir = argv[++i];
+        } else if ((strcmp(argv[i], "-index") == 0) && (i + 1 < argc)) {
+            cfg->index = argv[++i];
+        } else if ((strcmp(argv[i], "-dedup") == 0) && (i + 1 < argc)) {
+            cfg->dedup = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-keepdup") == 0) {
+            cfg->dedup = 0;
+        } else if ((strcmp(argv[i], "-help") == 0) || (argv[i][0] == '-')) {
+            printf("%s", helpText);
+            exit(EXIT_SUCCESS);
+        } else if (cfg->numFiles < MAX_FILES) {
+            cfg->files[cfg->numFiles++] = argv[i];
+        }
+    }
+    if (cfg->threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        cfg->threads = (cpus > 0) ? (uint32_t) cpus : 1;
+    }
+    cfg->threads = (cfg->threads > MAX_SHARDS) ? MAX_SHARDS : cfg->threads;
+}
+
+int main(int argc, char ** argv) {
+    shardCfg cfg;
+    shardCtx ctx;
+    WindOpJsonReader total;
+    const char * parts[MAX_SHARDS];
+    uint64_t start;
+    uint64_t readNs;
+    uint64_t maxUplinks = 0;
+    uint64_t uplinks = 0;
+    uint64_t duplicates = 0;
+    uint64_t badRaw = 0;
+    uint64_t failed = 0;
+    uint64_t rows = 0;
+    uint32_t devices = 0;
+    double seconds;
+    shard * s;
+    uint32_t i;
+    int result = EXIT_SUCCESS;
+
+    memset(&cfg, 0, sizeof(cfg));
+    memset(&ctx, 0, sizeof(ctx));
+    memset(&total, 0, sizeof(total));
+    cfg.dedup = DEFAULT_DEDUP;
+    processCommandLine(argc, argv, &cfg);
+    ctx.cfg = &cfg;
+    loadSelection(&ctx);
+
+    if ((cfg.dir != NULL) && (mkdir(cfg.dir, 0777) != 0) && (access(cfg.dir, W_OK) != 0)) {
+        fprintf(stderr, "Can't open %s\n", cfg.dir);
+        return EXIT_FAILURE;
+    }
+    ctx.numShards = cfg.threads;
+    ctx.shards = malloc(ctx.numShards * sizeof(shard));
+    if (ctx.shards == NULL) {
+        outOfMemory();
+    }
+    atomic_init(&ctx.readDone, 0);
+    for (i = 0; i < ctx.numShards; i++) {
+        startShard(&ctx.shards[i], i, &cfg, &ctx.readDone);
+    }
+
+    start = nowNs();
+    if (cfg.numFiles == 0) {
+        result = (readDump(&ctx, NULL, &total) == WINDOP_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    for (i = 0; i < cfg.numFiles; i++) {
+        if (readDump(&ctx, cfg.files[i], &total) != WINDOP_OK) {
+            result = EXIT_FAILURE;
+        }
+    }
+    for (i = 0; i < ctx.numShards; i++) {
+        if (ctx.shards[i].pending->count != 0) {
+            while (!push_WindOpQueue(&ctx.shards[i].full, ctx.shards[i].pending)) {
+                sched_yield();
+            }
+        }
+    }
+    readNs = nowNs() - start;
+    atomic_store_explicit(&ctx.readDone, 1, memory_order_release);
+    for (i = 0; i < ctx.numShards; i++) {
+        pthread_join(ctx.shards[i].thread, NULL);
+    }
+
+    // One index from the shards' parts, in shard order
+    if (cfg.index != NULL) {
+        for (i = 0; i < ctx.numShards; i++) {
+            parts[i] = ctx.shards[i].indexPart;
+            result = (ctx.shards[i].status != WINDOP_OK) ? EXIT_FAILURE : result;
+        }
+        if ((result == EXIT_SUCCESS) && (merge_WindOpTimeIndex(cfg.index, parts, ctx.numShards) != WINDOP_OK)) {
+            fprintf(stderr, "ERROR writing %s\n", cfg.index);
+            result = EXIT_FAILURE;
+        }
+        for (i = 0; i < ctx.numShards; i++) {
+            if (parts[i][0] != '\0') {
+                unlink(parts[i]);
+            }
+        }
+    }
+    seconds = (double) (nowNs() - start) / 1e9;
+
+    fprintf(stderr, "---Read %lu bytes, %u uplinks, %u records skipped in %.0f ms, %lu from other devices\n",
+            (unsigned long) total.base, total.uplinks, total.skipped, readNs / 1e6, (unsigned long) ctx.otherDevice);
+    fprintf(stderr, "shard   devices     uplinks  duplicates   bad raw    failed        rows   busy ms\n");
+    for (i = 0; i < ctx.numShards; i++) {
+        s = &ctx.shards[i];
+        fprintf(stderr, "%5u %9u %11lu %11lu %9lu %9lu %11lu %9.0f\n", i, s->numDevices, (unsigned long) s->uplinks,
+                (unsigned long) s->dedup.duplicates, (unsigned long) s->badRaw, (unsigned long) s->failed,
+                (unsigned long) s->rows, s->busyNs / 1e6);
+        result = (s->status != WINDOP_OK) ? EXIT_FAILURE : result;
+        maxUplinks = (s->uplinks > maxUplinks) ? s->uplinks : maxUplinks;
+        uplinks += s->uplinks;
+        duplicates += s->dedup.duplicates;
+        badRaw += s->badRaw;
+        failed += s->failed;
+        rows += s->rows;
+        devices += s->numDevices;
+    }
+    fprintf(stderr, "  all %9u %11lu %11lu %9lu %9lu %11lu\n", devices, (unsigned long) uplinks,
+            (unsigned long) duplicates, (unsigned long) badRaw, (unsigned long) failed, (unsigned long) rows);
+    fprintf(stderr, "Decoded in %.3f s, %.0f uplinks/s, busiest shard %.2f of the mean\n", seconds,
+            (seconds > 0) ? uplinks / seconds : 0.0, uplinks ? (double) maxUplinks * ctx.numShards / uplinks : 0.0);
+
+    for (i = 0; i < ctx.numShards; i++) {
+        freeShard(&ctx.shards[i]);
+    }
+    free(ctx.shards);
+    for (i = 0; i < ctx.numSelected; i++) {
+        free(ctx.selected[i]);
+    }
+    free(ctx.selected);
+    return result;
+}
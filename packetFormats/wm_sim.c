@@ -0,0 +1,406 @@
+/*
+ ============================================================================
+ Name        : wm_sim.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Seeded fleet simulator emitting WindOp uplinks
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "wm_sim.h"
+
+/* ****************************************************************************
+ *
+ * Node state. The series live in physical units, the readings are stored
+ * in the raw units of both the T3 family (pack) and T6 (env) as they are
+ * made, so a send is only the packing.
+ *
+ * */
+typedef struct WindOpSimNode {
+    uint64_t rng;
+    uint8_t profile;
+    uint8_t incSeconds;
+    uint8_t readings;         // Per packet, cut to what the profile's types fit
+    uint8_t fill;             // Readings held
+    uint8_t target;           // Readings before the next send, short for the first to stagger nodes
+    uint8_t lag;              // Seconds after the last minute the uplink arrives
+    int64_t first;            // Epoch seconds of reading 0 of the packet being filled
+
+    int32_t windMean;         // cm/s
+    int32_t ws;
+    int32_t wd;               // degrees
+    int32_t tmpBase;          // 0.01 C
+    int32_t tmpSwing;
+    int32_t tmpDrift;
+    int32_t press;            // Pa
+    int32_t pressTarget;
+    int32_t bv;               // mV
+
+    packCtrl pack;
+    int32_t env[4][READINGS_BUFFER_SIZE]; // T6 tmp, press, hum, bv
+} WindOpSimNode;
+
+static const uint8_t profileTypes[WINDOP_SIM_PROFILES][2] = {
+    { WINDOPDATAPACKET_T3_TYPE, 0 },
+    { WINDOPDATAPACKET_T4_TYPE, WINDOPDATAPACKET_T5_TYPE },
+    { WINDOPDATAPACKET_T4_TYPE, WINDOPDATAPACKET_T6_TYPE },
+    { WINDOPDATAPACKET_T6_TYPE, 0 },
+};
+
+/* ****************************************************************************
+ * Random numbers, xorshift64* per node so node series do not depend on the
+ * number of nodes, seeded through splitmix64.
+ * */
+static uint64_t splitMix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x ? x : 1;
+}
+
+static inline uint64_t nextRandom(uint64_t * state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+// 0...range-1
+static inline int32_t randomRange(uint64_t * state, uint32_t range) {
+    return (int32_t) (((nextRandom(state) >> 32) * range) >> 32);
+}
+
+// -half...half
+static inline int32_t randomSpread(uint64_t * state, int32_t half) {
+    return randomRange(state, (uint32_t) (2 * half + 1)) - half;
+}
+
+/*
+ * Day cycle, -1000 at 02:00 UTC rising to 1000 at 14:00. Two parabolas
+ * rather than a cosine, close enough for weather and no libm.
+ */
+static inline int32_t diurnal(int64_t epoch) {
+    const int32_t x = (int32_t) ((epoch / 60 + 1440 - 840 + 720) % 1440) - 720;
+    const int32_t y = (x < 0) ? x + 360 : x - 360; // -360...360 from the mid points
+    const int32_t curve = 1000 - 1000 * y * y / (360 * 360);
+    return ((x > -360) && (x < 360)) ? curve : -curve;
+}
+
+static inline int32_t clamp(int32_t v, int32_t lo, int32_t hi) {
+    return (v < lo) ? lo : ((v > hi) ? hi : v);
+}
+
+static uint8_t maxReadings(uint8_t dataType) {
+    const WindOpTypeInfo * info = info_WindOpDataType(dataType);
+    uint32_t n = (WINDOP_MAX_PACKET_LENGTH - WINDOP_PACKET_HEADER_SIZE - WINDOP_TIME_EXT_SIZE) / info->readingSize;
+    return (uint8_t) ((n < READINGS_BUFFER_SIZE) ? n : READINGS_BUFFER_SIZE);
+}
+
+static void initNode(WindOpSim * sim, WindOpSimNode * node, uint32_t index, const uint8_t * allowed,
+                     uint32_t numAllowed) {
+    const WindOpSimConfig * cfg = &sim->config;
+    uint32_t phase;
+    uint8_t limit;
+
+    memset(node, 0, sizeof(*node));
+    node->rng = splitMix(cfg->seed ^ ((uint64_t) (index + 1) * 0xD1B54A32D192ED03ull));
+    node->profile = allowed[randomRange(&node->rng, numAllowed)];
+
+    limit = maxReadings(profileTypes[node->profile][0]);
+    if (profileTypes[node->profile][1] && (maxReadings(profileTypes[node->profile][1]) < limit)) {
+        limit = maxReadings(profileTypes[node->profile][1]);
+    }
+    node->readings = (cfg->readings < limit) ? cfg->readings : limit;
+    node->target = (uint8_t) (1 + randomRange(&node->rng, node->readings));
+
+    node->incSeconds = (randomRange(&node->rng, 4) == 0);
+    phase = node->incSeconds ? (uint32_t) randomRange(&node->rng, 60) : 0;
+    node->first = sim->minute + phase;
+    node->lag = (uint8_t) (1 + randomRange(&node->rng, 20));
+
+    node->windMean = 250 + randomRange(&node->rng, 750);
+    node->ws = node->windMean;
+    node->wd = randomRange(&node->rng, 360);
+    node->tmpBase = 500 + randomRange(&node->rng, 1000);
+    node->tmpSwing = 300 + randomRange(&node->rng, 500);
+    node->press = 98500 + randomRange(&node->rng, 5000);
+    node->pressTarget = node->press;
+    node->bv = 3600 + randomRange(&node->rng, 500);
+}
+
+/*
+ * One minute of weather. Wind reverts to a mean that picks up in the
+ * afternoon, gusts bound the minute, the direction wanders with the odd
+ * shift. Temperature follows the day, humidity mirrors it, pressure drifts
+ * towards a target that moves about once a day. The battery charges in
+ * daylight and drains slowly at night.
+ */
+static void stepNode(WindOpSimNode * node, int64_t time) {
+    WindOpDataPacket_t3 * r = &node->pack.readings[node->fill];
+    const int32_t day = diurnal(time);
+    const int32_t target = node->windMean + node->windMean * day / 3000;
+    int32_t wsx;
+    int32_t wsm;
+    int32_t tmp;
+    int32_t hum;
+
+    node->ws = clamp(node->ws + (target - node->ws) / 16 + randomSpread(&node->rng, 40), 0, 6000);
+    wsx = node->ws + randomRange(&node->rng, (uint32_t) (node->ws / 3 + 50));
+    wsm = clamp(node->ws - randomRange(&node->rng, (uint32_t) (node->ws / 3 + 50)), 0, node->ws);
+
+    node->wd += randomSpread(&node->rng, 6);
+    if (randomRange(&node->rng, 200) == 0) {
+        node->wd += randomSpread(&node->rng, 60);
+    }
+    node->wd = (node->wd % 360 + 360) % 360;
+
+    node->tmpDrift += randomSpread(&node->rng, 3);
+    node->tmpDrift -= node->tmpDrift / 64;
+    tmp = node->tmpBase + node->tmpSwing * day / 1000 + node->tmpDrift;
+    hum = clamp(7500 - (tmp - node->tmpBase) * 2 + randomSpread(&node->rng, 20), 500, 10000);
+
+    if (randomRange(&node->rng, 1440) == 0) {
+        node->pressTarget = 98500 + randomRange(&node->rng, 5000);
+    }
+    node->press += (node->pressTarget - node->press) / 256 + randomSpread(&node->rng, 4);
+
+    if (day > 0) {
+        node->bv = clamp(node->bv + randomRange(&node->rng, 3), 3300, 4200);
+    } else if (randomRange(&node->rng, 4) == 0) {
+        node->bv = clamp(node->bv - 1, 3300, 4200);
+    }
+
+    r->ws = (uint16_t) node->ws;
+    r->wsx = (uint16_t) wsx;
+    r->wsm = (uint16_t) wsm;
+    r->wd = (uint16_t) node->wd;
+    r->tmp = (int16_t) (tmp / 10);
+    r->press = (uint16_t) (node->press / 10);
+    r->hum = (uint16_t) hum;
+    r->bv = (uint16_t) node->bv;
+
+    node->env[0][node->fill] = tmp;
+    node->env[1][node->fill] = node->press;
+    node->env[2][node->fill] = hum;
+    node->env[3][node->fill] = node->bv / 10;
+}
+
+/*
+ * The T3 family goes through the packCtrl codec. Its readings are 16 bit,
+ * too narrow for T6 pressure in Pa, so T6 is packed from channels.
+ */
+static uint8_t packNode(WindOpSimNode * node, uint8_t dataType, uint8_t * out) {
+    const WindOpTypeInfo * info = info_WindOpDataType(dataType);
+    int32_t * channel[WINDOP_NUM_CHANNELS] = { NULL };
+    uint32_t length = 0;
+    uint32_t r;
+
+    if (dataType != WINDOPDATAPACKET_T6_TYPE) {
+        calendar_WindOpEpoch(&node->pack.time, node->first - info->firstOffset);
+        node->pack.dataType = dataType;
+        node->pack.numOfReadings = node->fill;
+        node->pack.incSeconds = node->incSeconds;
+        if (packBounded_WindOpDataPacket(&node->pack, out, WINDOP_MAX_PACKET_LENGTH, &length) != WINDOP_OK) {
+            return 0;
+        }
+        return (uint8_t) length;
+    }
+
+    channel[WINDOP_CH_TMP] = node->env[0];
+    channel[WINDOP_CH_PRESS] = node->env[1];
+    channel[WINDOP_CH_HUM] = node->env[2];
+    channel[WINDOP_CH_BV] = node->env[3];
+    out[0] = dataType;
+    length = WINDOP_PACKET_HEADER_SIZE + pack_WindOpEpochTime(node->first, &out[2], node->incSeconds);
+    for (r = 0; r < node->fill; r++) {
+        length += pack_WindOpReadingChannels(info, channel, r, &out[length]);
+    }
+    out[1] = (uint8_t) length;
+    return (uint8_t) length;
+}
+
+/*
+ * Damage an uplink the ways a gateway sees it: a flipped bit, a short
+ * read, a bad length byte, a type nobody sends, or a time stamp with no
+ * month. A flipped bit can still leave a packet that decodes.
+ */
+static void corrupt(WindOpSim * sim, WindOpSimUplink * up) {
+    switch (randomRange(&sim->rng, 5)) {
+    case 0:
+        up->bytes[randomRange(&sim->rng, up->length)] ^= (uint8_t) (1u << randomRange(&sim->rng, 8));
+        break;
+    case 1:
+        up->length = (uint8_t) (1 + randomRange(&sim->rng, up->length - 1u));
+        break;
+    case 2:
+        up->bytes[1] = (uint8_t) (up->bytes[1] + 1 + randomRange(&sim->rng, 254));
+        break;
+    case 3:
+        up->bytes[0] = (uint8_t) (0x09 + randomRange(&sim->rng, 0xF7));
+        break;
+    default:
+        up->bytes[4] &= 0xF0;
+        break;
+    }
+    up->flags |= WINDOP_SIM_CORRUPT;
+}
+
+static void send(WindOpSim * sim, WindOpSimNode * node, uint32_t index, uint8_t dataType) {
+    const WindOpSimConfig * cfg = &sim->config;
+    WindOpSimUplink * up = &sim->queue[sim->queueCount];
+    WindOpSimUplink * dup;
+
+    up->length = packNode(node, dataType, up->bytes);
+    if (up->length == 0) {
+        return;
+    }
+    up->node = index;
+    up->time = sim->minute + 60 + node->lag;
+    up->flags = 0;
+    up->readings = node->fill;
+    sim->queueCount++;
+
+    if ((uint32_t) randomRange(&sim->rng, 1000000) < cfg->corruptPpm) {
+        corrupt(sim, up);
+    }
+    if ((uint32_t) randomRange(&sim->rng, 1000000) >= cfg->duplicatePpm) {
+        return;
+    }
+    if ((randomRange(&sim->rng, 2) == 0) && (sim->numDelayed < WINDOP_SIM_DELAYED)) {
+        dup = &sim->delayed[sim->numDelayed++];
+        *dup = *up;
+        dup->time += 60 * (1 + randomRange(&sim->rng, 10));
+    } else {
+        dup = &sim->queue[sim->queueCount++];
+        *dup = *up;
+        dup->time += 1 + randomRange(&sim->rng, 5);
+    }
+    dup->flags |= WINDOP_SIM_DUPLICATE;
+    dup->readings = 0;
+}
+
+static void fillMinute(WindOpSim * sim) {
+    const int64_t due = sim->minute + 120;
+    WindOpSimNode * node;
+    uint32_t i;
+
+    sim->queueHead = 0;
+    sim->queueCount = 0;
+    for (i = 0; i < sim->config.numNodes; i++) {
+        node = &sim->nodes[i];
+        stepNode(node, node->first + 60 * node->fill);
+        if (++node->fill < node->target) {
+            continue;
+        }
+        send(sim, node, i, profileTypes[node->profile][0]);
+        if (profileTypes[node->profile][1]) {
+            send(sim, node, i, profileTypes[node->profile][1]);
+        }
+        node->first += 60 * node->fill;
+        node->fill = 0;
+        node->target = node->readings;
+    }
+
+    // Held back duplicates whose time has come
+    for (i = 0; i < sim->numDelayed;) {
+        if (sim->delayed[i].time < due) {
+            sim->queue[sim->queueCount++] = sim->delayed[i];
+            sim->delayed[i] = sim->delayed[--sim->numDelayed];
+        } else {
+            i++;
+        }
+    }
+    sim->minute += 60;
+}
+
+uint8_t init_WindOpSim(WindOpSim * sim, const WindOpSimConfig * config) {
+    uint8_t allowed[WINDOP_SIM_PROFILES];
+    uint32_t numAllowed = 0;
+    uint32_t i;
+
+    memset(sim, 0, sizeof(*sim));
+    sim->config = *config;
+    if ((config->numNodes == 0) || (config->readings == 0) || (config->readings > READINGS_BUFFER_SIZE)) {
+        return WINDOP_ERR_FORMAT;
+    }
+    for (i = 0; i < WINDOP_SIM_PROFILES; i++) {
+        if ((config->profiles == 0) || (config->profiles & (1u << i))) {
+            allowed[numAllowed++] = (uint8_t) i;
+        }
+    }
+    if (numAllowed == 0) {
+        return WINDOP_ERR_FORMAT;
+    }
+
+    // Two types a node, each possibly repeated, plus the held back repeats
+    sim->queueCapacity = 4 * config->numNodes + WINDOP_SIM_DELAYED;
+    sim->queue = malloc(sizeof(WindOpSimUplink) * sim->queueCapacity);
+    sim->nodes = malloc(sizeof(WindOpSimNode) * config->numNodes);
+    if ((sim->queue == NULL) || (sim->nodes == NULL)) {
+        free_WindOpSim(sim);
+        return WINDOP_ERR_MEMORY;
+    }
+    sim->minute = config->start - ((config->start % 60 + 60) % 60);
+    sim->rng = splitMix(config->seed);
+    for (i = 0; i < config->numNodes; i++) {
+        initNode(sim, &sim->nodes[i], i, allowed, numAllowed);
+    }
+    return WINDOP_OK;
+}
+
+void free_WindOpSim(WindOpSim * sim) {
+    free(sim->queue);
+    free(sim->nodes);
+    sim->queue = NULL;
+    sim->nodes = NULL;
+}
+
+const WindOpSimUplink * next_WindOpSim(WindOpSim * sim) {
+    const WindOpSimUplink * up;
+
+    while (sim->queueHead == sim->queueCount) {
+        fillMinute(sim);
+    }
+    up = &sim->queue[sim->queueHead++];
+    sim->uplinks++;
+    sim->readings += up->readings;
+    sim->byType[up->bytes[0]]++;
+    sim->corrupt += up->flags & WINDOP_SIM_CORRUPT;
+    sim->duplicates += (up->flags & WINDOP_SIM_DUPLICATE) != 0;
+    return up;
+}
+
+void name_WindOpSimNode(uint32_t node, char * out) {
+    snprintf(out, WINDOP_SIM_NAME_SIZE, "sim-%06u", node);
+}
@@ -0,0 +1,137 @@
+/*
+ ============================================================================
+ Name        : wm_sim.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Seeded fleet simulator emitting WindOp uplinks
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_SIM_H
+#define WM_SIM_H
+
+#include <stdint.h>
+
+#include "wm_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ****************************************************************************
+ *
+ * Seeded fleet simulator. Each node walks a wind, temperature, pressure,
+ * humidity and battery series one reading a minute and, when it has a
+ * packet's worth, packs them with packBounded_WindOpDataPacket as the node
+ * firmware would. Nodes are spread across the profiles below and send at
+ * staggered minutes, so the stream interleaves types and devices the way a
+ * gateway sees them.
+ *
+ * The same seed and config always give the same bytes, so a capture can be
+ * thrown away and regenerated rather than kept.
+ *
+ * Raw units, as the packet fields carry them
+ *   ws, wsx, wsm  cm/s
+ *   wd            degrees
+ *   tmp           0.1 C in T3/T5, 0.01 C in T6
+ *   press         0.1 hPa in T3/T5 (16 bit), Pa in T6 (24 bit)
+ *   hum           0.01 %
+ *   bv            mV in T3/T5, 10 mV in T6
+ *
+ * */
+#define WINDOP_SIM_T3              0 // One T3 carrying every channel
+#define WINDOP_SIM_T4_T5           1 // A T4 and a T5 covering the same minutes
+#define WINDOP_SIM_T4_T6           2 // A T4 and a high resolution T6
+#define WINDOP_SIM_T6              3 // Environment only
+#define WINDOP_SIM_PROFILES        4
+
+// WindOpSimUplink flags
+#define WINDOP_SIM_CORRUPT         0x01 // Bytes damaged after packing
+#define WINDOP_SIM_DUPLICATE       0x02 // A repeat of an uplink already sent
+
+#define WINDOP_SIM_DELAYED         256  // Duplicates held back for a later minute
+#define WINDOP_SIM_NAME_SIZE       16   // sim-NNNNNN and the NUL
+
+typedef struct WindOpSimConfig {
+    uint64_t seed;
+    uint32_t numNodes;
+    int64_t start;            // Epoch seconds of the first reading, rounded down to a minute
+    uint8_t readings;         // Readings per packet, 1...READINGS_BUFFER_SIZE, cut to what fits the type
+    uint8_t profiles;         // Bit n allows WINDOP_SIM_* profile n, 0 allows all
+    uint32_t corruptPpm;      // Uplinks corrupted per million
+    uint32_t duplicatePpm;    // Uplinks repeated per million
+} WindOpSimConfig;
+
+typedef struct WindOpSimUplink {
+    uint32_t node;
+    int64_t time;             // Epoch seconds the gateway received it
+    uint8_t flags;
+    uint8_t length;
+    uint8_t readings;         // Readings packed, 0 on duplicates
+    uint8_t bytes[WINDOP_MAX_PACKET_LENGTH];
+} WindOpSimUplink;
+
+struct WindOpSimNode;
+
+typedef struct WindOpSim {
+    WindOpSimConfig config;
+    struct WindOpSimNode * nodes;
+    int64_t minute;           // Epoch seconds of the minute the queue holds
+    uint64_t rng;             // Corruption and duplicate draws
+    WindOpSimUplink * queue;
+    uint32_t queueHead;
+    uint32_t queueCount;
+    uint32_t queueCapacity;
+    WindOpSimUplink delayed[WINDOP_SIM_DELAYED];
+    uint32_t numDelayed;
+
+    // Totals so far
+    uint64_t uplinks;
+    uint64_t readings;        // Readings in the uplinks returned, duplicates not counted again
+    uint64_t corrupt;
+    uint64_t duplicates;
+    uint64_t byType[256];     // Uplinks by type byte, corrupt ones included
+} WindOpSim;
+
+uint8_t init_WindOpSim(WindOpSim * sim, const WindOpSimConfig * config);
+void free_WindOpSim(WindOpSim * sim);
+
+/*
+ * The next uplink in receive order, minute by minute. The stream does not
+ * end, callers stop on time or count. The uplink stays valid until the next
+ * call.
+ */
+const WindOpSimUplink * next_WindOpSim(WindOpSim * sim);
+
+// Device id of a node, sim-000042
+void name_WindOpSimNode(uint32_t node, char * out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_SIM_H
@@ -0,0 +1,502 @@
+/*
+ ============================================================================
+ Name        : wm_simd.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Vector de-interleave of fixed stride reading blocks
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stddef.h>
+
+#include "wm_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WINDOP_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+/* ****************************************************************************
+ *
+ * Layout of the 16 bit field types, taken from the type's schema entry. The
+ * readings are numFields little endian 16 bit words, written to channels
+ * firstChannel onwards. signedMask marks the two's complement fields
+ * (temperature).
+ *
+ * */
+typedef struct fieldLayout {
+    uint8_t numFields;
+    uint8_t firstChannel;
+    uint8_t signedMask;
+} fieldLayout;
+
+typedef void (*deinterleaveKernel)(const uint8_t * in, uint32_t n, float * const * out,
+                                   const float * scale, uint8_t signedMask);
+
+/* ****************************************************************************
+ *
+ * Scalar reference, also used for the tail of the vector kernels.
+ *
+ * */
+static void deinterleave_scalar(const uint8_t * in, uint32_t n, uint8_t numFields, float * const * out,
+                                const float * scale, uint8_t signedMask) {
+    uint32_t i;
+    uint8_t f;
+    int32_t raw;
+
+    for (i = 0; i < n; i++) {
+        for (f = 0; f < numFields; f++) {
+            raw = in[0] | (in[1] << 8);
+            if (signedMask & (1 << f)) {
+                raw = (int16_t) raw;
+            }
+            out[f][i] = (float) raw * scale[f];
+            in += 2;
+        }
+    }
+}
+
+static void deinterleave8_scalar(const uint8_t * in, uint32_t n, float * const * out,
+                                 const float * scale, uint8_t signedMask) {
+    deinterleave_scalar(in, n, 8, out, scale, signedMask);
+}
+
+static void deinterleave4_scalar(const uint8_t * in, uint32_t n, float * const * out,
+                                 const float * scale, uint8_t signedMask) {
+    deinterleave_scalar(in, n, 4, out, scale, signedMask);
+}
+
+#ifdef WINDOP_SIMD_X86
+/* ****************************************************************************
+ *
+ * SSE2. Eight readings at a time, a transpose of 8 x 16 bit words turns the
+ * records into one register per field, then widen, convert and scale.
+ *
+ * */
+static inline void store8_sse2(__m128i v, uint8_t isSigned, __m128 scale, float * dst) {
+    __m128i lo;
+    __m128i hi;
+    if (isSigned) {
+        lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    } else {
+        lo = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+        hi = _mm_unpackhi_epi16(v, _mm_setzero_si128());
+    }
+    _mm_storeu_ps(dst, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+}
+
+static void deinterleave8_sse2(const uint8_t * in, uint32_t n, float * const * out,
+                               const float * scale, uint8_t signedMask) {
+    __m128 s[8];
+    __m128i r[8];
+    __m128i t[8];
+    __m128i u[8];
+    __m128i f[8];
+    uint32_t i;
+    uint8_t k;
+
+    for (k = 0; k < 8; k++) {
+        s[k] = _mm_set1_ps(scale[k]);
+    }
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        for (k = 0; k < 8; k++) {
+            r[k] = _mm_loadu_si128((const __m128i *) (in + 16 * k));
+        }
+        // Pairs of records, fields 0-3 and 4-7
+        t[0] = _mm_unpacklo_epi16(r[0], r[1]);
+        t[1] = _mm_unpackhi_epi16(r[0], r[1]);
+        t[2] = _mm_unpacklo_epi16(r[2], r[3]);
+        t[3] = _mm_unpackhi_epi16(r[2], r[3]);
+        t[4] = _mm_unpacklo_epi16(r[4], r[5]);
+        t[5] = _mm_unpackhi_epi16(r[4], r[5]);
+        t[6] = _mm_unpacklo_epi16(r[6], r[7]);
+        t[7] = _mm_unpackhi_epi16(r[6], r[7]);
+        // Groups of four records, two fields each
+        u[0] = _mm_unpacklo_epi32(t[0], t[2]);
+        u[1] = _mm_unpackhi_epi32(t[0], t[2]);
+        u[2] = _mm_unpacklo_epi32(t[1], t[3]);
+        u[3] = _mm_unpackhi_epi32(t[1], t[3]);
+        u[4] = _mm_unpacklo_epi32(t[4], t[6]);
+        u[5] = _mm_unpackhi_epi32(t[4], t[6]);
+        u[6] = _mm_unpacklo_epi32(t[5], t[7]);
+        u[7] = _mm_unpackhi_epi32(t[5], t[7]);
+        // All eight records of one field
+        f[0] = _mm_unpacklo_epi64(u[0], u[4]);
+        f[1] = _mm_unpackhi_epi64(u[0], u[4]);
+        f[2] = _mm_unpacklo_epi64(u[1], u[5]);
+        f[3] = _mm_unpackhi_epi64(u[1], u[5]);
+        f[4] = _mm_unpacklo_epi64(u[2], u[6]);
+        f[5] = _mm_unpackhi_epi64(u[2], u[6]);
+        f[6] = _mm_unpacklo_epi64(u[3], u[7]);
+        f[7] = _mm_unpackhi_epi64(u[3], u[7]);
+
+        for (k = 0; k < 8; k++) {
+            store8_sse2(f[k], (signedMask >> k) & 1, s[k], out[k] + i);
+        }
+        in += 128;
+    }
+
+    if (i < n) {
+        float * tail[8];
+        for (k = 0; k < 8; k++) {
+            tail[k] = out[k] + i;
+        }
+        deinterleave_scalar(in, n - i, 8, tail, scale, signedMask);
+    }
+}
+
+static void deinterleave4_sse2(const uint8_t * in, uint32_t n, float * const * out,
+                               const float * scale, uint8_t signedMask) {
+    __m128 s[4];
+    __m128i r[4];
+    __m128i t[4];
+    __m128i u[4];
+    __m128i f[4];
+    uint32_t i;
+    uint8_t k;
+
+    for (k = 0; k < 4; k++) {
+        s[k] = _mm_set1_ps(scale[k]);
+    }
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        // Each load holds two records
+        for (k = 0; k < 4; k++) {
+            r[k] = _mm_loadu_si128((const __m128i *) (in + 16 * k));
+        }
+        t[0] = _mm_unpacklo_epi16(r[0], r[1]); // records 0 2
+        t[1] = _mm_unpackhi_epi16(r[0], r[1]); // records 1 3
+        t[2] = _mm_unpacklo_epi16(r[2], r[3]); // records 4 6
+        t[3] = _mm_unpackhi_epi16(r[2], r[3]); // records 5 7
+        u[0] = _mm_unpacklo_epi16(t[0], t[1]); // records 0-3, fields 0 1
+        u[1] = _mm_unpackhi_epi16(t[0], t[1]); // records 0-3, fields 2 3
+        u[2] = _mm_unpacklo_epi16(t[2], t[3]); // records 4-7, fields 0 1
+        u[3] = _mm_unpackhi_epi16(t[2], t[3]); // records 4-7, fields 2 3
+        f[0] = _mm_unpacklo_epi64(u[0], u[2]);
+        f[1] = _mm_unpackhi_epi64(u[0], u[2]);
+        f[2] = _mm_unpacklo_epi64(u[1], u[3]);
+        f[3] = _mm_unpackhi_epi64(u[1], u[3]);
+
+        for (k = 0; k < 4; k++) {
+            store8_sse2(f[k], (signedMask >> k) & 1, s[k], out[k] + i);
+        }
+        in += 64;
+    }
+
+    if (i < n) {
+        float * tail[4];
+        for (k = 0; k < 4; k++) {
+            tail[k] = out[k] + i;
+        }
+        deinterleave_scalar(in, n - i, 4, tail, scale, signedMask);
+    }
+}
+
+/* ****************************************************************************
+ *
+ * AVX2. Sixteen readings at a time. Records 0-7 go in the low lane and 8-15
+ * in the high lane so the in-lane unpacks run the SSE2 transpose on both
+ * halves at once, leaving each field register in record order.
+ *
+ * */
+__attribute__((target("avx2")))
+static inline void store16_avx2(__m256i v, uint8_t isSigned, __m256 scale, float * dst) {
+    __m256i lo;
+    __m256i hi;
+    if (isSigned) {
+        lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v));
+        hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1));
+    } else {
+        lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+        hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+    }
+    _mm256_storeu_ps(dst, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+    _mm256_storeu_ps(dst + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i loadPair_avx2(const uint8_t * lo, const uint8_t * hi) {
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) lo)),
+                                   _mm_loadu_si128((const __m128i *) hi), 1);
+}
+
+__attribute__((target("avx2")))
+static void deinterleave8_avx2(const uint8_t * in, uint32_t n, float * const * out,
+                               const float * scale, uint8_t signedMask) {
+    __m256 s[8];
+    __m256i r[8];
+    __m256i t[8];
+    __m256i u[8];
+    __m256i f[8];
+    uint32_t i;
+    uint8_t k;
+
+    for (k = 0; k < 8; k++) {
+        s[k] = _mm256_set1_ps(scale[k]);
+    }
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        for (k = 0; k < 8; k++) {
+            r[k] = loadPair_avx2(in + 16 * k, in + 16 * (k + 8));
+        }
+        t[0] = _mm256_unpacklo_epi16(r[0], r[1]);
+        t[1] = _mm256_unpackhi_epi16(r[0], r[1]);
+        t[2] = _mm256_unpacklo_epi16(r[2], r[3]);
+        t[3] = _mm256_unpackhi_epi16(r[2], r[3]);
+        t[4] = _mm256_unpacklo_epi16(r[4], r[5]);
+        t[5] = _mm256_unpackhi_epi16(r[4], r[5]);
+        t[6] = _mm256_unpacklo_epi16(r[6], r[7]);
+        t[7] = _mm256_unpackhi_epi16(r[6], r[7]);
+        u[0] = _mm256_unpacklo_epi32(t[0], t[2]);
+        u[1] = _mm256_unpackhi_epi32(t[0], t[2]);
+        u[2] = _mm256_unpacklo_epi32(t[1], t[3]);
+        u[3] = _mm256_unpackhi_epi32(t[1], t[3]);
+        u[4] = _mm256_unpacklo_epi32(t[4], t[6]);
+        u[5] = _mm256_unpackhi_epi32(t[4], t[6]);
+        u[6] = _mm256_unpacklo_epi32(t[5], t[7]);
+        u[7] = _mm256_unpackhi_epi32(t[5], t[7]);
+        f[0] = _mm256_unpacklo_epi64(u[0], u[4]);
+        f[1] = _mm256_unpackhi_epi64(u[0], u[4]);
+        f[2] = _mm256_unpacklo_epi64(u[1], u[5]);
+        f[3] = _mm256_unpackhi_epi64(u[1], u[5]);
+        f[4] = _mm256_unpacklo_epi64(u[2], u[6]);
+        f[5] = _mm256_unpackhi_epi64(u[2], u[6]);
+        f[6] = _mm256_unpacklo_epi64(u[3], u[7]);
+        f[7] = _mm256_unpackhi_epi64(u[3], u[7]);
+
+        for (k = 0; k < 8; k++) {
+            store16_avx2(f[k], (signedMask >> k) & 1, s[k], out[k] + i);
+        }
+        in += 256;
+    }
+
+    if (i < n) {
+        float * tail[8];
+        for (k = 0; k < 8; k++) {
+            tail[k] = out[k] + i;
+        }
+        deinterleave8_sse2(in, n - i, tail, scale, signedMask);
+    }
+}
+
+__attribute__((target("avx2")))
+static void deinterleave4_avx2(const uint8_t * in, uint32_t n, float * const * out,
+                               const float * scale, uint8_t signedMask) {
+    __m256 s[4];
+    __m256i r[4];
+    __m256i t[4];
+    __m256i u[4];
+    __m256i f[4];
+    uint32_t i;
+    uint8_t k;
+
+    for (k = 0; k < 4; k++) {
+        s[k] = _mm256_set1_ps(scale[k]);
+    }
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        for (k = 0; k < 4; k++) {
+            r[k] = loadPair_avx2(in + 16 * k, in + 16 * (k + 4));
+        }
+        t[0] = _mm256_unpacklo_epi16(r[0], r[1]);
+        t[1] = _mm256_unpackhi_epi16(r[0], r[1]);
+        t[2] = _mm256_unpacklo_epi16(r[2], r[3]);
+        t[3] = _mm256_unpackhi_epi16(r[2], r[3]);
+        u[0] = _mm256_unpacklo_epi16(t[0], t[1]);
+        u[1] = _mm256_unpackhi_epi16(t[0], t[1]);
+        u[2] = _mm256_unpacklo_epi16(t[2], t[3]);
+        u[3] = _mm256_unpackhi_epi16(t[2], t[3]);
+        f[0] = _mm256_unpacklo_epi64(u[0], u[2]);
+        f[1] = _mm256_unpackhi_epi64(u[0], u[2]);
+        f[2] = _mm256_unpacklo_epi64(u[1], u[3]);
+        f[3] = _mm256_unpackhi_epi64(u[1], u[3]);
+
+        for (k = 0; k < 4; k++) {
+            store16_avx2(f[k], (signedMask >> k) & 1, s[k], out[k] + i);
+        }
+        in += 128;
+    }
+
+    if (i < n) {
+        float * tail[4];
+        for (k = 0; k < 4; k++) {
+            tail[k] = out[k] + i;
+        }
+        deinterleave4_sse2(in, n - i, tail, scale, signedMask);
+    }
+}
+#endif // WINDOP_SIMD_X86
+
+/* ****************************************************************************
+ *
+ * Kernel selection
+ *
+ * */
+static const deinterleaveKernel kernels8[] = {
+    deinterleave8_scalar,
+#ifdef WINDOP_SIMD_X86
+    deinterleave8_sse2,
+    deinterleave8_avx2,
+#endif
+};
+
+static const deinterleaveKernel kernels4[] = {
+    deinterleave4_scalar,
+#ifdef WINDOP_SIMD_X86
+    deinterleave4_sse2,
+    deinterleave4_avx2,
+#endif
+};
+
+// Worker threads read it, -1 until the first use picks a level
+static int8_t simdLevel = -1;
+
+static uint8_t bestLevel(void) {
+#ifdef WINDOP_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return WINDOP_SIMD_AVX2;
+    }
+    return WINDOP_SIMD_SSE2;
+#else
+    return WINDOP_SIMD_SCALAR;
+#endif
+}
+
+uint8_t level_WindOpSimd(void) {
+    int8_t level = __atomic_load_n(&simdLevel, __ATOMIC_RELAXED);
+    int8_t unset = -1;
+
+    // Threads racing here all find the same level, only the first store lands
+    if (level < 0) {
+        level = (int8_t) bestLevel();
+        if (!__atomic_compare_exchange_n(&simdLevel, &unset, level, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            level = unset;
+        }
+    }
+    return (uint8_t) level;
+}
+
+uint8_t setLevel_WindOpSimd(uint8_t level) {
+    uint8_t best = bestLevel();
+    level = (level < best) ? level : best;
+    __atomic_store_n(&simdLevel, (int8_t) level, __ATOMIC_RELAXED);
+    return level;
+}
+
+const char * levelName_WindOpSimd(uint8_t level) {
+    switch (level) {
+    case WINDOP_SIMD_SCALAR:
+        return "scalar";
+    case WINDOP_SIMD_SSE2:
+        return "sse2";
+    case WINDOP_SIMD_AVX2:
+        return "avx2";
+    default:
+        return "unknown";
+    }
+}
+
+/*
+ * The vector kernels take readings made only of 4 or 8 back to back 16 bit
+ * fields on consecutive channels, as T3, T4 and T5 are. Returns 0 for any
+ * other layout.
+ */
+static uint8_t vectorLayout(const WindOpTypeInfo * info, fieldLayout * layout) {
+    const WindOpFieldInfo * field;
+    uint8_t f;
+
+    if (((info->numFields != 4) && (info->numFields != 8)) || (info->readingSize != 2 * info->numFields)) {
+        return 0;
+    }
+    layout->numFields = info->numFields;
+    layout->firstChannel = info->fields[0].channel;
+    layout->signedMask = 0;
+    for (f = 0; f < info->numFields; f++) {
+        field = &info->fields[f];
+        if ((field->bytes != 2) || (field->offset != 2 * f) || (field->channel != layout->firstChannel + f)) {
+            return 0;
+        }
+        layout->signedMask |= field->isSigned << f;
+    }
+    return 1;
+}
+
+// Any other fixed layout, field by field from the schema
+static uint32_t deinterleave_fields(const WindOpTypeInfo * info, const uint8_t * in, uint32_t n, float * const * out) {
+    const WindOpFieldInfo * field;
+    const uint8_t * at;
+    uint32_t i;
+    int32_t raw;
+    uint8_t f;
+
+    for (i = 0; i < n; i++) {
+        for (f = 0; f < info->numFields; f++) {
+            field = &info->fields[f];
+            at = &in[field->offset];
+            raw = at[0] | (at[1] << 8);
+            if (field->bytes == 3) {
+                raw |= at[2] << 16;
+                raw = field->isSigned ? (raw ^ 0x800000) - 0x800000 : raw;
+            } else if (field->isSigned) {
+                raw = (int16_t) raw;
+            }
+            out[field->channel][i] = (float) raw * (float) field->scale;
+        }
+        in += info->readingSize;
+    }
+    return n;
+}
+
+uint32_t deinterleave_WindOpReadings(uint8_t dataType, const uint8_t * in, uint32_t numReadings, float * const * out) {
+    const WindOpTypeInfo * info = info_WindOpDataType(dataType);
+    fieldLayout layout;
+    float scale[WINDOP_NUM_CHANNELS];
+    uint8_t level = level_WindOpSimd();
+    uint8_t f;
+
+    if ((info == NULL) || (info->readingSize == 0)) {
+        return 0; // No fixed stride, T8 deltas go through wm_delta
+    }
+    if (!vectorLayout(info, &layout)) {
+        return deinterleave_fields(info, in, numReadings, out);
+    }
+
+    for (f = 0; f < layout.numFields; f++) {
+        scale[f] = (float) info->fields[f].scale;
+    }
+    if (layout.numFields == 8) {
+        kernels8[level](in, numReadings, &out[layout.firstChannel], scale, layout.signedMask);
+    } else {
+        kernels4[level](in, numReadings, &out[layout.firstChannel], scale, layout.signedMask);
+    }
+
+    return numReadings;
+}
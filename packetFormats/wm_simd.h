@@ -0,0 +1,78 @@
+/*
+ ============================================================================
+ Name        : wm_simd.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Vector de-interleave of fixed stride reading blocks
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_SIMD_H
+#define WM_SIMD_H
+
+#include <stdint.h>
+
+#include "wm_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Kernel levels, the best the CPU supports is picked on first use
+#define WINDOP_SIMD_SCALAR       0
+#define WINDOP_SIMD_SSE2         1
+#define WINDOP_SIMD_AVX2         2
+
+/* ****************************************************************************
+ *
+ * De-interleave numReadings fixed stride readings, as found after the time
+ * stamp of a T3, T4 or T5 packet, straight into per channel float arrays.
+ * Values are scaled to units with the type's scale table, as the Perl
+ * decoders do. Only the channels the type carries are written, out is
+ * indexed by WINDOP_CH_*. The layout comes from the type's schema entry.
+ * Types that are not all 16 bit fields, T6 and T7, go through a scalar
+ * path, T8 has no fixed stride and returns 0.
+ *
+ * The decoders keep raw integers in WindOpColumns and scale on output, so
+ * only wm_bench calls this today.
+ *
+ * Returns the number of readings written, 0 for an unknown type.
+ *
+ * */
+uint32_t deinterleave_WindOpReadings(uint8_t dataType, const uint8_t * in, uint32_t numReadings, float * const * out);
+
+// Force a kernel level, mainly for the benchmark. Returns the level in use,
+// which is lower than asked for if the CPU can't run it.
+uint8_t setLevel_WindOpSimd(uint8_t level);
+uint8_t level_WindOpSimd(void);
+const char * levelName_WindOpSimd(uint8_t level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_SIMD_H
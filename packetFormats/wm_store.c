@@ -0,0 +1,127 @@
+/*
+ ============================================================================
+ Name        : wm_store.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Row append and packet pack paths over WindOpColumns
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <string.h>
+
+#include "wm_delta.h"
+#include "wm_store.h"
+
+uint8_t appendChannels_WindOpColumns(WindOpColumns * cols, int64_t time, uint8_t dataType,
+                                     const int32_t * values, uint8_t channels) {
+    uint32_t row = cols->numRows;
+    uint8_t ch;
+
+    if (reserve_WindOpColumns(cols, 1) != WINDOP_OK) {
+        return WINDOP_ERR_MEMORY;
+    }
+
+    cols->time[row] = time;
+    cols->packet[row] = 0;
+    cols->dataType[row] = dataType;
+    cols->valid[row] = channels;
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        cols->channel[ch][row] = (channels & (1 << ch)) ? values[ch] : 0;
+    }
+    cols->numRows++;
+
+    return WINDOP_OK;
+}
+
+/* ****************************************************************************
+ *
+ * Pack straight from the columns.
+ *
+ * */
+uint16_t pack_WindOpDataPacketFromColumns(const WindOpColumns * cols, uint32_t firstRow, uint32_t numRows,
+                                          uint8_t dataType, uint8_t incSeconds, uint8_t * outBuffer) {
+    const WindOpTypeInfo * info = info_WindOpDataType(dataType);
+    uint16_t timeSize;
+    uint32_t row;
+    uint32_t length;
+    uint32_t packed;
+    uint8_t channels;
+    uint8_t ch;
+
+    if ((info == NULL) || (numRows == 0) || (firstRow + (uint64_t) numRows > cols->numRows)) {
+        return 0;
+    }
+    length = WINDOP_PACKET_HEADER_SIZE + (incSeconds ? WINDOP_TIME_EXT_SIZE : WINDOP_TIME_SIZE);
+    if ((info->readingSize != 0) && (length + numRows * info->readingSize > WINDOP_MAX_PACKET_LENGTH)) {
+        return 0;
+    }
+    if ((info->readingSize == 0) && (numRows > WINDOP_DELTA_MAX_READINGS)) {
+        return 0;
+    }
+
+    // Fixed types need all their channels, T8 takes those every row has
+    channels = info->channels;
+    for (row = firstRow; row < firstRow + numRows; row++) {
+        if (cols->time[row] != cols->time[firstRow] + 60 * (int64_t) (row - firstRow)) {
+            return 0;
+        }
+        for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+            if ((channels & (1 << ch)) && !carries_WindOpColumns(cols, ch, row)) {
+                if (info->readingSize != 0) {
+                    return 0;
+                }
+                channels &= ~(1 << ch);
+            }
+        }
+    }
+    if (channels == 0) {
+        return 0;
+    }
+
+    outBuffer[0] = dataType;
+    timeSize = pack_WindOpEpochTime(cols->time[firstRow] - info->firstOffset, &outBuffer[WINDOP_PACKET_HEADER_SIZE],
+                                    incSeconds);
+    if (timeSize == 0) {
+        return 0;
+    }
+    length = WINDOP_PACKET_HEADER_SIZE + timeSize;
+    if (info->readingSize == 0) {
+        packed = pack_WindOpDeltaReadings(cols->channel, firstRow, (uint8_t) numRows, channels, &outBuffer[length],
+                                          WINDOP_MAX_PACKET_LENGTH - length);
+        if (packed == 0) {
+            return 0;
+        }
+        length += packed;
+    } else {
+        for (row = firstRow; row < firstRow + numRows; row++) {
+            length += pack_WindOpReadingChannels(info, cols->channel, row, &outBuffer[length]);
+        }
+    }
+    outBuffer[1] = (uint8_t) length;
+
+    return (uint16_t) length;
+}
@@ -0,0 +1,78 @@
+/*
+ ============================================================================
+ Name        : wm_store.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Row append and packet pack paths over WindOpColumns
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_STORE_H
+#define WM_STORE_H
+
+#include <stdint.h>
+
+#include "wm_batch.h"
+#include "wm_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ****************************************************************************
+ *
+ * The reading store is WindOpColumns, see wm_batch.h. Packets unpack into
+ * it with reserve_WindOpColumns and decode_WindOpPacketColumns, these are
+ * the other directions.
+ *
+ * */
+
+// Producer side, add a reading with one raw value per channel carrying the
+// channels set in channels. The row's packet index is 0.
+uint8_t appendChannels_WindOpColumns(WindOpColumns * cols, int64_t time, uint8_t dataType,
+                                     const int32_t * values, uint8_t channels);
+
+static inline uint8_t carries_WindOpColumns(const WindOpColumns * cols, uint8_t channel, uint32_t row) {
+    return (cols->valid[row] >> channel) & 1;
+}
+
+/* ****************************************************************************
+ *
+ * Build one packet from numRows rows starting at firstRow, which must be a
+ * minute apart and carry all the channels of dataType. A T8 packet carries
+ * the channels valid on every row instead. It returns the packet length, or
+ * 0 if the rows cannot be packed.
+ *
+ * */
+uint16_t pack_WindOpDataPacketFromColumns(const WindOpColumns * cols, uint32_t firstRow, uint32_t numRows,
+                                          uint8_t dataType, uint8_t incSeconds, uint8_t * outBuffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_STORE_H
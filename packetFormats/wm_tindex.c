@@ -0,0 +1,684 @@
+/*
+ ============================================================================
+ Name        : wm_tindex.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Minute keyed on disk index of decoded readings
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "wm_tindex.h"
+
+#define MAGIC_SIZE               8
+#define TABLE_ALIGN              8 // Keeps the mmapped tables naturally aligned
+
+static void * growTable(void * table, uint32_t * capacity, uint32_t needed, size_t elemSize) {
+    uint32_t newCapacity = *capacity ? *capacity : 64;
+    void * grown;
+
+    if (needed <= *capacity) {
+        return table;
+    }
+    while (newCapacity < needed) {
+        newCapacity *= 2;
+    }
+    grown = realloc(table, newCapacity * elemSize);
+    if (grown != NULL) {
+        *capacity = newCapacity;
+    }
+    return grown;
+}
+
+// Bytes of the minute and valid columns of a block, before the channels
+static inline uint64_t keyBytes(uint32_t rows) {
+    return (uint64_t) rows * sizeof(int32_t) + ((rows + 3u) & ~3u);
+}
+
+static inline uint64_t blockBytes(const WindOpTimeIndexBlock * block) {
+    return keyBytes(block->rows) + (uint64_t) __builtin_popcount(block->channels) * block->rows * sizeof(float);
+}
+
+/* ****************************************************************************
+ *
+ * Writer
+ *
+ * */
+uint8_t open_WindOpTimeIndexWriter(WindOpTimeIndexWriter * writer, const char * path) {
+    memset(writer, 0, sizeof(*writer));
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        return WINDOP_ERR_FORMAT;
+    }
+    if (fwrite(WINDOP_TINDEX_MAGIC, MAGIC_SIZE, 1, writer->file) != 1) {
+        fclose(writer->file);
+        writer->file = NULL;
+        return WINDOP_ERR_FORMAT;
+    }
+    writer->offset = MAGIC_SIZE;
+    return WINDOP_OK;
+}
+
+// One block's worth of merged rows waiting to be written
+typedef struct blockRows {
+    uint32_t rows;
+    int32_t minute[WINDOP_TINDEX_BLOCK_ROWS];
+    uint8_t valid[WINDOP_TINDEX_BLOCK_ROWS + 3];
+    float value[WINDOP_NUM_CHANNELS][WINDOP_TINDEX_BLOCK_ROWS];
+} blockRows;
+
+static uint8_t writeBlock(WindOpTimeIndexWriter * writer, blockRows * rows) {
+    WindOpTimeIndexBlock * block;
+    WindOpTimeIndexBlock * blocks;
+    uint32_t r;
+    uint8_t ch;
+
+    blocks = growTable(writer->blocks, &writer->blockCapacity, writer->numBlocks + 1, sizeof(WindOpTimeIndexBlock));
+    if (blocks == NULL) {
+        return WINDOP_ERR_MEMORY;
+    }
+    writer->blocks = blocks;
+    block = &blocks[writer->numBlocks];
+    memset(block, 0, sizeof(*block));
+    block->offset = writer->offset;
+    block->rows = rows->rows;
+    block->firstMinute = rows->minute[0];
+    block->lastMinute = rows->minute[rows->rows - 1];
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        block->min[ch] = 0;
+        block->max[ch] = 0;
+        for (r = 0; r < rows->rows; r++) {
+            if (!(rows->valid[r] & (1u << ch))) {
+                continue;
+            }
+            if (!(block->channels & (1u << ch))) {
+                block->channels |= (uint8_t) (1u << ch);
+                block->min[ch] = rows->value[ch][r];
+                block->max[ch] = rows->value[ch][r];
+            }
+            block->min[ch] = (rows->value[ch][r] < block->min[ch]) ? rows->value[ch][r] : block->min[ch];
+            block->max[ch] = (rows->value[ch][r] > block->max[ch]) ? rows->value[ch][r] : block->max[ch];
+        }
+    }
+
+    memset(&rows->valid[rows->rows], 0, 3);
+    fwrite(rows->minute, sizeof(int32_t), rows->rows, writer->file);
+    fwrite(rows->valid, 1, (rows->rows + 3u) & ~3u, writer->file);
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        if (block->channels & (1u << ch)) {
+            fwrite(rows->value[ch], sizeof(float), rows->rows, writer->file);
+        }
+    }
+    if (ferror(writer->file)) {
+        return WINDOP_ERR_FORMAT;
+    }
+    writer->offset += blockBytes(block);
+    writer->numBlocks++;
+    rows->rows = 0;
+    return WINDOP_OK;
+}
+
+static int compareKeys(const void * a, const void * b) {
+    const uint64_t ka = *(const uint64_t *) a;
+    const uint64_t kb = *(const uint64_t *) b;
+    return (ka > kb) - (ka < kb);
+}
+
+static inline int32_t minuteOf(int64_t time) {
+    return (int32_t) ((time >= 0) ? time / 60 : -((-time + 59) / 60));
+}
+
+/*
+ * Sort the rows by minute, keeping input order within a minute, then fold
+ * each minute into one row channel by channel, the last row carrying a
+ * channel giving its value.
+ */
+uint8_t addDevice_WindOpTimeIndex(WindOpTimeIndexWriter * writer, const char * device, const WindOpColumns * cols) {
+    WindOpTimeIndexDevice * dev;
+    WindOpTimeIndexDevice * devices;
+    const WindOpTypeInfo * info;
+    blockRows * rows;
+    uint64_t * keys;
+    uint32_t i;
+    uint32_t row;
+    uint32_t r;
+    int32_t minute;
+    uint8_t status = WINDOP_OK;
+    uint8_t ch;
+
+    if (strlen(device) >= WINDOP_TINDEX_DEVICE_SIZE) {
+        return WINDOP_ERR_LENGTH;
+    }
+    for (i = 0; i < writer->numDevices; i++) {
+        if (strncmp(writer->devices[i].name, device, WINDOP_TINDEX_DEVICE_SIZE) == 0) {
+            return WINDOP_ERR_FORMAT; // Devices go in once
+        }
+    }
+    devices = growTable(writer->devices, &writer->deviceCapacity, writer->numDevices + 1,
+                        sizeof(WindOpTimeIndexDevice));
+    if (devices == NULL) {
+        return WINDOP_ERR_MEMORY;
+    }
+    writer->devices = devices;
+    dev = &devices[writer->numDevices];
+    memset(dev, 0, sizeof(*dev));
+    strncpy(dev->name, device, WINDOP_TINDEX_DEVICE_SIZE - 1);
+    dev->firstBlock = writer->numBlocks;
+
+    keys = malloc(((size_t) cols->numRows + 1) * sizeof(uint64_t));
+    rows = malloc(sizeof(blockRows));
+    if ((keys == NULL) || (rows == NULL)) {
+        free(keys);
+        free(rows);
+        return WINDOP_ERR_MEMORY;
+    }
+    for (i = 0; i < cols->numRows; i++) {
+        keys[i] = ((uint64_t) ((uint32_t) minuteOf(cols->time[i]) ^ 0x80000000u) << 32) | i;
+    }
+    qsort(keys, cols->numRows, sizeof(uint64_t), compareKeys);
+
+    rows->rows = 0;
+    for (i = 0; (i < cols->numRows) && (status == WINDOP_OK); i++) {
+        row = (uint32_t) keys[i];
+        minute = (int32_t) ((uint32_t) (keys[i] >> 32) ^ 0x80000000u);
+        if ((rows->rows == 0) || (rows->minute[rows->rows - 1] != minute)) {
+            if ((rows->rows == WINDOP_TINDEX_BLOCK_ROWS) && ((status = writeBlock(writer, rows)) != WINDOP_OK)) {
+                break;
+            }
+            r = rows->rows++;
+            rows->minute[r] = minute;
+            rows->valid[r] = 0;
+            dev->rows++;
+        }
+        r = rows->rows - 1;
+        info = info_WindOpDataType(cols->dataType[row]);
+        for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+            if (cols->valid[row] & (1u << ch)) {
+                rows->value[ch][r] = (float) (cols->channel[ch][row] * info->scale[ch]);
+            } else if (!(rows->valid[r] & (1u << ch))) {
+                rows->value[ch][r] = 0;
+            }
+        }
+        rows->valid[r] |= cols->valid[row];
+    }
+    if ((status == WINDOP_OK) && (rows->rows > 0)) {
+        status = writeBlock(writer, rows);
+    }
+    free(keys);
+    free(rows);
+
+    dev->numBlocks = writer->numBlocks - dev->firstBlock;
+    writer->numDevices++;
+    return status;
+}
+
+uint8_t close_WindOpTimeIndexWriter(WindOpTimeIndexWriter * writer) {
+    static const uint8_t zeros[TABLE_ALIGN] = { 0 };
+    WindOpTimeIndexFooter footer;
+    uint32_t pad;
+    uint8_t result = WINDOP_OK;
+
+    memset(&footer, 0, sizeof(footer));
+    pad = (TABLE_ALIGN - writer->offset % TABLE_ALIGN) % TABLE_ALIGN;
+    footer.deviceOffset = writer->offset + pad;
+    footer.blockOffset = footer.deviceOffset + (uint64_t) writer->numDevices * sizeof(WindOpTimeIndexDevice);
+    footer.numDevices = writer->numDevices;
+    footer.numBlocks = writer->numBlocks;
+    memcpy(footer.magic, WINDOP_TINDEX_END_MAGIC, MAGIC_SIZE);
+
+    fwrite(zeros, 1, pad, writer->file);
+    fwrite(writer->devices, sizeof(WindOpTimeIndexDevice), writer->numDevices, writer->file);
+    fwrite(writer->blocks, sizeof(WindOpTimeIndexBlock), writer->numBlocks, writer->file);
+    fwrite(&footer, sizeof(footer), 1, writer->file);
+    if (ferror(writer->file)) {
+        result = WINDOP_ERR_FORMAT;
+    }
+    if (fclose(writer->file) != 0) {
+        result = WINDOP_ERR_FORMAT;
+    }
+    free(writer->devices);
+    free(writer->blocks);
+    memset(writer, 0, sizeof(*writer));
+    return result;
+}
+
+static uint8_t mergePart(WindOpTimeIndexWriter * writer, const WindOpTimeIndexReader * part) {
+    const uint64_t bytes = (uint64_t) ((const uint8_t *) part->devices - part->map) - MAGIC_SIZE;
+    const uint64_t delta = writer->offset - MAGIC_SIZE;
+    WindOpTimeIndexDevice * devices;
+    WindOpTimeIndexBlock * blocks;
+    uint32_t i;
+    uint32_t d;
+
+    if (part->numDevices == 0) {
+        return WINDOP_OK; // Nothing to copy, a shard may have seen no devices
+    }
+    for (i = 0; i < part->numDevices; i++) {
+        for (d = 0; d < writer->numDevices; d++) {
+            if (strncmp(writer->devices[d].name, part->devices[i].name, WINDOP_TINDEX_DEVICE_SIZE) == 0) {
+                return WINDOP_ERR_FORMAT;
+            }
+        }
+    }
+    devices = growTable(writer->devices, &writer->deviceCapacity, writer->numDevices + part->numDevices,
+                        sizeof(WindOpTimeIndexDevice));
+    if (devices == NULL) {
+        return WINDOP_ERR_MEMORY;
+    }
+    writer->devices = devices;
+    blocks = growTable(writer->blocks, &writer->blockCapacity, writer->numBlocks + part->numBlocks,
+                       sizeof(WindOpTimeIndexBlock));
+    if (blocks == NULL) {
+        return WINDOP_ERR_MEMORY;
+    }
+    writer->blocks = blocks;
+
+    // The part's block bytes end table aligned, so offsets keep their alignment
+    if ((bytes != 0) && (fwrite(&part->map[MAGIC_SIZE], bytes, 1, writer->file) != 1)) {
+        return WINDOP_ERR_FORMAT;
+    }
+    for (i = 0; i < part->numDevices; i++) {
+        devices[writer->numDevices] = part->devices[i];
+        devices[writer->numDevices++].firstBlock += writer->numBlocks;
+    }
+    for (i = 0; i < part->numBlocks; i++) {
+        blocks[writer->numBlocks] = part->blocks[i];
+        blocks[writer->numBlocks++].offset += delta;
+    }
+    writer->offset += bytes;
+    return WINDOP_OK;
+}
+
+uint8_t merge_WindOpTimeIndex(const char * path, const char * const * parts, uint32_t numParts) {
+    WindOpTimeIndexWriter writer;
+    WindOpTimeIndexReader part;
+    uint8_t status;
+    uint32_t i;
+
+    status = open_WindOpTimeIndexWriter(&writer, path);
+    for (i = 0; (i < numParts) && (status == WINDOP_OK); i++) {
+        status = open_WindOpTimeIndexReader(&part, parts[i]);
+        if (status == WINDOP_OK) {
+            status = mergePart(&writer, &part);
+            close_WindOpTimeIndexReader(&part);
+        }
+    }
+    if (writer.file != NULL) {
+        if (close_WindOpTimeIndexWriter(&writer) != WINDOP_OK) {
+            status = (status == WINDOP_OK) ? WINDOP_ERR_FORMAT : status;
+        }
+    }
+    if (status != WINDOP_OK) {
+        unlink(path);
+    }
+    return status;
+}
+
+/* ****************************************************************************
+ *
+ * Reader
+ *
+ * */
+uint8_t open_WindOpTimeIndexReader(WindOpTimeIndexReader * reader, const char * path) {
+    const WindOpTimeIndexFooter * footer;
+    const WindOpTimeIndexDevice * dev;
+    struct stat st;
+    uint32_t i;
+    int fd;
+
+    memset(reader, 0, sizeof(*reader));
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return WINDOP_ERR_FORMAT;
+    }
+    if ((fstat(fd, &st) != 0) || ((size_t) st.st_size < MAGIC_SIZE + sizeof(WindOpTimeIndexFooter))) {
+        close(fd);
+        return WINDOP_ERR_FORMAT;
+    }
+    reader->size = (size_t) st.st_size;
+    reader->map = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (reader->map == MAP_FAILED) {
+        memset(reader, 0, sizeof(*reader));
+        return WINDOP_ERR_MEMORY;
+    }
+
+    footer = (const WindOpTimeIndexFooter *) &reader->map[reader->size - sizeof(WindOpTimeIndexFooter)];
+    if ((memcmp(reader->map, WINDOP_TINDEX_MAGIC, MAGIC_SIZE) != 0) ||
+        (memcmp(footer->magic, WINDOP_TINDEX_END_MAGIC, MAGIC_SIZE) != 0) ||
+        (footer->deviceOffset % TABLE_ALIGN != 0) ||
+        (footer->deviceOffset + (uint64_t) footer->numDevices * sizeof(WindOpTimeIndexDevice) != footer->blockOffset) ||
+        (footer->blockOffset + (uint64_t) footer->numBlocks * sizeof(WindOpTimeIndexBlock) !=
+         reader->size - sizeof(WindOpTimeIndexFooter))) {
+        close_WindOpTimeIndexReader(reader);
+        return WINDOP_ERR_FORMAT;
+    }
+    reader->devices = (const WindOpTimeIndexDevice *) &reader->map[footer->deviceOffset];
+    reader->numDevices = footer->numDevices;
+    reader->blocks = (const WindOpTimeIndexBlock *) &reader->map[footer->blockOffset];
+    reader->numBlocks = footer->numBlocks;
+
+    // Every block must sit between the magic and the tables, every device own its blocks
+    for (i = 0; i < reader->numBlocks; i++) {
+        if ((reader->blocks[i].offset < MAGIC_SIZE) || (reader->blocks[i].offset % 4 != 0) ||
+            (reader->blocks[i].rows == 0) || (reader->blocks[i].rows > WINDOP_TINDEX_BLOCK_ROWS) ||
+            (reader->blocks[i].offset + blockBytes(&reader->blocks[i]) > footer->deviceOffset)) {
+            close_WindOpTimeIndexReader(reader);
+            return WINDOP_ERR_FORMAT;
+        }
+    }
+    for (i = 0; i < reader->numDevices; i++) {
+        dev = &reader->devices[i];
+        if ((uint64_t) dev->firstBlock + dev->numBlocks > reader->numBlocks) {
+            close_WindOpTimeIndexReader(reader);
+            return WINDOP_ERR_FORMAT;
+        }
+    }
+    return WINDOP_OK;
+}
+
+void close_WindOpTimeIndexReader(WindOpTimeIndexReader * reader) {
+    if (reader->map != NULL) {
+        munmap((void *) reader->map, reader->size);
+    }
+    memset(reader, 0, sizeof(*reader));
+}
+
+int32_t findDevice_WindOpTimeIndex(const WindOpTimeIndexReader * reader, const char * device) {
+    uint32_t i;
+
+    for (i = 0; i < reader->numDevices; i++) {
+        if (strncmp(reader->devices[i].name, device, WINDOP_TINDEX_DEVICE_SIZE) == 0) {
+            return (int32_t) i;
+        }
+    }
+    return -1;
+}
+
+/* ****************************************************************************
+ *
+ * Scans
+ *
+ * */
+uint8_t parse_WindOpPredicate(const char * text, WindOpPredicate * pred) {
+    char name[8];
+    char * end;
+    uint32_t n = 0;
+    uint8_t ch;
+
+    while ((text[n] >= 'a') && (text[n] <= 'z') && (n < sizeof(name) - 1)) {
+        name[n] = text[n];
+        n++;
+    }
+    name[n] = '\0';
+    for (ch = 0; (ch < WINDOP_NUM_CHANNELS) && (strcmp(name, key_WindOpChannel(ch)) != 0); ch++) {
+    }
+    if (ch == WINDOP_NUM_CHANNELS) {
+        return WINDOP_ERR_FORMAT;
+    }
+    pred->channel = ch;
+    text += n;
+    if (text[0] == '<') {
+        pred->op = (text[1] == '=') ? WINDOP_PRED_LE : WINDOP_PRED_LT;
+    } else if (text[0] == '>') {
+        pred->op = (text[1] == '=') ? WINDOP_PRED_GE : WINDOP_PRED_GT;
+    } else {
+        return WINDOP_ERR_FORMAT;
+    }
+    text += (text[1] == '=') ? 2 : 1;
+    pred->value = strtof(text, &end);
+    return ((end == text) || (*end != '\0')) ? WINDOP_ERR_FORMAT : WINDOP_OK;
+}
+
+void init_WindOpQueryResult(WindOpQueryResult * result) {
+    memset(result, 0, sizeof(*result));
+}
+
+void free_WindOpQueryResult(WindOpQueryResult * result) {
+    uint8_t ch;
+
+    free(result->time);
+    free(result->valid);
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        free(result->value[ch]);
+    }
+    memset(result, 0, sizeof(*result));
+}
+
+/*
+ * Room for rows more rows in time, valid and every requested channel. A
+ * result reused with other channels gets the missing arrays at the current
+ * capacity, and every array held grows together so none falls behind.
+ */
+static uint8_t reserveResult(WindOpQueryResult * result, uint8_t channels, uint32_t rows) {
+    uint32_t capacity = result->capacity ? result->capacity : 4096;
+    void * grown;
+    uint8_t ch;
+
+    while (capacity < result->numRows + rows) {
+        capacity *= 2;
+    }
+    if (capacity != result->capacity) {
+        if ((grown = realloc(result->time, capacity * sizeof(int64_t))) == NULL) {
+            return WINDOP_ERR_MEMORY;
+        }
+        result->time = grown;
+        if ((grown = realloc(result->valid, capacity)) == NULL) {
+            return WINDOP_ERR_MEMORY;
+        }
+        result->valid = grown;
+    }
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        if ((result->value[ch] == NULL) ? !(channels & (1u << ch)) : (capacity == result->capacity)) {
+            continue;
+        }
+        if ((grown = realloc(result->value[ch], capacity * sizeof(float))) == NULL) {
+            return WINDOP_ERR_MEMORY;
+        }
+        result->value[ch] = grown;
+    }
+    result->capacity = capacity;
+    return WINDOP_OK;
+}
+
+// Can any row of the block pass pred, going by its min and max
+static uint8_t blockMayMatch(const WindOpTimeIndexBlock * block, const WindOpPredicate * pred) {
+    const float min = block->min[pred->channel];
+    const float max = block->max[pred->channel];
+
+    if (!(block->channels & (1u << pred->channel))) {
+        return 0;
+    }
+    switch (pred->op) {
+    case WINDOP_PRED_LT:
+        return min < pred->value;
+    case WINDOP_PRED_LE:
+        return min <= pred->value;
+    case WINDOP_PRED_GT:
+        return max > pred->value;
+    default:
+        return max >= pred->value;
+    }
+}
+
+// Column of channel ch in a block, which must carry it
+static const float * blockColumn(const WindOpTimeIndexReader * reader, const WindOpTimeIndexBlock * block,
+                                 uint8_t ch) {
+    const uint32_t before = (uint32_t) __builtin_popcount(block->channels & ((1u << ch) - 1));
+    return (const float *) &reader->map[block->offset + keyBytes(block->rows) +
+                                        (uint64_t) before * block->rows * sizeof(float)];
+}
+
+/*
+ * Narrow sel, one byte a row, by one predicate. Written as straight loops
+ * over the column so they vectorise.
+ */
+static void applyPredicate(const WindOpPredicate * pred, const float * column, const uint8_t * valid,
+                           uint8_t * sel, uint32_t rows) {
+    const uint8_t bit = (uint8_t) (1u << pred->channel);
+    const float value = pred->value;
+    uint32_t r;
+
+    switch (pred->op) {
+    case WINDOP_PRED_LT:
+        for (r = 0; r < rows; r++) {
+            sel[r] &= (uint8_t) (((valid[r] & bit) != 0) & (column[r] < value));
+        }
+        break;
+    case WINDOP_PRED_LE:
+        for (r = 0; r < rows; r++) {
+            sel[r] &= (uint8_t) (((valid[r] & bit) != 0) & (column[r] <= value));
+        }
+        break;
+    case WINDOP_PRED_GT:
+        for (r = 0; r < rows; r++) {
+            sel[r] &= (uint8_t) (((valid[r] & bit) != 0) & (column[r] > value));
+        }
+        break;
+    default:
+        for (r = 0; r < rows; r++) {
+            sel[r] &= (uint8_t) (((valid[r] & bit) != 0) & (column[r] >= value));
+        }
+        break;
+    }
+}
+
+uint8_t query_WindOpTimeIndex(const WindOpTimeIndexReader * reader, const WindOpQuery * query,
+                              WindOpQueryResult * result) {
+    uint8_t sel[WINDOP_TINDEX_BLOCK_ROWS];
+    const WindOpTimeIndexDevice * dev;
+    const WindOpTimeIndexBlock * block;
+    const int32_t * minute;
+    const uint8_t * valid;
+    const float * column;
+    int32_t fromMinute;
+    int32_t toMinute;
+    int32_t index;
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t mid;
+    uint32_t b;
+    uint32_t r;
+    uint32_t out;
+    uint8_t p;
+    uint8_t ch;
+
+    result->numRows = 0;
+    result->blocksInRange = 0;
+    result->blocksSkipped = 0;
+    result->rowsScanned = 0;
+    index = findDevice_WindOpTimeIndex(reader, query->device);
+    if ((index < 0) || (query->numPredicates > WINDOP_MAX_PREDICATES)) {
+        return WINDOP_ERR_FORMAT;
+    }
+    for (p = 0; p < query->numPredicates; p++) {
+        if ((query->predicates[p].channel >= WINDOP_NUM_CHANNELS) || (query->predicates[p].op > WINDOP_PRED_GE)) {
+            return WINDOP_ERR_FORMAT;
+        }
+    }
+    if (query->from > query->to) {
+        return WINDOP_OK;
+    }
+    dev = &reader->devices[index];
+
+    // Whole minutes overlapping [from, to], clamped to the int32_t minute range
+    fromMinute = (query->from <= (int64_t) INT32_MIN * 60) ? INT32_MIN : minuteOf(query->from);
+    toMinute = (query->to >= (int64_t) INT32_MAX * 60) ? INT32_MAX : minuteOf(query->to);
+    if ((int64_t) fromMinute * 60 < query->from) {
+        fromMinute++;
+    }
+
+    // First block of the device ending at or after fromMinute
+    lo = dev->firstBlock;
+    hi = dev->firstBlock + dev->numBlocks;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (reader->blocks[mid].lastMinute < fromMinute) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (b = lo; (b < dev->firstBlock + dev->numBlocks) && (reader->blocks[b].firstMinute <= toMinute); b++) {
+        block = &reader->blocks[b];
+        result->blocksInRange++;
+        for (p = 0; (p < query->numPredicates) && blockMayMatch(block, &query->predicates[p]); p++) {
+        }
+        if (p < query->numPredicates) {
+            result->blocksSkipped++;
+            continue;
+        }
+
+        minute = (const int32_t *) &reader->map[block->offset];
+        valid = &reader->map[block->offset + (uint64_t) block->rows * sizeof(int32_t)];
+        for (r = 0; r < block->rows; r++) {
+            sel[r] = (uint8_t) ((minute[r] >= fromMinute) & (minute[r] <= toMinute));
+        }
+        for (p = 0; p < query->numPredicates; p++) {
+            applyPredicate(&query->predicates[p], blockColumn(reader, block, query->predicates[p].channel), valid,
+                           sel, block->rows);
+        }
+        result->rowsScanned += block->rows;
+
+        if (reserveResult(result, query->channels, block->rows) != WINDOP_OK) {
+            return WINDOP_ERR_MEMORY;
+        }
+        out = result->numRows;
+        for (r = 0; r < block->rows; r++) {
+            result->time[out] = (int64_t) minute[r] * 60;
+            result->valid[out] = valid[r] & query->channels;
+            out += sel[r];
+        }
+        for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+            if (!(query->channels & (1u << ch))) {
+                continue;
+            }
+            out = result->numRows;
+            if (!(block->channels & (1u << ch))) {
+                for (r = 0; r < block->rows; r++) {
+                    result->value[ch][out] = 0;
+                    out += sel[r];
+                }
+                continue;
+            }
+            column = blockColumn(reader, block, ch);
+            for (r = 0; r < block->rows; r++) {
+                result->value[ch][out] = column[r];
+                out += sel[r];
+            }
+        }
+        result->numRows = out;
+    }
+    return WINDOP_OK;
+}
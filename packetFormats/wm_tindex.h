@@ -0,0 +1,213 @@
+/*
+ ============================================================================
+ Name        : wm_tindex.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Minute keyed on disk index of decoded readings
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_TINDEX_H
+#define WM_TINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wm_codec.h"
+#include "wm_batch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WINDOP_TINDEX_MAGIC        "WMTIX002"
+#define WINDOP_TINDEX_END_MAGIC    "WMTIXEND"
+#define WINDOP_TINDEX_DEVICE_SIZE  64    // Device id bytes, zero padded, as WINDOP_JSON_DEVICE_SIZE
+#define WINDOP_TINDEX_BLOCK_ROWS   1440  // A day of minutes
+
+/* ****************************************************************************
+ *
+ * Decoded history keyed by device and minute, for range scans that do not
+ * go back to the packets. Each device's readings are merged to one row a
+ * minute, seconds dropped, the channels of a T4 and T5 for the same minute
+ * on one row and a later packet winning where two carry a channel. Values
+ * are stored in units, raw times the type's scale, as the CSVs show them.
+ *
+ * Rows are cut into blocks of up to WINDOP_TINDEX_BLOCK_ROWS. A block is
+ * stored by column and its directory entry keeps the minute range and the
+ * min and max of every channel, so a scan skips blocks outside the time
+ * range or that no row of could match a predicate, and of the rest only
+ * reads the columns it needs. Integers are little endian, the tables are
+ * written as they sit in memory and used in place from the mmapped file.
+ *
+ *   magic      8 bytes WINDOP_TINDEX_MAGIC
+ *   blocks     minute int32_t[rows], valid uint8_t[rows] padded to 4 bytes,
+ *              then float[rows] per channel carried, in channel order
+ *   devices    numDevices WindOpTimeIndexDevice
+ *   blocks     numBlocks WindOpTimeIndexBlock, by device then time
+ *   footer     WindOpTimeIndexFooter
+ *
+ * */
+typedef struct WindOpTimeIndexBlock {
+    uint64_t offset;          // File offset of the minute column
+    int32_t firstMinute;      // Epoch minutes of the first and last row
+    int32_t lastMinute;
+    uint32_t rows;
+    uint8_t channels;         // Bit n set when any row carries channel n
+    uint8_t reserved[3];
+    float min[WINDOP_NUM_CHANNELS];
+    float max[WINDOP_NUM_CHANNELS];
+} WindOpTimeIndexBlock;
+
+typedef struct WindOpTimeIndexDevice {
+    char name[WINDOP_TINDEX_DEVICE_SIZE];
+    uint32_t firstBlock;
+    uint32_t numBlocks;
+    uint64_t rows;
+} WindOpTimeIndexDevice;
+
+typedef struct WindOpTimeIndexFooter {
+    uint64_t deviceOffset;
+    uint64_t blockOffset;
+    uint32_t numDevices;
+    uint32_t numBlocks;
+    char magic[8];
+} WindOpTimeIndexFooter;
+
+/* ****************************************************************************
+ *
+ * Writer. Each device is added once with all its readings, in any order.
+ *
+ * */
+typedef struct WindOpTimeIndexWriter {
+    FILE * file;
+    uint64_t offset;
+    WindOpTimeIndexDevice * devices;
+    uint32_t numDevices;
+    uint32_t deviceCapacity;
+    WindOpTimeIndexBlock * blocks;
+    uint32_t numBlocks;
+    uint32_t blockCapacity;
+} WindOpTimeIndexWriter;
+
+uint8_t open_WindOpTimeIndexWriter(WindOpTimeIndexWriter * writer, const char * path);
+
+/*
+ * Returns WINDOP_ERR_LENGTH for an id of WINDOP_TINDEX_DEVICE_SIZE bytes or
+ * more, which would be cut short and could meet another, WINDOP_ERR_FORMAT
+ * for a device already added, WINDOP_ERR_MEMORY, or WINDOP_OK.
+ */
+uint8_t addDevice_WindOpTimeIndex(WindOpTimeIndexWriter * writer, const char * device, const WindOpColumns * cols);
+uint8_t close_WindOpTimeIndexWriter(WindOpTimeIndexWriter * writer);
+
+/*
+ * Write path as one index of every device of the parts, in part order. Block
+ * bytes are copied as they stand and only the tables rebased, so indexes
+ * built in parallel join at the cost of a copy. Device names must not
+ * repeat across parts. Returns a WINDOP_* code.
+ */
+uint8_t merge_WindOpTimeIndex(const char * path, const char * const * parts, uint32_t numParts);
+
+/* ****************************************************************************
+ *
+ * Reader and scans
+ *
+ * */
+typedef struct WindOpTimeIndexReader {
+    const uint8_t * map;
+    size_t size;
+    const WindOpTimeIndexDevice * devices;
+    uint32_t numDevices;
+    const WindOpTimeIndexBlock * blocks;
+    uint32_t numBlocks;
+} WindOpTimeIndexReader;
+
+uint8_t open_WindOpTimeIndexReader(WindOpTimeIndexReader * reader, const char * path);
+void close_WindOpTimeIndexReader(WindOpTimeIndexReader * reader);
+int32_t findDevice_WindOpTimeIndex(const WindOpTimeIndexReader * reader, const char * device);
+
+// Predicate operators
+#define WINDOP_PRED_LT             0
+#define WINDOP_PRED_LE             1
+#define WINDOP_PRED_GT             2
+#define WINDOP_PRED_GE             3
+
+#define WINDOP_MAX_PREDICATES      8
+
+// A row matches when the channel carries a value and value op threshold holds
+typedef struct WindOpPredicate {
+    uint8_t channel;
+    uint8_t op;
+    float value;
+} WindOpPredicate;
+
+// Parse ws>5, bv<=3.6 and the like. Returns a WINDOP_* code
+uint8_t parse_WindOpPredicate(const char * text, WindOpPredicate * pred);
+
+typedef struct WindOpQuery {
+    const char * device;
+    int64_t from;             // Epoch seconds, both ends included
+    int64_t to;
+    uint8_t channels;         // Columns wanted in the result
+    uint8_t numPredicates;    // All must hold
+    WindOpPredicate predicates[WINDOP_MAX_PREDICATES];
+} WindOpQuery;
+
+/*
+ * Matching rows by column. value[ch] is only allocated for the channels
+ * the query asked for, valid has bit n set when the row carries channel n.
+ */
+typedef struct WindOpQueryResult {
+    uint32_t capacity;
+    uint32_t numRows;
+    int64_t * time;
+    uint8_t * valid;
+    float * value[WINDOP_NUM_CHANNELS];
+
+    // Where the scan went, for tuning
+    uint32_t blocksInRange;
+    uint32_t blocksSkipped;   // In range but ruled out by min and max
+    uint64_t rowsScanned;
+} WindOpQueryResult;
+
+void init_WindOpQueryResult(WindOpQueryResult * result);
+void free_WindOpQueryResult(WindOpQueryResult * result);
+
+/*
+ * Run query, replacing the rows of result. Returns WINDOP_OK,
+ * WINDOP_ERR_FORMAT for an unknown device or a bad predicate, or
+ * WINDOP_ERR_MEMORY.
+ */
+uint8_t query_WindOpTimeIndex(const WindOpTimeIndexReader * reader, const WindOpQuery * query,
+                              WindOpQueryResult * result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_TINDEX_H
@@ -0,0 +1,537 @@
+/*
+ ============================================================================
+ Name        : wm_ttn.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Decode TTN storage integration JSON dumps
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "wm_codec.h"
+#include "wm_archive.h"
+#include "wm_arrow.h"
+#include "wm_base64.h"
+#include "wm_batch.h"
+#include "wm_csv.h"
+#include "wm_dedup.h"
+#include "wm_gps.h"
+#include "wm_json.h"
+#include "wm_metrics.h"
+
+static const char * helpText =
+"\n"
+"   WindOp TTN storage dump decoder\n"
+"\n"
+"   Streams the JSON returned by the TTN storage integration, as saved by\n"
+"   the curl call in queryTtndReturnHashRef, and decodes the raw payload of\n"
+"   every uplink as it is read. Only device_id, time and raw are looked at,\n"
+"   the rest of each record is skipped without being stored.\n"
+"\n"
+"   Uplinks seen before, same device and packet bytes, are dropped before\n"
+"   decoding. Overlapping -duration fetches and retransmits give these.\n"
+"\n"
+"      wm_ttn [options] dump.json ...  : Reads stdin when no file is given\n"
+"\n"
+"      -sel device            : Only decode uplinks from device\n"
+"      -o file                : Write the device's merged CSV to file, needs\n"
+"                               -sel as rows sharing a minute are merged.\n"
+"                               wm_shard -dir writes every device's\n"
+"                               CSV in one pass\n"
+"      -a archive             : Append every packet to a wm_arc archive\n"
+"      -arrow file            : Write a reading per row as an Arrow IPC file,\n"
+"                               pyarrow.feather.read_table or pd.read_feather\n"
+"      -list                  : Print device_id time raw per uplink\n"
+"      -dedup n               : Catch duplicates up to n uplinks apart, default\n"
+"                               262144, 36 bytes of memory each\n"
+"      -keepdup               : Keep duplicate uplinks\n"
+"      -gaps file             : Write each device's missing minutes as CSV\n"
+"      -cover file            : Write each device's minute coverage bitmap,\n"
+"                               a hex digit per 4 minutes, lowest bit first\n"
+"      -metrics file          : Write the decode metrics to file at the end,\n"
+"                               Prometheus text format\n"
+"      -gps file              : Write the fixes of T7 GPS packets as CSV with\n"
+"                               the distance in metres from home\n"
+"      -home lat,lon          : Home in degrees, default the Edinburgh point\n"
+"                               s1_wm_node_fetchUnpack.pl measures from\n"
+"      -fence metres          : Drop fixes further than metres from home\n"
+"      -help                  : Prints this\n"
+"\n";
+
+#define MAX_FILES                64
+#define DEFAULT_DEDUP            262144
+#define MAX_GAPS                 (WINDOP_COVERAGE_MINUTES / 2)
+
+typedef struct ttnCfg {
+    const char * files[MAX_FILES];
+    uint32_t numFiles;
+    const char * device;
+    const char * outFile;
+    const char * archive;
+    const char * arrowFile;
+    const char * gapsFile;
+    const char * coverFile;
+    const char * metricsFile;
+    const char * gpsFile;
+    double homeLat;
+    double homeLon;
+    double fence;             // Metres, 0 for none
+    uint32_t dedup;           // 0 keeps duplicates
+    uint8_t list;
+} ttnCfg;
+
+typedef struct ttnCtx {
+    ttnCfg * cfg;
+    WindOpColumns cols;
+    WindOpColumns packetCols; // One packet's readings on their way to arrow, without -o
+    WindOpArchiveWriter writer;
+    WindOpArrowWriter arrow;
+    WindOpDedup dedup;
+    WindOpCoverage cover;
+    WindOpGpsTrack track;
+    WindOpGeofence fence;
+    char ** gpsDevices;       // Device of each GPS packet, the track packet index
+    uint32_t numGpsPackets;
+    uint32_t gpsCapacity;
+    uint64_t packets;
+    uint64_t badRaw;
+    uint64_t failed;
+    uint64_t otherDevice;
+} ttnCtx;
+
+static void outOfMemory(void) {
+    fprintf(stderr, "ERROR out of memory\n");
+    exit(EXIT_FAILURE);
+}
+
+// The rows of cols from first on, sharing its arrays
+static void tailColumns(const WindOpColumns * cols, uint32_t first, WindOpColumns * tail) {
+    uint8_t ch;
+
+    tail->capacity = cols->capacity - first;
+    tail->numRows = cols->numRows - first;
+    tail->time = &cols->time[first];
+    tail->packet = &cols->packet[first];
+    tail->dataType = &cols->dataType[first];
+    tail->valid = &cols->valid[first];
+    for (ch = 0; ch < WINDOP_NUM_CHANNELS; ch++) {
+        tail->channel[ch] = &cols->channel[ch][first];
+    }
+}
+
+static void addGpsPacket(ttnCtx * ctx, const char * device, const uint8_t * packet, uint32_t length) {
+    const WindOpGeofence * fence = (ctx->cfg->fence > 0) ? &ctx->fence : NULL;
+    char ** grown;
+
+    if (ctx->numGpsPackets == ctx->gpsCapacity) {
+        ctx->gpsCapacity = ctx->gpsCapacity ? 2 * ctx->gpsCapacity : 64;
+        grown = realloc(ctx->gpsDevices, ctx->gpsCapacity * sizeof(char *));
+        if (grown == NULL) {
+            outOfMemory();
+        }
+        ctx->gpsDevices = grown;
+    }
+    switch (decode_WindOpGpsPacket(packet, length, ctx->numGpsPackets, fence, &ctx->track)) {
+    case WINDOP_OK:
+        break;
+    case WINDOP_ERR_MEMORY:
+        outOfMemory();
+        break;
+    default:
+        ctx->failed++;
+        return;
+    }
+    if ((ctx->gpsDevices[ctx->numGpsPackets++] = strdup(device)) == NULL) {
+        outOfMemory();
+    }
+}
+
+static void onUplink(void * context, const WindOpUplink * uplink) {
+    ttnCtx * ctx = context;
+    uint8_t packet[WINDOP_JSON_RAW_SIZE];
+    WindOpColumns * cols;
+    WindOpColumns tail;
+    uint32_t first;
+    int32_t length;
+
+    if ((ctx->cfg->device != NULL) && (strcmp(ctx->cfg->device, uplink->device) != 0)) {
+        ctx->otherDevice++;
+        return;
+    }
+    if (ctx->cfg->list) {
+        printf("%s %s %s\n", uplink->device, uplink->time, uplink->raw);
+    }
+    length = decode_WindOpBase64(uplink->raw, uplink->rawLength, packet, sizeof(packet));
+    if (length < 0) {
+        ctx->badRaw++;
+        return;
+    }
+    if ((ctx->cfg->dedup != 0) &&
+        check_WindOpDedup(&ctx->dedup, key_WindOpDedup(uplink->device, packet, (uint32_t) length))) {
+        return;
+    }
+    ctx->packets++;
+
+    if ((ctx->cfg->gapsFile != NULL) || (ctx->cfg->coverFile != NULL)) {
+        if (addPacket_WindOpCoverage(&ctx->cover, uplink->device, packet, (uint32_t) length) == WINDOP_ERR_MEMORY) {
+            outOfMemory();
+        }
+    }
+
+    if ((ctx->cfg->archive != NULL) &&
+        (append_WindOpArchive(&ctx->writer, uplink->device, packet, (uint32_t) length) != WINDOP_OK)) {
+        ctx->failed++;
+        return;
+    }
+    if ((ctx->cfg->gpsFile != NULL) && (packet[0] == WINDOPDATAPACKET_T7_TYPE)) {
+        addGpsPacket(ctx, uplink->device, packet, (uint32_t) length);
+    }
+    if ((ctx->cfg->outFile == NULL) && (ctx->cfg->arrowFile == NULL)) {
+        return;
+    }
+
+    // Decoded once, into the CSV columns when there are some
+    cols = (ctx->cfg->outFile != NULL) ? &ctx->cols : &ctx->packetCols;
+    if (cols == &ctx->packetCols) {
+        cols->numRows = 0;
+    }
+    first = cols->numRows;
+    if (reserve_WindOpColumns(cols, maxReadings_WindOpPacket(packet, (uint32_t) length)) != WINDOP_OK) {
+        outOfMemory();
+    }
+    if (decode_WindOpPacketColumns(packet, (uint32_t) length, (uint32_t) ctx->packets - 1, cols) != WINDOP_OK) {
+        ctx->failed++;
+        return;
+    }
+    if (ctx->cfg->arrowFile != NULL) {
+        tailColumns(cols, first, &tail);
+        if (append_WindOpArrow(&ctx->arrow, uplink->device, &tail) == WINDOP_ERR_MEMORY) {
+            outOfMemory();
+        }
+    }
+}
+
+static uint8_t readDump(ttnCtx * ctx, const char * path, WindOpJsonReader * total) {
+    WindOpJsonReader reader;
+    FILE * in = stdin;
+    uint8_t status;
+
+    if ((path != NULL) && ((in = fopen(path, "r")) == NULL)) {
+        fprintf(stderr, "Can't open %s\n", path);
+        return WINDOP_ERR_FORMAT;
+    }
+    if (init_WindOpJsonReader(&reader, in, NULL, 0) != WINDOP_OK) {
+        outOfMemory();
+    }
+    status = read_WindOpTtnJson(&reader, onUplink, ctx);
+    if (status != WINDOP_OK) {
+        fprintf(stderr, "ERROR %s does not parse as JSON near byte %lu\n", (path != NULL) ? path : "stdin",
+                (unsigned long) offset_WindOpJsonReader(&reader));
+    }
+    total->uplinks += reader.uplinks;
+    total->skipped += reader.skipped;
+    total->base += offset_WindOpJsonReader(&reader);
+
+    free_WindOpJsonReader(&reader);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return status;
+}
+
+/* ****************************************************************************
+ *
+ * Coverage outputs. Both cover the window each device's ring holds, the
+ * last WINDOP_COVERAGE_MINUTES minutes up to its newest reading.
+ *
+ * */
+static FILE * openOutput(const char * path) {
+    FILE * out = fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    return out;
+}
+
+static void writeGaps(const WindOpCoverage * cover, const char * path) {
+    WindOpGap * gaps = malloc(MAX_GAPS * sizeof(WindOpGap));
+    WindOpTimeFormat fmt;
+    char from[WINDOP_TIME_KEY_SIZE];
+    char to[WINDOP_TIME_KEY_SIZE];
+    FILE * out = openOutput(path);
+    uint32_t count;
+    uint32_t i;
+    uint32_t g;
+
+    if (gaps == NULL) {
+        outOfMemory();
+    }
+    init_WindOpTimeFormat(&fmt);
+    fprintf(out, "device,from,to,minutes\n");
+    for (i = 0; i < cover->numDevices; i++) {
+        count = gaps_WindOpCoverage(&cover->devices[i], gaps, MAX_GAPS);
+        for (g = 0; g < count; g++) {
+            format_WindOpTime(&fmt, gaps[g].from, from);
+            format_WindOpTime(&fmt, gaps[g].to, to);
+            fprintf(out, "%s,%s,%s,%u\n", cover->devices[i].name, from, to, gaps[g].minutes);
+        }
+    }
+    fclose(out);
+    free(gaps);
+}
+
+static void writeCoverage(const WindOpCoverage * cover, const char * path) {
+    static const char hex[] = "0123456789abcdef";
+    const WindOpCoverageDevice * dev;
+    WindOpTimeFormat fmt;
+    char first[WINDOP_TIME_KEY_SIZE];
+    char last[WINDOP_TIME_KEY_SIZE];
+    FILE * out = openOutput(path);
+    int64_t start;
+    uint32_t minutes;
+    uint32_t m;
+    uint32_t i;
+    uint8_t nibble;
+
+    init_WindOpTimeFormat(&fmt);
+    fprintf(out, "device,first,last,minutes,covered,late,bitmap\n");
+    for (i = 0; i < cover->numDevices; i++) {
+        dev = &cover->devices[i];
+        start = windowStart_WindOpCoverage(dev);
+        minutes = windowMinutes_WindOpCoverage(dev);
+        format_WindOpTime(&fmt, start, first);
+        format_WindOpTime(&fmt, 60 * dev->newest, last);
+        fprintf(out, "%s,%s,%s,%u,%u,%lu,", dev->name, first, last, minutes, count_WindOpCoverage(dev),
+                (unsigned long) dev->late);
+        for (m = 0, nibble = 0; m < minutes; m++) {
+            nibble |= (uint8_t) (covered_WindOpCoverage(dev, start + 60 * (int64_t) m) << (m % 4));
+            if ((m % 4 == 3) || (m + 1 == minutes)) {
+                fputc(hex[nibble], out);
+                nibble = 0;
+            }
+        }
+        fputc('\n', out);
+    }
+    fclose(out);
+}
+
+/* ****************************************************************************
+ *
+ * GPS fixes, the distances worked out in one pass over the whole track
+ *
+ * */
+static void writeGps(ttnCtx * ctx, const char * path) {
+    const WindOpGpsTrack * track = &ctx->track;
+    const double bvScale = info_WindOpDataType(WINDOPDATAPACKET_T7_TYPE)->scale[WINDOP_CH_BV];
+    double * metres = malloc((track->numFixes + 1) * sizeof(double));
+    WindOpTimeFormat fmt;
+    char key[WINDOP_TIME_KEY_SIZE];
+    FILE * out = openOutput(path);
+    uint32_t i;
+
+    if (metres == NULL) {
+        outOfMemory();
+    }
+    distance_WindOpGps(track->lat, track->lon, track->numFixes, ctx->cfg->homeLat, ctx->cfg->homeLon, metres);
+    init_WindOpTimeFormat(&fmt);
+    fprintf(out, "device,time,lat,lon,bv,distance\n");
+    for (i = 0; i < track->numFixes; i++) {
+        format_WindOpTime(&fmt, track->time[i], key);
+        fprintf(out, "%s,%s,%.7f,%.7f,%.3f,%.1f\n", ctx->gpsDevices[track->packet[i]], key, track->lat[i],
+                track->lon[i], track->bv[i] * bvScale, metres[i]);
+    }
+    fclose(out);
+    free(metres);
+}
+
+static void processCommandLine(int argc, char ** argv, ttnCfg * cfg) {
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-list") == 0) {
+            cfg->list = 1;
+        } else if ((strcmp(argv[i], "-sel") == 0) && (i + 1 < argc)) {
+            cfg->device = argv[++i];
+        } else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+            cfg->outFile = argv[++i];
+        } else if ((strcmp(argv[i], "-a") == 0) && (i + 1 < argc)) {
+            cfg->archive = argv[++i];
+        } else if ((strcmp(argv[i], "-arrow") == 0) && (i + 1 < argc)) {
+            cfg->arrowFile = argv[++i];
+        } else if ((strcmp(argv[i], "-dedup") == 0) && (i + 1 < argc)) {
+            cfg->dedup = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-keepdup") == 0) {
+            cfg->dedup = 0;
+        } else if ((strcmp(argv[i], "-gaps") == 0) && (i + 1 < argc)) {
+            cfg->gapsFile = argv[++i];
+        } else if ((strcmp(argv[i], "-cover") == 0) && (i + 1 < argc)) {
+            cfg->coverFile = argv[++i];
+        } else if ((strcmp(argv[i], "-metrics") == 0) && (i + 1 < argc)) {
+            cfg->metricsFile = argv[++i];
+        } else if ((strcmp(argv[i], "-gps") == 0) && (i + 1 < argc)) {
+            cfg->gpsFile = argv[++i];
+        } else if ((strcmp(argv[i], "-home") == 0) && (i + 1 < argc)) {
+            if (sscanf(argv[++i], "%lf,%lf", &cfg->homeLat, &cfg->homeLon) != 2) {
+                printf("%s", helpText);
+                exit(EXIT_FAILURE);
+            }
+        } else if ((strcmp(argv[i], "-fence") == 0) && (i + 1 < argc)) {
+            cfg->fence = strtod(argv[++i], NULL);
+        } else if ((strcmp(argv[i], "-help") == 0) || (argv[i][0] == '-')) {
+            printf("%s", helpText);
+            exit(EXIT_SUCCESS);
+        } else if (cfg->numFiles < MAX_FILES) {
+            cfg->files[cfg->numFiles++] = argv[i];
+        }
+    }
+    // One CSV row per time stamp would mix devices' readings
+    if ((cfg->outFile != NULL) && (cfg->device == NULL)) {
+        fprintf(stderr, "ERROR -o needs -sel device\n%s", helpText);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char ** argv) {
+    ttnCfg cfg;
+    ttnCtx ctx;
+    WindOpJsonReader total;
+    FILE * out;
+    clock_t start;
+    double seconds;
+    uint32_t i;
+    int result = EXIT_SUCCESS;
+
+    memset(&cfg, 0, sizeof(cfg));
+    memset(&ctx, 0, sizeof(ctx));
+    memset(&total, 0, sizeof(total));
+    cfg.dedup = DEFAULT_DEDUP;
+    cfg.homeLat = WINDOP_GPS_HOME_LAT;
+    cfg.homeLon = WINDOP_GPS_HOME_LON;
+    processCommandLine(argc, argv, &cfg);
+    ctx.cfg = &cfg;
+
+    if ((cfg.dedup != 0) && (init_WindOpDedup(&ctx.dedup, cfg.dedup) != WINDOP_OK)) {
+        outOfMemory();
+    }
+    init_WindOpCoverage(&ctx.cover);
+    if ((cfg.gpsFile != NULL) && (init_WindOpGpsTrack(&ctx.track, 256) != WINDOP_OK)) {
+        outOfMemory();
+    }
+    init_WindOpGeofence(&ctx.fence, cfg.homeLat, cfg.homeLon, cfg.fence);
+
+    if ((cfg.outFile != NULL) && (init_WindOpColumns(&ctx.cols, 1024) != WINDOP_OK)) {
+        outOfMemory();
+    }
+    if ((cfg.archive != NULL) && (open_WindOpArchiveWriter(&ctx.writer, cfg.archive) != WINDOP_OK)) {
+        fprintf(stderr, "Can't open %s\n", cfg.archive);
+        return EXIT_FAILURE;
+    }
+    if (cfg.arrowFile != NULL) {
+        if (init_WindOpColumns(&ctx.packetCols, 64) != WINDOP_OK) {
+            outOfMemory();
+        }
+        if (open_WindOpArrowWriter(&ctx.arrow, cfg.arrowFile) != WINDOP_OK) {
+            fprintf(stderr, "Can't open %s\n", cfg.arrowFile);
+            return EXIT_FAILURE;
+        }
+    }
+
+    start = clock();
+    if (cfg.numFiles == 0) {
+        result = (readDump(&ctx, NULL, &total) == WINDOP_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    for (i = 0; i < cfg.numFiles; i++) {
+        if (readDump(&ctx, cfg.files[i], &total) != WINDOP_OK) {
+            result = EXIT_FAILURE;
+        }
+    }
+    seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    fprintf(stderr, "---Read %lu bytes, %u uplinks, %u records skipped in %.3f s, %.1f MB/s\n",
+            (unsigned long) total.base, total.uplinks, total.skipped, seconds,
+            (seconds > 0) ? total.base / seconds / 1e6 : 0.0);
+    fprintf(stderr, "Decoded %lu packets, %u readings, %lu bad raw, %lu failed, %lu from other devices\n",
+            (unsigned long) ctx.packets, ctx.cols.numRows, (unsigned long) ctx.badRaw, (unsigned long) ctx.failed,
+            (unsigned long) ctx.otherDevice);
+    if (cfg.dedup != 0) {
+        fprintf(stderr, "Dropped %lu duplicates of %lu uplinks, %.1f MB for %u keys, %lu filter false positives\n",
+                (unsigned long) ctx.dedup.duplicates, (unsigned long) ctx.dedup.seen,
+                bytes_WindOpDedup(&ctx.dedup) / 1e6, 2 * ctx.dedup.capacity, (unsigned long) ctx.dedup.falsePositives);
+    }
+    if (cfg.gpsFile != NULL) {
+        fprintf(stderr, "GPS %u fixes from %u packets, %lu without a fix, %lu outside %.0f m\n", ctx.track.numFixes,
+                ctx.numGpsPackets, (unsigned long) ctx.track.noFix, (unsigned long) ctx.track.outside, cfg.fence);
+        writeGps(&ctx, cfg.gpsFile);
+    }
+    if (cfg.gapsFile != NULL) {
+        writeGaps(&ctx.cover, cfg.gapsFile);
+    }
+    if (cfg.coverFile != NULL) {
+        writeCoverage(&ctx.cover, cfg.coverFile);
+    }
+    if ((cfg.metricsFile != NULL) && (save_WindOpMetrics(cfg.metricsFile) != WINDOP_OK)) {
+        fprintf(stderr, "ERROR writing %s\n", cfg.metricsFile);
+        result = EXIT_FAILURE;
+    }
+    free_WindOpCoverage(&ctx.cover);
+    free_WindOpDedup(&ctx.dedup);
+    free_WindOpGpsTrack(&ctx.track);
+    for (i = 0; i < ctx.numGpsPackets; i++) {
+        free(ctx.gpsDevices[i]);
+    }
+    free(ctx.gpsDevices);
+
+    if ((cfg.archive != NULL) && (close_WindOpArchiveWriter(&ctx.writer) != WINDOP_OK)) {
+        fprintf(stderr, "ERROR writing %s\n", cfg.archive);
+        result = EXIT_FAILURE;
+    }
+    if (cfg.arrowFile != NULL) {
+        fprintf(stderr, "Arrow %lu rows, %u devices, %u batches\n", (unsigned long) (ctx.arrow.rows + ctx.arrow.batchRows),
+                ctx.arrow.numDevices, ctx.arrow.numBatches + (ctx.arrow.batchRows != 0));
+        if (close_WindOpArrowWriter(&ctx.arrow) != WINDOP_OK) {
+            fprintf(stderr, "ERROR writing %s\n", cfg.arrowFile);
+            result = EXIT_FAILURE;
+        }
+        free_WindOpColumns(&ctx.packetCols);
+    }
+    if (cfg.outFile != NULL) {
+        if ((out = fopen(cfg.outFile, "w")) == NULL) {
+            fprintf(stderr, "Can't open %s\n", cfg.outFile);
+            return EXIT_FAILURE;
+        }
+        if (writeColumns_WindOpCsv(out, &ctx.cols) != WINDOP_OK) {
+            outOfMemory();
+        }
+        fclose(out);
+        free_WindOpColumns(&ctx.cols);
+    }
+    return result;
+}
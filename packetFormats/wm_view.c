@@ -0,0 +1,86 @@
+/*
+ ============================================================================
+ Name        : wm_view.c
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Zero copy read only view over a raw packet
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#include "wm_view.h"
+
+uint8_t open_WindOpPacketView(WindOpPacketView * view, const uint8_t * bytes, uint32_t length) {
+    WindOpPacketHeader hdr;
+    uint8_t status = check_WindOpPacketLayout(&hdr, bytes, length);
+
+    if (status != WINDOP_OK) {
+        return status;
+    }
+    view->bytes = bytes;
+    view->info = hdr.info;
+    view->dataOffset = hdr.dataOffset;
+    view->numReadings = hdr.numReadings;
+
+    return WINDOP_OK;
+}
+
+uint8_t next_WindOpPacketView(WindOpPacketView * view, const uint8_t * capture, uint32_t size, uint32_t * offset) {
+    uint32_t remaining;
+    uint8_t status;
+
+    if (*offset + WINDOP_PACKET_HEADER_SIZE > size) {
+        *offset = size;
+        return WINDOP_ERR_SHORT;
+    }
+
+    remaining = size - *offset;
+    status = open_WindOpPacketView(view, &capture[*offset], remaining);
+
+    // A length byte shorter than the header cannot be stepped over safely,
+    // give up on the rest of the capture rather than resync on a guess
+    if ((capture[*offset + 1] < WINDOP_PACKET_HEADER_SIZE + WINDOP_TIME_SIZE) ||
+        (capture[*offset + 1] > remaining)) {
+        *offset = size;
+        return status;
+    }
+    *offset += capture[*offset + 1];
+
+    return status;
+}
+
+uint8_t time_WindOpPacketView(const WindOpPacketView * view, Calendar * timeOut) {
+    unpack_WindOpMinuteTime(timeOut, &view->bytes[WINDOP_PACKET_HEADER_SIZE]);
+    return check_WindOpMinuteTime(timeOut);
+}
+
+uint8_t readingTime_WindOpPacketView(const WindOpPacketView * view, uint16_t reading, int64_t * epoch) {
+    if (unpack_WindOpEpochTime(&view->bytes[WINDOP_PACKET_HEADER_SIZE], epoch) == 0) {
+        return WINDOP_ERR_TIME;
+    }
+    *epoch += view->info->firstOffset + 60 * (int64_t) reading;
+    return WINDOP_OK;
+}
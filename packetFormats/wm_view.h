@@ -0,0 +1,113 @@
+/*
+ ============================================================================
+ Name        : wm_view.h
+ Author      : Andy Maginnis
+ Version     : 1
+ Copyright   : MIT (See below)
+ Description : Zero copy read only view over a raw packet
+ ============================================================================
+
+ MIT License
+
+ Copyright (c) 2017 Andy Maginnis
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ */
+
+#ifndef WM_VIEW_H
+#define WM_VIEW_H
+
+#include <stdint.h>
+
+#include "wm_codec.h"
+#include "wm_schema.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ****************************************************************************
+ *
+ * Read only view over the bytes of one packet. Nothing is copied, the view
+ * points into the caller's buffer (a receive buffer, an mmapped capture)
+ * which must outlive it. Opening checks the header and lengths only, the
+ * time stamp is decoded when asked for.
+ *
+ * After an OK open, reading n < numReadings of any carried channel can be
+ * read with field_WindOpPacketView without further checks. T8 readings are
+ * delta coded with no fixed place, those go through wm_delta.h instead.
+ *
+ * */
+typedef struct WindOpPacketView {
+    const uint8_t * bytes;
+    const WindOpTypeInfo * info;
+    uint16_t dataOffset;      // Byte offset of the first reading
+    uint16_t numReadings;     // Whole readings held in the packet
+} WindOpPacketView;
+
+// Returns a WINDOP_* code, the view is only usable after WINDOP_OK
+uint8_t open_WindOpPacketView(WindOpPacketView * view, const uint8_t * bytes, uint32_t length);
+
+/*
+ * Step through packets stored back to back, as in a raw capture. Opens the
+ * packet at *offset and moves *offset past it using its length byte. A
+ * packet that fails to open is still stepped over when its length byte is
+ * usable, so one bad packet does not end the walk. Returns WINDOP_ERR_SHORT
+ * with *offset == size at the end of the capture.
+ */
+uint8_t next_WindOpPacketView(WindOpPacketView * view, const uint8_t * capture, uint32_t size, uint32_t * offset);
+
+// Packet time stamp, returns WINDOP_ERR_TIME when its fields are out of range
+uint8_t time_WindOpPacketView(const WindOpPacketView * view, Calendar * timeOut);
+
+// Epoch seconds of reading n, returns a WINDOP_* code
+uint8_t readingTime_WindOpPacketView(const WindOpPacketView * view, uint16_t reading, int64_t * epoch);
+
+static inline uint8_t dataType_WindOpPacketView(const WindOpPacketView * view) {
+    return view->bytes[0];
+}
+
+static inline uint8_t length_WindOpPacketView(const WindOpPacketView * view) {
+    return view->bytes[1];
+}
+
+static inline uint8_t carries_WindOpPacketView(const WindOpPacketView * view, uint8_t channel) {
+    uint8_t channels = view->info->channels;
+
+    if (view->info->readingSize == 0) {
+        channels = view->bytes[view->dataOffset + 1]; // T8 channel mask
+    }
+    return (channels >> channel) & 1;
+}
+
+// Raw value of channel for reading, scale with view->info->scale[channel].
+// Fixed layouts only, view->info->readingSize != 0
+static inline int32_t field_WindOpPacketView(const WindOpPacketView * view, uint16_t reading, uint8_t channel) {
+    const WindOpFieldInfo * field = &view->info->byChannel[channel];
+    const uint8_t * p = view->bytes + view->dataOffset + reading * view->info->readingSize + field->offset;
+
+    return read_WindOpField(p, field->bytes, field->isSigned);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WM_VIEW_H
@@ -44,6 +44,8 @@ use Data::Dumper;
 use DateTime;
 use JSON; 
 use FindBin qw($Bin);
+use lib $Bin;
+use wm_schema;
 use GIS::Distance;
 
 
@@ -296,28 +298,18 @@ sub call_packetUnpack_004 {
    ## Calculate the packet length based in the repetitons of data
    $packetLength -= $dataOffset;
    $packetLength -= 2;
-   $packetLength /= 8;
+   $packetLength /= $wm_schema::windOpSchema{4}{readingSize};
    
-   ## From C golden reference for pack
-   # outBuffer[0] = readingsIn->ws & 0x00FF;            // LSB Wind speed, Average over 1 minute
-   # outBuffer[1] = (readingsIn->ws & 0xFF00) >> 8;     // MSB
-   # outBuffer[2] = readingsIn->wsx & 0x00FF;           // Wind speed max measured over 1 second
-   # outBuffer[3] = (readingsIn->wsx & 0xFF00) >> 8;    // during the last averaging period
-   # outBuffer[4] = readingsIn->wsm & 0x00FF;           // Wind speed min measured over 1 second
-   # outBuffer[5] = (readingsIn->wsm & 0xFF00) >> 8;    // during the last averaging period
-   # outBuffer[6] = readingsIn->wd & 0x00FF;            // Wind Direction
-   # outBuffer[7] = (readingsIn->wd & 0xFF00) >> 8;     //
+   ## Layout and scales are defined once in packetFormats/wm_schema.h,
+   ## make schema writes them to wm_schema.pm
 
    for ($packetCount = 0; $packetCount < $packetLength ; $packetCount++) {
       
-      my $base = $dataOffset + ($packetCount * 8);
+      my $base = $dataOffset + ($packetCount * $wm_schema::windOpSchema{4}{readingSize});
       $time{dt}->add( minutes => 1 );
       my $timeStr = $time{dt}->ymd('') . $time{dt}->hms('');
 
-      $resRef->{$device}{$timeStr}{ws}  = 0.01 * (($byteRef->[$base + 0]) + ($byteRef->[$base + 1]<<8));
-      $resRef->{$device}{$timeStr}{wsa} = 0.01 * (($byteRef->[$base + 2]) + ($byteRef->[$base + 3]<<8));
-      $resRef->{$device}{$timeStr}{wsm} = 0.01 * (($byteRef->[$base + 4]) + ($byteRef->[$base + 5]<<8));
-      $resRef->{$device}{$timeStr}{wd}  = ($byteRef->[$base + 6]) + ($byteRef->[$base + 7]<<8);      
+      wm_schema::unpackReading(4, $byteRef, $base, $resRef->{$device}{$timeStr} //= {});
    
    }
 
@@ -340,23 +332,13 @@ sub call_packetUnpack_005 {
    
    # printf ("call_packetUnpack_005 Length=%3d ", $packetLength);
 
-   ## From C golden reference
-   # outBuffer[0] = readingsIn->tmp & 0x00FF;          // Temperature
-   # outBuffer[1] = (readingsIn->tmp & 0xFF00) >> 8;   //
-   # outBuffer[2] = readingsIn->press & 0x00FF;        // Pressure
-   # outBuffer[3] = (readingsIn->press & 0xFF00) >> 8; //
-   # outBuffer[4] = readingsIn->hum & 0x00FF;          // Humidity
-   # outBuffer[5] = (readingsIn->hum & 0xFF00) >> 8;   //
-   # outBuffer[6] = readingsIn->bv & 0x00FF;           // Battery voltage
-   # outBuffer[7] = (readingsIn->bv & 0xFF00) >> 8;    //
+   ## Layout and scales are defined once in packetFormats/wm_schema.h,
+   ## make schema writes them to wm_schema.pm
       
    my $base = $dataOffset;
    my $timeStr = $time{dt}->ymd('') . $time{dt}->hms('');
 
-   $resRef->{$device}{$timeStr}{tmp}  = 0.1   * (($byteRef->[$base + 0]) + ($byteRef->[$base + 1]<<8));
-   $resRef->{$device}{$timeStr}{pres} = 0.01  * (($byteRef->[$base + 2]) + ($byteRef->[$base + 3]<<8));
-   $resRef->{$device}{$timeStr}{hum}  = 0.01  * (($byteRef->[$base + 4]) + ($byteRef->[$base + 5]<<8));
-   $resRef->{$device}{$timeStr}{bv}   = 0.001 * (($byteRef->[$base + 6]) + ($byteRef->[$base + 7]<<8));      
+   wm_schema::unpackReading(5, $byteRef, $base, $resRef->{$device}{$timeStr} //= {});
 
 }
 
@@ -380,10 +362,8 @@ sub call_packetUnpack_006 {
    my $base = $dataOffset;
    my $timeStr = $time{dt}->ymd('') . $time{dt}->hms('');
 
-   $resRef->{$device}{$timeStr}{tmp}  = 0.01  * (($byteRef->[$base + 0]<<0) + ($byteRef->[$base + 1]<<8) + ($byteRef->[$base + 2]<<16));
-   $resRef->{$device}{$timeStr}{pres} = 0.01  * (($byteRef->[$base + 3]<<0) + ($byteRef->[$base + 4]<<8) + ($byteRef->[$base + 5]<<16));
-   $resRef->{$device}{$timeStr}{hum}  = 0.01  * (($byteRef->[$base + 6]<<0) + ($byteRef->[$base + 7]<<8));
-   $resRef->{$device}{$timeStr}{bv}   = 0.01  * (($byteRef->[$base + 8]) + ($byteRef->[$base + 9]<<8));
+   ## Layout and scales are defined once in packetFormats/wm_schema.h
+   wm_schema::unpackReading(6, $byteRef, $base, $resRef->{$device}{$timeStr} //= {});
    # printf("---------- %x lllll \n ", $resRef->{$device}{$timeStr}{hum});
    # if (($resRef->{$device}{$timeStr}{hum} & 0x8000) == 0x8000) {
       # $resRef->{$device}{$timeStr}{hum} = (~$resRef->{$device}{$timeStr}{hum}) & 0xffff;
@@ -433,7 +413,7 @@ sub call_packetUnpack_007 {
    }
    $latt = processLatLong($latt);
 
-   for (my $i = 13; $i < 126; $i++) {
+   for (my $i = 13; $i < 26; $i++) {
       $long .= (chr($byteRef->[$base + $i]));
    }
    $long = processLatLong($long);
@@ -448,7 +428,7 @@ sub call_packetUnpack_007 {
    ##system("open $http");
 
 
-   $resRef->{$device}{$timeStr}{bv}   = 0.001 * (($byteRef->[$base + 26]) + ($byteRef->[$base + 27]<<8));
+   wm_schema::unpackReading(7, $byteRef, $base, $resRef->{$device}{$timeStr} //= {});
    # printf("---------- %x lllll \n ", $resRef->{$device}{$timeStr}{hum});
    # if (($resRef->{$device}{$timeStr}{hum} & 0x8000) == 0x8000) {
       # $resRef->{$device}{$timeStr}{hum} = (~$resRef->{$device}{$timeStr}{hum}) & 0xffff;
@@ -10,6 +10,8 @@
 #                     CSV file read into Pandas datatable
 #                     Pandas date time conversion of ASCII string
 #                     Plot using the dateTime objects on the Y axis
+#                     Or an Arrow file from wm_ttn -arrow, memory mapped
+#                     with typed columns, nothing to parse
 #
 # ============================================================================
 # 
@@ -50,6 +52,8 @@ def main(argv):
    ## Variables
    ##--------------------------------------------------------------------------
    csvFile   = ''
+   arrowFile = ''
+   device    = ''
    series    = 1 
    plotTitle = "LoRa WM data feed"
 
@@ -57,18 +61,25 @@ def main(argv):
    ## Commandline
    ##--------------------------------------------------------------------------
    try:
-      opts, args = getopt.getopt(argv,"hc:s:",["csvFile=","series"])
+      opts, args = getopt.getopt(argv,"hc:a:d:s:",["csvFile=","arrowFile=","device=","series"])
    except getopt.GetoptError:
-      print ('s3_wm_csv_plot.py -c <csvfile>')
+      print ('s3_wm_csv_plot.py -c <csvfile> | -a <arrowfile> [-d <device>]')
       sys.exit(2)
    for opt, arg in opts:
       if opt == '-h':
-         print ('s3_wm_csv_plot.py -c <csvfile>')
+         print ('s3_wm_csv_plot.py -c <csvfile> | -a <arrowfile> [-d <device>]')
          sys.exit()
       elif opt in ("-c", "--csvFile"):
          csvFile = arg
+      elif opt in ("-a", "--arrowFile"):
+         arrowFile = arg
+      elif opt in ("-d", "--device"):
+         device = arg
       elif opt in ("-s", "--series"):
          series = int(arg)
+   if arrowFile != '':
+      plotArrow(arrowFile, device, series, plotTitle)
+      return
    print ('Input file is ' +  csvFile + ' Series is ' + str(series))
    
    ##--------------------------------------------------------------------------
@@ -109,6 +120,31 @@ def main(argv):
 
    plt.show()
 
+##----------------------------------------------------------------------------
+## Arrow file written by wm_ttn -arrow, one row per reading. The columns are
+## device, time, type then the CSV channels, so series 1 is still ws. Rows
+## from packets without the channel are null and left out.
+##----------------------------------------------------------------------------
+def plotArrow(arrowFile, device, series, plotTitle):
+   import pyarrow.feather as feather
+
+   print ('Input file is ' +  arrowFile + ' Series is ' + str(series))
+   df = feather.read_table(arrowFile, memory_map=True).to_pandas()
+   if device != '':
+      df = df[df['device'] == device]
+   key = df.columns[series + 2]
+   df = df[df[key].notna()]
+
+   print ("Data loaded, plotting Column " + str(series) + ":" + key + " against time.")
+   plt.plot(df['time'], df[key])
+
+   plt.gcf().autofmt_xdate()
+   plt.ylabel('WindSpeed(mph)')
+   perlRocks = "%s (%d datapoints)" % (plotTitle, df.shape[0])
+   plt.title(perlRocks)
+
+   plt.show()
+
 if __name__ == "__main__":
    main(sys.argv[1:])
 
@@ -0,0 +1,83 @@
+## Generated by wm_decode -schema from packetFormats/wm_schema.h, do not edit
+package wm_schema;
+
+use strict;
+use warnings;
+
+our %windOpSchema = (
+   0x03 => {
+      name        => 't3',
+      readingSize => 16,
+      firstOffset => 60,
+      fields      => [
+         { key => 'ws', offset => 0, bytes => 2, signed => 0, scale => 0.01 },
+         { key => 'wsa', offset => 2, bytes => 2, signed => 0, scale => 0.01 },
+         { key => 'wsm', offset => 4, bytes => 2, signed => 0, scale => 0.01 },
+         { key => 'wd', offset => 6, bytes => 2, signed => 0, scale => 1 },
+         { key => 'tmp', offset => 8, bytes => 2, signed => 1, scale => 0.1 },
+         { key => 'pres', offset => 10, bytes => 2, signed => 0, scale => 0.01 },
+         { key => 'hum', offset => 12, bytes => 2, signed => 0, scale => 0.01 },
+         { key => 'bv', offset => 14, bytes => 2, signed => 0, scale => 0.001 },
+      ],
+   },
+   0x04 => {
+      name        => 't4',
+      readingSize => 8,
+      firstOffset => 60,
+      fields      => [
+         { key => 'ws', offset => 0, bytes => 2, signed => 0, scale => 0.01 },
+         { key => 'wsa', offset => 2, bytes => 2, signed => 0, scale => 0.01 },
+         { key => 'wsm', offset => 4, bytes => 2, signed => 0, scale => 0.01 },
+         { key => 'wd', offset => 6, bytes => 2, signed => 0, scale => 1 },
+      ],
+   },
+   0x05 => {
+      name        => 't5',
+      readingSize => 8,
+      firstOffset => 0,
+      fields      => [
+         { key => 'tmp', offset => 0, bytes => 2, signed => 1, scale => 0.1 },
+         { key => 'pres', offset => 2, bytes => 2, signed => 0, scale => 0.01 },
+         { key => 'hum', offset => 4, bytes => 2, signed => 0, scale => 0.01 },
+         { key => 'bv', offset => 6, bytes => 2, signed => 0, scale => 0.001 },
+      ],
+   },
+   0x06 => {
+      name        => 't6',
+      readingSize => 10,
+      firstOffset => 0,
+      fields      => [
+         { key => 'tmp', offset => 0, bytes => 3, signed => 1, scale => 0.01 },
+         { key => 'pres', offset => 3, bytes => 3, signed => 0, scale => 0.01 },
+         { key => 'hum', offset => 6, bytes => 2, signed => 0, scale => 0.01 },
+         { key => 'bv', offset => 8, bytes => 2, signed => 0, scale => 0.01 },
+      ],
+   },
+   0x07 => {
+      name        => 't7',
+      readingSize => 28,
+      firstOffset => 0,
+      fields      => [
+         { key => 'bv', offset => 26, bytes => 2, signed => 0, scale => 0.001 },
+      ],
+   },
+);
+
+## Decode the reading of type $type at $base into $readingRef, keyed as the
+## CSV columns. Returns the reading size, 0 for a type with no layout.
+sub unpackReading {
+   my ( $type, $byteRef, $base, $readingRef ) = @_;
+   my $layout = $windOpSchema{$type} or return 0;
+
+   foreach my $field (@{$layout->{fields}}) {
+      my $raw = 0;
+      for (my $i = $field->{bytes} - 1; $i >= 0; $i--) {
+         $raw = ($raw << 8) + $byteRef->[$base + $field->{offset} + $i];
+      }
+      $raw -= 1 << (8 * $field->{bytes}) if ($field->{signed} && ($raw >> (8 * $field->{bytes} - 1)));
+      $readingRef->{$field->{key}} = $field->{scale} * $raw;
+   }
+   return $layout->{readingSize};
+}
+
+1;